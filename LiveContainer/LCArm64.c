@@ -0,0 +1,364 @@
+#include "LCArm64.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int64_t signExtend(uint64_t value, int bits) {
+    return (int64_t)(value << (64 - bits)) >> (64 - bits);
+}
+
+static void decodeADR(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    int64_t imm = signExtend((((i >> 5) & 0x7FFFF) << 2) | ((i >> 29) & 3), 21);
+    out->rd = i & 0x1F;
+    if (out->op == LCArm64OpADRP) {
+        out->imm = imm * 4096;
+        out->target = (pc & ~0xFFFULL) + out->imm;
+    } else {
+        out->imm = imm;
+        out->target = pc + imm;
+    }
+}
+
+static void decodeADDImm(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    (void)pc;
+    out->rd = i & 0x1F;
+    out->rn = (i >> 5) & 0x1F;
+    out->size = (i >> 31) ? 8 : 4;
+    out->imm = ((i >> 10) & 0xFFF) << ((i & 0x400000) ? 12 : 0);
+}
+
+static void decodeLDRImm(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    (void)pc;
+    uint32_t scale = i >> 30;
+    out->rd = i & 0x1F;
+    out->rn = (i >> 5) & 0x1F;
+    out->size = 1 << scale;
+    out->imm = ((i >> 10) & 0xFFF) << scale;
+}
+
+static void decodeLDURImm(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    (void)pc;
+    out->rd = i & 0x1F;
+    out->rn = (i >> 5) & 0x1F;
+    out->size = 1 << (i >> 30);
+    out->imm = signExtend((i >> 12) & 0x1FF, 9);
+}
+
+static void decodeLDRLiteral(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    out->rd = i & 0x1F;
+    out->size = (i & 0x40000000) ? 8 : 4;
+    out->imm = signExtend((i >> 5) & 0x7FFFF, 19) * 4;
+    out->target = pc + out->imm;
+}
+
+static void decodeMOVWide(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    (void)pc;
+    out->rd = i & 0x1F;
+    out->size = (i >> 31) ? 8 : 4;
+    out->extra = ((i >> 21) & 3) * 16;
+    out->imm = (int64_t)((uint64_t)((i >> 5) & 0xFFFF) << out->extra);
+}
+
+static void decodeBranchImm26(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    out->imm = signExtend(i & 0x3FFFFFF, 26) * 4;
+    out->target = pc + out->imm;
+}
+
+static void decodeBCond(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    out->extra = i & 0xF;
+    out->imm = signExtend((i >> 5) & 0x7FFFF, 19) * 4;
+    out->target = pc + out->imm;
+}
+
+static void decodeCompareBranch(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    out->rd = i & 0x1F;
+    out->size = (i >> 31) ? 8 : 4;
+    out->imm = signExtend((i >> 5) & 0x7FFFF, 19) * 4;
+    out->target = pc + out->imm;
+}
+
+static void decodeTestBranch(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    out->rd = i & 0x1F;
+    out->extra = ((i >> 26) & 0x20) | ((i >> 19) & 0x1F);
+    out->imm = signExtend((i >> 5) & 0x3FFF, 14) * 4;
+    out->target = pc + out->imm;
+}
+
+static void decodeBranchReg(uint32_t i, uint64_t pc, LCArm64Insn *out) {
+    (void)pc;
+    out->rn = (i >> 5) & 0x1F;
+}
+
+static const struct {
+    uint32_t mask;
+    uint32_t value;
+    LCArm64Op op;
+    void (*decode)(uint32_t instruction, uint64_t pc, LCArm64Insn *out);
+} decodeTable[] = {
+    {0x9F000000, 0x90000000, LCArm64OpADRP, decodeADR},
+    {0x9F000000, 0x10000000, LCArm64OpADR, decodeADR},
+    {0x7F800000, 0x11000000, LCArm64OpADDImm, decodeADDImm},
+    {0x3FC00000, 0x39400000, LCArm64OpLDRImm, decodeLDRImm},
+    {0x3FE00C00, 0x38400000, LCArm64OpLDURImm, decodeLDURImm},
+    {0xBF000000, 0x18000000, LCArm64OpLDRLiteral, decodeLDRLiteral},
+    {0x7F800000, 0x52800000, LCArm64OpMOVZ, decodeMOVWide},
+    {0x7F800000, 0x72800000, LCArm64OpMOVK, decodeMOVWide},
+    {0xFC000000, 0x14000000, LCArm64OpB, decodeBranchImm26},
+    {0xFC000000, 0x94000000, LCArm64OpBL, decodeBranchImm26},
+    {0xFF000010, 0x54000000, LCArm64OpBCond, decodeBCond},
+    {0x7F000000, 0x34000000, LCArm64OpCBZ, decodeCompareBranch},
+    {0x7F000000, 0x35000000, LCArm64OpCBNZ, decodeCompareBranch},
+    {0x7F000000, 0x36000000, LCArm64OpTBZ, decodeTestBranch},
+    {0x7F000000, 0x37000000, LCArm64OpTBNZ, decodeTestBranch},
+    {0xFFFFFC1F, 0xD61F0000, LCArm64OpBR, decodeBranchReg},
+    {0xFFFFFC1F, 0xD63F0000, LCArm64OpBLR, decodeBranchReg},
+    {0xFFFFFC1F, 0xD65F0000, LCArm64OpRET, decodeBranchReg},
+};
+
+#define DECODE_TABLE_COUNT (sizeof(decodeTable) / sizeof(decodeTable[0]))
+
+// For every top byte, the table entries whose mask and value allow it. Most instructions match none and are
+// rejected with one load instead of a walk over the whole table.
+static uint32_t candidatesByTopByte[256];
+static pthread_once_t candidatesOnce = PTHREAD_ONCE_INIT;
+
+static void buildCandidates(void) {
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        for (uint32_t i = 0; i < DECODE_TABLE_COUNT; i++) {
+            if (((byte << 24) & decodeTable[i].mask) == (decodeTable[i].value & decodeTable[i].mask & 0xFF000000)) {
+                candidatesByTopByte[byte] |= 1u << i;
+            }
+        }
+    }
+}
+
+bool LCArm64Decode(uint32_t instruction, uint64_t pc, LCArm64Insn *out) {
+    pthread_once(&candidatesOnce, buildCandidates);
+    memset(out, 0, sizeof(LCArm64Insn));
+    // entries are tried in table order, so overlapping encodings resolve the same way as a linear walk
+    for (uint32_t candidates = candidatesByTopByte[instruction >> 24]; candidates; candidates &= candidates - 1) {
+        uint32_t i = __builtin_ctz(candidates);
+        if ((instruction & decodeTable[i].mask) == decodeTable[i].value) {
+            out->op = decodeTable[i].op;
+            decodeTable[i].decode(instruction, pc, out);
+            return true;
+        }
+    }
+    return false;
+}
+
+// adrp pairs are only followed this many instructions, compilers keep them close together
+#define ADRP_PAIR_WINDOW 8
+
+static int compareXrefs(const void *a, const void *b) {
+    const LCArm64Xref *x = a, *y = b;
+    if (x->target != y->target) {
+        return x->target < y->target ? -1 : 1;
+    }
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+struct LCArm64XrefIndex {
+    LCArm64Xref *xrefs;
+    size_t count;
+};
+
+typedef struct {
+    const uint32_t *code;
+    uint64_t pc;
+    size_t begin;
+    size_t end;
+    LCArm64Xref *xrefs;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} LCArm64XrefChunk;
+
+static void addXref(LCArm64XrefChunk *chunk, uint64_t target, uint64_t pc, uint64_t adrpPc, LCArm64XrefKind kind) {
+    if (chunk->failed) {
+        return;
+    }
+    if (chunk->count == chunk->capacity) {
+        size_t capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+        LCArm64Xref *xrefs = realloc(chunk->xrefs, capacity * sizeof(LCArm64Xref));
+        if (!xrefs) {
+            chunk->failed = true;
+            return;
+        }
+        chunk->xrefs = xrefs;
+        chunk->capacity = capacity;
+    }
+    chunk->xrefs[chunk->count++] = (LCArm64Xref){target, pc, adrpPc, kind};
+}
+
+static void *indexChunk(void *arg) {
+    LCArm64XrefChunk *chunk = arg;
+    // page of the last adrp into each register, and where it was
+    uint64_t page[32];
+    size_t adrpIndex[32];
+    bool live[32] = {0};
+    // start a little early so pairs straddling the chunk boundary are still seen
+    size_t start = chunk->begin > ADRP_PAIR_WINDOW ? chunk->begin - ADRP_PAIR_WINDOW : 0;
+    for (size_t i = start; i < chunk->end; i++) {
+        uint64_t pc = chunk->pc + i * 4;
+        LCArm64Insn insn;
+        if (!LCArm64Decode(chunk->code[i], pc, &insn)) {
+            continue;
+        }
+        bool emit = i >= chunk->begin;
+        switch (insn.op) {
+        case LCArm64OpADRP:
+            page[insn.rd] = insn.target;
+            adrpIndex[insn.rd] = i;
+            live[insn.rd] = true;
+            break;
+        case LCArm64OpADR:
+            if (emit) addXref(chunk, insn.target, pc, 0, LCArm64XrefAddress);
+            live[insn.rd] = false;
+            break;
+        case LCArm64OpLDRLiteral:
+            if (emit) addXref(chunk, insn.target, pc, 0, LCArm64XrefLoad);
+            live[insn.rd] = false;
+            break;
+        case LCArm64OpADDImm:
+        case LCArm64OpLDRImm:
+        case LCArm64OpLDURImm:
+            if (live[insn.rn] && i - adrpIndex[insn.rn] <= ADRP_PAIR_WINDOW && emit) {
+                addXref(chunk, page[insn.rn] + insn.imm, pc, chunk->pc + adrpIndex[insn.rn] * 4,
+                        insn.op == LCArm64OpADDImm ? LCArm64XrefAddress : LCArm64XrefLoad);
+            }
+            live[insn.rd] = false;
+            break;
+        case LCArm64OpB:
+        case LCArm64OpBL:
+        case LCArm64OpBCond:
+        case LCArm64OpCBZ:
+        case LCArm64OpCBNZ:
+        case LCArm64OpTBZ:
+        case LCArm64OpTBNZ:
+            if (emit) addXref(chunk, insn.target, pc, 0, LCArm64XrefBranch);
+            break;
+        case LCArm64OpMOVZ:
+        case LCArm64OpMOVK:
+            live[insn.rd] = false;
+            break;
+        default:
+            break;
+        }
+    }
+    // sorting per chunk keeps most of the work on the workers, the caller only merges
+    if (!chunk->failed) {
+        qsort(chunk->xrefs, chunk->count, sizeof(LCArm64Xref), compareXrefs);
+    }
+    return NULL;
+}
+
+LCArm64XrefIndex *LCArm64XrefIndexBuild(const uint32_t *code, size_t count, uint64_t pc, int threadCount) {
+    if (threadCount <= 0) {
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        // not worth a thread for less than 64K instructions
+        size_t maxThreads = count / 0x10000 + 1;
+        if (threadCount <= 0) {
+            threadCount = 1;
+        } else if ((size_t)threadCount > maxThreads) {
+            threadCount = (int)maxThreads;
+        }
+    }
+    if (threadCount > 64) {
+        threadCount = 64;
+    }
+
+    LCArm64XrefChunk chunks[64] = {0};
+    pthread_t threads[64];
+    bool started[64] = {0};
+    size_t chunkSize = (count + threadCount - 1) / threadCount;
+    for (int t = 0; t < threadCount; t++) {
+        chunks[t] = (LCArm64XrefChunk){.code = code, .pc = pc, .begin = t * chunkSize, .end = (t + 1) * chunkSize};
+        if (chunks[t].begin > count) chunks[t].begin = count;
+        if (chunks[t].end > count) chunks[t].end = count;
+        // the calling thread handles chunk 0, and any chunk whose thread fails to start
+        if (t > 0) {
+            started[t] = pthread_create(&threads[t], NULL, indexChunk, &chunks[t]) == 0;
+        }
+    }
+    indexChunk(&chunks[0]);
+    bool failed = chunks[0].failed;
+    for (int t = 1; t < threadCount; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            indexChunk(&chunks[t]);
+        }
+        failed = failed || chunks[t].failed;
+    }
+
+    // merge the sorted chunks pairwise until one run is left
+    LCArm64XrefIndex *index = failed ? NULL : calloc(1, sizeof(LCArm64XrefIndex));
+    for (int width = 1; index && width < threadCount; width *= 2) {
+        for (int t = 0; t + width < threadCount; t += width * 2) {
+            LCArm64XrefChunk *a = &chunks[t], *b = &chunks[t + width];
+            LCArm64Xref *merged = malloc((a->count + b->count + 1) * sizeof(LCArm64Xref));
+            if (!merged) {
+                free(index);
+                index = NULL;
+                break;
+            }
+            size_t i = 0, j = 0, k = 0;
+            while (i < a->count && j < b->count) {
+                merged[k++] = compareXrefs(&b->xrefs[j], &a->xrefs[i]) < 0 ? b->xrefs[j++] : a->xrefs[i++];
+            }
+            memcpy(merged + k, a->xrefs + i, (a->count - i) * sizeof(LCArm64Xref));
+            k += a->count - i;
+            memcpy(merged + k, b->xrefs + j, (b->count - j) * sizeof(LCArm64Xref));
+            k += b->count - j;
+            free(a->xrefs);
+            free(b->xrefs);
+            a->xrefs = merged;
+            a->count = k;
+            b->xrefs = NULL;
+            b->count = 0;
+        }
+    }
+    if (!index) {
+        for (int t = 0; t < threadCount; t++) {
+            free(chunks[t].xrefs);
+        }
+        return NULL;
+    }
+    index->xrefs = chunks[0].xrefs;
+    index->count = chunks[0].count;
+    return index;
+}
+
+size_t LCArm64XrefIndexLookup(const LCArm64XrefIndex *index, uint64_t target, const LCArm64Xref **xrefsOut) {
+    size_t lo = 0, hi = index->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (index->xrefs[mid].target < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t end = lo;
+    while (end < index->count && index->xrefs[end].target == target) {
+        end++;
+    }
+    if (xrefsOut) {
+        *xrefsOut = index->xrefs + lo;
+    }
+    return end - lo;
+}
+
+size_t LCArm64XrefIndexCount(const LCArm64XrefIndex *index) {
+    return index->count;
+}
+
+void LCArm64XrefIndexFree(LCArm64XrefIndex *index) {
+    if (!index) {
+        return;
+    }
+    free(index->xrefs);
+    free(index);
+}
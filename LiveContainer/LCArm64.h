@@ -0,0 +1,63 @@
+#pragma once
+// Table driven AArch64 decoder for the handful of instruction classes LiveContainer emulates,
+// plus a cross-reference index over a code region. Plain C so it can be run against dumped images offline.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    LCArm64OpUnknown = 0,
+    LCArm64OpADR,
+    LCArm64OpADRP,
+    LCArm64OpADDImm,
+    LCArm64OpLDRImm,     // ldr/ldrb/ldrh (unsigned offset), size in bytes
+    LCArm64OpLDURImm,
+    LCArm64OpLDRLiteral,
+    LCArm64OpMOVZ,
+    LCArm64OpMOVK,
+    LCArm64OpB,
+    LCArm64OpBL,
+    LCArm64OpBCond,
+    LCArm64OpCBZ,
+    LCArm64OpCBNZ,
+    LCArm64OpTBZ,
+    LCArm64OpTBNZ,
+    LCArm64OpBR,
+    LCArm64OpBLR,
+    LCArm64OpRET,
+} LCArm64Op;
+
+typedef struct {
+    LCArm64Op op;
+    uint8_t rd;      // destination, or the tested register for cbz/tbz
+    uint8_t rn;      // base register
+    uint8_t size;    // operand size in bytes
+    uint8_t extra;   // condition for b.cond, bit number for tbz, shift for movz/movk
+    int64_t imm;     // immediate, already scaled
+    uint64_t target; // resolved address for pc relative instructions
+} LCArm64Insn;
+
+bool LCArm64Decode(uint32_t instruction, uint64_t pc, LCArm64Insn *out);
+
+typedef enum {
+    LCArm64XrefBranch,   // b, bl, b.cond, cbz, tbz and friends
+    LCArm64XrefAddress,  // adr, adrp + add
+    LCArm64XrefLoad,     // ldr literal, adrp + ldr
+} LCArm64XrefKind;
+
+typedef struct {
+    uint64_t target;
+    uint64_t pc;      // instruction that completes the reference
+    uint64_t adrpPc;  // adrp of the pair, 0 if there is none
+    uint32_t kind;
+} LCArm64Xref;
+
+typedef struct LCArm64XrefIndex LCArm64XrefIndex;
+
+// Index code[0..count) mapped at pc, splitting it across threadCount workers (0 = online CPUs).
+// Returns NULL if out of memory.
+LCArm64XrefIndex *LCArm64XrefIndexBuild(const uint32_t *code, size_t count, uint64_t pc, int threadCount);
+// Returns how many references point at target, *xrefsOut points into the index
+size_t LCArm64XrefIndexLookup(const LCArm64XrefIndex *index, uint64_t target, const LCArm64Xref **xrefsOut);
+size_t LCArm64XrefIndexCount(const LCArm64XrefIndex *index);
+void LCArm64XrefIndexFree(LCArm64XrefIndex *index);
@@ -206,6 +206,122 @@ static void *getAppEntryPoint(void *handle) {
     return (void *)header + entryoff;
 }
 
+// mapped from the bundle when it was current, otherwise built from the plists and backed by launchManifestStorage
+static LCLaunchManifest launchManifest;
+static NSArray* launchManifestStorage;
+// set when the manifest in the bundle is missing, stale or lacks a symbol this launch resolved
+static bool launchManifestDirty;
+// symbols resolved until the manifest is written back, launchManifestSymbolNames backs their names
+static bool launchManifestRecording;
+static NSMutableData* launchManifestSymbols;
+static NSMutableArray<NSData*>* launchManifestSymbolNames;
+
+// Maps the manifest of the bundle when it is current, otherwise reads both plists once and builds it in memory,
+// returns false if LCAppInfo.plist can't be read
+static bool loadLaunchManifest(NSString *bundlePath, bool rebuild) {
+    LCLaunchManifestClose(&launchManifest);
+    launchManifestStorage = nil;
+    launchManifestRecording = true;
+    if(!rebuild && LCLaunchManifestOpen(&launchManifest, [bundlePath stringByAppendingPathComponent:@LC_LAUNCH_MANIFEST_NAME].fileSystemRepresentation)) {
+        if(LCLaunchManifestIsCurrent(&launchManifest, bundlePath.fileSystemRepresentation)) {
+            launchManifestDirty = false;
+            return true;
+        }
+        LCLaunchManifestClose(&launchManifest);
+    }
+    // stamped before reading, a plist replaced in between leaves a stale manifest rather than a wrong one
+    NSString *infoPath = [bundlePath stringByAppendingPathComponent:@"Info.plist"];
+    NSString *appInfoPath = [bundlePath stringByAppendingPathComponent:@"LCAppInfo.plist"];
+    LCLaunchManifestStampFile(infoPath.fileSystemRepresentation, &launchManifest.infoPlist);
+    LCLaunchManifestStampFile(appInfoPath.fileSystemRepresentation, &launchManifest.appInfo);
+    NSDictionary *appInfo = [NSDictionary dictionaryWithContentsOfFile:appInfoPath];
+    NSDictionary *infoPlist = [NSDictionary dictionaryWithContentsOfFile:infoPath];
+    launchManifestStorage = [LCSharedUtils fillLaunchManifest:&launchManifest appInfo:appInfo bundleIdentifier:infoPlist[@"CFBundleIdentifier"] executable:infoPlist[@"CFBundleExecutable"]];
+    launchManifestDirty = true;
+    return launchManifestStorage != nil;
+}
+
+static NSString* launchManifestString(LCLaunchManifestField field) {
+    if(!launchManifest.fieldLengths[field]) {
+        return nil;
+    }
+    return [[NSString alloc] initWithBytes:launchManifest.fields[field] length:launchManifest.fieldLengths[field] encoding:NSUTF8StringEncoding];
+}
+
+// the LCAppInfo keys the guest hooks and TweakLoader read
+static NSDictionary* guestAppInfoFromLaunchManifest(void) {
+    NSMutableDictionary* info = [NSMutableDictionary new];
+    info[@"doUseLCBundleId"] = @((bool)(launchManifest.flags & LCLaunchFlagUseLCBundleId));
+    info[@"doSymlinkInbox"] = @((bool)(launchManifest.flags & LCLaunchFlagSymlinkInbox));
+    info[@"dontInjectTweakLoader"] = @((bool)(launchManifest.flags & LCLaunchFlagDontInjectTweakLoader));
+    info[@"fixLocalNotification"] = @((bool)(launchManifest.flags & LCLaunchFlagFixLocalNotification));
+    info[@"fixFilePickerNew"] = @((bool)(launchManifest.flags & LCLaunchFlagFixFilePickerNew));
+    info[@"LCOrientationLock"] = @(launchManifest.orientationLock);
+    info[@"LCOrignalBundleIdentifier"] = launchManifestString(LCLaunchManifestFieldOriginalBundleIdentifier);
+    info[@"LCTweakFolder"] = launchManifestString(LCLaunchManifestFieldTweakFolder);
+    info[@"LCSelectedLanguage"] = launchManifestString(LCLaunchManifestFieldSelectedLanguage);
+    return info;
+}
+
+static const LCLaunchManifestSymbol* findRecordedSymbol(const char *symbol, const uint8_t uuid[16]) {
+    const LCLaunchManifestSymbol* symbols = launchManifestSymbols.bytes;
+    size_t count = launchManifestSymbols.length / sizeof(LCLaunchManifestSymbol);
+    for(size_t i = 0; i < count; i++) {
+        if(!memcmp(symbols[i].uuid, uuid, sizeof(symbols[i].uuid)) && !strcmp(symbols[i].name, symbol)) {
+            return &symbols[i];
+        }
+    }
+    return NULL;
+}
+
+static void recordSymbol(const char *symbol, const uint8_t uuid[16], uint64_t offset) {
+    if(!launchManifestSymbols) {
+        launchManifestSymbols = [NSMutableData new];
+        launchManifestSymbolNames = [NSMutableArray new];
+    }
+    NSData* name = [NSData dataWithBytes:symbol length:strlen(symbol) + 1];
+    [launchManifestSymbolNames addObject:name];
+    LCLaunchManifestSymbol entry = {name.bytes, {0}, offset};
+    memcpy(entry.uuid, uuid, sizeof(entry.uuid));
+    [launchManifestSymbols appendBytes:&entry length:sizeof(entry)];
+}
+
+bool launchManifestLookupSymbol(const char *symbol, const uint8_t uuid[16], uint64_t *offsetOut) {
+    return uuid && LCLaunchManifestFindSymbol(&launchManifest, symbol, uuid, offsetOut);
+}
+
+void launchManifestNoteSymbol(const char *symbol, const uint8_t uuid[16], uint64_t offset) {
+    if(!launchManifestRecording || !uuid || findRecordedSymbol(symbol, uuid)) {
+        return;
+    }
+    uint64_t known;
+    if(!LCLaunchManifestFindSymbol(&launchManifest, symbol, uuid, &known) || known != offset) {
+        launchManifestDirty = true;
+    }
+    recordSymbol(symbol, uuid, offset);
+}
+
+// called once the guest executable is loaded, the symbols its hooks needed are known by then
+static void writeLaunchManifest(NSString *bundlePath) {
+    launchManifestRecording = false;
+    // SideStore's bundle is part of LiveContainer and read-only
+    if(!launchManifestDirty || isSideStore) {
+        return;
+    }
+    // keep what earlier launches resolved and this one didn't need
+    for(size_t i = 0; i < launchManifest.symbolCount; i++) {
+        const LCLaunchManifestSymbol* symbol = &launchManifest.symbols[i];
+        if(!findRecordedSymbol(symbol->name, symbol->uuid)) {
+            recordSymbol(symbol->name, symbol->uuid, symbol->offset);
+        }
+    }
+    LCLaunchManifest manifest = launchManifest;
+    manifest.symbols = launchManifestSymbols.bytes;
+    manifest.symbolCount = launchManifestSymbols.length / sizeof(LCLaunchManifestSymbol);
+    LCLaunchManifestWrite(&manifest, [bundlePath stringByAppendingPathComponent:@LC_LAUNCH_MANIFEST_NAME].fileSystemRepresentation);
+    launchManifestDirty = false;
+}
+
 static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContainer, int argc, char *argv[]) {
     NSString *appError = nil;
     if([[lcUserDefaults objectForKey:@"LCWaitForDebugger"] boolValue]) {
@@ -242,23 +358,22 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
     }
     
 
-    guestAppInfo = [NSDictionary dictionaryWithContentsOfFile:[NSString stringWithFormat:@"%@/LCAppInfo.plist", bundlePath]];
+    bool appInfoFound = loadLaunchManifest(bundlePath, false);
 
     // not found locally, let's look for the app in shared folder
-    if(!guestAppInfo) {
+    if(!appInfoFound) {
         NSURL *appGroupPath = [NSFileManager.defaultManager containerURLForSecurityApplicationGroupIdentifier:[LCSharedUtils appGroupID]];
         appGroupFolder = [appGroupPath URLByAppendingPathComponent:@"LiveContainer"];
         bundlePath = [NSString stringWithFormat:@"%@/Applications/%@", appGroupFolder.path, selectedApp];
-        guestAppInfo = [NSDictionary dictionaryWithContentsOfFile:[NSString stringWithFormat:@"%@/LCAppInfo.plist", bundlePath]];
+        appInfoFound = loadLaunchManifest(bundlePath, false);
         isSharedBundle = true;
     }
     
-    if(!guestAppInfo) {
+    if(!appInfoFound) {
         return @"App bundle not found! Unable to read LCAppInfo.plist.";
     }
     
-    if([guestAppInfo[@"doUseLCBundleId"] boolValue] ) {
-        NSMutableDictionary* infoPlist = [NSMutableDictionary dictionaryWithContentsOfFile:[NSString stringWithFormat:@"%@/Info.plist", bundlePath]];
+    if(launchManifest.flags & LCLaunchFlagUseLCBundleId) {
         CFErrorRef error = NULL;
         void* taskSelf = SecTaskCreateFromSelf(NULL);
         CFTypeRef value = SecTaskCopyValueForEntitlement(taskSelf, CFSTR("application-identifier"), &error);
@@ -269,24 +384,32 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
             NSRange dotRange = [entStr rangeOfString:@"."];
             if (dotRange.location != NSNotFound) {
                 NSString *expectedBundleId = [entStr substringFromIndex:dotRange.location + 1];
-                if(![infoPlist[@"CFBundleIdentifier"] isEqualToString:expectedBundleId]) {
-                    infoPlist[@"CFBundleIdentifier"] = expectedBundleId;
-                    [infoPlist writeBinToFile:[NSString stringWithFormat:@"%@/Info.plist", bundlePath] atomically:YES];
+                // the manifest knows the bundle id Info.plist has, so it only needs reading when it must change
+                if(![launchManifestString(LCLaunchManifestFieldBundleIdentifier) isEqualToString:expectedBundleId]) {
+                    NSMutableDictionary* infoPlist = [NSMutableDictionary dictionaryWithContentsOfFile:[NSString stringWithFormat:@"%@/Info.plist", bundlePath]];
+                    if(![infoPlist[@"CFBundleIdentifier"] isEqualToString:expectedBundleId]) {
+                        infoPlist[@"CFBundleIdentifier"] = expectedBundleId;
+                        [infoPlist writeBinToFile:[NSString stringWithFormat:@"%@/Info.plist", bundlePath] atomically:YES];
+                    }
+                    if(!loadLaunchManifest(bundlePath, true)) {
+                        return @"Unable to read LCAppInfo.plist.";
+                    }
                 }
             }
         }
     }
-    
-    NSBundle *appBundle = [[NSBundle alloc] initWithPathForMainBundle:bundlePath];
-    
-    if(!appBundle) {
-        return @"App not found";
+    guestAppInfo = guestAppInfoFromLaunchManifest();
+    NSString *guestBundleId = launchManifestString(LCLaunchManifestFieldBundleIdentifier);
+    NSString *guestExecutable = launchManifestString(LCLaunchManifestFieldExecutable);
+    if(!guestExecutable) {
+        return @"App's executable path not found. Please try force re-signing or reinstalling this app.";
     }
+    NSString *guestExecPath = [bundlePath stringByAppendingPathComponent:guestExecutable];
     
     // find container in Info.plist
     NSString* dataUUID = selectedContainer;
-    if(!dataUUID) {
-        dataUUID = guestAppInfo[@"LCDataUUID"];
+    if(!dataUUID && launchManifest.fieldLengths[LCLaunchManifestFieldDefaultContainer]) {
+        dataUUID = [[NSString alloc] initWithBytes:launchManifest.fields[LCLaunchManifestFieldDefaultContainer] length:launchManifest.fieldLengths[LCLaunchManifestFieldDefaultContainer] encoding:NSUTF8StringEncoding];
     }
 
     if(dataUUID == nil) {
@@ -333,7 +456,7 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
     const char *oldPath = *path;
     
     // Overwrite @executable_path
-    const char *appExecPath = appBundle.executablePath.fileSystemRepresentation;
+    const char *appExecPath = guestExecPath.fileSystemRepresentation;
     *path = appExecPath;
     overwriteExecPath(appExecPath);
     
@@ -341,38 +464,28 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
     if([guestAppInfo[@"doUseLCBundleId"] boolValue]) {
         lcGuestAppId = guestAppInfo[@"LCOrignalBundleIdentifier"];
     } else {
-        lcGuestAppId = appBundle.bundleIdentifier;
+        lcGuestAppId = guestBundleId;
         
     }
 
     // Overwrite home and tmp path
     NSString *newHomePath = nil;
-    NSArray<NSDictionary*>* containers = guestAppInfo[@"LCContainers"];
     NSURL* bookmarkURL = nil;
 
     // see if the container contains a bookmark. if so, resolve it and report error upon failure.
-    if(containers && [containers isKindOfClass:NSArray.class]) {
-        for(NSDictionary* container in containers){
-            if(![container isKindOfClass:NSDictionary.class]) {
-                continue;
-            }
-            if([container[@"folderName"] isEqualToString:dataUUID]) {
-                NSData* bookmarkData = container[@"bookmarkData"];
-                if(bookmarkData && [bookmarkData isKindOfClass:NSData.class]) {
-                    // we will be killed by watchdog before timedout, so we set this error beforehand.
-                    [lcUserDefaults setObject:@"Bookmark resolution timed out. Is the data storage offline?" forKey:@"error"];
-                    NSError* err = nil;
-                    BOOL isStale = false;
-                    bookmarkURL = [NSURL URLByResolvingBookmarkData:bookmarkData options:0 relativeToURL:nil bookmarkDataIsStale:&isStale error:&err];
-                    bool access = [bookmarkURL startAccessingSecurityScopedResource];
-                    if(!bookmarkURL || !access) {
-                        return [@"Bookmark resolution failed or unable to access the container. You might need to readd the data storage. %@" stringByAppendingString:err.localizedDescription];
-                    }
-                    [lcUserDefaults removeObjectForKey:@"error"];
-                }
-                break;
-            }
+    const LCLaunchManifestContainer* container = LCLaunchManifestFindContainer(&launchManifest, dataUUID.UTF8String);
+    if(container && container->bookmarkLength) {
+        NSData* bookmarkData = [NSData dataWithBytes:container->bookmark length:container->bookmarkLength];
+        // we will be killed by watchdog before timedout, so we set this error beforehand.
+        [lcUserDefaults setObject:@"Bookmark resolution timed out. Is the data storage offline?" forKey:@"error"];
+        NSError* err = nil;
+        BOOL isStale = false;
+        bookmarkURL = [NSURL URLByResolvingBookmarkData:bookmarkData options:0 relativeToURL:nil bookmarkDataIsStale:&isStale error:&err];
+        bool access = [bookmarkURL startAccessingSecurityScopedResource];
+        if(!bookmarkURL || !access) {
+            return [@"Bookmark resolution failed or unable to access the container. You might need to readd the data storage. %@" stringByAppendingString:err.localizedDescription];
         }
+        [lcUserDefaults removeObjectForKey:@"error"];
     }
     
     if(isSideStore) {
@@ -384,6 +497,9 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
         }
     } else if (bookmarkURL) {
         newHomePath = bookmarkURL.path;
+    } else if(container && container->homePath[0]) {
+        // recorded relative to the folder holding Applications and Data when the manifest was written
+        newHomePath = [(isSharedBundle ? appGroupFolder.path : docPath) stringByAppendingPathComponent:@(container->homePath)];
     } else if(isSharedBundle) {
         newHomePath = [NSString stringWithFormat:@"%@/Data/Application/%@", appGroupFolder.path, dataUUID];
         
@@ -396,8 +512,8 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
     remove(newTmpPath.UTF8String);
     symlink(getenv("TMPDIR"), newTmpPath.UTF8String);
     
-    if([guestAppInfo[@"doSymlinkInbox"] boolValue]) {
-        NSString* inboxSymlinkPath = [NSString stringWithFormat:@"%s/%@-Inbox", getenv("TMPDIR"), [appBundle bundleIdentifier]];
+    if(launchManifest.flags & LCLaunchFlagSymlinkInbox) {
+        NSString* inboxSymlinkPath = [NSString stringWithFormat:@"%s/%@-Inbox", getenv("TMPDIR"), guestBundleId];
         NSString* inboxPath = [newHomePath stringByAppendingPathComponent:@"Inbox"];
         
         if (![fm fileExistsAtPath:inboxPath]) {
@@ -417,7 +533,7 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
 
         symlink(inboxPath.UTF8String, inboxSymlinkPath.UTF8String);
     } else {
-        NSString* inboxSymlinkPath = [NSString stringWithFormat:@"%s/%@-Inbox", getenv("TMPDIR"), [appBundle bundleIdentifier]];
+        NSString* inboxSymlinkPath = [NSString stringWithFormat:@"%s/%@-Inbox", getenv("TMPDIR"), guestBundleId];
         NSDictionary* targetAttribute = [fm attributesOfItemAtPath:inboxSymlinkPath error:&error];
         if(targetAttribute) {
             if(targetAttribute[NSFileType] == NSFileTypeSymbolicLink) {
@@ -444,21 +560,21 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
     
     [LCSharedUtils setContainerUsingByLC:lcAppUrlScheme folderName:dataUUID auditToken:0];
 
-    // Overwrite NSBundle
+    // Overwrite NSBundle, the only place the guest bundle is resolved as an NSBundle
+    NSBundle *appBundle = [[NSBundle alloc] initWithPathForMainBundle:bundlePath];
+    if(!appBundle) {
+        return @"App not found";
+    }
     overwriteMainNSBundle(appBundle);
 
     // Overwrite CFBundle
     overwriteMainCFBundle();
 
     // Overwrite executable info
-    if(!appBundle.executablePath) {
-        return @"App's executable path not found. Please try force re-signing or reinstalling this app.";
-    }
-
     NSMutableArray<NSString *> *objcArgv = NSProcessInfo.processInfo.arguments.mutableCopy;
-    objcArgv[0] = appBundle.executablePath;
+    objcArgv[0] = guestExecPath;
     [NSProcessInfo.processInfo performSelector:@selector(setArguments:) withObject:objcArgv];
-    NSProcessInfo.processInfo.processName = appBundle.infoDictionary[@"CFBundleExecutable"];
+    NSProcessInfo.processInfo.processName = guestExecutable;
     *_CFGetProgname() = NSProcessInfo.processInfo.processName.UTF8String;
     Class swiftNSProcessInfo = NSClassFromString(@"_NSSwiftProcessInfo");
     if(swiftNSProcessInfo) {
@@ -478,9 +594,9 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
     litehook_rebind_symbol(LITEHOOK_REBIND_GLOBAL, NSSetUncaughtExceptionHandler, hook_do_nothing, nil);
     
     BOOL hookDlopen = !isSideStore && !isSharedBundle && LCSharedUtils.certificatePassword && isLiveProcess;
-    DyldHooksInit([guestAppInfo[@"hideLiveContainer"] boolValue], hookDlopen, [guestAppInfo[@"spoofSDKVersion"] unsignedIntValue]);
+    DyldHooksInit(launchManifest.flags & LCLaunchFlagHideLiveContainer, hookDlopen, launchManifest.spoofSDKVersion);
 #if is32BitSupported
-    bool is32bit = [guestAppInfo[@"is32bit"] boolValue];
+    bool is32bit = launchManifest.flags & LCLaunchFlagIs32Bit;
     if(is32bit) {
         if (!isJitEnabled) {
             return @"JIT is required to run 32-bit apps.";
@@ -504,7 +620,8 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
         appExecPath = strdup(selected32bitLayerBundle.executablePath.UTF8String);
     }
 #endif
-    if(![guestAppInfo[@"dontInjectTweakLoader"] boolValue]) {
+    bool dontInjectTweakLoader = launchManifest.flags & LCLaunchFlagDontInjectTweakLoader;
+    if(!dontInjectTweakLoader) {
         tweakLoaderLoaded = true;
     }
     
@@ -524,8 +641,9 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
         *path = oldPath;
         return appError;
     }
+    writeLaunchManifest(bundlePath);
     
-    if([guestAppInfo[@"dontInjectTweakLoader"] boolValue] && ![guestAppInfo[@"dontLoadTweakLoader"] boolValue]) {
+    if(dontInjectTweakLoader && !(launchManifest.flags & LCLaunchFlagDontLoadTweakLoader)) {
         tweakLoaderLoaded = true;
         dlopen("@loader_path/../TweakLoader.dylib", RTLD_LAZY|RTLD_GLOBAL);
     }
@@ -535,7 +653,7 @@ static NSString* invokeAppMain(NSString *selectedApp, NSString *selectedContaine
         dlopen([lcMainBundle.bundlePath stringByAppendingPathComponent:@"Frameworks/TweakLoader.dylib"].UTF8String, RTLD_LAZY|RTLD_GLOBAL);
     }
     
-    if(!isSideStore && sideStoreExist && ![guestAppInfo[@"dontInjectTweakLoader"] boolValue]) {
+    if(!isSideStore && sideStoreExist && !dontInjectTweakLoader) {
         dlopen([lcMainBundle.bundlePath stringByAppendingPathComponent:@"Frameworks/SideStore.framework/SideStore"].UTF8String, RTLD_LAZY);
     }
     
@@ -0,0 +1,168 @@
+#include "LCBundlePatch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <fts.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Mach-O constants we need, spelled out so this file does not depend on <mach-o/*.h>
+#define LCB_FAT_CIGAM 0xbebafeca
+#define LCB_CPU_TYPE_ARM64 0x0100000c
+#define LCB_CPU_SUBTYPE_ARM64E 2
+#define LCB_CPU_SUBTYPE_LIB64 0x80000000
+#define LCB_FAT_ARCH_SIZE 20
+#define LCB_MAX_FAT_ARCHS 32
+
+static bool hasSuffix(const char *str, const char *suffix) {
+    size_t len = strlen(str), suffixLen = strlen(suffix);
+    return len >= suffixLen && !strcmp(str + len - suffixLen, suffix);
+}
+
+static void appendPath(char ***paths, size_t *count, size_t *capacity, const char *path) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *paths = realloc(*paths, *capacity * sizeof(char *));
+    }
+    (*paths)[(*count)++] = strdup(path);
+}
+
+size_t LCBundleCollectMachOs(const char *bundlePath, char ***pathsOut, LCFrameworkExecutableResolver resolver, void *context) {
+    size_t count = 0, capacity = 0;
+    *pathsOut = NULL;
+    char *const roots[] = {(char *)bundlePath, NULL};
+    FTS *fts = fts_open(roots, FTS_PHYSICAL | FTS_NOCHDIR | FTS_NOSTAT, NULL);
+    if (!fts) {
+        return 0;
+    }
+    FTSENT *entry;
+    while ((entry = fts_read(fts))) {
+        if (entry->fts_level > 0 && entry->fts_name[0] == '.') {
+            // same as NSDirectoryEnumerationSkipsHiddenFiles
+            if (entry->fts_info == FTS_D) {
+                fts_set(fts, entry, FTS_SKIP);
+            }
+            continue;
+        }
+        if (entry->fts_info == FTS_DP) {
+            continue;
+        }
+        if (hasSuffix(entry->fts_name, ".dylib")) {
+            appendPath(pathsOut, &count, &capacity, entry->fts_path);
+        } else if (entry->fts_info == FTS_D && hasSuffix(entry->fts_name, ".framework")) {
+            char name[NAME_MAX + 1];
+            if (!resolver || !resolver(entry->fts_path, name, sizeof(name), context)) {
+                snprintf(name, sizeof(name), "%.*s", (int)(strlen(entry->fts_name) - strlen(".framework")), entry->fts_name);
+            }
+            char executablePath[PATH_MAX];
+            snprintf(executablePath, sizeof(executablePath), "%s/%s", entry->fts_path, name);
+            appendPath(pathsOut, &count, &capacity, executablePath);
+        }
+    }
+    fts_close(fts);
+    return count;
+}
+
+void LCBundleFreePaths(char **paths, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+// Returns 1 if patched, 0 if there is nothing to do, -1 on error
+static int fixupARM64eSlice(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    uint8_t buf[8 + LCB_FAT_ARCH_SIZE * LCB_MAX_FAT_ARCHS];
+    ssize_t length = pread(fd, buf, sizeof(buf), 0);
+    if (length < 8 || *(uint32_t *)buf != LCB_FAT_CIGAM) {
+        close(fd);
+        return 0;
+    }
+
+    // Find arm64e slice without CPU_SUBTYPE_LIB64, slices that already have it are left alone
+    uint32_t nfatArch = __builtin_bswap32(*(uint32_t *)(buf + 4));
+    off_t archOffset = -1, sliceOffset = 0;
+    for (uint32_t i = 0; i < nfatArch && 8 + LCB_FAT_ARCH_SIZE * (i + 1) <= length; i++) {
+        uint32_t *arch = (uint32_t *)(buf + 8 + LCB_FAT_ARCH_SIZE * i);
+        if (__builtin_bswap32(arch[0]) == LCB_CPU_TYPE_ARM64 && __builtin_bswap32(arch[1]) == LCB_CPU_SUBTYPE_ARM64E) {
+            archOffset = 8 + LCB_FAT_ARCH_SIZE * i;
+            sliceOffset = __builtin_bswap32(arch[2]);
+            break;
+        }
+    }
+    close(fd);
+    if (archOffset < 0) {
+        return 0;
+    }
+
+    // only the two cpusubtype words change, so write them directly instead of mapping the file
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+    uint32_t cpusubtype;
+    int ret = -1;
+    if (pread(fd, &cpusubtype, sizeof(cpusubtype), sliceOffset + 8) == sizeof(cpusubtype)) {
+        cpusubtype |= LCB_CPU_SUBTYPE_LIB64;
+        uint32_t archSubtype = __builtin_bswap32(cpusubtype);
+        if (pwrite(fd, &cpusubtype, sizeof(cpusubtype), sliceOffset + 8) == sizeof(cpusubtype) &&
+            pwrite(fd, &archSubtype, sizeof(archSubtype), archOffset + 4) == sizeof(archSubtype)) {
+            ret = 1;
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+typedef struct {
+    char *const *paths;
+    size_t count;
+    size_t next;
+    LCBundlePatchStats stats;
+} LCBundlePatchJob;
+
+static void *fixupWorker(void *arg) {
+    LCBundlePatchJob *job = arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+        int result = fixupARM64eSlice(job->paths[i]);
+        size_t *counter = result > 0 ? &job->stats.patched : result == 0 ? &job->stats.skipped : &job->stats.failed;
+        __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&job->stats.scanned, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+void LCBundleFixupARM64eSlices(char *const *paths, size_t count, int threadCount, LCBundlePatchStats *statsOut) {
+    LCBundlePatchJob job = {.paths = paths, .count = count};
+    if (threadCount <= 0) {
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((size_t)threadCount > count) {
+        threadCount = (int)count;
+    }
+
+    pthread_t threads[64];
+    int started = 0;
+    for (; started < threadCount - 1 && started < 64; started++) {
+        if (pthread_create(&threads[started], NULL, fixupWorker, &job) != 0) {
+            break;
+        }
+    }
+    // the calling thread works too, so a failed pthread_create only costs parallelism
+    fixupWorker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (statsOut) {
+        *statsOut = job.stats;
+    }
+}
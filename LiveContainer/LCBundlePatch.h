@@ -0,0 +1,18 @@
+#pragma once
+// Portable bundle-wide Mach-O patching, kept free of Foundation so it can also run headless on Linux
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct LCBundlePatchStats {
+    size_t scanned;
+    size_t patched;
+    size_t skipped;
+    size_t failed;
+} LCBundlePatchStats;
+
+// Fills nameOut with the CFBundleExecutable of a .framework, return false to use the folder name
+typedef bool (*LCFrameworkExecutableResolver)(const char *frameworkPath, char *nameOut, size_t nameSize, void *context);
+
+size_t LCBundleCollectMachOs(const char *bundlePath, char ***pathsOut, LCFrameworkExecutableResolver resolver, void *context);
+void LCBundleFreePaths(char **paths, size_t count);
+void LCBundleFixupARM64eSlices(char *const *paths, size_t count, int threadCount, LCBundlePatchStats *statsOut);
@@ -0,0 +1,297 @@
+#include "LCContainerLock.h"
+#include "LCHash.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LCCL_MAGIC 0x4c43434c // 'LCCL'
+#define LCCL_VERSION 1
+// a slot held this long belongs to a writer that died in the middle of an update
+#define LCCL_STEAL_SPINS 100000
+#define LCCL_READ_TRIES 1000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    uint64_t generation;
+    uint8_t reserved[40];
+} LCContainerLockHeader;
+
+// The header is followed by the key hash of every slot, 0 when free, so lookups scan one dense array,
+// then by the slots themselves
+typedef struct {
+    uint64_t sequence; // odd while a writer holds the slot
+    uint64_t owner;
+    uint64_t generation; // the newest of two slots a race left with the same key wins
+    uint64_t reserved;
+    char key[LC_CONTAINER_LOCK_KEY_SIZE];
+    char value[LC_CONTAINER_LOCK_VALUE_SIZE];
+} LCContainerLockSlot;
+
+#define LCCL_FILE_SIZE (sizeof(LCContainerLockHeader) + LC_CONTAINER_LOCK_SLOTS * (sizeof(uint64_t) + sizeof(LCContainerLockSlot)))
+
+static LCContainerLockHeader *tableHeader(const LCContainerLockTable *table) {
+    return table->map;
+}
+
+static uint64_t *tableHashes(const LCContainerLockTable *table) {
+    return (uint64_t *)(tableHeader(table) + 1);
+}
+
+static LCContainerLockSlot *tableSlots(const LCContainerLockTable *table) {
+    return (LCContainerLockSlot *)(tableHashes(table) + LC_CONTAINER_LOCK_SLOTS);
+}
+
+static uint64_t hashKey(const char *key) {
+    // never 0 so it can't be taken for a free slot
+    return LCHashString(key) | 1;
+}
+
+// every field is a constant that is 0 in a new file, so concurrent openers can all fill it in
+static bool initHeaderField(uint32_t *field, uint32_t value) {
+    uint32_t expected = 0;
+    __atomic_compare_exchange_n(field, &expected, value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(field, __ATOMIC_ACQUIRE) == value;
+}
+
+static bool initHeader(LCContainerLockHeader *header) {
+    return initHeaderField(&header->magic, LCCL_MAGIC) && initHeaderField(&header->version, LCCL_VERSION) &&
+           initHeaderField(&header->slotCount, LC_CONTAINER_LOCK_SLOTS) && initHeaderField(&header->slotSize, sizeof(LCContainerLockSlot));
+}
+
+bool LCContainerLockOpen(LCContainerLockTable *table, const char *path) {
+    memset(table, 0, sizeof(*table));
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat s;
+    // only ever grown, a process that maps it while another one sizes it still sees zeros
+    if (fstat(fd, &s) != 0 || (s.st_size < (off_t)LCCL_FILE_SIZE && ftruncate(fd, LCCL_FILE_SIZE) != 0)) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+    void *map = mmap(NULL, LCCL_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = error;
+        return false;
+    }
+    table->map = map;
+    table->mapSize = LCCL_FILE_SIZE;
+    if (!initHeader(map)) {
+        // a damaged or foreign table only holds stale locks, start it over
+        memset(map, 0, LCCL_FILE_SIZE);
+        if (!initHeader(map)) {
+            LCContainerLockClose(table);
+            errno = EINVAL;
+            return false;
+        }
+    }
+    return true;
+}
+
+void LCContainerLockClose(LCContainerLockTable *table) {
+    if (table->map) {
+        munmap(table->map, table->mapSize);
+    }
+    memset(table, 0, sizeof(*table));
+}
+
+static uint64_t lockSlot(LCContainerLockSlot *slot) {
+    for (int spins = 0;; spins++) {
+        uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+        // stealing keeps the sequence odd, so readers keep retrying until the new holder is done
+        uint64_t locked = (sequence & 1) ? (spins > LCCL_STEAL_SPINS ? sequence + 2 : 0) : sequence + 1;
+        if (locked && __atomic_compare_exchange_n(&slot->sequence, &sequence, locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return locked;
+        }
+        if (spins > 64) {
+            sched_yield();
+        }
+    }
+}
+
+static void unlockSlot(LCContainerLockSlot *slot, uint64_t locked) {
+    // fails only if the slot was stolen from us, the thief unlocks it then
+    __atomic_compare_exchange_n(&slot->sequence, &locked, locked + 1, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+static bool readSlot(const LCContainerLockSlot *slot, LCContainerLockSlot *copy) {
+    for (int tries = 0; tries < LCCL_READ_TRIES; tries++) {
+        uint64_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(copy, slot, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before) {
+            copy->key[LC_CONTAINER_LOCK_KEY_SIZE - 1] = '\0';
+            copy->value[LC_CONTAINER_LOCK_VALUE_SIZE - 1] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+// under the slot lock, the key goes first so a reader never pairs a freed slot with a new hash
+static void freeSlot(const LCContainerLockTable *table, size_t index) {
+    tableSlots(table)[index].key[0] = '\0';
+    __atomic_store_n(&tableHashes(table)[index], 0, __ATOMIC_RELEASE);
+}
+
+bool LCContainerLockGet(const LCContainerLockTable *table, const char *key, char *value, size_t valueSize, uint64_t *owner) {
+    uint64_t hash = hashKey(key);
+    const uint64_t *hashes = tableHashes(table);
+    const LCContainerLockSlot *slots = tableSlots(table);
+    LCContainerLockSlot best, copy;
+    bool found = false;
+    for (size_t i = 0; i < LC_CONTAINER_LOCK_SLOTS; i++) {
+        if (__atomic_load_n(&hashes[i], __ATOMIC_ACQUIRE) != hash || !readSlot(&slots[i], &copy) || strcmp(copy.key, key) != 0) {
+            continue;
+        }
+        if (!found || copy.generation > best.generation) {
+            best = copy;
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    if (value && valueSize > 0) {
+        size_t length = strnlen(best.value, valueSize - 1);
+        memcpy(value, best.value, length);
+        value[length] = '\0';
+    }
+    if (owner) {
+        *owner = best.owner;
+    }
+    return true;
+}
+
+static void writeSlot(LCContainerLockSlot *slot, const char *key, const char *value, uint64_t owner, uint64_t generation) {
+    // both were checked to fit
+    memset(slot->key, 0, sizeof(slot->key));
+    memset(slot->value, 0, sizeof(slot->value));
+    memcpy(slot->key, key, strlen(key));
+    memcpy(slot->value, value, strlen(value));
+    slot->owner = owner;
+    slot->generation = generation;
+}
+
+bool LCContainerLockSet(LCContainerLockTable *table, const char *key, const char *value, uint64_t owner, LCContainerLockAliveFunc alive, void *context) {
+    if (!key[0] || strlen(key) >= LC_CONTAINER_LOCK_KEY_SIZE || strlen(value) >= LC_CONTAINER_LOCK_VALUE_SIZE) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    uint64_t hash = hashKey(key);
+    uint64_t *hashes = tableHashes(table);
+    LCContainerLockSlot *slots = tableSlots(table);
+    uint64_t generation = __atomic_add_fetch(&tableHeader(table)->generation, 1, __ATOMIC_RELAXED);
+
+    // update the key's slot in place, and drop any duplicate two racing writers left behind
+    bool stored = false;
+    for (size_t i = 0; i < LC_CONTAINER_LOCK_SLOTS; i++) {
+        if (__atomic_load_n(&hashes[i], __ATOMIC_ACQUIRE) != hash) {
+            continue;
+        }
+        uint64_t locked = lockSlot(&slots[i]);
+        if (__atomic_load_n(&hashes[i], __ATOMIC_ACQUIRE) == hash && !strncmp(slots[i].key, key, LC_CONTAINER_LOCK_KEY_SIZE)) {
+            if (!stored) {
+                writeSlot(&slots[i], key, value, owner, generation);
+                stored = true;
+            } else {
+                freeSlot(table, i);
+            }
+        }
+        unlockSlot(&slots[i], locked);
+    }
+    if (stored) {
+        return true;
+    }
+
+    // claim a free slot, starting at the hash so writers of different keys rarely meet
+    for (int attempt = 0; attempt < 2; attempt++) {
+        for (size_t j = 0; j < LC_CONTAINER_LOCK_SLOTS; j++) {
+            size_t i = (hash + j) % LC_CONTAINER_LOCK_SLOTS;
+            uint64_t expected = 0;
+            if (__atomic_load_n(&hashes[i], __ATOMIC_RELAXED) != 0 ||
+                !__atomic_compare_exchange_n(&hashes[i], &expected, hash, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                continue;
+            }
+            uint64_t locked = lockSlot(&slots[i]);
+            writeSlot(&slots[i], key, value, owner, generation);
+            unlockSlot(&slots[i], locked);
+            return true;
+        }
+        if (!alive || LCContainerLockSweep(table, alive, context) == 0) {
+            break;
+        }
+    }
+    errno = ENOSPC;
+    return false;
+}
+
+static int compareOwners(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+size_t LCContainerLockSweep(LCContainerLockTable *table, LCContainerLockAliveFunc alive, void *context) {
+    uint64_t *hashes = tableHashes(table);
+    LCContainerLockSlot *slots = tableSlots(table);
+    uint64_t *owners = malloc(LC_CONTAINER_LOCK_SLOTS * sizeof(uint64_t));
+    bool *ownerAlive = malloc(LC_CONTAINER_LOCK_SLOTS * sizeof(bool));
+    if (!owners || !ownerAlive) {
+        free(owners);
+        free(ownerAlive);
+        return 0;
+    }
+
+    // most slots share a handful of owners, so each one is only looked up once
+    size_t ownerCount = 0;
+    LCContainerLockSlot copy;
+    for (size_t i = 0; i < LC_CONTAINER_LOCK_SLOTS; i++) {
+        if (__atomic_load_n(&hashes[i], __ATOMIC_ACQUIRE) != 0 && readSlot(&slots[i], &copy) && copy.key[0]) {
+            owners[ownerCount++] = copy.owner;
+        }
+    }
+    qsort(owners, ownerCount, sizeof(uint64_t), compareOwners);
+    size_t distinct = 0;
+    for (size_t i = 0; i < ownerCount; i++) {
+        if (distinct == 0 || owners[distinct - 1] != owners[i]) {
+            owners[distinct] = owners[i];
+            ownerAlive[distinct] = owners[i] != 0 && alive(owners[i], context);
+            distinct++;
+        }
+    }
+
+    size_t freed = 0;
+    for (size_t i = 0; i < LC_CONTAINER_LOCK_SLOTS; i++) {
+        if (__atomic_load_n(&hashes[i], __ATOMIC_ACQUIRE) == 0) {
+            continue;
+        }
+        uint64_t locked = lockSlot(&slots[i]);
+        // an owner that took the slot after the lookups isn't in the list and stays
+        const uint64_t *owner = bsearch(&slots[i].owner, owners, distinct, sizeof(uint64_t), compareOwners);
+        if (__atomic_load_n(&hashes[i], __ATOMIC_ACQUIRE) != 0 && slots[i].key[0] && owner && !ownerAlive[owner - owners]) {
+            freeSlot(table, i);
+            freed++;
+        }
+        unlockSlot(&slots[i], locked);
+    }
+    free(owners);
+    free(ownerAlive);
+    return freed;
+}
@@ -0,0 +1,31 @@
+#pragma once
+// Which LiveContainer runs a container, shared by every LiveContainer through one mapped file in the app group.
+// The file is a fixed table of slots, each a key (container folder name or LC scheme), a value (the LC scheme running it)
+// and the audit token of the owning process. Writers claim and update slots with compare-and-swap, readers take no
+// locks and retry if a slot changed under them. Nothing is ever removed on exit, a slot is stale once its owner is gone.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LC_CONTAINER_LOCK_SLOTS 1024
+#define LC_CONTAINER_LOCK_KEY_SIZE 64
+#define LC_CONTAINER_LOCK_VALUE_SIZE 32
+
+// owner is audit token val[5] << 32 | val[7], pid and pid version, 0 is never alive
+typedef bool (*LCContainerLockAliveFunc)(uint64_t owner, void *context);
+
+typedef struct LCContainerLockTable {
+    void *map;
+    size_t mapSize;
+} LCContainerLockTable;
+
+// Maps the table at path, creating it if needed. Returns false with errno set.
+bool LCContainerLockOpen(LCContainerLockTable *table, const char *path);
+void LCContainerLockClose(LCContainerLockTable *table);
+// Copies the value and owner last stored for key, whether or not the owner still runs. value can be NULL.
+bool LCContainerLockGet(const LCContainerLockTable *table, const char *key, char *value, size_t valueSize, uint64_t *owner);
+// Stores value and owner for key. When the table is full, slots of dead owners are swept first.
+// Returns false with errno set, ENAMETOOLONG if key or value doesn't fit a slot, ENOSPC if every owner is alive.
+bool LCContainerLockSet(LCContainerLockTable *table, const char *key, const char *value, uint64_t owner, LCContainerLockAliveFunc alive, void *context);
+// Frees the slots of owners that are gone, asking alive once per distinct owner. Returns how many were freed.
+size_t LCContainerLockSweep(LCContainerLockTable *table, LCContainerLockAliveFunc alive, void *context);
@@ -0,0 +1,23 @@
+#pragma once
+// FNV-1a, shared by the on-disk symbol index, symbol cache and container lock table.
+// The value is stored in those files, so the algorithm must not change without bumping their versions.
+#include <stddef.h>
+#include <stdint.h>
+
+static inline uint64_t LCHashBytes(const char *data, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static inline uint64_t LCHashString(const char *string) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *string; string++) {
+        hash ^= (uint8_t)*string;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,274 @@
+#include "LCLaunchManifest.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LCLM_MAGIC 0x4d4c434c // 'LCLM'
+#define LCLM_VERSION 2
+#define LCLM_MAX_SIZE (16u << 20)
+
+#ifdef __APPLE__
+#define LCLM_MTIME(st) ((st).st_mtimespec)
+#else
+#define LCLM_MTIME(st) ((st).st_mtim)
+#endif
+
+// The file is this header, containerCount container records, symbolCount symbol records, then the strings and data they
+// point at. Offsets are from the start of the file.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    LCLaunchManifestStamp infoPlist;
+    LCLaunchManifestStamp appInfo;
+    uint32_t flags;
+    uint32_t spoofSDKVersion;
+    int32_t orientationLock;
+    uint32_t fieldOffsets[LCLaunchManifestFieldCount];
+    uint32_t fieldLengths[LCLaunchManifestFieldCount];
+    uint32_t containerCount;
+    uint32_t symbolCount;
+} LCLaunchManifestHeader;
+
+typedef struct {
+    uint32_t nameOffset; // NUL terminated, so is homeOffset
+    uint32_t nameLength;
+    uint32_t homeOffset;
+    uint32_t homeLength;
+    uint32_t bookmarkOffset;
+    uint32_t bookmarkLength;
+} LCLaunchManifestContainerRecord;
+
+typedef struct {
+    uint8_t uuid[16];
+    uint64_t offset;
+    uint32_t nameOffset; // NUL terminated
+    uint32_t nameLength;
+} LCLaunchManifestSymbolRecord;
+
+static bool fits(size_t mapSize, uint32_t offset, uint32_t length) {
+    return offset <= mapSize && length <= mapSize - offset;
+}
+
+static bool fitsString(const uint8_t *map, size_t mapSize, uint32_t offset, uint32_t length) {
+    return length < UINT32_MAX && fits(mapSize, offset, length + 1) && map[offset + length] == '\0';
+}
+
+bool LCLaunchManifestOpen(LCLaunchManifest *manifest, const char *path) {
+    memset(manifest, 0, sizeof(*manifest));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0 || s.st_size < (off_t)sizeof(LCLaunchManifestHeader) || s.st_size > LCLM_MAX_SIZE) {
+        close(fd);
+        return false;
+    }
+    size_t mapSize = (size_t)s.st_size;
+    uint8_t *map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const LCLaunchManifestHeader *header = (const LCLaunchManifestHeader *)map;
+    const LCLaunchManifestContainerRecord *records = (const LCLaunchManifestContainerRecord *)(header + 1);
+    const LCLaunchManifestSymbolRecord *symbolRecords = (const LCLaunchManifestSymbolRecord *)(records + header->containerCount);
+    size_t recordSpace = mapSize - sizeof(LCLaunchManifestHeader);
+    bool valid = header->magic == LCLM_MAGIC && header->version == LCLM_VERSION &&
+        header->containerCount <= recordSpace / sizeof(LCLaunchManifestContainerRecord) &&
+        header->symbolCount <= (recordSpace - header->containerCount * sizeof(LCLaunchManifestContainerRecord)) / sizeof(LCLaunchManifestSymbolRecord);
+    for (int i = 0; valid && i < LCLaunchManifestFieldCount; i++) {
+        valid = fits(mapSize, header->fieldOffsets[i], header->fieldLengths[i]);
+    }
+    // both tables come from one allocation, the symbols follow the containers
+    void *tables = valid ? calloc(1, (header->containerCount + 1) * sizeof(LCLaunchManifestContainer) + header->symbolCount * sizeof(LCLaunchManifestSymbol)) : NULL;
+    LCLaunchManifestContainer *containers = tables;
+    LCLaunchManifestSymbol *symbols = tables ? (LCLaunchManifestSymbol *)(containers + header->containerCount + 1) : NULL;
+    for (uint32_t i = 0; tables && valid && i < header->containerCount; i++) {
+        const LCLaunchManifestContainerRecord *record = &records[i];
+        valid = fitsString(map, mapSize, record->nameOffset, record->nameLength) && fitsString(map, mapSize, record->homeOffset, record->homeLength) &&
+            fits(mapSize, record->bookmarkOffset, record->bookmarkLength);
+        containers[i] = (LCLaunchManifestContainer){(const char *)map + record->nameOffset, (const char *)map + record->homeOffset, map + record->bookmarkOffset, record->bookmarkLength};
+    }
+    for (uint32_t i = 0; tables && valid && i < header->symbolCount; i++) {
+        const LCLaunchManifestSymbolRecord *record = &symbolRecords[i];
+        valid = fitsString(map, mapSize, record->nameOffset, record->nameLength);
+        symbols[i].name = (const char *)map + record->nameOffset;
+        memcpy(symbols[i].uuid, record->uuid, sizeof(symbols[i].uuid));
+        symbols[i].offset = record->offset;
+    }
+    if (!valid || !tables) {
+        free(tables);
+        munmap(map, mapSize);
+        return false;
+    }
+
+    manifest->infoPlist = header->infoPlist;
+    manifest->appInfo = header->appInfo;
+    manifest->flags = header->flags;
+    manifest->spoofSDKVersion = header->spoofSDKVersion;
+    manifest->orientationLock = header->orientationLock;
+    for (int i = 0; i < LCLaunchManifestFieldCount; i++) {
+        manifest->fields[i] = map + header->fieldOffsets[i];
+        manifest->fieldLengths[i] = header->fieldLengths[i];
+    }
+    manifest->containers = containers;
+    manifest->containerCount = header->containerCount;
+    manifest->symbols = symbols;
+    manifest->symbolCount = header->symbolCount;
+    manifest->map = map;
+    manifest->mapSize = mapSize;
+    return true;
+}
+
+void LCLaunchManifestClose(LCLaunchManifest *manifest) {
+    if (manifest->map) {
+        free((void *)manifest->containers);
+        munmap(manifest->map, manifest->mapSize);
+    }
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+void LCLaunchManifestStampFile(const char *path, LCLaunchManifestStamp *stamp) {
+    struct stat s;
+    memset(stamp, 0, sizeof(*stamp));
+    if (stat(path, &s) == 0) {
+        stamp->inode = (uint64_t)s.st_ino;
+        stamp->mtime = (int64_t)LCLM_MTIME(s).tv_sec * 1000000000 + LCLM_MTIME(s).tv_nsec;
+        stamp->size = (uint64_t)s.st_size;
+    }
+}
+
+static bool isStampCurrent(const LCLaunchManifestStamp *stamp, const char *bundlePath, const char *name) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", bundlePath, name) >= (int)sizeof(path)) {
+        return false;
+    }
+    LCLaunchManifestStamp current;
+    LCLaunchManifestStampFile(path, &current);
+    return !memcmp(&current, stamp, sizeof(current));
+}
+
+bool LCLaunchManifestIsCurrent(const LCLaunchManifest *manifest, const char *bundlePath) {
+    return isStampCurrent(&manifest->appInfo, bundlePath, "LCAppInfo.plist") && isStampCurrent(&manifest->infoPlist, bundlePath, "Info.plist");
+}
+
+const LCLaunchManifestContainer *LCLaunchManifestFindContainer(const LCLaunchManifest *manifest, const char *folderName) {
+    for (size_t i = 0; folderName && i < manifest->containerCount; i++) {
+        if (!strcmp(manifest->containers[i].folderName, folderName)) {
+            return &manifest->containers[i];
+        }
+    }
+    return NULL;
+}
+
+bool LCLaunchManifestFindSymbol(const LCLaunchManifest *manifest, const char *name, const uint8_t uuid[16], uint64_t *offsetOut) {
+    for (size_t i = 0; i < manifest->symbolCount; i++) {
+        const LCLaunchManifestSymbol *symbol = &manifest->symbols[i];
+        if (!memcmp(symbol->uuid, uuid, sizeof(symbol->uuid)) && !strcmp(symbol->name, name)) {
+            *offsetOut = symbol->offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LCLaunchManifestWrite(const LCLaunchManifest *manifest, const char *path) {
+    size_t offset = sizeof(LCLaunchManifestHeader) + manifest->containerCount * sizeof(LCLaunchManifestContainerRecord) +
+        manifest->symbolCount * sizeof(LCLaunchManifestSymbolRecord);
+    size_t size = offset;
+    for (int i = 0; i < LCLaunchManifestFieldCount; i++) {
+        size += manifest->fieldLengths[i];
+    }
+    for (size_t i = 0; i < manifest->containerCount; i++) {
+        const LCLaunchManifestContainer *container = &manifest->containers[i];
+        size += strlen(container->folderName) + 1 + (container->homePath ? strlen(container->homePath) : 0) + 1 + container->bookmarkLength;
+    }
+    for (size_t i = 0; i < manifest->symbolCount; i++) {
+        size += strlen(manifest->symbols[i].name) + 1;
+    }
+    if (size > LCLM_MAX_SIZE) {
+        return false;
+    }
+    uint8_t *buffer = calloc(1, size);
+    if (!buffer) {
+        return false;
+    }
+
+    LCLaunchManifestHeader *header = (LCLaunchManifestHeader *)buffer;
+    LCLaunchManifestContainerRecord *records = (LCLaunchManifestContainerRecord *)(header + 1);
+    LCLaunchManifestSymbolRecord *symbolRecords = (LCLaunchManifestSymbolRecord *)(records + manifest->containerCount);
+    header->magic = LCLM_MAGIC;
+    header->version = LCLM_VERSION;
+    header->infoPlist = manifest->infoPlist;
+    header->appInfo = manifest->appInfo;
+    header->flags = manifest->flags;
+    header->spoofSDKVersion = manifest->spoofSDKVersion;
+    header->orientationLock = manifest->orientationLock;
+    header->containerCount = (uint32_t)manifest->containerCount;
+    header->symbolCount = (uint32_t)manifest->symbolCount;
+    for (int i = 0; i < LCLaunchManifestFieldCount; i++) {
+        header->fieldOffsets[i] = (uint32_t)offset;
+        header->fieldLengths[i] = manifest->fieldLengths[i];
+        if (manifest->fieldLengths[i]) {
+            memcpy(buffer + offset, manifest->fields[i], manifest->fieldLengths[i]);
+        }
+        offset += manifest->fieldLengths[i];
+    }
+    // strings are copied with their NUL, the buffer is zeroed so an empty one is just the terminator
+    for (size_t i = 0; i < manifest->containerCount; i++) {
+        const LCLaunchManifestContainer *container = &manifest->containers[i];
+        size_t nameLength = strlen(container->folderName);
+        records[i].nameOffset = (uint32_t)offset;
+        records[i].nameLength = (uint32_t)nameLength;
+        memcpy(buffer + offset, container->folderName, nameLength);
+        offset += nameLength + 1;
+        size_t homeLength = container->homePath ? strlen(container->homePath) : 0;
+        records[i].homeOffset = (uint32_t)offset;
+        records[i].homeLength = (uint32_t)homeLength;
+        if (homeLength) {
+            memcpy(buffer + offset, container->homePath, homeLength);
+        }
+        offset += homeLength + 1;
+        records[i].bookmarkOffset = (uint32_t)offset;
+        records[i].bookmarkLength = container->bookmarkLength;
+        if (container->bookmarkLength) {
+            memcpy(buffer + offset, container->bookmark, container->bookmarkLength);
+        }
+        offset += container->bookmarkLength;
+    }
+    for (size_t i = 0; i < manifest->symbolCount; i++) {
+        const LCLaunchManifestSymbol *symbol = &manifest->symbols[i];
+        size_t nameLength = strlen(symbol->name);
+        memcpy(symbolRecords[i].uuid, symbol->uuid, sizeof(symbolRecords[i].uuid));
+        symbolRecords[i].offset = symbol->offset;
+        symbolRecords[i].nameOffset = (uint32_t)offset;
+        symbolRecords[i].nameLength = (uint32_t)nameLength;
+        memcpy(buffer + offset, symbol->name, nameLength);
+        offset += nameLength + 1;
+    }
+
+    char tmpPath[PATH_MAX];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, getpid()) >= (int)sizeof(tmpPath)) {
+        free(buffer);
+        return false;
+    }
+    bool success = false;
+    FILE *file = fopen(tmpPath, "wb");
+    if (file) {
+        success = fwrite(buffer, size, 1, file) == 1;
+        success = fclose(file) == 0 && success;
+        success = success && rename(tmpPath, path) == 0;
+        if (!success) {
+            unlink(tmpPath);
+        }
+    }
+    free(buffer);
+    return success;
+}
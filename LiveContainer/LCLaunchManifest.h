@@ -0,0 +1,80 @@
+#pragma once
+// Everything the bootstrap resolves from an app's plists before jumping to its main, precomputed into one file in the
+// bundle. It is mapped read-only and trusted while the inode, mtime and size of Info.plist and LCAppInfo.plist match the
+// stamps it was written with, anything else falls back to reading the plists and writing a new manifest. The LCAppInfo
+// keys the guest hooks read are kept as flat values, so a launch from a current manifest parses no plist at all.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LC_LAUNCH_MANIFEST_NAME ".LCLaunchManifest"
+
+enum {
+    LCLaunchFlagUseLCBundleId = 1 << 0,
+    LCLaunchFlagSymlinkInbox = 1 << 1,
+    LCLaunchFlagHideLiveContainer = 1 << 2,
+    LCLaunchFlagDontInjectTweakLoader = 1 << 3,
+    LCLaunchFlagDontLoadTweakLoader = 1 << 4,
+    LCLaunchFlagIs32Bit = 1 << 5,
+    LCLaunchFlagFixLocalNotification = 1 << 6,
+    LCLaunchFlagFixFilePickerNew = 1 << 7,
+};
+
+typedef enum {
+    LCLaunchManifestFieldExecutable,
+    LCLaunchManifestFieldBundleIdentifier, // CFBundleIdentifier in Info.plist when it was stamped
+    LCLaunchManifestFieldOriginalBundleIdentifier,
+    LCLaunchManifestFieldDefaultContainer,
+    LCLaunchManifestFieldTweakFolder,
+    LCLaunchManifestFieldSelectedLanguage,
+    LCLaunchManifestFieldCount
+} LCLaunchManifestField;
+
+// a file that doesn't exist has an all zero stamp
+typedef struct {
+    uint64_t inode;
+    int64_t mtime; // nanoseconds
+    uint64_t size;
+} LCLaunchManifestStamp;
+
+typedef struct {
+    const char *folderName;
+    const char *homePath; // relative to the folder holding Applications and Data, empty for a bookmarked container
+    const void *bookmark; // security scoped bookmark of a container kept outside LiveContainer
+    uint32_t bookmarkLength;
+} LCLaunchManifestContainer;
+
+// a symbol the last launch of this app resolved, only valid for the image with this UUID
+typedef struct {
+    const char *name;
+    uint8_t uuid[16];
+    uint64_t offset;
+} LCLaunchManifestSymbol;
+
+typedef struct {
+    LCLaunchManifestStamp infoPlist;
+    LCLaunchManifestStamp appInfo;
+    uint32_t flags;
+    uint32_t spoofSDKVersion;
+    int32_t orientationLock;
+    const void *fields[LCLaunchManifestFieldCount];
+    uint32_t fieldLengths[LCLaunchManifestFieldCount];
+    const LCLaunchManifestContainer *containers;
+    size_t containerCount;
+    const LCLaunchManifestSymbol *symbols;
+    size_t symbolCount;
+    // set by LCLaunchManifestOpen, everything above points into the mapping until LCLaunchManifestClose
+    void *map;
+    size_t mapSize;
+} LCLaunchManifest;
+
+// Maps the manifest at path, false if it is missing or doesn't fit its own layout
+bool LCLaunchManifestOpen(LCLaunchManifest *manifest, const char *path);
+void LCLaunchManifestClose(LCLaunchManifest *manifest);
+void LCLaunchManifestStampFile(const char *path, LCLaunchManifestStamp *stamp);
+// Two stats, true while neither plist of the bundle was replaced since the manifest was stamped
+bool LCLaunchManifestIsCurrent(const LCLaunchManifest *manifest, const char *bundlePath);
+const LCLaunchManifestContainer *LCLaunchManifestFindContainer(const LCLaunchManifest *manifest, const char *folderName);
+bool LCLaunchManifestFindSymbol(const LCLaunchManifest *manifest, const char *name, const uint8_t uuid[16], uint64_t *offsetOut);
+// Writes manifest to a temporary file and renames it over path, returns false if it could not be written
+bool LCLaunchManifestWrite(const LCLaunchManifest *manifest, const char *path);
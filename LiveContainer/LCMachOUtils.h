@@ -1,14 +1,19 @@
 @import Foundation;
 @import MachO;
+#include "../ZSign/common/macho_view.h"
+#include "../ZSign/common/dirty_ranges.h"
 
 typedef void (^LCParseMachOCallback)(const char *path, struct mach_header_64 *header, int fd, void* filePtr);
 
 #define PATCH_EXEC_RESULT_NO_SPACE_FOR_TWEAKLOADER 1
+#define PATCH_EXEC_RESULT_MALFORMED 2
 
 void LCPatchAppBundleFixupARM64eSlice(NSURL *bundleURL);
+void LCPatchMappedFixupARM64eSlice(void *filePtr);
 NSString *LCParseMachO(const char *path, bool readOnly, NS_NOESCAPE LCParseMachOCallback callback);
 void LCPatchAddRPath(const char *path, struct mach_header_64 *header);
 int LCPatchExecSlice(const char *path, struct mach_header_64 *header, bool doInject);
+int LCPatchExecSliceWithView(const char *path, macho_view *view, bool doInject);
 void LCChangeMachOUUID(struct mach_header_64 *header);
 const uint8_t* LCGetMachOUUID(struct mach_header_64 *header);
 bool LCIsMachOEncrypted(struct mach_header_64 *header);
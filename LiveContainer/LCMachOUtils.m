@@ -4,12 +4,71 @@
 #import "../litehook/src/litehook.h"
 #import "LCUtils.h"
 #include "dyld_cache_format.h"
+#include "LCBundlePatch.h"
+#include "LCSymbolIndex.h"
 
 static uint32_t rnd32(uint32_t v, uint32_t r) {
     r--;
     return (v + r) & ~r;
 }
 
+// Copies of the regions LCParseMachO callbacks edit in place: the fat header and every slice's header and load
+// commands, plus a page for the ones they insert. Comparing them afterwards tells which pages to flush, the state belongs
+// to one LCParseMachO call so nested or concurrent parses of other files can't mix their ranges into it.
+typedef struct {
+    uint32_t count;
+    uint64_t offsets[8];
+    uint64_t lengths[8];
+    void *copies[8];
+} LCHeaderSnapshots;
+
+static void snapshotRegion(LCHeaderSnapshots *snapshots, void *map, size_t size, uint64_t offset, uint64_t length) {
+    if(snapshots->count >= sizeof(snapshots->offsets) / sizeof(snapshots->offsets[0]) || offset >= size) {
+        return;
+    }
+    length = MIN(length, size - offset);
+    void *copy = malloc(length);
+    if(!copy) {
+        return;
+    }
+    memcpy(copy, map + offset, length);
+    snapshots->offsets[snapshots->count] = offset;
+    snapshots->lengths[snapshots->count] = length;
+    snapshots->copies[snapshots->count++] = copy;
+}
+
+static void snapshotSlice(LCHeaderSnapshots *snapshots, void *map, size_t size, uint64_t offset) {
+    if(offset + sizeof(struct mach_header_64) > size) {
+        return;
+    }
+    // the commands callbacks insert are all far smaller than a page
+    struct mach_header_64 *header = map + offset;
+    if(header->magic == MH_MAGIC_64 || header->magic == MH_MAGIC) {
+        snapshotRegion(snapshots, map, size, offset, sizeof(struct mach_header_64) + (uint64_t)header->sizeofcmds + PAGE_SIZE);
+    }
+}
+
+static void diffSnapshots(LCHeaderSnapshots *snapshots, void *map, dirty_ranges *ranges) {
+    for(uint32_t i = 0; i < snapshots->count; i++) {
+        for(uint64_t page = 0; page < snapshots->lengths[i]; page += PAGE_SIZE) {
+            uint64_t length = MIN((uint64_t)PAGE_SIZE, snapshots->lengths[i] - page);
+            if(memcmp(snapshots->copies[i] + page, map + snapshots->offsets[i] + page, length)) {
+                dirty_ranges_add(ranges, snapshots->offsets[i] + page, length);
+            }
+        }
+        free(snapshots->copies[i]);
+    }
+    snapshots->count = 0;
+}
+
+static void flushDirtyRanges(void *map, size_t size, dirty_ranges *ranges) {
+    for(uint32_t i = 0; i < ranges->count; i++) {
+        uint64_t begin = ranges->begin[i] & ~(uint64_t)PAGE_MASK;
+        uint64_t end = MIN(ranges->end[i], size);
+        msync(map + begin, end - begin, MS_SYNC);
+    }
+}
+
 struct dyld_all_image_infos *_alt_dyld_get_all_image_infos(void) {
     static struct dyld_all_image_infos *result;
     if (result) {
@@ -86,6 +145,15 @@ void LCPatchAddRPath(const char *path, struct mach_header_64 *header) {
 }
 
 int LCPatchExecSlice(const char *path, struct mach_header_64 *header, bool doInject) {
+    macho_view view;
+    if (!macho_view_init(&view, header, 0)) {
+        return PATCH_EXEC_RESULT_MALFORMED;
+    }
+    return LCPatchExecSliceWithView(path, &view, doInject);
+}
+
+int LCPatchExecSliceWithView(const char *path, macho_view *view, bool doInject) {
+    struct mach_header_64 *header = (struct mach_header_64 *)view->base;
     uint8_t *imageHeaderPtr = (uint8_t*)header + sizeof(struct mach_header_64);
     int ans = 0;
     // Literally convert an executable to a dylib
@@ -104,103 +172,84 @@ int LCPatchExecSlice(const char *path, struct mach_header_64 *header, bool doInj
         seg->vmsize = 0x4000;
     }
 
-    BOOL hasDylibCommand = NO;
     struct dylib_command * dylibLoaderCommand = 0;
     const char *tweakLoaderPath = "@loader_path/../../Tweaks/TweakLoader.dylib";
     const char *libCppPath = "/usr/lib/libc++.1.dylib";
-    int textSectionOffest = 0;
-    struct load_command *command = (struct load_command *)imageHeaderPtr;
-    struct dylinker_command* dylinkerCommand = 0;
-    bool codeSignatureCommandFound = false;
-    for(int i = 0; i < header->ncmds; i++) {
-        if(command->cmd == LC_ID_DYLIB) {
-            hasDylibCommand = YES;
-        } else if(command->cmd == LC_LOAD_DYLIB) {
-            struct dylib_command *dylib = (struct dylib_command *)command;
+    uint32_t cursor = 0;
+    for(uint32_t offset; (offset = macho_view_next_dylib(view, &cursor));) {
+        struct dylib_command *dylib = macho_view_ptr(view, offset);
+        if(dylib->cmd == MACHO_VIEW_CMD_DISABLED_DYLIB) {
+            dylibLoaderCommand = dylib;
+        } else if(dylib->cmd == LC_LOAD_DYLIB) {
             char *dylibName = (void *)dylib + dylib->dylib.name.offset;
             if (!strncmp(dylibName, tweakLoaderPath, strlen(tweakLoaderPath))) {
                 dylibLoaderCommand = dylib;
             }
-        } else if(command->cmd == 0x114514) {
-            dylibLoaderCommand = (struct dylib_command *)command;
-        } else if(command->cmd == LC_SEGMENT_64) {
-            struct segment_command_64* seglc = (struct segment_command_64*)command;
-            if (strcmp("__TEXT", seglc->segname) == 0) {
-                for (uint32_t j = 0; j < seglc->nsects; j++) {
-                    struct section_64* sect = (struct section_64*)(((void*)command + sizeof(struct segment_command_64) + sizeof(struct section_64) * j));
-                    if (0 == strcmp("__text", sect->sectname)) {
-                        textSectionOffest = sect->offset;
-                    }
-                }
-            }
-        } else if (command->cmd == LC_CODE_SIGNATURE) {
-            codeSignatureCommandFound = true;
-        } else if (command->cmd == LC_LOAD_DYLINKER) {
-            dylinkerCommand = (struct dylinker_command*)command;
         }
-        
-        command = (struct load_command *)((void *)command + command->cmdsize);
     }
-    long freeLoadCommandCountLeft = (void*)header + textSectionOffest - (void*)command;
+    long freeLoadCommandCountLeft = view->textsection.offset - (long)view->cmdsend;
     int tweakLoaderLoadDylibCmdSize = 0x48;
     
     // Insert command priority: LC_CODE_SIGNATURE > LC_ID_DYLIB > LC_LOAD_DYLIB
-    if(!codeSignatureCommandFound) {
+    if(!view->codesignature) {
         freeLoadCommandCountLeft -= 0x10;
     }
-    
-    int idDylibCommandSize = sizeof(struct dylib_command) + rnd32((uint32_t)strlen(basename((char*)path)) + 1, 8);
-    if(!hasDylibCommand) {
-        if (freeLoadCommandCountLeft >= idDylibCommandSize) {
-            freeLoadCommandCountLeft -= idDylibCommandSize;
-            insertDylibCommand(LC_ID_DYLIB, path, header);
-        } else if (dylinkerCommand) {
-            // #1042 fix: if there's not enough space for LC_ID_DYLIB we resue LC_LOAD_DYLINKER's space for LC_ID_DYLIB
-            replaceDylinkerWithIDDylibCommand(dylinkerCommand, path);
-        }
-    }
 
     if (dylibLoaderCommand) {
-        dylibLoaderCommand->cmd = doInject ? LC_LOAD_DYLIB : 0x114514;
+        dylibLoaderCommand->cmd = doInject ? LC_LOAD_DYLIB : MACHO_VIEW_CMD_DISABLED_DYLIB;
         strcpy((void *)dylibLoaderCommand + dylibLoaderCommand->dylib.name.offset, doInject ? tweakLoaderPath : libCppPath);
-    } else  {
-        if (freeLoadCommandCountLeft >= tweakLoaderLoadDylibCmdSize) {
-            freeLoadCommandCountLeft -= tweakLoaderLoadDylibCmdSize;
-            insertDylibCommand(doInject ? LC_LOAD_DYLIB : 0x114514, doInject ? tweakLoaderPath : libCppPath, header);
-        } else {
-            // Not enough free space of injection tweak loader!
-            ans |= PATCH_EXEC_RESULT_NO_SPACE_FOR_TWEAKLOADER;
-        }
     }
     
     // Ensure No duplicated dylibs, often caused by incorrect tweak injection
     // https://github.com/LiveContainer/LiveContainer/issues/582
     // https://github.com/apple-oss-distributions/dyld/blob/93bd81f9d7fcf004fcebcb66ec78983882b41e71/mach_o/Header.cpp#L678
-    struct load_command *command2 = (struct load_command *)imageHeaderPtr;
-    __block int   depCount = 0;
-    const char**  depPaths = malloc(header->ncmds * sizeof(char*));
-    for(int i = 0; i < header->ncmds; i++) {
-        switch ( command2->cmd ) {
+    // This runs before inserting new commands so the offsets in the view are still valid, inserted commands never duplicate an existing one.
+    int depCount = 0;
+    const char**  depPaths = malloc(view->ncmds * sizeof(char*));
+    cursor = 0;
+    for(uint32_t offset; (offset = macho_view_next_dylib(view, &cursor));) {
+        struct dylib_command *dylib = macho_view_ptr(view, offset);
+        switch ( dylib->cmd ) {
             case LC_LOAD_DYLIB:
             case LC_LOAD_WEAK_DYLIB:
             case LC_REEXPORT_DYLIB:
             case LC_LOAD_UPWARD_DYLIB: {
-                char* loadPath =  (void *)command2 + ((struct dylib_command*)command2)->dylib.name.offset;
-                for ( int i = 0; i < depCount; ++i ) {
-                    if ( strcmp(loadPath, depPaths[i]) == 0 ) {
+                char* loadPath =  (void *)dylib + dylib->dylib.name.offset;
+                for ( int j = 0; j < depCount; ++j ) {
+                    if ( strcmp(loadPath, depPaths[j]) == 0 ) {
                         // replace this duplicated dylib command with an invalid command number
-                        command2->cmd = 0x114515;
-                        continue;
+                        dylib->cmd = MACHO_VIEW_CMD_DUPLICATED_DYLIB;
+                        break;
                     }
                 }
                 depPaths[depCount] = loadPath;
                 ++depCount;
             }
         }
-        command2 = (struct load_command *)((void *)command2 + command2->cmdsize);
     }
     free(depPaths);
     
+    int idDylibCommandSize = sizeof(struct dylib_command) + rnd32((uint32_t)strlen(basename((char*)path)) + 1, 8);
+    if(!view->iddylib) {
+        if (freeLoadCommandCountLeft >= idDylibCommandSize) {
+            freeLoadCommandCountLeft -= idDylibCommandSize;
+            insertDylibCommand(LC_ID_DYLIB, path, header);
+        } else if (view->dylinker) {
+            // #1042 fix: if there's not enough space for LC_ID_DYLIB we resue LC_LOAD_DYLINKER's space for LC_ID_DYLIB
+            replaceDylinkerWithIDDylibCommand(macho_view_ptr(view, view->dylinker), path);
+        }
+    }
+
+    if (!dylibLoaderCommand) {
+        if (freeLoadCommandCountLeft >= tweakLoaderLoadDylibCmdSize) {
+            freeLoadCommandCountLeft -= tweakLoaderLoadDylibCmdSize;
+            insertDylibCommand(doInject ? LC_LOAD_DYLIB : MACHO_VIEW_CMD_DISABLED_DYLIB, doInject ? tweakLoaderPath : libCppPath, header);
+        } else {
+            // Not enough free space of injection tweak loader!
+            ans |= PATCH_EXEC_RESULT_NO_SPACE_FOR_TWEAKLOADER;
+        }
+    }
+    
     return ans;
 }
 
@@ -213,7 +262,19 @@ NSString *LCParseMachO(const char *path, bool readOnly, LCParseMachOCallback cal
         return [NSString stringWithFormat:@"Failed to map %s: %s", path, strerror(errno)];
     }
 
+    LCHeaderSnapshots snapshots = {0};
     uint32_t magic = *(uint32_t *)map;
+    if (!readOnly && magic == FAT_CIGAM) {
+        struct fat_header *header = (struct fat_header *)map;
+        snapshotRegion(&snapshots, map, s.st_size, 0, sizeof(struct fat_header) + OSSwapInt32(header->nfat_arch) * sizeof(struct fat_arch));
+        struct fat_arch *arch = (struct fat_arch *)(map + sizeof(struct fat_header));
+        for (int i = 0; i < OSSwapInt32(header->nfat_arch); i++) {
+            snapshotSlice(&snapshots, map, s.st_size, OSSwapInt32(arch[i].offset));
+        }
+    } else if (!readOnly) {
+        snapshotSlice(&snapshots, map, s.st_size, 0);
+    }
+
     if (magic == FAT_CIGAM) {
         // Find compatible slice
         struct fat_header *header = (struct fat_header *)map;
@@ -227,95 +288,74 @@ NSString *LCParseMachO(const char *path, bool readOnly, LCParseMachOCallback cal
     } else if (magic == MH_MAGIC_64 || magic == MH_MAGIC) {
         callback(path, (struct mach_header_64 *)map, fd, map);
     } else {
+        munmap(map, s.st_size);
+        close(fd);
         return @"Not a Mach-O file";
     }
 
-    msync(map, s.st_size, MS_SYNC);
+    if (!readOnly) {
+        // anything written outside the snapshots still reaches the file through the shared mapping, it just isn't
+        // forced out here
+        dirty_ranges ranges;
+        dirty_ranges_reset(&ranges);
+        diffSnapshots(&snapshots, map, &ranges);
+        flushDirtyRanges(map, s.st_size, &ranges);
+    }
     munmap(map, s.st_size);
     close(fd);
     return nil;
 }
 
-NSString *LCPatchMachOFixupARM64eSlice(const char *path) {
-    int fd = open(path, O_RDWR, 0600);
-    if(fd < 0) {
-        return [NSString stringWithFormat:@"Failed to open %s: %s", path, strerror(errno)];
+void LCPatchMappedFixupARM64eSlice(void *filePtr) {
+    uint32_t magic = *(uint32_t *)filePtr;
+    if(magic != FAT_CIGAM) {
+        return;
     }
-    struct stat s = {0};
-    fstat(fd, &s);
-    void *map = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(map == MAP_FAILED) {
-        close(fd);
-        return [NSString stringWithFormat:@"Failed to map %s: %s", path, strerror(errno)];
-    }
-
-    uint32_t magic = *(uint32_t *)map;
-    if(magic == FAT_CIGAM) {
-        // Find arm64e slice without CPU_SUBTYPE_LIB64
-        struct fat_header *header = (struct fat_header *)map;
-        struct fat_arch *arch = (struct fat_arch *)(map + sizeof(struct fat_header));
-        for(int i = 0; i < OSSwapInt32(header->nfat_arch); i++) {
-            if(OSSwapInt32(arch->cputype) == CPU_TYPE_ARM64 && OSSwapInt32(arch->cpusubtype) == CPU_SUBTYPE_ARM64E) {
-                struct mach_header_64 *header = (struct mach_header_64 *)(map + OSSwapInt32(arch->offset));
-                header->cpusubtype |= CPU_SUBTYPE_LIB64;
-                arch->cpusubtype = htonl(header->cpusubtype);
-                break;
-            }
-            arch = (struct fat_arch *)((void *)arch + sizeof(struct fat_arch));
+    // Find arm64e slice without CPU_SUBTYPE_LIB64
+    struct fat_header *header = (struct fat_header *)filePtr;
+    struct fat_arch *arch = (struct fat_arch *)(filePtr + sizeof(struct fat_header));
+    for(int i = 0; i < OSSwapInt32(header->nfat_arch); i++) {
+        if(OSSwapInt32(arch->cputype) == CPU_TYPE_ARM64 && OSSwapInt32(arch->cpusubtype) == CPU_SUBTYPE_ARM64E) {
+            struct mach_header_64 *header = (struct mach_header_64 *)(filePtr + OSSwapInt32(arch->offset));
+            header->cpusubtype |= CPU_SUBTYPE_LIB64;
+            arch->cpusubtype = htonl(header->cpusubtype);
+            break;
         }
+        arch = (struct fat_arch *)((void *)arch + sizeof(struct fat_arch));
     }
+}
 
-    msync(map, s.st_size, MS_SYNC);
-    munmap(map, s.st_size);
-    close(fd);
-    return nil;
+static bool LCResolveFrameworkExecutable(const char *frameworkPath, char *nameOut, size_t nameSize, void *context) {
+    NSString *infoPath = [@(frameworkPath) stringByAppendingPathComponent:@"Info.plist"];
+    NSString *executableName = [NSDictionary dictionaryWithContentsOfFile:infoPath][@"CFBundleExecutable"];
+    return executableName && [executableName getFileSystemRepresentation:nameOut maxLength:nameSize];
 }
 
 void LCPatchAppBundleFixupARM64eSlice(NSURL *bundleURL) {
-    NSFileManager *fm = [NSFileManager defaultManager];
-    NSDirectoryEnumerator *enumerator = [fm enumeratorAtURL:bundleURL includingPropertiesForKeys:nil options:NSDirectoryEnumerationSkipsHiddenFiles errorHandler:nil];
-    for (NSURL *fileURL in enumerator) {
-        if ([fileURL.pathExtension isEqualToString:@"dylib"]) {
-            LCPatchMachOFixupARM64eSlice(fileURL.path.fileSystemRepresentation);
-        } else if ([fileURL.pathExtension isEqualToString:@"framework"]) {
-            NSDictionary *info = [NSDictionary dictionaryWithContentsOfURL:[fileURL URLByAppendingPathComponent:@"Info.plist"]];
-            NSString *executableName = info[@"CFBundleExecutable"];
-            if(!executableName) {
-                executableName = fileURL.lastPathComponent.stringByDeletingPathExtension;
-            }
-            NSURL *executableURL = [fileURL URLByAppendingPathComponent:executableName];
-            LCPatchMachOFixupARM64eSlice(executableURL.path.fileSystemRepresentation);
-        }
+    char **paths;
+    size_t count = LCBundleCollectMachOs(bundleURL.path.fileSystemRepresentation, &paths, LCResolveFrameworkExecutable, NULL);
+    LCBundlePatchStats stats = {0};
+    LCBundleFixupARM64eSlices(paths, count, 0, &stats);
+    if(stats.failed) {
+        NSLog(@"[LC] arm64e fixup failed for %zu of %zu binaries", stats.failed, stats.scanned);
     }
+    LCBundleFreePaths(paths, count);
 }
 
 void LCChangeMachOUUID(struct mach_header_64 *header) {
-    struct load_command *command = (struct load_command *)(header + 1);
-    for(int i = 0; i < header->ncmds; i++) {
-        if(command->cmd == LC_UUID) {
-            struct uuid_command *uuidCmd = (struct uuid_command *)command;
-            // let's add the first byte by 1
-            uuidCmd->uuid[0] += 1;
-            break;
-        }
-        command = (struct load_command *)((void *)command + command->cmdsize);
+    struct uuid_command *uuidCommand = macho_view_find_command(header, LC_UUID);
+    if(uuidCommand) {
+        uint8_t *uuid = uuidCommand->uuid;
+        // let's add the first byte by 1
+        uuid[0] += 1;
     }
 }
 
 const uint8_t* LCGetMachOUUID(struct mach_header_64 *header) {
     if (!header) return NULL;
     if(*(uint32_t*)header != 0x646c7964) { // dyld
-        // Find load commands
-        const struct load_command* command = (const struct load_command*)(header + 1);
-        
-        // Iterate through load commands to find LC_SYMTAB
-        for(uint32_t i = 0; i < header->ncmds; i++) {
-            if(command->cmd == LC_UUID) {
-                return ((const struct uuid_command*)command)->uuid;
-            }
-            command = (const struct load_command*)((void *)command + command->cmdsize);
-        }
-        return NULL;
+        struct uuid_command *uuidCommand = macho_view_find_command(header, LC_UUID);
+        return uuidCommand ? uuidCommand->uuid : NULL;
     } else {
         struct dyld_cache_header* dsc_header = (struct dyld_cache_header*)header;
         return dsc_header->uuid;
@@ -323,14 +363,20 @@ const uint8_t* LCGetMachOUUID(struct mach_header_64 *header) {
 }
 
 bool LCIsMachOEncrypted(struct mach_header_64 *header) {
-    struct load_command *command = (struct load_command *)(header + 1);
-    for(int i = 0; i < header->ncmds; i++) {
-        if(command->cmd == LC_ENCRYPTION_INFO || command->cmd == LC_ENCRYPTION_INFO_64) {
-            return ((struct encryption_info_command *)command)->cryptid != 0;
-        }
-        command = (struct load_command *)((void *)command + command->cmdsize);
+    struct encryption_info_command *encryption = macho_view_find_command(header, (header->magic == MH_MAGIC_64 || header->magic == MH_CIGAM_64) ? LC_ENCRYPTION_INFO_64 : LC_ENCRYPTION_INFO);
+    return encryption && encryption->cryptid != 0;
+}
+
+static NSString *LCSymbolIndexPath(const uint8_t *uuid) {
+    NSString *indexDir;
+    if(NSUserDefaults.lcAppGroupPath) {
+        indexDir = [NSUserDefaults.lcAppGroupPath stringByAppendingPathComponent:@"LiveContainer/SymbolIndex"];
+    } else {
+        indexDir = [NSTemporaryDirectory() stringByAppendingPathComponent:@"SymbolIndex"];
     }
-    return NO;
+    [NSFileManager.defaultManager createDirectoryAtPath:indexDir withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString *uuidString = [[NSUUID alloc] initWithUUIDBytes:uuid].UUIDString;
+    return [indexDir stringByAppendingPathComponent:[uuidString stringByAppendingPathExtension:@"lcsi"]];
 }
 
 uint64_t LCFindSymbolOffset(const char *basePath, const char *symbol) {
@@ -344,10 +390,29 @@ uint64_t LCFindSymbolOffset(const char *basePath, const char *symbol) {
     __block uint64_t offset = 0;
     LCParseMachO(path, true, ^(const char *path, struct mach_header_64 *header, int fd, void *filePtr) {
         if(header->cputype != CPU_TYPE_ARM64) return;
-        void *result = litehook_find_symbol_file(header, symbol);
-        offset = (uint64_t)result - (uint64_t)header;
+        // the image is only parsed once per UUID, later lookups hit the index stored on disk
+        const uint8_t *uuid = LCGetMachOUUID(header);
+        NSString *indexPath = uuid ? LCSymbolIndexPath(uuid) : nil;
+        LCSymbolIndex *index = indexPath ? LCSymbolIndexOpen(indexPath.fileSystemRepresentation, uuid) : NULL;
+        if(!index) {
+            index = LCSymbolIndexCreate(header, 0);
+            if(index && indexPath) {
+                LCSymbolIndexWrite(index, indexPath.fileSystemRepresentation);
+            }
+        }
+        if(index) {
+            offset = LCSymbolIndexLookup(index, symbol);
+            LCSymbolIndexClose(index);
+        }
+        // fall back to litehook if the index could not resolve it
+        if(!offset) {
+            void *result = litehook_find_symbol_file(header, symbol);
+            if(result) {
+                offset = (uint64_t)result - (uint64_t)header;
+            }
+        }
     });
-    NSCAssert(offset != 0, @"Failed to find symbol %s in %s", symbol, path);
+    NSCAssert(offset != 0, @"Failed to find symbol %s in %s", symbol, basePath);
     return offset;
 }
 
@@ -420,17 +485,7 @@ struct ui_CS_blob {
 
 
 struct code_signature_command* findSignatureCommand(struct mach_header_64* header) {
-    uint8_t *imageHeaderPtr = (uint8_t*)header + sizeof(struct mach_header_64);
-    struct load_command *command = (struct load_command *)imageHeaderPtr;
-    struct code_signature_command* codeSignCommand = 0;
-    for(int i = 0; i < header->ncmds; i++) {
-        if(command->cmd == LC_CODE_SIGNATURE) {
-            codeSignCommand = (struct code_signature_command*)command;
-            break;
-        }
-        command = (struct load_command *)((void *)command + command->cmdsize);
-    }
-    return codeSignCommand;
+    return macho_view_find_command(header, LC_CODE_SIGNATURE);
 }
 
 NSString* getEntitlementXML(struct mach_header_64* header, void** entitlementXMLPtrOut) {
@@ -1,4 +1,5 @@
 @import Foundation;
+#include "LCLaunchManifest.h"
 
 @interface LCSharedUtils : NSObject
 + (NSString*) teamIdentifier;
@@ -16,4 +17,8 @@
 + (void)dumpPreferenceToPath:(NSString*)plistLocationTo dataUUID:(NSString*)dataUUID;
 + (NSString*)findDefaultContainerWithBundleId:(NSString*)bundleId;
 + (NSArray<NSString*>*)lcUrlSchemes;
+// Fills all but the stamps of manifest, the returned objects back its pointers. nil if appInfo can't be serialized.
++ (NSArray*)fillLaunchManifest:(LCLaunchManifest*)manifest appInfo:(NSDictionary*)appInfo bundleIdentifier:(NSString*)bundleIdentifier executable:(NSString*)executable;
+// Stamps the bundle's plists as they are now, call it right after writing them
++ (void)writeLaunchManifestForBundlePath:(NSString*)bundlePath appInfo:(NSDictionary*)appInfo bundleIdentifier:(NSString*)bundleIdentifier executable:(NSString*)executable;
 @end
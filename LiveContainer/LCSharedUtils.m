@@ -2,6 +2,7 @@
 #import "FoundationPrivate.h"
 #import "UIKitPrivate.h"
 #import "utils.h"
+#import "LCContainerLock.h"
 @import MachO;
 
 extern NSUserDefaults *lcUserDefaults;
@@ -197,66 +198,63 @@ extern NSBundle *lcMainBundle;
     [lcUserDefaults setObject:urlString forKey:@"webPageToOpen"];
 }
 
-+ (NSURL*)containerLockPath {
+static bool isContainerLockOwnerAlive(uint64_t val57, void *context) {
+    audit_token_t token;
+    token.val[5] = val57 >> 32;
+    token.val[7] = val57 & 0xffffffff;
+    
+    errno = 0;
+    csops_audittoken(token.val[5], 0, NULL, 0, &token);
+    return errno != ESRCH;
+}
+
+// NULL if the app group can't be mapped, callers then act as if no container is in use
++ (LCContainerLockTable*)containerLockTable {
     static dispatch_once_t once;
-    static NSURL *infoPath;
+    static LCContainerLockTable table;
+    static LCContainerLockTable *tablePtr;
     
     dispatch_once(&once, ^{
-        infoPath = [[LCSharedUtils appGroupPath] URLByAppendingPathComponent:@"LiveContainer/containerLock.plist"];
+        NSURL* lockFolder = [[LCSharedUtils appGroupPath] URLByAppendingPathComponent:@"LiveContainer"];
+        if(!lockFolder) {
+            return;
+        }
+        if(LCContainerLockOpen(&table, [lockFolder URLByAppendingPathComponent:@"containerLock.table"].fileSystemRepresentation)) {
+            tablePtr = &table;
+            // replaced by the table, its tokens are of processes started before it
+            [NSFileManager.defaultManager removeItemAtURL:[lockFolder URLByAppendingPathComponent:@"containerLock.plist"] error:nil];
+        } else {
+            NSLog(@"[LC] failed to open container lock table: %s", strerror(errno));
+        }
     });
-    return infoPath;
+    return tablePtr;
 }
 
 + (BOOL)isLCSchemeInUse:(NSString*)lc {
-    NSURL* infoPath = [self containerLockPath];
-    NSMutableDictionary *info = [NSMutableDictionary dictionaryWithContentsOfFile:infoPath.path];
-    if (!info) {
+    LCContainerLockTable* table = [self containerLockTable];
+    uint64_t val57 = 0;
+    if (!table || !LCContainerLockGet(table, lc.UTF8String, NULL, 0, &val57)) {
         return NO;
     }
-    
-    NSNumber* num57 = info[lc];
-    if(![num57 isKindOfClass:NSNumber.class]) {
-        return NO;
-    }
-    
-    uint64_t val57 = [num57 longLongValue];
-    audit_token_t token;
-    token.val[5] = val57 >> 32;
-    token.val[7] = val57 & 0xffffffff;
-    
-    errno = 0;
-    csops_audittoken(token.val[5], 0, NULL, 0, &token);
-    return errno != ESRCH;
+    return val57 != 0 && isContainerLockOwnerAlive(val57, NULL);
 }
 
 + (NSString*)getContainerUsingLCSchemeWithFolderName:(NSString*)folderName {
-    NSURL* infoPath = [self containerLockPath];
-    NSMutableDictionary *info = [NSMutableDictionary dictionaryWithContentsOfFile:infoPath.path];
-    if (!info) {
-        return nil;
-    }
-    
-    NSDictionary* appUsageInfo = info[folderName];
-    if (!appUsageInfo) {
+    LCContainerLockTable* table = [self containerLockTable];
+    char runningLC[LC_CONTAINER_LOCK_VALUE_SIZE];
+    uint64_t val57 = 0;
+    if (!table || !folderName || !LCContainerLockGet(table, folderName.UTF8String, runningLC, sizeof(runningLC), &val57)) {
         return nil;
     }
-    uint64_t val57 = [appUsageInfo[@"auditToken57"] longLongValue];
-    audit_token_t token;
-    token.val[5] = val57 >> 32;
-    token.val[7] = val57 & 0xffffffff;
     
-    errno = 0;
-    csops_audittoken(token.val[5], 0, NULL, 0, &token);
-    return errno==ESRCH ? nil : appUsageInfo[@"runningLC"];
+    return (val57 != 0 && isContainerLockOwnerAlive(val57, NULL)) ? @(runningLC) : nil;
 }
 
 // lc can be something like livecontainer or livecontainer2.liveprocess, such that one LC can jump to another LC hosting the multitask app when user presses run while it's running
 + (void)setContainerUsingByLC:(NSString*)lc folderName:(NSString*)folderName auditToken:(uint64_t)val57 {
-    NSURL* infoPath = [self containerLockPath];
-    
-    NSMutableDictionary *info = [NSMutableDictionary dictionaryWithContentsOfFile:infoPath.path];
-    if (!info) {
-        info = [NSMutableDictionary new];
+    LCContainerLockTable* table = [self containerLockTable];
+    if (!table) {
+        return;
     }
     
     if(val57 == 0) {
@@ -269,16 +267,105 @@ extern NSBundle *lcMainBundle;
         }
         val57 = token.val[7] | ((uint64_t)token.val[5] << 32);
     }
-    info[folderName] = @{
-        @"runningLC": lc,
-        @"auditToken57": @(val57)
+    if(folderName && !LCContainerLockSet(table, folderName.UTF8String, lc.UTF8String, val57, isContainerLockOwnerAlive, NULL)) {
+        NSLog(@"[LC] failed to lock container %@: %s", folderName, strerror(errno));
+    }
+    
+    if(!NSUserDefaults.isLiveProcess && !LCContainerLockSet(table, lc.UTF8String, "", val57, isContainerLockOwnerAlive, NULL)) {
+        NSLog(@"[LC] failed to lock scheme %@: %s", lc, strerror(errno));
+    }
+}
+
++ (NSArray*)fillLaunchManifest:(LCLaunchManifest*)manifest appInfo:(NSDictionary*)appInfo bundleIdentifier:(NSString*)bundleIdentifier executable:(NSString*)executable {
+    if(![appInfo isKindOfClass:NSDictionary.class]) {
+        return nil;
+    }
+    NSMutableArray* storage = [NSMutableArray new];
+    void (^setField)(LCLaunchManifestField, id) = ^(LCLaunchManifestField field, id value) {
+        NSData* data = [value isKindOfClass:NSString.class] ? [value dataUsingEncoding:NSUTF8StringEncoding] : nil;
+        if(!data) {
+            data = [NSData data];
+        }
+        [storage addObject:data];
+        manifest->fields[field] = data.bytes;
+        manifest->fieldLengths[field] = (uint32_t)data.length;
     };
+    setField(LCLaunchManifestFieldExecutable, executable);
+    setField(LCLaunchManifestFieldBundleIdentifier, bundleIdentifier);
+    setField(LCLaunchManifestFieldOriginalBundleIdentifier, appInfo[@"LCOrignalBundleIdentifier"]);
+    setField(LCLaunchManifestFieldDefaultContainer, appInfo[@"LCDataUUID"]);
+    setField(LCLaunchManifestFieldTweakFolder, appInfo[@"LCTweakFolder"]);
+    setField(LCLaunchManifestFieldSelectedLanguage, appInfo[@"LCSelectedLanguage"]);
     
-    if(!NSUserDefaults.isLiveProcess) {
-        info[lc] = @(val57);
+    NSDictionary<NSString*, NSNumber*>* flagKeys = @{
+        @"doUseLCBundleId": @(LCLaunchFlagUseLCBundleId),
+        @"doSymlinkInbox": @(LCLaunchFlagSymlinkInbox),
+        @"hideLiveContainer": @(LCLaunchFlagHideLiveContainer),
+        @"dontInjectTweakLoader": @(LCLaunchFlagDontInjectTweakLoader),
+        @"dontLoadTweakLoader": @(LCLaunchFlagDontLoadTweakLoader),
+        @"is32bit": @(LCLaunchFlagIs32Bit),
+        @"fixLocalNotification": @(LCLaunchFlagFixLocalNotification),
+        @"fixFilePickerNew": @(LCLaunchFlagFixFilePickerNew),
+    };
+    manifest->flags = 0;
+    for(NSString* key in flagKeys) {
+        if([appInfo[key] boolValue]) {
+            manifest->flags |= flagKeys[key].unsignedIntValue;
+        }
     }
+    manifest->spoofSDKVersion = [appInfo[@"spoofSDKVersion"] unsignedIntValue];
+    manifest->orientationLock = (int32_t)[appInfo[@"LCOrientationLock"] integerValue];
+    
+    NSMutableData* containers = [NSMutableData new];
+    NSArray* containerInfo = appInfo[@"LCContainers"];
+    if([containerInfo isKindOfClass:NSArray.class]) {
+        for(NSDictionary* container in containerInfo) {
+            if(![container isKindOfClass:NSDictionary.class] || ![container[@"folderName"] isKindOfClass:NSString.class]) {
+                continue;
+            }
+            NSData* bookmark = container[@"bookmarkData"];
+            NSString* folderName = container[@"folderName"];
+            NSData* name = [NSData dataWithBytes:folderName.UTF8String length:strlen(folderName.UTF8String) + 1];
+            LCLaunchManifestContainer entry = {name.bytes, "", NULL, 0};
+            [storage addObject:name];
+            if([bookmark isKindOfClass:NSData.class]) {
+                [storage addObject:bookmark];
+                entry.bookmark = bookmark.bytes;
+                entry.bookmarkLength = (uint32_t)bookmark.length;
+            } else {
+                const char* homePath = [NSString stringWithFormat:@"Data/Application/%@", folderName].UTF8String;
+                NSData* home = [NSData dataWithBytes:homePath length:strlen(homePath) + 1];
+                [storage addObject:home];
+                entry.homePath = home.bytes;
+            }
+            [containers appendBytes:&entry length:sizeof(entry)];
+        }
+    }
+    [storage addObject:containers];
+    manifest->containers = containers.bytes;
+    manifest->containerCount = containers.length / sizeof(LCLaunchManifestContainer);
+    return storage;
+}
 
-    [info writeBinToFile:infoPath.path atomically:YES];
++ (void)writeLaunchManifestForBundlePath:(NSString*)bundlePath appInfo:(NSDictionary*)appInfo bundleIdentifier:(NSString*)bundleIdentifier executable:(NSString*)executable {
+    NSString* manifestPath = [bundlePath stringByAppendingPathComponent:@LC_LAUNCH_MANIFEST_NAME];
+    LCLaunchManifest manifest = {0};
+    LCLaunchManifestStampFile([bundlePath stringByAppendingPathComponent:@"Info.plist"].fileSystemRepresentation, &manifest.infoPlist);
+    LCLaunchManifestStampFile([bundlePath stringByAppendingPathComponent:@"LCAppInfo.plist"].fileSystemRepresentation, &manifest.appInfo);
+    NSArray* storage = [self fillLaunchManifest:&manifest appInfo:appInfo bundleIdentifier:bundleIdentifier executable:executable];
+    // the symbols only the bootstrap can resolve don't depend on the plists, keep what the last launch recorded
+    LCLaunchManifest previous;
+    bool hasPrevious = LCLaunchManifestOpen(&previous, manifestPath.fileSystemRepresentation);
+    if(hasPrevious) {
+        manifest.symbols = previous.symbols;
+        manifest.symbolCount = previous.symbolCount;
+    }
+    if(storage && !LCLaunchManifestWrite(&manifest, manifestPath.fileSystemRepresentation)) {
+        NSLog(@"[LC] failed to write launch manifest for %@", bundlePath.lastPathComponent);
+    }
+    if(hasPrevious) {
+        LCLaunchManifestClose(&previous);
+    }
 }
 
 // move app data to private folder to prevent 0xdead10cc https://forums.developer.apple.com/forums/thread/126438
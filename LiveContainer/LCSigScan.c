@@ -0,0 +1,150 @@
+#include "LCSigScan.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Patterns are bucketed by the mask of their first 4 bytes. At each offset the first byte is checked against a
+// table of bytes any pattern can start with, which rejects almost every offset, and only then is the first word
+// masked once per bucket and binary searched, so adding patterns does not add passes over the image.
+typedef struct {
+    uint32_t key;
+    uint32_t patternIndex;
+} LCSigKey;
+
+typedef struct {
+    uint32_t mask;
+    size_t count;
+    LCSigKey *keys;
+} LCSigBucket;
+
+struct LCSigScanner {
+    LCSigPattern *patterns;
+    size_t patternCount;
+    LCSigBucket *buckets;
+    size_t bucketCount;
+    bool firstBytes[256];
+};
+
+static uint32_t headWord(const uint8_t *bytes, const uint8_t *mask, size_t length, bool wantMask) {
+    uint8_t word[4] = {0};
+    for (size_t i = 0; i < 4 && i < length; i++) {
+        uint8_t m = mask ? mask[i] : 0xff;
+        word[i] = wantMask ? m : (bytes[i] & m);
+    }
+    uint32_t value;
+    memcpy(&value, word, sizeof(value));
+    return value;
+}
+
+static int compareKeys(const void *a, const void *b) {
+    const LCSigKey *x = a, *y = b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    // keep ties in pattern order so callbacks are deterministic
+    return x->patternIndex < y->patternIndex ? -1 : x->patternIndex > y->patternIndex;
+}
+
+LCSigScanner *LCSigScannerCreate(const LCSigPattern *patterns, size_t count) {
+    LCSigScanner *scanner = calloc(1, sizeof(LCSigScanner));
+    scanner->patterns = malloc(count * sizeof(LCSigPattern));
+    memcpy(scanner->patterns, patterns, count * sizeof(LCSigPattern));
+    scanner->patternCount = count;
+    scanner->buckets = calloc(count, sizeof(LCSigBucket));
+
+    for (size_t i = 0; i < count; i++) {
+        const LCSigPattern *pattern = &patterns[i];
+        uint32_t mask = headWord(pattern->bytes, pattern->mask, pattern->length, true);
+        LCSigBucket *bucket = NULL;
+        for (size_t j = 0; j < scanner->bucketCount; j++) {
+            if (scanner->buckets[j].mask == mask) {
+                bucket = &scanner->buckets[j];
+                break;
+            }
+        }
+        if (!bucket) {
+            bucket = &scanner->buckets[scanner->bucketCount++];
+            bucket->mask = mask;
+            bucket->keys = malloc(count * sizeof(LCSigKey));
+        }
+        bucket->keys[bucket->count++] = (LCSigKey){headWord(pattern->bytes, pattern->mask, pattern->length, false), (uint32_t)i};
+    }
+    for (size_t j = 0; j < scanner->bucketCount; j++) {
+        const LCSigBucket *bucket = &scanner->buckets[j];
+        qsort(bucket->keys, bucket->count, sizeof(LCSigKey), compareKeys);
+        for (size_t k = 0; k < bucket->count; k++) {
+            for (uint32_t byte = 0; byte < 256; byte++) {
+                if (((byte ^ bucket->keys[k].key) & bucket->mask & 0xff) == 0) {
+                    scanner->firstBytes[byte] = true;
+                }
+            }
+        }
+    }
+    return scanner;
+}
+
+void LCSigScannerFree(LCSigScanner *scanner) {
+    if (!scanner) {
+        return;
+    }
+    for (size_t j = 0; j < scanner->bucketCount; j++) {
+        free(scanner->buckets[j].keys);
+    }
+    free(scanner->buckets);
+    free(scanner->patterns);
+    free(scanner);
+}
+
+static bool matchTail(const LCSigPattern *pattern, const uint8_t *p) {
+    for (size_t i = 4; i < pattern->length; i++) {
+        uint8_t m = pattern->mask ? pattern->mask[i] : 0xff;
+        if ((p[i] & m) != (pattern->bytes[i] & m)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t LCSigScannerScan(const LCSigScanner *scanner, const uint8_t *base, size_t length, size_t stride, LCSigScanCallback callback, void *context) {
+    size_t matches = 0;
+    if (!stride) {
+        stride = 1;
+    }
+    const bool *firstBytes = scanner->firstBytes;
+    for (size_t offset = 0; offset + 4 <= length; offset += stride) {
+        // tight skip loop, this is where nearly all of the time goes
+        while (!firstBytes[base[offset]]) {
+            offset += stride;
+            if (offset + 4 > length) {
+                return matches;
+            }
+        }
+        uint32_t word;
+        memcpy(&word, base + offset, sizeof(word));
+        for (size_t j = 0; j < scanner->bucketCount; j++) {
+            const LCSigBucket *bucket = &scanner->buckets[j];
+            uint32_t key = word & bucket->mask;
+            // lower bound of key
+            size_t lo = 0, hi = bucket->count;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (bucket->keys[mid].key < key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            for (; lo < bucket->count && bucket->keys[lo].key == key; lo++) {
+                uint32_t index = bucket->keys[lo].patternIndex;
+                const LCSigPattern *pattern = &scanner->patterns[index];
+                if (offset + pattern->length > length || !matchTail(pattern, base + offset)) {
+                    continue;
+                }
+                matches++;
+                if (callback && !callback(index, offset, context)) {
+                    return matches;
+                }
+            }
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,22 @@
+#pragma once
+// Single pass multi-pattern byte signature scanner. Plain C so it can be run against dumped images offline.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct LCSigPattern {
+    const uint8_t *bytes;
+    // optional, 0 bits are wildcards such as register or immediate fields
+    const uint8_t *mask;
+    size_t length;
+} LCSigPattern;
+
+// Called for every match in address order, return false to stop scanning
+typedef bool (*LCSigScanCallback)(size_t patternIndex, size_t offset, void *context);
+
+typedef struct LCSigScanner LCSigScanner;
+
+LCSigScanner *LCSigScannerCreate(const LCSigPattern *patterns, size_t count);
+// Checks every stride-aligned offset in [0, length) and returns the number of matches reported
+size_t LCSigScannerScan(const LCSigScanner *scanner, const uint8_t *base, size_t length, size_t stride, LCSigScanCallback callback, void *context);
+void LCSigScannerFree(LCSigScanner *scanner);
@@ -0,0 +1,168 @@
+#include "LCSymbolCache.h"
+#include "LCHash.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LCSC_MAGIC 0x4353434c // 'LCSC'
+#define LCSC_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t uuidCount;
+    uint32_t recordCount;
+} LCSymbolCacheHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t uuidIndex;
+    uint32_t reserved;
+    uint64_t offset;
+} LCSymbolCacheRecord;
+
+typedef struct {
+    const LCSymbolCacheHeader *header;
+    const uint8_t (*uuids)[16];
+    const LCSymbolCacheRecord *records;
+} LCSymbolCacheMapping;
+
+static char cachePath[PATH_MAX];
+static LCSymbolCacheMapping *currentMapping;
+// only serializes writers, readers just load currentMapping
+static pthread_mutex_t storeLock = PTHREAD_MUTEX_INITIALIZER;
+
+static LCSymbolCacheMapping *mapCache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0 || s.st_size < (off_t)sizeof(LCSymbolCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const LCSymbolCacheHeader *header = map;
+    size_t expected = sizeof(LCSymbolCacheHeader) + (size_t)header->uuidCount * 16 + (size_t)header->recordCount * sizeof(LCSymbolCacheRecord);
+    if (header->magic != LCSC_MAGIC || header->version != LCSC_VERSION || expected != (size_t)s.st_size) {
+        munmap(map, s.st_size);
+        return NULL;
+    }
+    LCSymbolCacheMapping *mapping = malloc(sizeof(LCSymbolCacheMapping));
+    mapping->header = header;
+    mapping->uuids = (const uint8_t (*)[16])(header + 1);
+    mapping->records = (const LCSymbolCacheRecord *)((const uint8_t *)(header + 1) + header->uuidCount * 16);
+    return mapping;
+}
+
+void LCSymbolCacheOpen(const char *path) {
+    pthread_mutex_lock(&storeLock);
+    if (snprintf(cachePath, sizeof(cachePath), "%s", path) >= (int)sizeof(cachePath)) {
+        // a truncated path would read and write some other file, leave the cache disabled instead
+        cachePath[0] = 0;
+    }
+    __atomic_store_n(&currentMapping, mapCache(cachePath), __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&storeLock);
+}
+
+bool LCSymbolCacheLookup(const char *symbol, const uint8_t uuid[16], uint64_t *offsetOut) {
+    LCSymbolCacheMapping *mapping = __atomic_load_n(&currentMapping, __ATOMIC_ACQUIRE);
+    if (!mapping || !uuid) {
+        return false;
+    }
+    uint64_t hash = LCHashString(symbol);
+    for (uint32_t i = 0; i < mapping->header->recordCount; i++) {
+        const LCSymbolCacheRecord *record = &mapping->records[i];
+        if (record->hash == hash && record->uuidIndex < mapping->header->uuidCount && !memcmp(mapping->uuids[record->uuidIndex], uuid, 16)) {
+            *offsetOut = record->offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LCSymbolCacheStore(const char *symbol, const uint8_t uuid[16], uint64_t offset) {
+    if (!uuid) {
+        return false;
+    }
+    pthread_mutex_lock(&storeLock);
+    if (!cachePath[0]) {
+        pthread_mutex_unlock(&storeLock);
+        return false;
+    }
+    LCSymbolCacheMapping *old = __atomic_load_n(&currentMapping, __ATOMIC_ACQUIRE);
+    uint32_t oldUUIDCount = old ? old->header->uuidCount : 0;
+    uint32_t oldRecordCount = old ? old->header->recordCount : 0;
+    uint8_t (*uuids)[16] = malloc((oldUUIDCount + 1) * 16);
+    LCSymbolCacheRecord *records = malloc((oldRecordCount + 1) * sizeof(LCSymbolCacheRecord));
+    uint32_t uuidCount = 0, recordCount = 0;
+
+    // keep every other symbol, dropping UUIDs nothing refers to anymore
+    uint64_t hash = LCHashString(symbol);
+    for (uint32_t i = 0; i < oldRecordCount; i++) {
+        LCSymbolCacheRecord record = old->records[i];
+        if (record.hash == hash || record.uuidIndex >= oldUUIDCount) {
+            continue;
+        }
+        const uint8_t *recordUUID = old->uuids[record.uuidIndex];
+        uint32_t j = 0;
+        while (j < uuidCount && memcmp(uuids[j], recordUUID, 16)) {
+            j++;
+        }
+        if (j == uuidCount) {
+            memcpy(uuids[uuidCount++], recordUUID, 16);
+        }
+        record.uuidIndex = j;
+        records[recordCount++] = record;
+    }
+    uint32_t j = 0;
+    while (j < uuidCount && memcmp(uuids[j], uuid, 16)) {
+        j++;
+    }
+    if (j == uuidCount) {
+        memcpy(uuids[uuidCount++], uuid, 16);
+    }
+    records[recordCount++] = (LCSymbolCacheRecord){.hash = hash, .uuidIndex = j, .offset = offset};
+
+    LCSymbolCacheHeader header = {LCSC_MAGIC, LCSC_VERSION, uuidCount, recordCount};
+    char tmpPath[PATH_MAX];
+    bool success = false;
+    FILE *file = NULL;
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", cachePath, getpid()) < (int)sizeof(tmpPath)) {
+        file = fopen(tmpPath, "wb");
+    }
+    if (file) {
+        success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(uuids, 16, uuidCount, file) == uuidCount &&
+            fwrite(records, sizeof(LCSymbolCacheRecord), recordCount, file) == recordCount;
+        success = fclose(file) == 0 && success;
+        success = success && rename(tmpPath, cachePath) == 0;
+        if (!success) {
+            unlink(tmpPath);
+        }
+    }
+    free(uuids);
+    free(records);
+
+    if (success) {
+        // the previous mapping is intentionally leaked: lock-free readers may still be walking it,
+        // and stores only happen a handful of times after an OS update
+        LCSymbolCacheMapping *mapping = mapCache(cachePath);
+        if (mapping) {
+            __atomic_store_n(&currentMapping, mapping, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&storeLock);
+    return success;
+}
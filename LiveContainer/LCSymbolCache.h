@@ -0,0 +1,12 @@
+#pragma once
+// Small fixed-format symbol offset cache: header, UUID table, (symbol hash, UUID index, offset) records.
+// The file is mapped read-only so lookups on the launch path take no locks and parse nothing,
+// updates rewrite it to a temporary file and rename it over the old one.
+#include <stdbool.h>
+#include <stdint.h>
+
+// Map the cache at path, a missing file is treated as an empty cache
+void LCSymbolCacheOpen(const char *path);
+bool LCSymbolCacheLookup(const char *symbol, const uint8_t uuid[16], uint64_t *offsetOut);
+// Replaces any previous record for symbol, returns false if the new file could not be written
+bool LCSymbolCacheStore(const char *symbol, const uint8_t uuid[16], uint64_t offset);
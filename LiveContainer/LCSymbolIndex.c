@@ -0,0 +1,427 @@
+#include "LCSymbolIndex.h"
+#include "LCHash.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Mach-O layouts we need, spelled out so this file does not depend on <mach-o/*.h>
+#define LCS_MH_MAGIC_64 0xfeedfacf
+#define LCS_LC_SEGMENT_64 0x19
+#define LCS_LC_SYMTAB 0x2
+#define LCS_LC_UUID 0x1b
+#define LCS_LC_DYLD_INFO 0x22
+#define LCS_LC_DYLD_INFO_ONLY 0x80000022
+#define LCS_LC_DYLD_EXPORTS_TRIE 0x80000033
+#define LCS_N_STAB 0xe0
+#define LCS_N_TYPE 0x0e
+#define LCS_N_SECT 0x0e
+#define LCS_EXPORT_SYMBOL_FLAGS_REEXPORT 0x08
+
+#define LCSI_MAGIC 0x4953434c // 'LCSI'
+#define LCSI_VERSION 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t uuid[16];
+    uint32_t bucketBits;
+    uint32_t entryCount;
+    uint32_t stringsSize;
+    uint32_t reserved;
+} LCSymbolIndexHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t offset;
+    uint32_t nameOff;
+    uint32_t nameLen;
+} LCSymbolIndexEntry;
+
+struct LCSymbolIndex {
+    void *data;
+    size_t size;
+    bool mapped;
+    const LCSymbolIndexHeader *header;
+    const uint32_t *buckets;
+    const LCSymbolIndexEntry *entries;
+    const char *strings;
+};
+
+// When a name is in both tables the symtab value wins, it is what litehook_find_symbol_file returns
+// and what LCFindSymbolOffset resolved to before the index existed.
+typedef enum {
+    LCSymbolSourceSymtab,
+    LCSymbolSourceExportTrie,
+} LCSymbolSource;
+
+typedef struct {
+    uint64_t hash;
+    uint64_t offset;
+    const char *name;
+    uint32_t nameLen;
+    uint32_t source;
+} LCSymbolCandidate;
+
+typedef struct {
+    LCSymbolCandidate *items;
+    size_t count;
+    size_t capacity;
+    // names decoded from the export trie are not contiguous in the file and need their own storage
+    char **ownedNames;
+    size_t ownedCount;
+    size_t ownedCapacity;
+} LCSymbolCandidates;
+
+static uint32_t bucketForHash(uint64_t hash, uint32_t bucketBits) {
+    return bucketBits ? (uint32_t)(hash >> (64 - bucketBits)) : 0;
+}
+
+static void addCandidate(LCSymbolCandidates *list, const char *name, size_t len, uint64_t offset, LCSymbolSource source) {
+    if (!len) {
+        return;
+    }
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->items = realloc(list->items, list->capacity * sizeof(LCSymbolCandidate));
+    }
+    list->items[list->count++] = (LCSymbolCandidate){LCHashBytes(name, len), offset, name, (uint32_t)len, source};
+}
+
+static const char *ownName(LCSymbolCandidates *list, const char *name, size_t len) {
+    if (list->ownedCount == list->ownedCapacity) {
+        list->ownedCapacity = list->ownedCapacity ? list->ownedCapacity * 2 : 256;
+        list->ownedNames = realloc(list->ownedNames, list->ownedCapacity * sizeof(char *));
+    }
+    char *copy = malloc(len + 1);
+    memcpy(copy, name, len);
+    copy[len] = 0;
+    list->ownedNames[list->ownedCount++] = copy;
+    return copy;
+}
+
+static bool readUleb128(const uint8_t **p, const uint8_t *end, uint64_t *out) {
+    uint64_t result = 0;
+    int bit = 0;
+    while (*p < end) {
+        uint8_t byte = *(*p)++;
+        if (bit < 64) {
+            result |= (uint64_t)(byte & 0x7f) << bit;
+        }
+        bit += 7;
+        if (!(byte & 0x80)) {
+            *out = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void walkExportTrie(LCSymbolCandidates *list, const uint8_t *start, const uint8_t *end, uint64_t nodeOff, char *name, size_t nameLen, int depth) {
+    if (depth > 128 || nodeOff >= (uint64_t)(end - start)) {
+        return;
+    }
+    const uint8_t *p = start + nodeOff;
+    uint64_t terminalSize;
+    if (!readUleb128(&p, end, &terminalSize)) {
+        return;
+    }
+    const uint8_t *children = p + terminalSize;
+    if (terminalSize && children <= end) {
+        uint64_t flags, address;
+        if (readUleb128(&p, end, &flags) && !(flags & LCS_EXPORT_SYMBOL_FLAGS_REEXPORT) && readUleb128(&p, end, &address)) {
+            // for stub-and-resolver exports the first value is the stub, which is what callers bind to
+            addCandidate(list, ownName(list, name, nameLen), nameLen, address, LCSymbolSourceExportTrie);
+        }
+    }
+    if (children >= end) {
+        return;
+    }
+    p = children;
+    uint8_t childCount = *p++;
+    for (uint8_t i = 0; i < childCount; i++) {
+        size_t edgeLen = strnlen((const char *)p, end - p);
+        if (p + edgeLen >= end || nameLen + edgeLen >= PATH_MAX) {
+            return;
+        }
+        memcpy(name + nameLen, p, edgeLen);
+        p += edgeLen + 1;
+        uint64_t childOff;
+        if (!readUleb128(&p, end, &childOff)) {
+            return;
+        }
+        walkExportTrie(list, start, end, childOff, name, nameLen + edgeLen, depth + 1);
+    }
+}
+
+static int compareNames(const LCSymbolCandidate *x, const LCSymbolCandidate *y) {
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    if (x->nameLen != y->nameLen) {
+        return x->nameLen < y->nameLen ? -1 : 1;
+    }
+    return memcmp(x->name, y->name, x->nameLen);
+}
+
+// qsort is not stable, so duplicates are ordered by source and then offset to make the kept entry deterministic
+static int compareCandidates(const void *a, const void *b) {
+    const LCSymbolCandidate *x = a, *y = b;
+    int result = compareNames(x, y);
+    if (result) {
+        return result;
+    }
+    if (x->source != y->source) {
+        return x->source < y->source ? -1 : 1;
+    }
+    if (x->offset != y->offset) {
+        return x->offset < y->offset ? -1 : 1;
+    }
+    return 0;
+}
+
+static bool attachBlob(LCSymbolIndex *index) {
+    if (index->size < sizeof(LCSymbolIndexHeader)) {
+        return false;
+    }
+    const LCSymbolIndexHeader *header = index->data;
+    if (header->magic != LCSI_MAGIC || header->version != LCSI_VERSION || header->bucketBits > 24) {
+        return false;
+    }
+    size_t bucketsSize = (((size_t)1 << header->bucketBits) + 1) * sizeof(uint32_t);
+    size_t entriesOff = (sizeof(LCSymbolIndexHeader) + bucketsSize + 7) & ~(size_t)7;
+    size_t stringsOff = entriesOff + (size_t)header->entryCount * sizeof(LCSymbolIndexEntry);
+    if (stringsOff + header->stringsSize != index->size) {
+        return false;
+    }
+    index->header = header;
+    index->buckets = (const uint32_t *)(header + 1);
+    index->entries = (const LCSymbolIndexEntry *)((const uint8_t *)index->data + entriesOff);
+    index->strings = (const char *)index->data + stringsOff;
+    return true;
+}
+
+LCSymbolIndex *LCSymbolIndexCreate(const void *image, size_t length) {
+    const uint8_t *base = image;
+    const uint32_t *mh = image;
+    if (mh[0] != LCS_MH_MAGIC_64) {
+        return NULL;
+    }
+    uint32_t ncmds = mh[4], sizeofcmds = mh[5];
+    const uint8_t *cmdsEnd = base + 32 + sizeofcmds;
+    if (length && 32 + (size_t)sizeofcmds > length) {
+        return NULL;
+    }
+
+    uint8_t uuid[16] = {0};
+    uint64_t textVmaddr = 0;
+    const uint32_t *symtab = NULL;
+    uint32_t exportOff = 0, exportSize = 0;
+    const uint8_t *cmd = base + 32;
+    for (uint32_t i = 0; i < ncmds && cmd + 8 <= cmdsEnd; i++) {
+        const uint32_t *lc = (const uint32_t *)cmd;
+        if (lc[1] < 8 || cmd + lc[1] > cmdsEnd) {
+            return NULL;
+        }
+        switch (lc[0]) {
+        case LCS_LC_SEGMENT_64:
+            if (!strncmp((const char *)(lc + 2), "__TEXT", 16)) {
+                memcpy(&textVmaddr, cmd + 24, sizeof(textVmaddr));
+            }
+            break;
+        case LCS_LC_UUID:
+            memcpy(uuid, lc + 2, sizeof(uuid));
+            break;
+        case LCS_LC_SYMTAB:
+            symtab = lc;
+            break;
+        case LCS_LC_DYLD_INFO:
+        case LCS_LC_DYLD_INFO_ONLY:
+            exportOff = lc[10];
+            exportSize = lc[11];
+            break;
+        case LCS_LC_DYLD_EXPORTS_TRIE:
+            exportOff = lc[2];
+            exportSize = lc[3];
+            break;
+        }
+        cmd += lc[1];
+    }
+
+    LCSymbolCandidates list = {0};
+    if (symtab) {
+        uint32_t symoff = symtab[2], nsyms = symtab[3], stroff = symtab[4], strsize = symtab[5];
+        if (!length || ((uint64_t)symoff + (uint64_t)nsyms * 16 <= length && (uint64_t)stroff + strsize <= length)) {
+            const uint8_t *syms = base + symoff;
+            const char *strtab = (const char *)base + stroff;
+            for (uint32_t i = 0; i < nsyms; i++) {
+                const uint8_t *nl = syms + (size_t)i * 16;
+                uint32_t strx;
+                uint64_t value;
+                memcpy(&strx, nl, sizeof(strx));
+                memcpy(&value, nl + 8, sizeof(value));
+                uint8_t type = nl[4];
+                if ((type & LCS_N_STAB) || (type & LCS_N_TYPE) != LCS_N_SECT || strx >= strsize) {
+                    continue;
+                }
+                const char *name = strtab + strx;
+                addCandidate(&list, name, strnlen(name, strsize - strx), value - textVmaddr, LCSymbolSourceSymtab);
+            }
+        }
+    }
+    if (exportSize && (!length || (uint64_t)exportOff + exportSize <= length)) {
+        char name[PATH_MAX];
+        walkExportTrie(&list, base + exportOff, base + exportOff + exportSize, 0, name, 0, 0);
+    }
+
+    // sort by hash so each bucket is a contiguous run, then keep only the first (preferred) entry of every name
+    qsort(list.items, list.count, sizeof(LCSymbolCandidate), compareCandidates);
+    size_t unique = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        if (unique && !compareNames(&list.items[unique - 1], &list.items[i])) {
+            continue;
+        }
+        list.items[unique++] = list.items[i];
+    }
+
+    uint32_t bucketBits = 0;
+    while (((size_t)1 << bucketBits) < unique && bucketBits < 24) {
+        bucketBits++;
+    }
+    size_t bucketCount = (size_t)1 << bucketBits;
+    size_t stringsSize = 0;
+    for (size_t i = 0; i < unique; i++) {
+        stringsSize += list.items[i].nameLen + 1;
+    }
+    size_t bucketsSize = (bucketCount + 1) * sizeof(uint32_t);
+    size_t entriesOff = (sizeof(LCSymbolIndexHeader) + bucketsSize + 7) & ~(size_t)7;
+    size_t stringsOff = entriesOff + unique * sizeof(LCSymbolIndexEntry);
+
+    LCSymbolIndex *index = calloc(1, sizeof(LCSymbolIndex));
+    index->size = stringsOff + stringsSize;
+    index->data = calloc(1, index->size);
+    LCSymbolIndexHeader *header = index->data;
+    *header = (LCSymbolIndexHeader){.magic = LCSI_MAGIC, .version = LCSI_VERSION, .bucketBits = bucketBits, .entryCount = (uint32_t)unique, .stringsSize = (uint32_t)stringsSize};
+    memcpy(header->uuid, uuid, sizeof(uuid));
+
+    uint32_t *buckets = (uint32_t *)(header + 1);
+    LCSymbolIndexEntry *entries = (LCSymbolIndexEntry *)((uint8_t *)index->data + entriesOff);
+    char *strings = (char *)index->data + stringsOff;
+    uint32_t nameOff = 0;
+    size_t bucket = 0;
+    for (size_t i = 0; i < unique; i++) {
+        LCSymbolCandidate *item = &list.items[i];
+        uint32_t itemBucket = bucketForHash(item->hash, bucketBits);
+        while (bucket <= itemBucket) {
+            buckets[bucket++] = (uint32_t)i;
+        }
+        entries[i] = (LCSymbolIndexEntry){item->hash, item->offset, nameOff, item->nameLen};
+        memcpy(strings + nameOff, item->name, item->nameLen);
+        nameOff += item->nameLen + 1;
+    }
+    while (bucket <= bucketCount) {
+        buckets[bucket++] = (uint32_t)unique;
+    }
+
+    for (size_t i = 0; i < list.ownedCount; i++) {
+        free(list.ownedNames[i]);
+    }
+    free(list.ownedNames);
+    free(list.items);
+    attachBlob(index);
+    return index;
+}
+
+LCSymbolIndex *LCSymbolIndexOpen(const char *path, const uint8_t uuid[16]) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0 || s.st_size < (off_t)sizeof(LCSymbolIndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    LCSymbolIndex *index = calloc(1, sizeof(LCSymbolIndex));
+    index->data = map;
+    index->size = s.st_size;
+    index->mapped = true;
+    if (!attachBlob(index) || (uuid && memcmp(index->header->uuid, uuid, 16))) {
+        LCSymbolIndexClose(index);
+        return NULL;
+    }
+    return index;
+}
+
+bool LCSymbolIndexWrite(const LCSymbolIndex *index, const char *path) {
+    char tmpPath[PATH_MAX];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, getpid()) >= (int)sizeof(tmpPath)) {
+        return false;
+    }
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const uint8_t *p = index->data;
+    size_t left = index->size;
+    while (left) {
+        ssize_t written = write(fd, p, left);
+        if (written <= 0) {
+            close(fd);
+            unlink(tmpPath);
+            return false;
+        }
+        p += written;
+        left -= written;
+    }
+    close(fd);
+    if (rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+void LCSymbolIndexClose(LCSymbolIndex *index) {
+    if (!index) {
+        return;
+    }
+    if (index->mapped) {
+        munmap(index->data, index->size);
+    } else {
+        free(index->data);
+    }
+    free(index);
+}
+
+const uint8_t *LCSymbolIndexUUID(const LCSymbolIndex *index) {
+    return index->header->uuid;
+}
+
+size_t LCSymbolIndexCount(const LCSymbolIndex *index) {
+    return index->header->entryCount;
+}
+
+uint64_t LCSymbolIndexLookup(const LCSymbolIndex *index, const char *symbol) {
+    size_t len = strlen(symbol);
+    uint64_t hash = LCHashBytes(symbol, len);
+    uint32_t bucket = bucketForHash(hash, index->header->bucketBits);
+    uint32_t end = index->buckets[bucket + 1];
+    for (uint32_t i = index->buckets[bucket]; i < end && i < index->header->entryCount; i++) {
+        const LCSymbolIndexEntry *entry = &index->entries[i];
+        if (entry->hash == hash && entry->nameLen == len && entry->nameOff + len < index->header->stringsSize &&
+            !memcmp(index->strings + entry->nameOff, symbol, len)) {
+            return entry->offset;
+        }
+    }
+    return 0;
+}
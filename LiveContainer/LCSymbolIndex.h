@@ -0,0 +1,23 @@
+#pragma once
+// Hashed symbol -> offset table for a single Mach-O image, built from LC_SYMTAB and the export trie.
+// A name present in both keeps its LC_SYMTAB value, matching litehook_find_symbol_file.
+// Offsets are relative to the image base (__TEXT vmaddr), the same value LCFindSymbolOffset returns.
+// Plain C so the builder can run offline against fixture binaries.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct LCSymbolIndex LCSymbolIndex;
+
+// Index a mapped thin 64-bit Mach-O slice, length may be 0 if unknown
+LCSymbolIndex *LCSymbolIndexCreate(const void *header, size_t length);
+// Map a previously written index, returns NULL if missing, corrupt or built for another UUID
+LCSymbolIndex *LCSymbolIndexOpen(const char *path, const uint8_t uuid[16]);
+// Write via a temporary file and rename so concurrent readers never see a partial index
+bool LCSymbolIndexWrite(const LCSymbolIndex *index, const char *path);
+void LCSymbolIndexClose(LCSymbolIndex *index);
+
+const uint8_t *LCSymbolIndexUUID(const LCSymbolIndex *index);
+size_t LCSymbolIndexCount(const LCSymbolIndex *index);
+// Returns 0 if not found
+uint64_t LCSymbolIndexLookup(const LCSymbolIndex *index, const char *symbol);
@@ -11,7 +11,9 @@
 #import "LCMachOUtils.h"
 #include "mach_excServer.h"
 #import "../utils.h"
+#import "Tweaks.h"
 #import "../dyld_bypass_validation.h"
+#include "../LCSymbolCache.h"
 @import Darwin;
 @import Foundation;
 @import MachO;
@@ -138,34 +140,36 @@ void* getDSCAddr(void) {
     return (void*)infos->sharedCacheBaseAddress;
 }
 
+static void openSymbolCache(void) {
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        NSString *cacheDir = NSUserDefaults.lcAppGroupPath ? [NSUserDefaults.lcAppGroupPath stringByAppendingPathComponent:@"LiveContainer"] : NSTemporaryDirectory();
+        LCSymbolCacheOpen([cacheDir stringByAppendingPathComponent:@"symbolOffsetCache.bin"].fileSystemRepresentation);
+    });
+}
+
 void* getCachedSymbol(NSString* symbolName, mach_header_u* header) {
-    NSDictionary* symbolOffsetDict = [NSUserDefaults.lcSharedDefaults objectForKey:@"symbolOffsetCache"][symbolName];
-    if(!symbolOffsetDict) {
-        return NULL;
-    }
-    NSData* cachedSymbolUUID = symbolOffsetDict[@"uuid"];
-    if(!cachedSymbolUUID) {
-        return NULL;
-    }
     const uint8_t* uuid = LCGetMachOUUID(header);
-    if(!uuid || memcmp(uuid, [cachedSymbolUUID bytes], 16)) {
-        return NULL;
+    uint64_t offset;
+    // the launch manifest is already mapped, the shared cache is only opened for symbols the last launch didn't need
+    if(!launchManifestLookupSymbol(symbolName.UTF8String, uuid, &offset)) {
+        openSymbolCache();
+        if(!LCSymbolCacheLookup(symbolName.UTF8String, uuid, &offset)) {
+            return NULL;
+        }
     }
-    
-    return (void*)header + [symbolOffsetDict[@"offset"] unsignedLongLongValue];
+    launchManifestNoteSymbol(symbolName.UTF8String, uuid, offset);
+    return (void*)header + offset;
 }
 
 void saveCachedSymbol(NSString* symbolName, mach_header_u* header, uint64_t offset) {
-    NSMutableDictionary* allSymbolOffsetDict = [[NSUserDefaults.lcSharedDefaults objectForKey:@"symbolOffsetCache"] mutableCopy];
-    if(!allSymbolOffsetDict) {
-        allSymbolOffsetDict = [[NSMutableDictionary alloc] init];
+    openSymbolCache();
+    LCSymbolCacheStore(symbolName.UTF8String, LCGetMachOUUID(header), offset);
+    launchManifestNoteSymbol(symbolName.UTF8String, LCGetMachOUUID(header), offset);
+    // drop the plist based cache older versions kept in shared defaults
+    if([NSUserDefaults.lcSharedDefaults objectForKey:@"symbolOffsetCache"]) {
+        [NSUserDefaults.lcSharedDefaults removeObjectForKey:@"symbolOffsetCache"];
     }
-    
-    allSymbolOffsetDict[symbolName] = @{
-        @"uuid": [NSData dataWithBytes:LCGetMachOUUID(header) length:16],
-        @"offset": @(offset),
-    };
-    [NSUserDefaults.lcSharedDefaults setObject:allSymbolOffsetDict forKey:@"symbolOffsetCache"];
 }
 
 bool hook_dyld_program_sdk_at_least(void* dyldApiInstancePtr, dyld_build_version_t version) {
@@ -26,6 +26,9 @@ void* getGuestAppHeader(void);
 void* getDSCAddr(void);
 void* getCachedSymbol(NSString* symbolName, struct mach_header_64* header);
 void saveCachedSymbol(NSString* symbolName, struct mach_header_64* header, uint64_t offset);
+// symbol offsets recorded in the guest app's launch manifest, noted ones are written back once the app is loaded
+bool launchManifestLookupSymbol(const char *symbol, const uint8_t uuid[16], uint64_t *offsetOut);
+void launchManifestNoteSymbol(const char *symbol, const uint8_t uuid[16], uint64_t offset);
 void* dlopen_nolock(const char *path, int mode);
 
 static void hook_do_nothing(void) {}
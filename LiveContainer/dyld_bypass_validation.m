@@ -14,6 +14,7 @@
 #include <sys/syscall.h>
 
 #include "dyld_bypass_validation.h"
+#include "LCSigScan.h"
 #include "litehook.h"
 #include "utils.h"
 
@@ -74,15 +75,38 @@ static int hooked___fcntl(int fildes, int cmd, void *param) {
     return orig_fcntl(fildes, cmd, param);
 }
 
-char *searchDyldFunction(char *base, char *signature, int length) {
-    char *patchAddr = NULL;
-    for(int i=0; i < 0x80000; i+=4) {
-        if (base[i] == signature[0] && memcmp(base+i, signature, length) == 0) {
-            patchAddr = base + i;
+enum {
+    DyldSigFcntl,
+    DyldSigMmap,
+    DyldSigSyscall,
+};
+
+typedef struct {
+    const uint8_t *base;
+    char *fcntlAddr;
+    char *mmapAddr;
+    // first svc preceded by a branch, which is where Dopamine hooks fcntl
+    char *hookedSyscallAddr;
+} DyldSigScanResult;
+
+static bool dyldSigFound(size_t patternIndex, size_t offset, void *context) {
+    DyldSigScanResult *result = context;
+    char *addr = (char *)result->base + offset;
+    switch(patternIndex) {
+        case DyldSigFcntl:
+            if(!result->fcntlAddr) result->fcntlAddr = addr;
+            break;
+        case DyldSigMmap:
+            if(!result->mmapAddr) result->mmapAddr = addr;
+            break;
+        case DyldSigSyscall:
+            if(!result->hookedSyscallAddr && offset >= 4 && *(uint32_t *)(addr - 4) >> 26 == 0x5) {
+                result->hookedSyscallAddr = addr;
+            }
             break;
-        }
     }
-    return patchAddr;
+    // the Dopamine fallback is only needed if fcntl's own signature is missing
+    return !(result->fcntlAddr && result->mmapAddr);
 }
 
 void init_bypassDyldLibValidation(void) {
@@ -110,23 +134,22 @@ void searchDyldFunctions(void) {
     
     // TODO: cache offset and litehook_find_dsc_symbol
     char *dyldBase = (char *)_alt_dyld_get_all_image_infos()->dyldImageLoadAddress;
-    orig_dyld_fcntl = (void *)searchDyldFunction(dyldBase, fcntlSig, sizeof(fcntlSig));
-    orig_dyld_mmap = (void *)searchDyldFunction(dyldBase, mmapSig, sizeof(mmapSig));
+    // one pass over dyld for every signature instead of a rescan per signature
+    LCSigPattern patterns[] = {
+        [DyldSigFcntl] = {(const uint8_t *)fcntlSig, NULL, sizeof(fcntlSig)},
+        [DyldSigMmap] = {(const uint8_t *)mmapSig, NULL, sizeof(mmapSig)},
+        [DyldSigSyscall] = {(const uint8_t *)syscallSig, NULL, sizeof(syscallSig)},
+    };
+    LCSigScanner *scanner = LCSigScannerCreate(patterns, sizeof(patterns) / sizeof(patterns[0]));
+    DyldSigScanResult result = {.base = (const uint8_t *)dyldBase};
+    LCSigScannerScan(scanner, result.base, 0x80000, 4, dyldSigFound, &result);
+    LCSigScannerFree(scanner);
+    orig_dyld_fcntl = (void *)result.fcntlAddr;
+    orig_dyld_mmap = (void *)result.mmapAddr;
     
     // dopamine already hooked it, try to find its hook instead
     if(!orig_dyld_fcntl) {
-        char* fcntlAddr = 0;
-        // search all syscalls and see if the the instruction before it is a branch instruction
-        for(int i=0; i < 0x80000; i+=4) {
-            if (dyldBase[i] == syscallSig[0] && memcmp(dyldBase+i, syscallSig, 4) == 0) {
-                char* syscallAddr = dyldBase + i;
-                uint32_t* prev = (uint32_t*)(syscallAddr - 4);
-                if(*prev >> 26 == 0x5) {
-                    fcntlAddr = (char*)prev;
-                    break;
-                }
-            }
-        }
+        char* fcntlAddr = result.hookedSyscallAddr ? result.hookedSyscallAddr - 4 : NULL;
         
         if(fcntlAddr) {
             uint32_t* inst = (uint32_t*)fcntlAddr;
@@ -364,6 +364,8 @@ struct LCAppBanner : View {
             }
             
             let fm = FileManager()
+            self.appInfo.removeFromCatalog()
+            LCUtils.releaseBundleFiles(bundlePath: self.appInfo.bundlePath()!)
             try fm.removeItem(atPath: self.appInfo.bundlePath()!)
             self.delegate.removeApp(app: self.model)
             if doRemoveAppFolder {
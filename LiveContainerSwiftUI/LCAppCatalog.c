@@ -0,0 +1,300 @@
+#include "LCAppCatalog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LCAC_MAGIC 0x4341434c               // "LCAC"
+#define LCAC_VERSION 1
+#define LCAC_MAX_SIZE (64u << 20)
+
+#ifdef __APPLE__
+#define LCAC_MTIME(st) ((st).st_mtimespec)
+#else
+#define LCAC_MTIME(st) ((st).st_mtim)
+#endif
+
+// The file is this header, count records sorted by bundle name, then the names and fields they point at
+typedef struct LCACHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t recordSize;
+} LCACHeader;
+
+typedef struct LCACRecord {
+    uint32_t nameOffset;                    // from the start of the file, NUL terminated
+    uint32_t nameLength;
+    LCAppCatalogStamp infoPlist;
+    LCAppCatalogStamp appInfo;
+    uint64_t iconKey;
+    uint32_t fieldOffsets[LCAppCatalogFieldCount];
+    uint32_t fieldLengths[LCAppCatalogFieldCount];
+} LCACRecord;
+
+int LCAppCatalogOpen(LCAppCatalog *catalog, const char *path) {
+    memset(catalog, 0, sizeof(*catalog));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(LCACHeader) || st.st_size > LCAC_MAX_SIZE) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = error;
+        return -1;
+    }
+    const LCACHeader *header = map;
+    if (header->magic != LCAC_MAGIC || header->version != LCAC_VERSION || header->recordSize != sizeof(LCACRecord) ||
+        header->count > ((size_t)st.st_size - sizeof(LCACHeader)) / sizeof(LCACRecord)) {
+        munmap(map, (size_t)st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    catalog->map = map;
+    catalog->mapSize = (size_t)st.st_size;
+    catalog->count = header->count;
+    return 0;
+}
+
+void LCAppCatalogClose(LCAppCatalog *catalog) {
+    if (catalog->map) {
+        munmap((void *)catalog->map, catalog->mapSize);
+    }
+    memset(catalog, 0, sizeof(*catalog));
+}
+
+static const LCACRecord *recordAt(const LCAppCatalog *catalog, size_t index) {
+    return (const LCACRecord *)(catalog->map + sizeof(LCACHeader)) + index;
+}
+
+static bool fits(const LCAppCatalog *catalog, uint32_t offset, uint32_t length) {
+    return offset <= catalog->mapSize && length <= catalog->mapSize - offset;
+}
+
+static const char *recordName(const LCAppCatalog *catalog, const LCACRecord *record) {
+    if (!fits(catalog, record->nameOffset, record->nameLength + 1) || catalog->map[record->nameOffset + record->nameLength] != '\0') {
+        return NULL;
+    }
+    return (const char *)catalog->map + record->nameOffset;
+}
+
+bool LCAppCatalogGet(const LCAppCatalog *catalog, size_t index, LCAppCatalogEntry *entry) {
+    if (index >= catalog->count) {
+        return false;
+    }
+    const LCACRecord *record = recordAt(catalog, index);
+    entry->bundleName = recordName(catalog, record);
+    if (!entry->bundleName) {
+        return false;
+    }
+    entry->infoPlist = record->infoPlist;
+    entry->appInfo = record->appInfo;
+    entry->iconKey = record->iconKey;
+    for (int i = 0; i < LCAppCatalogFieldCount; i++) {
+        if (!fits(catalog, record->fieldOffsets[i], record->fieldLengths[i])) {
+            return false;
+        }
+        entry->fields[i] = catalog->map + record->fieldOffsets[i];
+        entry->fieldLengths[i] = record->fieldLengths[i];
+    }
+    return true;
+}
+
+bool LCAppCatalogFind(const LCAppCatalog *catalog, const char *bundleName, LCAppCatalogEntry *entry) {
+    size_t low = 0, high = catalog->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const char *name = recordName(catalog, recordAt(catalog, middle));
+        if (!name) {
+            return false;
+        }
+        int order = strcmp(name, bundleName);
+        if (order == 0) {
+            return LCAppCatalogGet(catalog, middle, entry);
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return false;
+}
+
+void LCAppCatalogStampFile(const char *path, LCAppCatalogStamp *stamp) {
+    struct stat st;
+    memset(stamp, 0, sizeof(*stamp));
+    if (stat(path, &st) == 0) {
+        stamp->inode = (uint64_t)st.st_ino;
+        stamp->mtime = (int64_t)LCAC_MTIME(st).tv_sec * 1000000000 + LCAC_MTIME(st).tv_nsec;
+        stamp->size = (uint64_t)st.st_size;
+    }
+}
+
+static bool isStampCurrent(const LCAppCatalogStamp *stamp, const char *bundlePath, const char *name) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", bundlePath, name) >= (int)sizeof(path)) {
+        return false;
+    }
+    LCAppCatalogStamp current;
+    LCAppCatalogStampFile(path, &current);
+    return !memcmp(&current, stamp, sizeof(current));
+}
+
+bool LCAppCatalogIsCurrent(const LCAppCatalogEntry *entry, const char *bundlePath) {
+    return isStampCurrent(&entry->infoPlist, bundlePath, "Info.plist") && isStampCurrent(&entry->appInfo, bundlePath, "LCAppInfo.plist");
+}
+
+static int compareEntryNames(const void *a, const void *b) {
+    return strcmp((*(const LCAppCatalogEntry *const *)a)->bundleName, (*(const LCAppCatalogEntry *const *)b)->bundleName);
+}
+
+static bool writeFully(int fd, const void *buffer, size_t size) {
+    const uint8_t *p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+int LCAppCatalogWrite(const char *path, const LCAppCatalogEntry *entries, size_t count) {
+    const LCAppCatalogEntry **sorted = malloc((count ? count : 1) * sizeof(*sorted));
+    if (!sorted) {
+        errno = ENOMEM;
+        return -1;
+    }
+    size_t size = sizeof(LCACHeader) + count * sizeof(LCACRecord);
+    for (size_t i = 0; i < count; i++) {
+        sorted[i] = &entries[i];
+        size += strlen(entries[i].bundleName) + 1;
+        for (int f = 0; f < LCAppCatalogFieldCount; f++) {
+            size += entries[i].fieldLengths[f];
+        }
+    }
+    if (size > LCAC_MAX_SIZE) {
+        free(sorted);
+        errno = EFBIG;
+        return -1;
+    }
+    qsort(sorted, count, sizeof(*sorted), compareEntryNames);
+
+    uint8_t *buffer = calloc(1, size);
+    if (!buffer) {
+        free(sorted);
+        errno = ENOMEM;
+        return -1;
+    }
+    LCACHeader *header = (LCACHeader *)buffer;
+    header->magic = LCAC_MAGIC;
+    header->version = LCAC_VERSION;
+    header->count = (uint32_t)count;
+    header->recordSize = sizeof(LCACRecord);
+    LCACRecord *records = (LCACRecord *)(buffer + sizeof(LCACHeader));
+    size_t offset = sizeof(LCACHeader) + count * sizeof(LCACRecord);
+    for (size_t i = 0; i < count; i++) {
+        const LCAppCatalogEntry *entry = sorted[i];
+        LCACRecord *record = &records[i];
+        size_t nameLength = strlen(entry->bundleName);
+        record->nameOffset = (uint32_t)offset;
+        record->nameLength = (uint32_t)nameLength;
+        memcpy(buffer + offset, entry->bundleName, nameLength + 1);
+        offset += nameLength + 1;
+        record->infoPlist = entry->infoPlist;
+        record->appInfo = entry->appInfo;
+        record->iconKey = entry->iconKey;
+        for (int f = 0; f < LCAppCatalogFieldCount; f++) {
+            record->fieldOffsets[f] = (uint32_t)offset;
+            record->fieldLengths[f] = entry->fieldLengths[f];
+            if (entry->fieldLengths[f]) {
+                memcpy(buffer + offset, entry->fields[f], entry->fieldLengths[f]);
+            }
+            offset += entry->fieldLengths[f];
+        }
+    }
+    free(sorted);
+
+    // a new file renamed over the old one, processes that have the old one mapped keep reading it
+    char tmpPath[PATH_MAX];
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.%d", path, (int)getpid()) >= (int)sizeof(tmpPath)) {
+        free(buffer);
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(buffer);
+        return -1;
+    }
+    bool ok = writeFully(fd, buffer, size);
+    int error = errno;
+    free(buffer);
+    if (close(fd) != 0 && ok) {
+        error = errno;
+        ok = false;
+    }
+    if (!ok || rename(tmpPath, path) != 0) {
+        error = ok ? errno : error;
+        unlink(tmpPath);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int LCAppCatalogUpdate(const char *path, const LCAppCatalogEntry *entry, const char *removedBundleName) {
+    LCAppCatalog catalog;
+    if (LCAppCatalogOpen(&catalog, path) != 0) {
+        memset(&catalog, 0, sizeof(catalog));
+    }
+    LCAppCatalogEntry *entries = malloc((catalog.count + 1) * sizeof(LCAppCatalogEntry));
+    if (!entries) {
+        LCAppCatalogClose(&catalog);
+        errno = ENOMEM;
+        return -1;
+    }
+    // the other entries are copied as they are, without looking at their bundles
+    size_t count = 0;
+    for (size_t i = 0; i < catalog.count; i++) {
+        if (!LCAppCatalogGet(&catalog, i, &entries[count]) || (entry && !strcmp(entries[count].bundleName, entry->bundleName)) ||
+            (removedBundleName && !strcmp(entries[count].bundleName, removedBundleName))) {
+            continue;
+        }
+        count++;
+    }
+    if (entry) {
+        entries[count++] = *entry;
+    }
+    int ret = LCAppCatalogWrite(path, entries, count);
+    int error = errno;
+    free(entries);
+    LCAppCatalogClose(&catalog);
+    errno = error;
+    return ret;
+}
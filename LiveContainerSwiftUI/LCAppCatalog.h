@@ -0,0 +1,60 @@
+#pragma once
+// Cache of what the app list needs from every bundle in a bundle folder, kept free of Foundation so it can also run
+// headless on Linux. The catalog is one file next to the bundles, mapped read-only and only ever replaced as a whole by
+// rename, so a reader never sees it half written. An entry is current while the inode, mtime and size of the bundle's
+// Info.plist and LCAppInfo.plist are what they were when it was written.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LC_APP_CATALOG_NAME ".LCAppCatalog"
+
+typedef enum LCAppCatalogField {
+    LCAppCatalogFieldDisplayName,
+    LCAppCatalogFieldBundleIdentifier,  // CFBundleIdentifier of Info.plist, LCAppInfo.plist has the original one
+    LCAppCatalogFieldVersion,
+    LCAppCatalogFieldExecutable,
+    LCAppCatalogFieldURLSchemes,        // separated by '\n'
+    LCAppCatalogFieldAppInfo,           // LCAppInfo.plist as a binary plist: flags, containers, tweak folder...
+    LCAppCatalogFieldCount
+} LCAppCatalogField;
+
+// A file that doesn't exist has an all zero stamp
+typedef struct LCAppCatalogStamp {
+    uint64_t inode;
+    int64_t mtime;                      // nanoseconds
+    uint64_t size;
+} LCAppCatalogStamp;
+
+typedef struct LCAppCatalogEntry {
+    const char *bundleName;             // folder name in the bundle folder
+    LCAppCatalogStamp infoPlist;
+    LCAppCatalogStamp appInfo;
+    uint64_t iconKey;                   // mtime of the cached light icon, 0 if there was none
+    const void *fields[LCAppCatalogFieldCount];
+    uint32_t fieldLengths[LCAppCatalogFieldCount];
+} LCAppCatalogEntry;
+
+typedef struct LCAppCatalog {
+    const uint8_t *map;
+    size_t mapSize;
+    size_t count;
+} LCAppCatalog;
+
+// Maps the catalog at path. Returns 0, or -1 with errno set, EINVAL if it isn't one of this version.
+int LCAppCatalogOpen(LCAppCatalog *catalog, const char *path);
+void LCAppCatalogClose(LCAppCatalog *catalog);
+// Entries are sorted by bundle name and point into the mapping, they are good until LCAppCatalogClose.
+// Both return false for an entry that doesn't fit the file.
+bool LCAppCatalogGet(const LCAppCatalog *catalog, size_t index, LCAppCatalogEntry *entry);
+bool LCAppCatalogFind(const LCAppCatalog *catalog, const char *bundleName, LCAppCatalogEntry *entry);
+
+void LCAppCatalogStampFile(const char *path, LCAppCatalogStamp *stamp);
+// Two stats, the entry describes the bundle at bundlePath as long as neither plist was replaced since
+bool LCAppCatalogIsCurrent(const LCAppCatalogEntry *entry, const char *bundlePath);
+
+// Replaces the catalog at path with entries, which must have distinct bundle names. Returns 0 or -1 with errno set.
+int LCAppCatalogWrite(const char *path, const LCAppCatalogEntry *entries, size_t count);
+// Rewrites the catalog at path with entry added or replaced and the entry of removedBundleName dropped, either can be
+// NULL. A missing or damaged catalog is started over. Returns 0 or -1 with errno set.
+int LCAppCatalogUpdate(const char *path, const LCAppCatalogEntry *entry, const char *removedBundleName);
@@ -52,6 +52,9 @@ typedef NS_ENUM(NSInteger, LCOrientationLock){
 - (NSString*)version;
 - (NSMutableArray<NSString *>*)urlSchemes;
 - (instancetype)initWithBundlePath:(NSString*)bundlePath;
+// Every bundle in folder, from the app catalog where it is still current
++ (NSArray<LCAppInfo*>*)appInfosInFolder:(NSString*)folder;
+- (void)removeFromCatalog;
 - (UIImage *)generateLiveContainerWrappedIconWithStyle:(GeneratedIconStyle)style;
 - (NSDictionary *)generateWebClipConfigWithContainerId:(NSString*)containerId iconStyle:(GeneratedIconStyle)style;
 - (void)save;
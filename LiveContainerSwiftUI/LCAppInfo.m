@@ -5,11 +5,19 @@
 #import <UIKit/UIKit.h>
 #import "LCAppInfo.h"
 #import "LCUtils.h"
+#import "LCAppCatalog.h"
+#import "LCCopy.h"
+#import "LCPageHash.h"
+#import "LCZip.h"
 #import "../LiveContainer/LCSharedUtils.h"
 
 uint32_t dyld_get_sdk_version(const struct mach_header* mh);
 
-@interface LCAppInfo()
+@interface LCAppInfo() {
+    // _infoPlist only has what the app catalog keeps until loadInfoPlist
+    bool _infoPlistPartial;
+    uint64_t _iconKey;
+}
 @property UIImage* cachedIcon;
 @property UIImage* cachedIconDark;
 @end
@@ -76,6 +84,153 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
     return self;
 }
 
+- (instancetype)initWithBundlePath:(NSString*)bundlePath catalogEntry:(const LCAppCatalogEntry*)entry {
+    self = [super init];
+    self.isShared = false;
+    if(self) {
+        _bundlePath = bundlePath;
+        NSData* infoData = [NSData dataWithBytes:entry->fields[LCAppCatalogFieldAppInfo] length:entry->fieldLengths[LCAppCatalogFieldAppInfo]];
+        _info = [NSPropertyListSerialization propertyListWithData:infoData options:NSPropertyListMutableContainers format:nil error:nil];
+        if(![_info isKindOfClass:NSMutableDictionary.class]) {
+            return nil;
+        }
+        
+        NSString* (^field)(LCAppCatalogField) = ^NSString*(LCAppCatalogField f) {
+            if(entry->fieldLengths[f] == 0) {
+                return nil;
+            }
+            return [[NSString alloc] initWithBytes:entry->fields[f] length:entry->fieldLengths[f] encoding:NSUTF8StringEncoding];
+        };
+        _infoPlist = [[NSMutableDictionary alloc] init];
+        _infoPlist[@"CFBundleDisplayName"] = field(LCAppCatalogFieldDisplayName);
+        _infoPlist[@"CFBundleIdentifier"] = field(LCAppCatalogFieldBundleIdentifier);
+        _infoPlist[@"CFBundleShortVersionString"] = field(LCAppCatalogFieldVersion);
+        _infoPlist[@"CFBundleExecutable"] = field(LCAppCatalogFieldExecutable);
+        NSString* urlSchemes = field(LCAppCatalogFieldURLSchemes);
+        if(urlSchemes) {
+            _infoPlist[@"CFBundleURLTypes"] = @[@{@"CFBundleURLSchemes": [urlSchemes componentsSeparatedByString:@"\n"]}];
+        }
+        _infoPlistPartial = true;
+        _iconKey = entry->iconKey;
+        _autoSaveDisabled = false;
+    }
+    return self;
+}
+
++ (NSArray<LCAppInfo*>*)appInfosInFolder:(NSString*)folder {
+    NSString* catalogPath = [folder stringByAppendingPathComponent:@LC_APP_CATALOG_NAME];
+    LCAppCatalog catalog;
+    if(LCAppCatalogOpen(&catalog, catalogPath.fileSystemRepresentation) != 0) {
+        memset(&catalog, 0, sizeof(catalog));
+    }
+    
+    NSArray<NSString*>* names = [NSFileManager.defaultManager contentsOfDirectoryAtPath:folder error:nil];
+    NSMutableArray<LCAppInfo*>* apps = [[NSMutableArray alloc] init];
+    NSMutableData* entries = [[NSMutableData alloc] init];
+    NSMutableArray* entryStorage = [[NSMutableArray alloc] init];
+    bool changed = false;
+    for(NSString* name in names) {
+        if(![name hasSuffix:@".app"]) {
+            continue;
+        }
+        NSString* bundlePath = [folder stringByAppendingPathComponent:name];
+        LCAppCatalogEntry entry;
+        LCAppInfo* app = nil;
+        if(LCAppCatalogFind(&catalog, name.fileSystemRepresentation, &entry) && LCAppCatalogIsCurrent(&entry, bundlePath.fileSystemRepresentation)) {
+            app = [[LCAppInfo alloc] initWithBundlePath:bundlePath catalogEntry:&entry];
+        }
+        if(!app) {
+            // new, changed outside LiveContainer or never cataloged
+            app = [[LCAppInfo alloc] initWithBundlePath:bundlePath];
+            NSArray* storage = [app fillCatalogEntry:&entry];
+            if(!storage) {
+                continue;
+            }
+            [entryStorage addObject:storage];
+            changed = true;
+        }
+        app.relativeBundlePath = name;
+        [apps addObject:app];
+        [entries appendBytes:&entry length:sizeof(entry)];
+    }
+    
+    size_t count = entries.length / sizeof(LCAppCatalogEntry);
+    if(changed || count != catalog.count) {
+        if(LCAppCatalogWrite(catalogPath.fileSystemRepresentation, entries.bytes, count) != 0) {
+            NSLog(@"[LC] failed to write app catalog %@: %s", catalogPath, strerror(errno));
+        }
+    }
+    LCAppCatalogClose(&catalog);
+    return apps;
+}
+
+// the returned objects back the pointers in entry, nil if the bundle doesn't have a usable folder name
+- (NSArray*)fillCatalogEntry:(LCAppCatalogEntry*)entry {
+    NSString* bundleName = _bundlePath.lastPathComponent;
+    NSData* appInfo = [NSPropertyListSerialization dataWithPropertyList:_info format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+    if(bundleName.length == 0 || !appInfo) {
+        return nil;
+    }
+    memset(entry, 0, sizeof(*entry));
+    NSMutableArray* storage = [[NSMutableArray alloc] init];
+    NSData* name = [NSData dataWithBytes:bundleName.fileSystemRepresentation length:strlen(bundleName.fileSystemRepresentation) + 1];
+    [storage addObject:name];
+    entry->bundleName = name.bytes;
+    void (^setField)(LCAppCatalogField, NSData*) = ^(LCAppCatalogField field, NSData* data) {
+        if(!data) {
+            return;
+        }
+        [storage addObject:data];
+        entry->fields[field] = data.bytes;
+        entry->fieldLengths[field] = (uint32_t)data.length;
+    };
+    NSString* displayName = _infoPlist[@"CFBundleDisplayName"] ?: _infoPlist[@"CFBundleName"] ?: _infoPlist[@"CFBundleExecutable"];
+    NSString* version = _infoPlist[@"CFBundleShortVersionString"] ?: _infoPlist[@"CFBundleVersion"];
+    setField(LCAppCatalogFieldDisplayName, [displayName dataUsingEncoding:NSUTF8StringEncoding]);
+    setField(LCAppCatalogFieldBundleIdentifier, [_infoPlist[@"CFBundleIdentifier"] dataUsingEncoding:NSUTF8StringEncoding]);
+    setField(LCAppCatalogFieldVersion, [version dataUsingEncoding:NSUTF8StringEncoding]);
+    setField(LCAppCatalogFieldExecutable, [_infoPlist[@"CFBundleExecutable"] dataUsingEncoding:NSUTF8StringEncoding]);
+    NSArray* urlSchemes = [self urlSchemes];
+    if(urlSchemes.count > 0) {
+        setField(LCAppCatalogFieldURLSchemes, [[urlSchemes componentsJoinedByString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]);
+    }
+    setField(LCAppCatalogFieldAppInfo, appInfo);
+    
+    LCAppCatalogStampFile([_bundlePath stringByAppendingPathComponent:@"Info.plist"].fileSystemRepresentation, &entry->infoPlist);
+    LCAppCatalogStampFile([_bundlePath stringByAppendingPathComponent:@"LCAppInfo.plist"].fileSystemRepresentation, &entry->appInfo);
+    LCAppCatalogStamp icon;
+    LCAppCatalogStampFile([_bundlePath stringByAppendingPathComponent:@"LCAppIconLight.png"].fileSystemRepresentation, &icon);
+    entry->iconKey = (uint64_t)icon.mtime;
+    return storage;
+}
+
+- (void)updateCatalog {
+    LCAppCatalogEntry entry;
+    NSArray* storage = [self fillCatalogEntry:&entry];
+    if(!storage) {
+        return;
+    }
+    NSString* catalogPath = [_bundlePath.stringByDeletingLastPathComponent stringByAppendingPathComponent:@LC_APP_CATALOG_NAME];
+    LCAppCatalogUpdate(catalogPath.fileSystemRepresentation, &entry, NULL);
+}
+
+- (void)removeFromCatalog {
+    NSString* catalogPath = [_bundlePath.stringByDeletingLastPathComponent stringByAppendingPathComponent:@LC_APP_CATALOG_NAME];
+    LCAppCatalogUpdate(catalogPath.fileSystemRepresentation, NULL, _bundlePath.lastPathComponent.fileSystemRepresentation);
+}
+
+// everything that writes Info.plist back needs all of it
+- (void)loadInfoPlist {
+    if(!_infoPlistPartial) {
+        return;
+    }
+    NSMutableDictionary* infoPlist = [NSMutableDictionary dictionaryWithContentsOfFile:[NSString stringWithFormat:@"%@/Info.plist", _bundlePath]];
+    if(infoPlist) {
+        _infoPlist = infoPlist;
+    }
+    _infoPlistPartial = false;
+}
+
 - (void)setBundlePath:(NSString*)newBundlePath {
     _bundlePath = newBundlePath;
 }
@@ -199,7 +354,8 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
     }
     NSURL* cachedIconUrl = [NSURL fileURLWithPath:cachedIconPath];
     
-    if([NSFileManager.defaultManager fileExistsAtPath:cachedIconPath]) {
+    // the catalog saw the light icon already, no need to look for it first
+    if((!isDarkIcon && _iconKey) || [NSFileManager.defaultManager fileExistsAtPath:cachedIconPath]) {
         CGImageRef imageRef = loadCGImageFromURL(cachedIconUrl);
         uiIcon = [UIImage imageWithCGImage:imageRef];
     }
@@ -230,6 +386,7 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
     [self setCachedColorDark:nil];
     _cachedIcon = nil;
     _cachedIconDark = nil;
+    _iconKey = 0;
 }
 
 - (UIImage *)generateLiveContainerWrappedIconWithStyle:(GeneratedIconStyle)style {
@@ -295,12 +452,15 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
 - (void)save {
     if(!_autoSaveDisabled) {
         [_info writeBinToFile:[NSString stringWithFormat:@"%@/LCAppInfo.plist", _bundlePath] atomically:YES];
+        [self updateCatalog];
+        [LCSharedUtils writeLaunchManifestForBundlePath:_bundlePath appInfo:_info bundleIdentifier:_infoPlist[@"CFBundleIdentifier"] executable:_infoPlist[@"CFBundleExecutable"]];
     }
 
 }
 
 - (void)patchExecAndSignIfNeedWithCompletionHandler:(void(^)(bool success, NSString* errorInfo))completetionHandler progressHandler:(void(^)(NSProgress* progress))progressHandler forceSign:(BOOL)forceSign {
     [NSUserDefaults.standardUserDefaults setObject:@(YES) forKey:@"SigningInProgress"];
+    [self loadInfoPlist];
     NSString *appPath = self.bundlePath;
     NSString *infoPath = [NSString stringWithFormat:@"%@/Info.plist", appPath];
     NSMutableDictionary *info = _info;
@@ -316,44 +476,79 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
     // Update patch
     int currentPatchRev = 7;
     bool needPatch = [info[@"LCPatchRevision"] intValue] < currentPatchRev;
+    // copy-patch-rename to avoid EXC_BAD_ACCESS (SIGKILL - CODESIGNING)
+    // the copy (a clone where possible, never a hard link) gets a fresh inode and is patched in a single mapping before it replaces the original
+    NSString *backupPath = [NSString stringWithFormat:@"%@/%@_LiveContainerPatchBackUp", appPath, _infoPlist[@"CFBundleExecutable"]];
     if (needPatch || forceSign) {
-        // copy-delete-move to avoid EXC_BAD_ACCESS (SIGKILL - CODESIGNING)
-        NSString *backupPath = [NSString stringWithFormat:@"%@/%@_LiveContainerPatchBackUp", appPath, _infoPlist[@"CFBundleExecutable"]];
-        NSError *err;
-        [fm copyItemAtPath:execPath toPath:backupPath error:&err];
-        [fm removeItemAtPath:execPath error:&err];
-        [fm moveItemAtPath:backupPath toPath:execPath error:&err];
+        [fm removeItemAtPath:backupPath error:nil];
+        if (LCCopyFile(execPath.fileSystemRepresentation, backupPath.fileSystemRepresentation, 0, NULL) != 0) {
+            NSString *error = [NSString stringWithFormat:@"Failed to copy %@: %s", execPath.lastPathComponent, strerror(errno)];
+            [fm removeItemAtPath:backupPath error:nil];
+            [NSUserDefaults.standardUserDefaults removeObjectForKey:@"SigningInProgress"];
+            completetionHandler(NO, error);
+            return;
+        }
     }
     
     bool is32bit = false;
     if (needPatch) {
         __block bool has64bitSlice = NO;
         __block bool isEncrypted = false;
-        NSString *error = LCParseMachO(execPath.UTF8String, false, ^(const char *path, struct mach_header_64 *header, int fd, void* filePtr) {
+        __block bool isMalformed = false;
+        NSString *error = LCParseMachO(backupPath.UTF8String, false, ^(const char *path, struct mach_header_64 *header, int fd, void* filePtr) {
+            macho_view view;
+            if(!macho_view_init(&view, header, 0)) {
+                isMalformed = true;
+                return;
+            }
+            isEncrypted |= macho_view_is_encrypted(&view);
             if(header->cputype == CPU_TYPE_ARM64) {
                 has64bitSlice |= YES;
-                int patchResult = LCPatchExecSlice(path, header, ![self dontInjectTweakLoader]);
+                int patchResult = LCPatchExecSliceWithView(execPath.fileSystemRepresentation, &view, ![self dontInjectTweakLoader]);
                 if(patchResult & PATCH_EXEC_RESULT_NO_SPACE_FOR_TWEAKLOADER) {
                     info[@"LCTweakLoaderCantInject"] = @YES;
                     info[@"dontInjectTweakLoader"] = @YES;
                 }
             }
-            isEncrypted |= LCIsMachOEncrypted(header);
+            LCPatchMappedFixupARM64eSlice(filePtr);
         });
         is32bit = !has64bitSlice;
-        LCPatchAppBundleFixupARM64eSlice([NSURL fileURLWithPath:appPath]);
-        if (isEncrypted) {
+        if (isMalformed) {
+            error = @"The app's executable has malformed load commands.";
+        } else if (isEncrypted) {
             error = @"The app you tried to install is encrypted. Please provide decrypted app.";
         }
         if (error) {
+            [fm removeItemAtPath:backupPath error:nil];
+            [NSUserDefaults.standardUserDefaults removeObjectForKey:@"SigningInProgress"];
+            completetionHandler(NO, error);
+            return;
+        }
+        if (rename(backupPath.fileSystemRepresentation, execPath.fileSystemRepresentation) != 0) {
+            error = [NSString stringWithFormat:@"Failed to replace %@: %s", execPath.lastPathComponent, strerror(errno)];
+            [fm removeItemAtPath:backupPath error:nil];
             [NSUserDefaults.standardUserDefaults removeObjectForKey:@"SigningInProgress"];
             completetionHandler(NO, error);
             return;
         }
+        LCPatchAppBundleFixupARM64eSlice([NSURL fileURLWithPath:appPath]);
         info[@"LCPatchRevision"] = @(currentPatchRev);
         forceSign = true;
         
         [self save];
+    } else if (forceSign) {
+        if (rename(backupPath.fileSystemRepresentation, execPath.fileSystemRepresentation) != 0) {
+            NSString *error = [NSString stringWithFormat:@"Failed to replace %@: %s", execPath.lastPathComponent, strerror(errno)];
+            [fm removeItemAtPath:backupPath error:nil];
+            [NSUserDefaults.standardUserDefaults removeObjectForKey:@"SigningInProgress"];
+            completetionHandler(NO, error);
+            return;
+        }
+    }
+    // code page hashes from the install are only good for a forced sign
+    NSString *codeSlotsPath = [appPath stringByAppendingPathComponent:@LC_CODE_SLOTS_FOLDER];
+    if (!LCSharedUtils.certificatePassword || is32bit || self.dontSign || !forceSign) {
+        [fm removeItemAtPath:codeSlotsPath error:nil];
     }
 #if !is32BitSupported
     if(is32bit) {
@@ -365,6 +560,8 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
 #endif
 
     if (!LCSharedUtils.certificatePassword || is32bit || self.dontSign) {
+        // the next update may reuse the executable as patched here
+        LCZipStampManifest(appPath.fileSystemRepresentation);
         [NSUserDefaults.standardUserDefaults removeObjectForKey:@"SigningInProgress"];
         completetionHandler(YES, nil);
         return;
@@ -403,7 +600,13 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
             NSString *tmpExecPath = [appPath stringByAppendingPathComponent:@"LiveContainer.tmp"];
             if (!info[@"LCBundleIdentifier"]) {
                 // Don't let main executable get entitlements
-                [fm copyItemAtPath:NSBundle.mainBundle.executablePath toPath:tmpExecPath error:nil];
+                if (LCCopyFile(NSBundle.mainBundle.executablePath.fileSystemRepresentation, tmpExecPath.fileSystemRepresentation, 0, NULL) != 0) {
+                    NSString *error = [NSString stringWithFormat:@"Failed to copy %@: %s", tmpExecPath.lastPathComponent, strerror(errno)];
+                    [fm removeItemAtPath:tmpExecPath error:nil];
+                    [NSUserDefaults.standardUserDefaults removeObjectForKey:@"SigningInProgress"];
+                    completetionHandler(NO, error);
+                    return;
+                }
 
                 infoPlist[@"LCBundleExecutable"] = infoPlist[@"CFBundleExecutable"];
                 infoPlist[@"LCBundleIdentifier"] = infoPlist[@"CFBundleIdentifier"];
@@ -422,13 +625,16 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
                     // Remove fake main executable
                     [fm removeItemAtPath:tmpExecPath error:nil];
                     
-                    // Save sign ID and restore bundle ID
-                    [self save];
+                    // Restore bundle ID and save sign ID, Info.plist goes first so the catalog entry save writes
+                    // stamps the restored file rather than the faked one
                     [infoPlist writeBinToFile:infoPath atomically:YES];
+                    [self save];
                     [NSUserDefaults.standardUserDefaults removeObjectForKey:@"SigningInProgress"];
                     if(!success) {
                         completetionHandler(NO, error.localizedDescription);
                     } else {
+                        // the next update may reuse the Mach-Os as signed here, a failed sign leaves them unrecorded
+                        LCZipStampManifest(appPath.fileSystemRepresentation);
                         bool signatureValid = checkCodeSignature(executablePath.UTF8String);
                         if(signatureValid) {
                             completetionHandler(YES, [error localizedDescription]);
@@ -550,6 +756,7 @@ uint32_t dyld_get_sdk_version(const struct mach_header* mh);
     }
 }
 - (void)setDoUseLCBundleId:(bool)doUseLCBundleId {
+    [self loadInfoPlist];
     _info[@"doUseLCBundleId"] = [NSNumber numberWithBool:doUseLCBundleId];
     NSString *infoPath = [NSString stringWithFormat:@"%@/Info.plist", self.bundlePath];
     if(doUseLCBundleId) {
@@ -592,8 +592,8 @@ struct LCAppListView : View, LCAppBannerDelegate, LCAppModelDelegate {
         }
     }
     
-    nonisolated func decompress(_ path: String, _ destination: String ,_ progress: Progress) async -> Int32 {
-        extract(path, destination, progress)
+    nonisolated func decompress(_ path: String, _ destination: String ,_ progress: Progress, hashCodePages: Bool, installedBundlePath: String? = nil) async -> Int32 {
+        extract(path, destination, progress, hashCodePages, installedBundlePath)
     }
     
     func installIpaFile(_ url:URL) async throws {
@@ -613,9 +613,14 @@ struct LCAppListView : View, LCAppBannerDelegate, LCAppModelDelegate {
             try fm.removeItem(at: payloadPath)
         }
         
-        // decompress
-        guard await decompress(url.path, fm.temporaryDirectory.path, decompressProgress) == 0 else {
-            throw "lc.appList.urlFileIsNotIpaError".loc
+        // decompress, hashing the code pages on the way if the app is going to be signed. Zips only need their Info.plist
+        // to pick the app to replace, so they are extracted after that and an update can keep the files that didn't change
+        let hashCodePages = LCSharedUtils.certificatePassword() != nil && !LCUtils.appGroupUserDefault.bool(forKey: "LCDontSignApp")
+        let extractLater = extractInfoPlist(url.path, fm.temporaryDirectory.path)
+        if !extractLater {
+            guard await decompress(url.path, fm.temporaryDirectory.path, decompressProgress, hashCodePages: hashCodePages) == 0 else {
+                throw "lc.appList.urlFileIsNotIpaError".loc
+            }
         }
 
         let payloadContents = try fm.contentsOfDirectory(atPath: payloadPath.path)
@@ -639,6 +644,7 @@ struct LCAppListView : View, LCAppBannerDelegate, LCAppModelDelegate {
         var appRelativePath = "\(newAppInfo.bundleIdentifier()!.sanitizeNonACSII()).app"
         var outputFolder = LCPath.bundlePath.appendingPathComponent(appRelativePath)
         var appToReplace : LCAppModel? = nil
+        var isReplace = false
         // Folder exist! show alert for user to choose which bundle to replace
         var sameBundleIdApp = sharedModel.apps.filter { app in
             return app.appInfo.bundleIdentifier()! == newAppInfo.bundleIdentifier()
@@ -688,10 +694,18 @@ struct LCAppListView : View, LCAppBannerDelegate, LCAppModelDelegate {
             }
             appRelativePath = installOptionChosen.nameOfFolderToInstall
             appToReplace = installOptionChosen.appToReplace
-            if installOptionChosen.isReplace {
-                try fm.removeItem(at: outputFolder)
+            isReplace = installOptionChosen.isReplace
+        }
+        if extractLater {
+            try fm.removeItem(at: payloadPath)
+            guard await decompress(url.path, fm.temporaryDirectory.path, decompressProgress, hashCodePages: hashCodePages, installedBundlePath: isReplace ? outputFolder.path : nil) == 0 else {
+                throw "lc.appList.urlFileIsNotIpaError".loc
             }
         }
+        if isReplace {
+            LCUtils.releaseBundleFiles(bundlePath: outputFolder.path)
+            try fm.removeItem(at: outputFolder)
+        }
         // Move it!
         try fm.moveItem(at: appFolderPath, to: outputFolder)
         let finalNewApp = LCAppInfo(bundlePath: outputFolder.path)
@@ -729,6 +743,9 @@ struct LCAppListView : View, LCAppBannerDelegate, LCAppModelDelegate {
             errorShow = true
         }
         
+        // after signing, so apps signed alike share their frameworks too
+        await LCUtils.shareBundleFiles(bundlePath: outputFolder.path)
+        
         if let appToReplace {
             // copy previous configration to new app
             finalNewApp.autoSaveDisabled = true
@@ -583,6 +583,8 @@ struct LCAppSettingsView: View {
         do {
             try LCPath.ensureAppGroupPaths()
             let fm = FileManager()
+            appInfo.removeFromCatalog()
+            LCUtils.releaseBundleFiles(bundlePath: appInfo.bundlePath())
             try fm.moveItem(atPath: appInfo.bundlePath(), toPath: LCPath.lcGroupBundlePath.appendingPathComponent(appInfo.relativeBundlePath).path)
             for container in model.uiContainers {
                 if container.storageBookMark != nil {
@@ -603,6 +605,8 @@ struct LCAppSettingsView: View {
                 })
             }
             appInfo.setBundlePath(LCPath.lcGroupBundlePath.appendingPathComponent(appInfo.relativeBundlePath).path)
+            appInfo.save()
+            await LCUtils.shareBundleFiles(bundlePath: appInfo.bundlePath())
             appInfo.isShared = true
             model.uiIsShared = true
             for container in model.uiContainers {
@@ -630,6 +634,8 @@ struct LCAppSettingsView: View {
         
         do {
             let fm = FileManager()
+            appInfo.removeFromCatalog()
+            LCUtils.releaseBundleFiles(bundlePath: appInfo.bundlePath())
             try fm.moveItem(atPath: appInfo.bundlePath(), toPath: LCPath.bundlePath.appendingPathComponent(appInfo.relativeBundlePath).path)
             for container in model.uiContainers {
                 if container.storageBookMark != nil {
@@ -646,6 +652,8 @@ struct LCAppSettingsView: View {
                 model.uiTweakFolder = tweakFolder
             }
             appInfo.setBundlePath(LCPath.bundlePath.appendingPathComponent(appInfo.relativeBundlePath).path)
+            appInfo.save()
+            await LCUtils.shareBundleFiles(bundlePath: appInfo.bundlePath())
             appInfo.isShared = false
             model.uiIsShared = false
             for container in model.uiContainers {
@@ -0,0 +1,964 @@
+#include "LCBlobStore.h"
+#include "LCCopy.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <CommonCrypto/CommonDigest.h>
+#else
+#include <openssl/sha.h>
+#define CC_LONG size_t
+#define CC_SHA256_CTX SHA256_CTX
+#define CC_SHA256_Init SHA256_Init
+#define CC_SHA256_Update SHA256_Update
+#define CC_SHA256_Final SHA256_Final
+#endif
+
+#define LCB_HASH_SIZE 32
+#define LCB_HEX_SIZE (LCB_HASH_SIZE * 2)
+#define LCB_INDEX_MAGIC 0x4942434c          // "LCBI"
+#define LCB_INDEX_VERSION 1
+#define LCB_REFS_HEADER "LCBlobRefs 1"
+#define LCB_BUFFER_SIZE (1 << 20)
+#define LCB_MAX_THREADS 64
+
+#ifdef __APPLE__
+#define LCB_MTIME(st) ((st).st_mtimespec)
+#else
+#define LCB_MTIME(st) ((st).st_mtim)
+#endif
+
+// One blob, the index file is a header and these sorted by hash
+typedef struct LCBRecord {
+    uint8_t hash[LCB_HASH_SIZE];
+    uint64_t size;
+    uint32_t refs;
+    uint32_t reserved;
+} LCBRecord;
+
+typedef struct LCBIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+} LCBIndexHeader;
+
+typedef struct LCBIndex {
+    LCBRecord *records;
+    size_t count;
+    size_t capacity;
+} LCBIndex;
+
+// One line of a bundle's refs list
+typedef struct LCBRef {
+    uint8_t hash[LCB_HASH_SIZE];
+    uint64_t size;
+    int64_t mtime;              // of the bundle's file once it was shared, a changed file no longer holds the blob
+    char *path;                 // relative to the bundle
+    bool dropped;
+} LCBRef;
+
+typedef struct LCBRefList {
+    LCBRef *refs;
+    size_t count;
+    size_t capacity;
+} LCBRefList;
+
+typedef struct LCBFile {
+    char *path;                 // relative to the bundle
+    uint64_t size;
+    mode_t mode;
+    struct timespec mtime;
+    uint8_t hash[LCB_HASH_SIZE];
+} LCBFile;
+
+// Files of a bundle to share, hashed by every worker of one LCBlobStoreAdd call
+typedef struct LCBHashJob {
+    const char *bundle;
+    LCBFile *files;             // largest first once the walk is done, so the long hashes start early
+    size_t fileCount;
+    size_t fileCapacity;
+    size_t next;
+    int error;                  // first errno, 0 while everything goes well
+} LCBHashJob;
+
+static void toHex(char hex[LCB_HEX_SIZE + 1], const uint8_t hash[LCB_HASH_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < LCB_HASH_SIZE; i++) {
+        hex[i * 2] = digits[hash[i] >> 4];
+        hex[i * 2 + 1] = digits[hash[i] & 0xf];
+    }
+    hex[LCB_HEX_SIZE] = '\0';
+}
+
+static int hexValue(char c) {
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static bool fromHex(uint8_t hash[LCB_HASH_SIZE], const char *hex) {
+    for (int i = 0; i < LCB_HASH_SIZE; i++) {
+        int high = hexValue(hex[i * 2]), low = high < 0 ? -1 : hexValue(hex[i * 2 + 1]);
+        if (low < 0) {
+            return false;
+        }
+        hash[i] = (uint8_t)(high << 4 | low);
+    }
+    return true;
+}
+
+static bool joinPath(char path[PATH_MAX], const char *folder, const char *name) {
+    int length = snprintf(path, PATH_MAX, "%s/%s", folder, name);
+    if (length < 0 || length >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    return true;
+}
+
+// objects/<first byte>/<hash>, creating the fan-out folder if asked to
+static bool objectPath(char path[PATH_MAX], const char *store, const uint8_t hash[LCB_HASH_SIZE], bool create) {
+    char hex[LCB_HEX_SIZE + 1];
+    toHex(hex, hash);
+    int length = snprintf(path, PATH_MAX, "%s/objects/%.2s", store, hex);
+    if (length < 0 || length + LCB_HEX_SIZE + 2 > PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    if (create && mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    snprintf(path + length, PATH_MAX - length, "/%s", hex);
+    return true;
+}
+
+static bool hashFile(const char *path, uint8_t hash[LCB_HASH_SIZE], uint8_t *buffer) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init(&ctx);
+    ssize_t n;
+    while ((n = read(fd, buffer, LCB_BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        CC_SHA256_Update(&ctx, buffer, (CC_LONG)n);
+    }
+    close(fd);
+    CC_SHA256_Final(hash, &ctx);
+    return true;
+}
+
+// Creates the store on first use and takes its lock, the returned descriptor is closed to unlock
+static int lockStore(const char *store) {
+    char path[PATH_MAX];
+    if (mkdir(store, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    if (!joinPath(path, store, "objects") || (mkdir(path, 0755) != 0 && errno != EEXIST)) {
+        return -1;
+    }
+    if (!joinPath(path, store, "tmp") || (mkdir(path, 0755) != 0 && errno != EEXIST)) {
+        return -1;
+    }
+    if (!joinPath(path, store, "lock")) {
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// A missing or damaged index loads empty, LCBlobStoreCheck rebuilds it from the refs lists
+static void loadIndex(const char *store, LCBIndex *index) {
+    memset(index, 0, sizeof(*index));
+    char path[PATH_MAX];
+    if (!joinPath(path, store, "index")) {
+        return;
+    }
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return;
+    }
+    LCBIndexHeader header;
+    if (fread(&header, sizeof(header), 1, fp) == 1 && header.magic == LCB_INDEX_MAGIC && header.version == LCB_INDEX_VERSION &&
+        header.count < SIZE_MAX / sizeof(LCBRecord)) {
+        index->records = malloc(header.count ? header.count * sizeof(LCBRecord) : 1);
+        if (index->records && fread(index->records, sizeof(LCBRecord), header.count, fp) == header.count) {
+            index->count = index->capacity = header.count;
+        } else {
+            free(index->records);
+            index->records = NULL;
+        }
+    }
+    fclose(fp);
+}
+
+static bool saveIndex(const char *store, const LCBIndex *index) {
+    char path[PATH_MAX], tmpPath[PATH_MAX];
+    if (!joinPath(path, store, "index") || !joinPath(tmpPath, store, "tmp/index")) {
+        return false;
+    }
+    FILE *fp = fopen(tmpPath, "wb");
+    if (!fp) {
+        return false;
+    }
+    LCBIndexHeader header = {LCB_INDEX_MAGIC, LCB_INDEX_VERSION, index->count};
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(index->records, sizeof(LCBRecord), index->count, fp) == index->count;
+    int error = errno;
+    if (fclose(fp) != 0 && ok) {
+        error = errno;
+        ok = false;
+    }
+    if (!ok || rename(tmpPath, path) != 0) {
+        error = ok ? errno : error;
+        unlink(tmpPath);
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+// Index of the record, or of where it would go with found false
+static size_t findRecord(const LCBIndex *index, const uint8_t hash[LCB_HASH_SIZE], bool *found) {
+    size_t low = 0, high = index->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order = memcmp(index->records[middle].hash, hash, LCB_HASH_SIZE);
+        if (order == 0) {
+            *found = true;
+            return middle;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *found = false;
+    return low;
+}
+
+static bool insertRecord(LCBIndex *index, size_t position, const uint8_t hash[LCB_HASH_SIZE], uint64_t size, uint32_t refs) {
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 256;
+        LCBRecord *records = realloc(index->records, capacity * sizeof(LCBRecord));
+        if (!records) {
+            return false;
+        }
+        index->records = records;
+        index->capacity = capacity;
+    }
+    memmove(index->records + position + 1, index->records + position, (index->count - position) * sizeof(LCBRecord));
+    LCBRecord *record = &index->records[position];
+    memset(record, 0, sizeof(*record));
+    memcpy(record->hash, hash, LCB_HASH_SIZE);
+    record->size = size;
+    record->refs = refs;
+    index->count++;
+    return true;
+}
+
+static void removeRecord(LCBIndex *index, size_t position) {
+    memmove(index->records + position, index->records + position + 1, (index->count - position - 1) * sizeof(LCBRecord));
+    index->count--;
+}
+
+static bool appendRef(LCBRefList *list, const uint8_t hash[LCB_HASH_SIZE], uint64_t size, int64_t mtime, const char *path) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        LCBRef *refs = realloc(list->refs, capacity * sizeof(LCBRef));
+        if (!refs) {
+            return false;
+        }
+        list->refs = refs;
+        list->capacity = capacity;
+    }
+    LCBRef *ref = &list->refs[list->count];
+    memcpy(ref->hash, hash, LCB_HASH_SIZE);
+    ref->size = size;
+    ref->mtime = mtime;
+    ref->dropped = false;
+    ref->path = strdup(path);
+    if (!ref->path) {
+        return false;
+    }
+    list->count++;
+    return true;
+}
+
+static void freeRefs(LCBRefList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->refs[i].path);
+    }
+    free(list->refs);
+    memset(list, 0, sizeof(*list));
+}
+
+// A bundle without a refs list has an empty one, malformed lines are skipped. The list names the inode of the bundle
+// folder it was written for, which moves keep, so a list that came along when someone copied the bundle counts as empty.
+static int readRefs(const char *bundle, LCBRefList *list) {
+    memset(list, 0, sizeof(*list));
+    char path[PATH_MAX];
+    struct stat st;
+    if (!joinPath(path, bundle, LC_BLOB_REFS_NAME) || stat(bundle, &st) != 0) {
+        return -1;
+    }
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    char line[LCB_HEX_SIZE + PATH_MAX + 64];
+    unsigned long long inode;
+    if (!fgets(line, sizeof(line), fp) || sscanf(line, LCB_REFS_HEADER " %llu", &inode) != 1 || inode != (unsigned long long)st.st_ino) {
+        fclose(fp);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        uint8_t hash[LCB_HASH_SIZE];
+        unsigned long long size;
+        long long mtime;
+        int pathOffset = 0;
+        size_t length = strlen(line);
+        if (length == 0 || line[length - 1] != '\n') {
+            continue;
+        }
+        line[length - 1] = '\0';
+        if (!fromHex(hash, line) || sscanf(line + LCB_HEX_SIZE, " %llu %lld %n", &size, &mtime, &pathOffset) != 2 || pathOffset == 0) {
+            continue;
+        }
+        if (!appendRef(list, hash, size, mtime, line + LCB_HEX_SIZE + pathOffset)) {
+            fclose(fp);
+            freeRefs(list);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+// Replaces the refs list with the refs that aren't dropped, or removes it if none are left
+static bool writeRefs(const char *bundle, const LCBRefList *list) {
+    char path[PATH_MAX], tmpPath[PATH_MAX];
+    struct stat st;
+    if (!joinPath(path, bundle, LC_BLOB_REFS_NAME) || !joinPath(tmpPath, bundle, LC_BLOB_REFS_NAME ".tmp") || stat(bundle, &st) != 0) {
+        return false;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        kept += !list->refs[i].dropped;
+    }
+    if (kept == 0) {
+        return unlink(path) == 0 || errno == ENOENT;
+    }
+    FILE *fp = fopen(tmpPath, "w");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fprintf(fp, LCB_REFS_HEADER " %llu\n", (unsigned long long)st.st_ino) > 0;
+    for (size_t i = 0; ok && i < list->count; i++) {
+        const LCBRef *ref = &list->refs[i];
+        char hex[LCB_HEX_SIZE + 1];
+        toHex(hex, ref->hash);
+        ok = ref->dropped || fprintf(fp, "%s %llu %lld %s\n", hex, (unsigned long long)ref->size, (long long)ref->mtime, ref->path) > 0;
+    }
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmpPath, path) != 0) {
+        int error = errno;
+        unlink(tmpPath);
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+// Gives back one reference per ref, removing blobs that drop to zero
+static void releaseRefs(const char *store, LCBIndex *index, const LCBRefList *list, LCBlobStoreStats *stats) {
+    for (size_t i = 0; i < list->count; i++) {
+        bool found;
+        size_t position = findRecord(index, list->refs[i].hash, &found);
+        if (!found) {
+            continue;
+        }
+        if (index->records[position].refs > 1) {
+            index->records[position].refs--;
+            continue;
+        }
+        char path[PATH_MAX];
+        if (objectPath(path, store, list->refs[i].hash, false)) {
+            unlink(path);
+        }
+        removeRecord(index, position);
+        if (stats) {
+            stats->releasedBlobs++;
+        }
+    }
+}
+
+static bool addFile(LCBHashJob *job, const char *path, const struct stat *st) {
+    if (job->fileCount == job->fileCapacity) {
+        size_t capacity = job->fileCapacity ? job->fileCapacity * 2 : 256;
+        LCBFile *files = realloc(job->files, capacity * sizeof(LCBFile));
+        if (!files) {
+            return false;
+        }
+        job->files = files;
+        job->fileCapacity = capacity;
+    }
+    LCBFile *file = &job->files[job->fileCount];
+    file->path = strdup(path);
+    file->size = (uint64_t)st->st_size;
+    file->mode = st->st_mode;
+    file->mtime = LCB_MTIME(*st);
+    if (!file->path) {
+        return false;
+    }
+    job->fileCount++;
+    return true;
+}
+
+// path is a PATH_MAX buffer of which the first rootLength bytes are the bundle. Files LiveContainer keeps next to the
+// app (.LCCodeSlots, manifests, the refs list) are per install and stay out, so do hard links, their other names would
+// keep the old data.
+static bool walkBundle(LCBHashJob *job, char *path, size_t length, size_t rootLength) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        job->error = errno;
+        return false;
+    }
+    bool ok = true;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..") || (length == rootLength && !strncmp(entry->d_name, ".LC", 3)) ||
+            strchr(entry->d_name, '\n')) {
+            continue;
+        }
+        size_t nameLength = strlen(entry->d_name);
+        if (length + nameLength + 2 > PATH_MAX) {
+            job->error = ENAMETOOLONG;
+            ok = false;
+            break;
+        }
+        path[length] = '/';
+        memcpy(path + length + 1, entry->d_name, nameLength + 1);
+
+        struct stat st;
+        if (lstat(path, &st) != 0) {
+            job->error = errno;
+            ok = false;
+        } else if (S_ISDIR(st.st_mode)) {
+            ok = walkBundle(job, path, length + 1 + nameLength, rootLength);
+        } else if (S_ISREG(st.st_mode) && st.st_nlink == 1 && st.st_size >= LC_BLOB_MIN_SIZE && !addFile(job, path + rootLength + 1, &st)) {
+            job->error = ENOMEM;
+            ok = false;
+        }
+        path[length] = '\0';
+    }
+    closedir(dir);
+    return ok;
+}
+
+static void *hashWorker(void *arg) {
+    LCBHashJob *job = arg;
+    uint8_t *buffer = malloc(LCB_BUFFER_SIZE);
+    size_t i;
+    while (buffer && !__atomic_load_n(&job->error, __ATOMIC_RELAXED) && (i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->fileCount) {
+        char path[PATH_MAX];
+        if (!joinPath(path, job->bundle, job->files[i].path) || !hashFile(path, job->files[i].hash, buffer)) {
+            int expected = 0;
+            __atomic_compare_exchange_n(&job->error, &expected, errno ? errno : EIO, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+static int compareFileSizesDescending(const void *a, const void *b) {
+    uint64_t x = ((const LCBFile *)a)->size, y = ((const LCBFile *)b)->size;
+    return x > y ? -1 : x < y;
+}
+
+// Copies source to destination, failing with EOPNOTSUPP where that wouldn't be a clone unless plain copies are allowed
+static bool cloneFile(const char *source, const char *destination, int flags) {
+    LCCopyMethod method;
+    if (LCCopyFile(source, destination, (flags & LC_BLOB_COPY_FALLBACK) ? 0 : LC_COPY_NO_RANGE, &method) != 0) {
+        return false;
+    }
+    if (method != LCCopyMethodClone && !(flags & LC_BLOB_COPY_FALLBACK)) {
+        unlink(destination);
+        errno = EOPNOTSUPP;
+        return false;
+    }
+    return true;
+}
+
+// Replaces the file with a clone of its blob, or makes it the blob if the store doesn't have its content yet.
+// shared is false if the file changed since it was hashed and was left alone.
+static bool shareFile(const char *store, LCBIndex *index, const char *bundle, const LCBFile *file, int flags, unsigned *tmpCounter,
+                      LCBlobStoreStats *stats, bool *shared) {
+    char path[PATH_MAX], object[PATH_MAX];
+    struct stat st;
+    *shared = false;
+    if (!joinPath(path, bundle, file->path) || !objectPath(object, store, file->hash, true)) {
+        return false;
+    }
+    if (lstat(path, &st) != 0 || (uint64_t)st.st_size != file->size || LCB_MTIME(st).tv_sec != file->mtime.tv_sec ||
+        LCB_MTIME(st).tv_nsec != file->mtime.tv_nsec) {
+        return true;
+    }
+
+    bool found;
+    size_t position = findRecord(index, file->hash, &found);
+    if (found && (lstat(object, &st) != 0 || (uint64_t)st.st_size != file->size)) {
+        // lost or damaged since, this file brings the content back
+        unlink(object);
+        removeRecord(index, position);
+        found = false;
+    }
+    if (found) {
+        char tmpPath[PATH_MAX];
+        if (snprintf(tmpPath, sizeof(tmpPath), "%s.lcblob", path) >= (int)sizeof(tmpPath)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        unlink(tmpPath);
+        if (!cloneFile(object, tmpPath, flags)) {
+            return false;
+        }
+        struct timespec times[2] = {file->mtime, file->mtime};
+        if (chmod(tmpPath, file->mode & 07777) != 0 || utimensat(AT_FDCWD, tmpPath, times, 0) != 0 || rename(tmpPath, path) != 0) {
+            int error = errno;
+            unlink(tmpPath);
+            errno = error;
+            return false;
+        }
+        index->records[position].refs++;
+        if (stats) {
+            stats->sharedFiles++;
+            stats->sharedBytes += file->size;
+        }
+    } else {
+        char tmpPath[PATH_MAX];
+        if (snprintf(tmpPath, sizeof(tmpPath), "%s/tmp/%d.%u", store, (int)getpid(), (*tmpCounter)++) >= (int)sizeof(tmpPath)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        unlink(tmpPath);
+        if (!cloneFile(path, tmpPath, flags)) {
+            return false;
+        }
+        // nothing writes a blob after this, bundles only get clones
+        chmod(tmpPath, 0444);
+        if (rename(tmpPath, object) != 0) {
+            int error = errno;
+            unlink(tmpPath);
+            errno = error;
+            return false;
+        }
+        if (!insertRecord(index, position, file->hash, file->size, 1)) {
+            unlink(object);
+            errno = ENOMEM;
+            return false;
+        }
+        if (stats) {
+            stats->newBlobs++;
+        }
+    }
+    *shared = true;
+    return true;
+}
+
+int LCBlobStoreAdd(const char *store, const char *bundle, int threadCount, int flags, LCBlobStoreStats *stats) {
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    char path[PATH_MAX];
+    size_t bundleLength = strlen(bundle);
+    if (bundleLength >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int lockFd = lockStore(store);
+    if (lockFd < 0) {
+        return -1;
+    }
+
+    LCBIndex index;
+    loadIndex(store, &index);
+    LCBRefList refs = {0};
+    LCBHashJob job = {0};
+    job.bundle = bundle;
+    int error = 0;
+    if (readRefs(bundle, &refs) != 0) {
+        error = errno;
+    } else {
+        releaseRefs(store, &index, &refs, stats);
+        freeRefs(&refs);
+        memcpy(path, bundle, bundleLength + 1);
+        walkBundle(&job, path, bundleLength, bundleLength);
+        error = job.error;
+    }
+
+    if (!error) {
+        qsort(job.files, job.fileCount, sizeof(LCBFile), compareFileSizesDescending);
+        if (threadCount <= 0) {
+            threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if ((size_t)threadCount > job.fileCount) {
+            threadCount = job.fileCount ? (int)job.fileCount : 1;
+        }
+        pthread_t threads[LCB_MAX_THREADS];
+        int started = 0;
+        for (; started < threadCount - 1 && started < LCB_MAX_THREADS; started++) {
+            if (pthread_create(&threads[started], NULL, hashWorker, &job) != 0) {
+                break;
+            }
+        }
+        // the calling thread works too, so a failed pthread_create only costs parallelism
+        hashWorker(&job);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        error = job.error ? job.error : (job.next < job.fileCount ? ENOMEM : 0);
+    }
+
+    // the store changes one file at a time, so whatever was shared before an error is recorded
+    unsigned tmpCounter = 0;
+    for (size_t i = 0; !error && i < job.fileCount; i++) {
+        LCBFile *file = &job.files[i];
+        bool shared;
+        if (!shareFile(store, &index, bundle, file, flags, &tmpCounter, stats, &shared)) {
+            error = errno ? errno : EIO;
+        } else if (shared && !appendRef(&refs, file->hash, file->size, (int64_t)file->mtime.tv_sec, file->path)) {
+            error = ENOMEM;
+        }
+    }
+    if (stats) {
+        stats->files = job.fileCount;
+    }
+    if (!writeRefs(bundle, &refs) && !error) {
+        error = errno;
+    }
+    if (!saveIndex(store, &index) && !error) {
+        error = errno;
+    }
+
+    freeRefs(&refs);
+    for (size_t i = 0; i < job.fileCount; i++) {
+        free(job.files[i].path);
+    }
+    free(job.files);
+    free(index.records);
+    close(lockFd);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int LCBlobStoreRelease(const char *store, const char *bundle, LCBlobStoreStats *stats) {
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    LCBRefList refs;
+    if (readRefs(bundle, &refs) != 0) {
+        return -1;
+    }
+    if (refs.count == 0) {
+        char path[PATH_MAX];
+        return !joinPath(path, bundle, LC_BLOB_REFS_NAME) || unlink(path) == 0 || errno == ENOENT ? 0 : -1;
+    }
+    int lockFd = lockStore(store);
+    if (lockFd < 0) {
+        int error = errno;
+        freeRefs(&refs);
+        errno = error;
+        return -1;
+    }
+    LCBIndex index;
+    loadIndex(store, &index);
+    releaseRefs(store, &index, &refs, stats);
+    for (size_t i = 0; i < refs.count; i++) {
+        refs.refs[i].dropped = true;
+    }
+    bool ok = saveIndex(store, &index) && writeRefs(bundle, &refs);
+    int error = errno;
+    freeRefs(&refs);
+    free(index.records);
+    close(lockFd);
+    errno = error;
+    return ok ? 0 : -1;
+}
+
+// What the checker knows about the bundles, every ref with the bundle it came from
+typedef struct LCBBundle {
+    char *path;
+    LCBRefList refs;
+    bool dirty;
+} LCBBundle;
+
+typedef struct LCBRefItem {
+    LCBRef *ref;
+    size_t bundle;
+} LCBRefItem;
+
+static int compareRefItems(const void *a, const void *b) {
+    return memcmp(((const LCBRefItem *)a)->ref->hash, ((const LCBRefItem *)b)->ref->hash, LCB_HASH_SIZE);
+}
+
+// The stored blob is there with the right size, and the right content if verify is set
+static bool isObjectIntact(const char *object, const uint8_t hash[LCB_HASH_SIZE], uint64_t size, bool verify, uint8_t *buffer) {
+    struct stat st;
+    if (lstat(object, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size != size) {
+        return false;
+    }
+    uint8_t actual[LCB_HASH_SIZE];
+    return !verify || (hashFile(object, actual, buffer) && !memcmp(actual, hash, LCB_HASH_SIZE));
+}
+
+// Deletes everything in a folder of the store that keep doesn't want, returning how many files went
+static size_t sweepFolder(const char *folder, bool (*keep)(const char *name, void *context), void *context) {
+    size_t removed = 0;
+    DIR *dir = opendir(folder);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        char path[PATH_MAX];
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..") || (keep && keep(entry->d_name, context)) ||
+            !joinPath(path, folder, entry->d_name)) {
+            continue;
+        }
+        removed += unlink(path) == 0;
+    }
+    closedir(dir);
+    return removed;
+}
+
+typedef struct LCBSweepContext {
+    const LCBIndex *index;
+    const char *fanOut;         // the two hex digits of the folder being swept
+} LCBSweepContext;
+
+static bool isIndexedObject(const char *name, void *context) {
+    LCBSweepContext *sweep = context;
+    uint8_t hash[LCB_HASH_SIZE];
+    bool found;
+    if (strlen(name) != LCB_HEX_SIZE || strncmp(name, sweep->fanOut, 2) != 0 || !fromHex(hash, name)) {
+        return false;
+    }
+    findRecord(sweep->index, hash, &found);
+    return found;
+}
+
+int LCBlobStoreCheck(const char *store, const char *bundleRoot, int flags, LCBlobStoreCheckReport *report) {
+    LCBlobStoreCheckReport result = {0};
+    int lockFd = lockStore(store);
+    if (lockFd < 0) {
+        return -1;
+    }
+    LCBIndex oldIndex, index = {0};
+    loadIndex(store, &oldIndex);
+    LCBBundle *bundles = NULL;
+    size_t bundleCount = 0, bundleCapacity = 0, itemCount = 0;
+    LCBRefItem *items = NULL;
+    uint8_t *buffer = malloc(LCB_BUFFER_SIZE);
+    int error = buffer ? 0 : ENOMEM;
+
+    // collect the refs of every bundle whose file still is what was shared
+    DIR *dir = error ? NULL : opendir(bundleRoot);
+    if (!dir && !error && errno != ENOENT) {
+        error = errno;
+    }
+    struct dirent *entry;
+    while (dir && !error && (entry = readdir(dir))) {
+        size_t nameLength = strlen(entry->d_name);
+        char bundlePath[PATH_MAX];
+        if (nameLength < 5 || strcmp(entry->d_name + nameLength - 4, ".app") != 0 || !joinPath(bundlePath, bundleRoot, entry->d_name)) {
+            continue;
+        }
+        LCBRefList refs;
+        if (readRefs(bundlePath, &refs) != 0 || refs.count == 0) {
+            continue;
+        }
+        if (bundleCount == bundleCapacity) {
+            size_t capacity = bundleCapacity ? bundleCapacity * 2 : 64;
+            LCBBundle *grown = realloc(bundles, capacity * sizeof(LCBBundle));
+            if (!grown) {
+                freeRefs(&refs);
+                error = ENOMEM;
+                break;
+            }
+            bundles = grown;
+            bundleCapacity = capacity;
+        }
+        LCBBundle *bundle = &bundles[bundleCount];
+        bundle->path = strdup(bundlePath);
+        bundle->refs = refs;
+        bundle->dirty = false;
+        if (!bundle->path) {
+            freeRefs(&bundle->refs);
+            error = ENOMEM;
+            break;
+        }
+        bundleCount++;
+        for (size_t i = 0; i < refs.count; i++) {
+            char path[PATH_MAX];
+            struct stat st;
+            LCBRef *ref = &refs.refs[i];
+            if (!joinPath(path, bundlePath, ref->path) || lstat(path, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size != ref->size ||
+                (int64_t)LCB_MTIME(st).tv_sec != ref->mtime) {
+                ref->dropped = true;
+                bundle->dirty = true;
+                result.staleRefs++;
+            } else {
+                itemCount++;
+            }
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    result.bundles = bundleCount;
+
+    if (!error) {
+        items = malloc((itemCount ? itemCount : 1) * sizeof(LCBRefItem));
+        error = items ? 0 : ENOMEM;
+    }
+    if (!error) {
+        size_t count = 0;
+        for (size_t b = 0; b < bundleCount; b++) {
+            for (size_t i = 0; i < bundles[b].refs.count; i++) {
+                if (!bundles[b].refs.refs[i].dropped) {
+                    items[count].ref = &bundles[b].refs.refs[i];
+                    items[count++].bundle = b;
+                }
+            }
+        }
+        qsort(items, itemCount, sizeof(LCBRefItem), compareRefItems);
+    }
+
+    // one blob per distinct hash, counted from the refs, brought back from a bundle if it's gone
+    unsigned tmpCounter = 0;
+    for (size_t start = 0, end; !error && start < itemCount; start = end) {
+        const LCBRef *first = items[start].ref;
+        for (end = start + 1; end < itemCount && !memcmp(items[end].ref->hash, first->hash, LCB_HASH_SIZE); end++) {
+        }
+        char object[PATH_MAX];
+        bool intact = objectPath(object, store, first->hash, true) && isObjectIntact(object, first->hash, first->size, flags & LC_BLOB_VERIFY, buffer);
+        for (size_t i = start; !intact && i < end; i++) {
+            char path[PATH_MAX], tmpPath[PATH_MAX];
+            uint8_t actual[LCB_HASH_SIZE];
+            if (!joinPath(path, bundles[items[i].bundle].path, items[i].ref->path) ||
+                ((flags & LC_BLOB_VERIFY) && (!hashFile(path, actual, buffer) || memcmp(actual, first->hash, LCB_HASH_SIZE))) ||
+                snprintf(tmpPath, sizeof(tmpPath), "%s/tmp/%d.%u", store, (int)getpid(), tmpCounter++) >= (int)sizeof(tmpPath)) {
+                continue;
+            }
+            unlink(tmpPath);
+            if (cloneFile(path, tmpPath, flags)) {
+                chmod(tmpPath, 0444);
+                intact = rename(tmpPath, object) == 0;
+                result.restoredBlobs += intact;
+                if (!intact) {
+                    unlink(tmpPath);
+                }
+            }
+        }
+        if (!intact) {
+            // nothing has the content anymore, so nothing can share it
+            for (size_t i = start; i < end; i++) {
+                items[i].ref->dropped = true;
+                bundles[items[i].bundle].dirty = true;
+                result.staleRefs++;
+            }
+            continue;
+        }
+        bool found;
+        size_t oldPosition = findRecord(&oldIndex, first->hash, &found);
+        if (!found || oldIndex.records[oldPosition].refs != end - start) {
+            result.fixedRefcounts++;
+        }
+        if (!insertRecord(&index, index.count, first->hash, first->size, (uint32_t)(end - start))) {
+            error = ENOMEM;
+        }
+    }
+    for (size_t i = 0; !error && i < oldIndex.count; i++) {
+        bool found;
+        findRecord(&index, oldIndex.records[i].hash, &found);
+        result.fixedRefcounts += !found;
+    }
+
+    if (!error) {
+        char path[PATH_MAX];
+        for (int i = 0; i < 256; i++) {
+            char fanOut[3];
+            snprintf(fanOut, sizeof(fanOut), "%02x", i);
+            LCBSweepContext context = {&index, fanOut};
+            if (snprintf(path, sizeof(path), "%s/objects/%s", store, fanOut) < (int)sizeof(path)) {
+                result.removedBlobs += sweepFolder(path, isIndexedObject, &context);
+            }
+        }
+        // leftovers of adds that didn't finish
+        if (joinPath(path, store, "tmp")) {
+            sweepFolder(path, NULL, NULL);
+        }
+        for (size_t b = 0; b < bundleCount; b++) {
+            if (bundles[b].dirty && !writeRefs(bundles[b].path, &bundles[b].refs) && !error) {
+                error = errno;
+            }
+        }
+        if (!saveIndex(store, &index) && !error) {
+            error = errno;
+        }
+    }
+    result.blobs = index.count;
+
+    for (size_t b = 0; b < bundleCount; b++) {
+        free(bundles[b].path);
+        freeRefs(&bundles[b].refs);
+    }
+    free(bundles);
+    free(items);
+    free(buffer);
+    free(oldIndex.records);
+    free(index.records);
+    close(lockFd);
+    if (report) {
+        *report = result;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+// Content addressed storage shared by the installed apps, kept free of Foundation so it can also run headless on Linux.
+// Files of a bundle that are already in the store are replaced by clones of the stored blob, so identical runtimes and
+// frameworks take their space once. Every blob has a refcount, the number of files added from any bundle that had its
+// content, and each bundle lists what it added in LC_BLOB_REFS_NAME so removing it can give those back.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LC_BLOB_REFS_NAME ".LCBlobRefs"
+// smaller files cost about as much to track as cloning saves
+#define LC_BLOB_MIN_SIZE (16 * 1024)
+
+// Store plain copies where the file system can't clone, for benchmarks. Sharing would take more space than it saves.
+#define LC_BLOB_COPY_FALLBACK 0x1
+// Let the checker rehash every blob and every file it would restore one from
+#define LC_BLOB_VERIFY 0x2
+
+typedef struct LCBlobStoreStats {
+    size_t files;               // files large enough to share that were hashed
+    size_t sharedFiles;         // replaced by a clone of a blob another bundle added first
+    uint64_t sharedBytes;
+    size_t newBlobs;
+    size_t releasedBlobs;       // refcount dropped to zero, removed from the store
+} LCBlobStoreStats;
+
+typedef struct LCBlobStoreCheckReport {
+    size_t bundles;             // bundles with a refs list
+    size_t blobs;               // in the store once the check is done
+    size_t fixedRefcounts;      // blobs whose refcount didn't match the refs lists
+    size_t staleRefs;           // files changed or removed since they were added, no longer counted
+    size_t restoredBlobs;       // indexed but gone, cloned back from a bundle that still has the content
+    size_t removedBlobs;        // unreferenced, corrupt or leftover blobs deleted
+} LCBlobStoreCheckReport;
+
+// Shares the files of bundle through the store at store, created if needed, and records them in the bundle's refs list.
+// Adding a bundle again first releases what it added before. Hashing runs on threadCount threads, 0 uses one per CPU.
+// Returns 0 or -1 with errno set, EOPNOTSUPP if the file system can't clone. What was shared before an error stays
+// recorded. stats is optional.
+int LCBlobStoreAdd(const char *store, const char *bundle, int threadCount, int flags, LCBlobStoreStats *stats);
+// Gives back what bundle added, removing blobs nothing else uses, and deletes its refs list. Call it before removing or
+// moving the bundle out of the folder the store serves. Returns 0 or -1 with errno set, stats is optional.
+int LCBlobStoreRelease(const char *store, const char *bundle, LCBlobStoreStats *stats);
+// Rebuilds the refcounts from the refs lists of the bundles in bundleRoot, drops references to files that changed,
+// restores missing blobs and deletes unreferenced ones. Returns 0 or -1 with errno set, report is optional.
+int LCBlobStoreCheck(const char *store, const char *bundleRoot, int flags, LCBlobStoreCheckReport *report);
@@ -0,0 +1,362 @@
+#ifndef __APPLE__
+#define _GNU_SOURCE     // copy_file_range
+#endif
+#include "LCCopy.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#else
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+
+#define LCC_BUFFER_SIZE (1 << 20)
+#define LCC_MAX_THREADS 64
+
+#ifdef __APPLE__
+#define LCC_MTIME(st) ((st).st_mtimespec)
+#else
+#define LCC_MTIME(st) ((st).st_mtim)
+#endif
+
+static bool writeFully(int fd, const void *buffer, size_t size) {
+    const uint8_t *p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Errors that only mean the method isn't available for this pair of files, so the next one is tried
+static bool isUnsupported(int error) {
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == ENOTTY || error == EBADF;
+}
+
+static int copyBuffered(int in, int out) {
+    uint8_t *buffer = malloc(LCC_BUFFER_SIZE);
+    if (!buffer) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int ret = 0;
+    for (;;) {
+        ssize_t n = read(in, buffer, LCC_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ret = n < 0 ? -1 : 0;
+            break;
+        }
+        if (!writeFully(out, buffer, (size_t)n)) {
+            ret = -1;
+            break;
+        }
+    }
+    free(buffer);
+    return ret;
+}
+
+// Copies the data of in to the empty out, trying the cheaper methods first
+static int copyData(int in, int out, uint64_t size, int flags, LCCopyMethod *method) {
+#ifndef __APPLE__
+    if (!(flags & LC_COPY_NO_CLONE)) {
+        if (ioctl(out, FICLONE, in) == 0) {
+            *method = LCCopyMethodClone;
+            return 0;
+        }
+        if (!isUnsupported(errno)) {
+            return -1;
+        }
+    }
+    if (!(flags & LC_COPY_NO_RANGE)) {
+        uint64_t copied = 0;
+        while (copied < size) {
+            ssize_t n = copy_file_range(in, NULL, out, NULL, (size_t)(size - copied < (1 << 30) ? size - copied : (1 << 30)), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            copied += (uint64_t)n;
+        }
+        if (copied == size) {
+            *method = LCCopyMethodRange;
+            return 0;
+        }
+        // only fall back if nothing went through, otherwise the file changed under us or the disk is full
+        if (copied > 0 || !isUnsupported(errno)) {
+            return -1;
+        }
+    }
+#endif
+    *method = LCCopyMethodBuffer;
+    return copyBuffered(in, out);
+}
+
+int LCCopyFile(const char *source, const char *destination, int flags, LCCopyMethod *method) {
+    LCCopyMethod used = LCCopyMethodClone;
+#ifdef __APPLE__
+    // APFS clones keep mode and times on their own
+    if (!(flags & LC_COPY_NO_CLONE)) {
+        if (clonefile(source, destination, CLONE_NOFOLLOW) == 0) {
+            if (method) {
+                *method = used;
+            }
+            return 0;
+        }
+        if (!isUnsupported(errno) && errno != ENOTSUP) {
+            return -1;
+        }
+    }
+#endif
+
+    int in = open(source, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (in < 0 || fstat(in, &st) != 0) {
+        int error = errno;
+        if (in >= 0) {
+            close(in);
+        }
+        errno = error;
+        return -1;
+    }
+    int out = open(destination, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (out < 0) {
+        int error = errno;
+        close(in);
+        errno = error;
+        return -1;
+    }
+    int ret = copyData(in, out, (uint64_t)st.st_size, flags, &used);
+    if (ret == 0) {
+        struct timespec times[2] = {LCC_MTIME(st), LCC_MTIME(st)};
+        futimens(out, times);
+        fchmod(out, st.st_mode & 07777);
+    }
+    int error = errno;
+    close(in);
+    if (close(out) != 0 && ret == 0) {
+        error = errno;
+        ret = -1;
+    }
+    if (ret != 0) {
+        unlink(destination);
+        errno = error;
+    } else if (method) {
+        *method = used;
+    }
+    return ret;
+}
+
+typedef struct LCCopyFileJob {
+    char *source;
+    char *destination;
+    uint64_t size;
+} LCCopyFileJob;
+
+// Shared by every worker of one LCCopyTree call
+typedef struct LCCopyJob {
+    int flags;              // grows by what the first files showed the file systems can't do
+    LCCopyFileJob *files;   // largest first once the walk is done, so the long copies start early
+    size_t fileCount;
+    size_t fileCapacity;
+    size_t next;
+    int error;              // first errno, 0 while everything goes well
+    size_t counts[LCCopyMethodCount];
+    uint64_t bytes;
+} LCCopyJob;
+
+static void jobFail(LCCopyJob *job, int error) {
+    int expected = 0;
+    __atomic_compare_exchange_n(&job->error, &expected, error ? error : EIO, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static bool addFile(LCCopyJob *job, const char *source, const char *destination, uint64_t size) {
+    if (job->fileCount == job->fileCapacity) {
+        size_t capacity = job->fileCapacity ? job->fileCapacity * 2 : 256;
+        LCCopyFileJob *files = realloc(job->files, capacity * sizeof(LCCopyFileJob));
+        if (!files) {
+            return false;
+        }
+        job->files = files;
+        job->fileCapacity = capacity;
+    }
+    LCCopyFileJob *file = &job->files[job->fileCount];
+    file->source = strdup(source);
+    file->destination = strdup(destination);
+    file->size = size;
+    if (!file->source || !file->destination) {
+        free(file->source);
+        free(file->destination);
+        return false;
+    }
+    job->fileCount++;
+    return true;
+}
+
+// Creates the folders and symlinks right away and queues the files. source and destination are PATH_MAX buffers
+// the names of the children are appended to.
+static bool walkTree(LCCopyJob *job, char *source, size_t sourceLength, char *destination, size_t destinationLength, mode_t mode) {
+    if (mkdir(destination, (mode & 07777) | 0700) != 0) {
+        jobFail(job, errno);
+        return false;
+    }
+    DIR *dir = opendir(source);
+    if (!dir) {
+        jobFail(job, errno);
+        return false;
+    }
+    bool ok = true;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        size_t nameLength = strlen(entry->d_name);
+        if (sourceLength + nameLength + 2 > PATH_MAX || destinationLength + nameLength + 2 > PATH_MAX) {
+            jobFail(job, ENAMETOOLONG);
+            ok = false;
+            break;
+        }
+        source[sourceLength] = destination[destinationLength] = '/';
+        memcpy(source + sourceLength + 1, entry->d_name, nameLength + 1);
+        memcpy(destination + destinationLength + 1, entry->d_name, nameLength + 1);
+
+        struct stat st;
+        if (lstat(source, &st) != 0) {
+            jobFail(job, errno);
+            ok = false;
+        } else if (S_ISDIR(st.st_mode)) {
+            ok = walkTree(job, source, sourceLength + 1 + nameLength, destination, destinationLength + 1 + nameLength, st.st_mode);
+        } else if (S_ISLNK(st.st_mode)) {
+            char target[PATH_MAX];
+            ssize_t length = readlink(source, target, sizeof(target) - 1);
+            if (length < 0 || (target[length] = '\0', symlink(target, destination) != 0)) {
+                jobFail(job, errno);
+                ok = false;
+            }
+        } else if (S_ISREG(st.st_mode) && !addFile(job, source, destination, (uint64_t)st.st_size)) {
+            jobFail(job, ENOMEM);
+            ok = false;
+        }
+        source[sourceLength] = destination[destinationLength] = '\0';
+    }
+    closedir(dir);
+    return ok;
+}
+
+static void *copyWorker(void *arg) {
+    LCCopyJob *job = arg;
+    size_t i;
+    while (!__atomic_load_n(&job->error, __ATOMIC_RELAXED) && (i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->fileCount) {
+        LCCopyFileJob *file = &job->files[i];
+        LCCopyMethod method;
+        if (LCCopyFile(file->source, file->destination, __atomic_load_n(&job->flags, __ATOMIC_RELAXED), &method) != 0) {
+            jobFail(job, errno);
+            break;
+        }
+        // a tree rarely spans file systems, so the rest of the files don't need to try what failed here
+        if (method != LCCopyMethodClone) {
+            __atomic_fetch_or(&job->flags, method == LCCopyMethodRange ? LC_COPY_NO_CLONE : LC_COPY_NO_CLONE | LC_COPY_NO_RANGE, __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&job->counts[method], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&job->bytes, file->size, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static int compareFileSizesDescending(const void *a, const void *b) {
+    uint64_t x = ((const LCCopyFileJob *)a)->size, y = ((const LCCopyFileJob *)b)->size;
+    return x > y ? -1 : x < y;
+}
+
+int LCCopyTree(const char *source, const char *destination, int threadCount, int flags, LCCopyStats *stats) {
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+#ifdef __APPLE__
+    // APFS clones a whole folder in one call
+    if (!(flags & LC_COPY_NO_CLONE) && clonefile(source, destination, CLONE_NOFOLLOW) == 0) {
+        if (stats) {
+            stats->treeCloned = true;
+        }
+        return 0;
+    }
+#endif
+
+    struct stat st;
+    if (stat(source, &st) != 0) {
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+    }
+    char sourcePath[PATH_MAX], destinationPath[PATH_MAX];
+    size_t sourceLength = strlen(source), destinationLength = strlen(destination);
+    if (sourceLength >= PATH_MAX || destinationLength >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(sourcePath, source, sourceLength + 1);
+    memcpy(destinationPath, destination, destinationLength + 1);
+
+    LCCopyJob job = {0};
+    job.flags = flags;
+    if (walkTree(&job, sourcePath, sourceLength, destinationPath, destinationLength, st.st_mode)) {
+        qsort(job.files, job.fileCount, sizeof(LCCopyFileJob), compareFileSizesDescending);
+        if (threadCount <= 0) {
+            threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if ((size_t)threadCount > job.fileCount) {
+            threadCount = job.fileCount ? (int)job.fileCount : 1;
+        }
+        pthread_t threads[LCC_MAX_THREADS];
+        int started = 0;
+        for (; started < threadCount - 1 && started < LCC_MAX_THREADS; started++) {
+            if (pthread_create(&threads[started], NULL, copyWorker, &job) != 0) {
+                break;
+            }
+        }
+        // the calling thread works too, so a failed pthread_create only costs parallelism
+        copyWorker(&job);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (size_t i = 0; i < job.fileCount; i++) {
+        free(job.files[i].source);
+        free(job.files[i].destination);
+    }
+    free(job.files);
+    if (stats) {
+        memcpy(stats->files, job.counts, sizeof(stats->files));
+        stats->bytes = job.bytes;
+    }
+    if (job.error) {
+        errno = job.error;
+        return -1;
+    }
+    return 0;
+}
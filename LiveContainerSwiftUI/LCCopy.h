@@ -0,0 +1,29 @@
+#pragma once
+// File and folder copies that clone where the file system can, kept free of Foundation so it can also run headless on Linux
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// How a file was copied, cheapest first
+typedef enum LCCopyMethod {
+    LCCopyMethodClone,      // clonefile / FICLONE, the data is shared copy-on-write
+    LCCopyMethodRange,      // copy_file_range, the kernel copies without a round trip through user space
+    LCCopyMethodBuffer,     // read/write through a large buffer
+    LCCopyMethodCount
+} LCCopyMethod;
+
+// Leave out the cheaper methods, for benchmarks
+#define LC_COPY_NO_CLONE 0x1
+#define LC_COPY_NO_RANGE 0x2
+
+typedef struct LCCopyStats {
+    bool treeCloned;                    // the whole folder was cloned in one call, nothing below is counted then
+    size_t files[LCCopyMethodCount];
+    uint64_t bytes;
+} LCCopyStats;
+
+// Copies a regular file with its mode and mtime, destination must not exist. Returns 0 or -1 with errno set, method is optional.
+int LCCopyFile(const char *source, const char *destination, int flags, LCCopyMethod *method);
+// Copies a folder with symlinks as symlinks, destination must not exist. Unless the whole tree can be cloned at once
+// the files are copied by threadCount threads, 0 uses one per CPU. Returns 0 or -1 with errno set, stats is optional.
+int LCCopyTree(const char *source, const char *destination, int threadCount, int flags, LCCopyStats *stats);
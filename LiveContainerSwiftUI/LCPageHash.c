@@ -0,0 +1,434 @@
+#include "LCPageHash.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <CommonCrypto/CommonDigest.h>
+#else
+#include <openssl/sha.h>
+#define CC_LONG size_t
+#define CC_SHA1(data, size, md) SHA1((const unsigned char *)(data), (size), (md))
+#define CC_SHA256(data, size, md) SHA256((const unsigned char *)(data), (size), (md))
+#endif
+
+// Mach-O constants we need, spelled out so this file does not depend on <mach-o/*.h>
+#define LCP_MH_MAGIC_64 0xfeedfacf
+#define LCP_FAT_MAGIC 0xcafebabe
+#define LCP_FAT_MAGIC_64 0xcafebabf
+#define LCP_LC_CODE_SIGNATURE 0x1d
+#define LCP_HEADER_SIZE 32
+#define LCP_FAT_ARCH_SIZE 20
+#define LCP_FAT_ARCH_64_SIZE 32
+#define LCP_MAX_FAT_ARCHS 32
+#define LCP_MAX_COMMANDS_SIZE (1 << 20)
+#define LCP_PAGE_SIZE 4096
+#define LCP_SHA1_SIZE 20
+#define LCP_SHA256_SIZE 32
+
+typedef struct LCPageSlice {
+    uint64_t offset;
+    uint64_t size;
+    uint8_t *commands;          // mach header and load commands, kept until the code signature is found
+    uint32_t commandsSize;      // 0 until the header is in
+    uint32_t codeLength;        // LC_CODE_SIGNATURE dataoff, 0 until the load commands are in
+    bool failed;
+    uint8_t *sha1;
+    uint8_t *sha256;
+    uint32_t pageCount;
+    uint32_t pageCapacity;
+} LCPageSlice;
+
+struct LCPageHasher {
+    uint64_t fileSize;
+    uint64_t position;
+    bool ignored;
+    uint8_t head[8 + LCP_MAX_FAT_ARCHS * LCP_FAT_ARCH_64_SIZE];  // start of the file, buffered until the slices are known
+    size_t headSize;
+    LCPageSlice *slices;
+    uint32_t sliceCount;
+    uint32_t current;
+    uint8_t page[LCP_PAGE_SIZE];  // a page split across two writes
+    uint32_t pageFill;
+};
+
+static uint32_t readLE32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t readBE32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t readBE64(const uint8_t *p) {
+    return (uint64_t)readBE32(p) << 32 | readBE32(p + 4);
+}
+
+LCPageHasher *LCPageHasherCreate(uint64_t fileSize) {
+    LCPageHasher *hasher = calloc(1, sizeof(LCPageHasher));
+    if (hasher) {
+        hasher->fileSize = fileSize;
+        hasher->ignored = fileSize < LCP_HEADER_SIZE;
+    }
+    return hasher;
+}
+
+void LCPageHasherFree(LCPageHasher *hasher) {
+    if (!hasher) {
+        return;
+    }
+    for (uint32_t i = 0; i < hasher->sliceCount; i++) {
+        free(hasher->slices[i].commands);
+        free(hasher->slices[i].sha1);
+        free(hasher->slices[i].sha256);
+    }
+    free(hasher->slices);
+    free(hasher);
+}
+
+static bool addSlice(LCPageHasher *hasher, uint64_t offset, uint64_t size) {
+    uint64_t previousEnd = hasher->sliceCount ? hasher->slices[hasher->sliceCount - 1].offset + hasher->slices[hasher->sliceCount - 1].size : 0;
+    // slices are hashed in one forward pass, so they have to be laid out in fat_arch order
+    if (offset < previousEnd || size < LCP_HEADER_SIZE || offset + size > hasher->fileSize || size > UINT32_MAX) {
+        return false;
+    }
+    LCPageSlice *slice = &hasher->slices[hasher->sliceCount++];
+    slice->offset = offset;
+    slice->size = size;
+    slice->commands = malloc(LCP_HEADER_SIZE);
+    return slice->commands != NULL;
+}
+
+// Java class files share the fat magic, the arch count and the offsets tell them apart
+static bool parseHead(LCPageHasher *hasher) {
+    const uint8_t *head = hasher->head;
+    if (readLE32(head) == LCP_MH_MAGIC_64) {
+        hasher->slices = calloc(1, sizeof(LCPageSlice));
+        return hasher->slices && addSlice(hasher, 0, hasher->fileSize);
+    }
+    uint32_t magic = readBE32(head);
+    if ((magic != LCP_FAT_MAGIC && magic != LCP_FAT_MAGIC_64) || hasher->headSize < 8) {
+        return false;
+    }
+    uint32_t count = readBE32(head + 4);
+    size_t archSize = magic == LCP_FAT_MAGIC_64 ? LCP_FAT_ARCH_64_SIZE : LCP_FAT_ARCH_SIZE;
+    if (count == 0 || count > LCP_MAX_FAT_ARCHS || 8 + count * archSize > hasher->headSize) {
+        return false;
+    }
+    hasher->slices = calloc(count, sizeof(LCPageSlice));
+    if (!hasher->slices) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *arch = head + 8 + i * archSize;
+        uint64_t offset = magic == LCP_FAT_MAGIC_64 ? readBE64(arch + 8) : readBE32(arch + 8);
+        uint64_t size = magic == LCP_FAT_MAGIC_64 ? readBE64(arch + 16) : readBE32(arch + 12);
+        if (!addSlice(hasher, offset, size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void failSlice(LCPageHasher *hasher, LCPageSlice *slice) {
+    slice->failed = true;
+    hasher->pageFill = 0;
+}
+
+// Finds the code signature once the header and load commands of a slice are complete
+static bool parseCommands(LCPageSlice *slice) {
+    const uint8_t *commands = slice->commands;
+    uint32_t count = readLE32(commands + 16);
+    uint32_t offset = LCP_HEADER_SIZE;
+    for (uint32_t i = 0; i < count && offset + 8 <= slice->commandsSize; i++) {
+        uint32_t cmd = readLE32(commands + offset), cmdSize = readLE32(commands + offset + 4);
+        if (cmdSize < 8 || offset + cmdSize > slice->commandsSize) {
+            return false;
+        }
+        if (cmd == LCP_LC_CODE_SIGNATURE && cmdSize >= 16) {
+            uint32_t dataOffset = readLE32(commands + offset + 8);
+            if (dataOffset < slice->commandsSize || dataOffset > slice->size) {
+                return false;
+            }
+            slice->codeLength = dataOffset;
+            return true;
+        }
+        offset += cmdSize;
+    }
+    // unsigned binaries get a new signature area on sign, which moves the code limit
+    return false;
+}
+
+static bool hashPage(LCPageSlice *slice, const uint8_t *page, size_t size) {
+    if (slice->pageCount == slice->pageCapacity) {
+        uint32_t capacity = slice->pageCapacity ? slice->pageCapacity * 2 : 256;
+        uint8_t *sha1 = realloc(slice->sha1, (size_t)capacity * LCP_SHA1_SIZE);
+        if (sha1) {
+            slice->sha1 = sha1;
+        }
+        uint8_t *sha256 = realloc(slice->sha256, (size_t)capacity * LCP_SHA256_SIZE);
+        if (sha256) {
+            slice->sha256 = sha256;
+        }
+        if (!sha1 || !sha256) {
+            return false;
+        }
+        slice->pageCapacity = capacity;
+    }
+    CC_SHA1(page, (CC_LONG)size, slice->sha1 + (size_t)slice->pageCount * LCP_SHA1_SIZE);
+    CC_SHA256(page, (CC_LONG)size, slice->sha256 + (size_t)slice->pageCount * LCP_SHA256_SIZE);
+    slice->pageCount++;
+    return true;
+}
+
+// Consumes up to the next boundary (end of header, of load commands, of a page or of the code) and returns how much
+static size_t feedSlice(LCPageHasher *hasher, LCPageSlice *slice, uint64_t offset, const uint8_t *bytes, size_t size) {
+    if (slice->failed || (slice->codeLength && offset >= slice->codeLength)) {
+        return size;
+    }
+    uint64_t wanted = slice->commandsSize ? slice->commandsSize : LCP_HEADER_SIZE;
+    if (offset < wanted && size > wanted - offset) {
+        size = (size_t)(wanted - offset);
+    }
+    if (size > LCP_PAGE_SIZE - hasher->pageFill) {
+        size = LCP_PAGE_SIZE - hasher->pageFill;
+    }
+    if (slice->codeLength && size > slice->codeLength - offset) {
+        size = (size_t)(slice->codeLength - offset);
+    }
+
+    if (offset < wanted) {
+        memcpy(slice->commands + offset, bytes, size);
+        if (offset + size == LCP_HEADER_SIZE && !slice->commandsSize) {
+            uint32_t commandsSize = LCP_HEADER_SIZE + readLE32(slice->commands + 20);
+            uint8_t *commands = NULL;
+            if (readLE32(slice->commands) != LCP_MH_MAGIC_64 || commandsSize == LCP_HEADER_SIZE ||
+                commandsSize > LCP_MAX_COMMANDS_SIZE || commandsSize > slice->size ||
+                !(commands = realloc(slice->commands, commandsSize))) {
+                failSlice(hasher, slice);
+                return size;
+            }
+            slice->commands = commands;
+            slice->commandsSize = commandsSize;
+        } else if (slice->commandsSize && offset + size == slice->commandsSize) {
+            if (!parseCommands(slice)) {
+                failSlice(hasher, slice);
+                return size;
+            }
+            free(slice->commands);
+            slice->commands = NULL;
+        }
+    }
+
+    bool ok = true;
+    bool codeEnd = slice->codeLength && offset + size == slice->codeLength;
+    if (hasher->pageFill == 0 && size == LCP_PAGE_SIZE) {
+        ok = hashPage(slice, bytes, size);
+    } else {
+        memcpy(hasher->page + hasher->pageFill, bytes, size);
+        hasher->pageFill += (uint32_t)size;
+        if (hasher->pageFill == LCP_PAGE_SIZE || codeEnd) {
+            ok = hashPage(slice, hasher->page, hasher->pageFill);
+            hasher->pageFill = 0;
+        }
+    }
+    if (!ok) {
+        failSlice(hasher, slice);
+    }
+    return size;
+}
+
+static void feedSlices(LCPageHasher *hasher, const uint8_t *bytes, size_t size) {
+    while (size > 0 && hasher->current < hasher->sliceCount) {
+        LCPageSlice *slice = &hasher->slices[hasher->current];
+        size_t consumed;
+        if (hasher->position < slice->offset) {
+            consumed = (size_t)(slice->offset - hasher->position < size ? slice->offset - hasher->position : size);
+        } else if (hasher->position - slice->offset >= slice->size) {
+            hasher->current++;
+            continue;
+        } else {
+            uint64_t offset = hasher->position - slice->offset;
+            size_t available = (size_t)(slice->size - offset < size ? slice->size - offset : size);
+            consumed = feedSlice(hasher, slice, offset, bytes, available);
+        }
+        hasher->position += consumed;
+        bytes += consumed;
+        size -= consumed;
+    }
+    hasher->position += size;
+}
+
+void LCPageHasherUpdate(LCPageHasher *hasher, const void *bytes, size_t size) {
+    if (hasher->ignored) {
+        hasher->position += size;
+        return;
+    }
+    if (!hasher->slices) {
+        size_t wanted = hasher->fileSize < sizeof(hasher->head) ? (size_t)hasher->fileSize : sizeof(hasher->head);
+        size_t copied = wanted - hasher->headSize < size ? wanted - hasher->headSize : size;
+        memcpy(hasher->head + hasher->headSize, bytes, copied);
+        hasher->headSize += copied;
+        if (hasher->headSize < wanted) {
+            return;
+        }
+        // the head is part of the first slice of a thin file, so it goes through the slices once they are known
+        if (!parseHead(hasher)) {
+            hasher->ignored = true;
+            hasher->position = hasher->headSize + (size - copied);
+            return;
+        }
+        feedSlices(hasher, hasher->head, hasher->headSize);
+        bytes = (const uint8_t *)bytes + copied;
+        size -= copied;
+    }
+    feedSlices(hasher, bytes, size);
+}
+
+// <bundle>/.LCCodeSlots/<relative path with '/' replaced by ':'><suffix>, creating the folder
+static bool makeSidecarPath(char path[PATH_MAX], const char *bundlePath, const char *relativePath, const char *suffix) {
+    int folderLength = snprintf(path, PATH_MAX, "%s/" LC_CODE_SLOTS_FOLDER, bundlePath);
+    if (folderLength <= 0 || snprintf(path + folderLength, PATH_MAX - folderLength, "/%s%s", relativePath, suffix) >= PATH_MAX - folderLength) {
+        return false;
+    }
+    for (char *p = path + folderLength + 1; *p; p++) {
+        if (*p == '/') {
+            *p = ':';
+        }
+    }
+    path[folderLength] = '\0';
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    path[folderLength] = '/';
+    return true;
+}
+
+bool LCPageHasherWrite(LCPageHasher *hasher, const char *bundlePath, const char *relativePath) {
+    if (hasher->ignored || !hasher->slices || hasher->position != hasher->fileSize) {
+        return false;
+    }
+    bool any = false;
+    for (uint32_t i = 0; i < hasher->sliceCount; i++) {
+        LCPageSlice *slice = &hasher->slices[i];
+        if (slice->failed || !slice->codeLength || slice->pageCount != (slice->codeLength + LCP_PAGE_SIZE - 1) / LCP_PAGE_SIZE) {
+            slice->codeLength = 0;
+            slice->pageCount = 0;
+        }
+        any |= slice->codeLength != 0;
+    }
+    if (!any) {
+        return false;
+    }
+
+    char path[PATH_MAX];
+    if (!makeSidecarPath(path, bundlePath, relativePath, ".slots")) {
+        return false;
+    }
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        return false;
+    }
+    uint32_t header[] = {LC_CODE_SLOTS_MAGIC, LC_CODE_SLOTS_VERSION};
+    uint32_t pathLength = (uint32_t)strlen(relativePath);
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&
+        fwrite(&hasher->fileSize, sizeof(hasher->fileSize), 1, fp) == 1 &&
+        fwrite(&hasher->sliceCount, sizeof(hasher->sliceCount), 1, fp) == 1 &&
+        fwrite(&pathLength, sizeof(pathLength), 1, fp) == 1 &&
+        fwrite(relativePath, 1, pathLength, fp) == pathLength;
+    for (uint32_t i = 0; ok && i < hasher->sliceCount; i++) {
+        LCPageSlice *slice = &hasher->slices[i];
+        ok = fwrite(&slice->codeLength, sizeof(slice->codeLength), 1, fp) == 1 &&
+            fwrite(&slice->pageCount, sizeof(slice->pageCount), 1, fp) == 1 &&
+            fwrite(slice->sha1, LCP_SHA1_SIZE, slice->pageCount, fp) == slice->pageCount &&
+            fwrite(slice->sha256, LCP_SHA256_SIZE, slice->pageCount, fp) == slice->pageCount;
+    }
+    ok &= fclose(fp) == 0;
+    if (!ok) {
+        unlink(path);
+    }
+    return ok;
+}
+
+typedef struct LCPageHashEntry {
+    LCPageHasher *hasher;
+    const char *relativePath;   // points into the entry name, which lives as long as the archive
+    char bundlePath[];
+} LCPageHashEntry;
+
+static void *zipObserverBegin(const LCZipEntry *entry, const char *path, void *context) {
+    (void)context;
+    // Payload/<name>.app/<relative path>
+    const char *name = entry->name;
+    if (strncmp(name, "Payload/", 8) != 0 || entry->uncompressedSize < LCP_HEADER_SIZE) {
+        return NULL;
+    }
+    const char *bundleEnd = strchr(name + 8, '/');
+    if (!bundleEnd || bundleEnd - name < 12 || strncmp(bundleEnd - 4, ".app", 4) != 0 || !bundleEnd[1]) {
+        return NULL;
+    }
+    const char *relativePath = bundleEnd + 1;
+    size_t bundleLength = strlen(path) - strlen(relativePath) - 1;
+    LCPageHashEntry *state = malloc(sizeof(LCPageHashEntry) + bundleLength + 1);
+    if (!state) {
+        return NULL;
+    }
+    state->hasher = LCPageHasherCreate(entry->uncompressedSize);
+    if (!state->hasher) {
+        free(state);
+        return NULL;
+    }
+    state->relativePath = relativePath;
+    memcpy(state->bundlePath, path, bundleLength);
+    state->bundlePath[bundleLength] = '\0';
+    return state;
+}
+
+static void zipObserverWrite(void *state, const void *bytes, size_t size) {
+    LCPageHasherUpdate(((LCPageHashEntry *)state)->hasher, bytes, size);
+}
+
+static void zipObserverEnd(void *state, bool success) {
+    LCPageHashEntry *entry = state;
+    if (success) {
+        LCPageHasherWrite(entry->hasher, entry->bundlePath, entry->relativePath);
+    }
+    LCPageHasherFree(entry->hasher);
+    free(entry);
+}
+
+// A file an update took over from the installed bundle was signed before, its own code directory has the page hashes
+static void zipObserverReused(const LCZipEntry *entry, const char *path, void *context) {
+    (void)context;
+    const char *relativePath = strncmp(entry->name, "Payload/", 8) == 0 ? strchr(entry->name + 8, '/') : NULL;
+    uint8_t magic[4];
+    FILE *fp = relativePath && relativePath[1] && entry->uncompressedSize >= LCP_HEADER_SIZE ? fopen(path, "rb") : NULL;
+    bool machO = fp && fread(magic, sizeof(magic), 1, fp) == 1 &&
+        (readLE32(magic) == LCP_MH_MAGIC_64 || readBE32(magic) == LCP_FAT_MAGIC || readBE32(magic) == LCP_FAT_MAGIC_64);
+    if (fp) {
+        fclose(fp);
+    }
+    if (!machO) {
+        return;
+    }
+    relativePath++;
+    char bundlePath[PATH_MAX], marker[PATH_MAX];
+    size_t bundleLength = strlen(path) - strlen(relativePath) - 1;
+    if (bundleLength >= sizeof(bundlePath)) {
+        return;
+    }
+    memcpy(bundlePath, path, bundleLength);
+    bundlePath[bundleLength] = '\0';
+    if (makeSidecarPath(marker, bundlePath, relativePath, LC_CODE_SLOTS_EMBEDDED_SUFFIX)) {
+        FILE *out = fopen(marker, "wb");
+        if (out) {
+            fclose(out);
+        }
+    }
+}
+
+const LCZipObserver LCPageHashZipObserver = {zipObserverBegin, zipObserverWrite, zipObserverEnd, zipObserverReused, NULL};
@@ -0,0 +1,26 @@
+#pragma once
+// Code page hashes of Mach-Os taken while they are written, kept free of Foundation so it can also run headless on Linux.
+// A forced ZSign run picks them up and only rehashes the header pages patched in between instead of reading every page.
+#include "LCZip.h"
+
+// <bundle>/.LCCodeSlots/<path inside the bundle with '/' replaced by ':'>.slots, ZBundle looks them up the same way.
+// Layout, host byte order: magic, version, file size (u64), slice count, path length, path, then per slice (in fat_arch
+// order) the code length and page count followed by the SHA-1 and the SHA-256 of every 4K page. Code length 0 skips a slice.
+#define LC_CODE_SLOTS_FOLDER ".LCCodeSlots"
+#define LC_CODE_SLOTS_MAGIC 0x4850434c
+#define LC_CODE_SLOTS_VERSION 1
+// Empty marker in place of .slots for a Mach-O an update reused: its existing code directory still covers every page
+#define LC_CODE_SLOTS_EMBEDDED_SUFFIX ".embedded"
+
+typedef struct LCPageHasher LCPageHasher;
+
+LCPageHasher *LCPageHasherCreate(uint64_t fileSize);
+// Data has to arrive in file order. Anything that isn't a signed 64-bit Mach-O is recognized by its first bytes and ignored.
+void LCPageHasherUpdate(LCPageHasher *hasher, const void *bytes, size_t size);
+// Writes the sidecar if the file was a complete, signed Mach-O. relativePath is the file's path inside bundlePath.
+bool LCPageHasherWrite(LCPageHasher *hasher, const char *bundlePath, const char *relativePath);
+void LCPageHasherFree(LCPageHasher *hasher);
+
+// Hashes every Mach-O below Payload/*.app while LCZipExtractAll writes it and marks the ones LCZipExtractUpdate reused,
+// context is unused
+extern const LCZipObserver LCPageHashZipObserver;
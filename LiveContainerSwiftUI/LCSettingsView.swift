@@ -554,12 +554,11 @@ struct LCSettingsView: View {
         let url = Bundle.main.bundleURL
         let fileManager = FileManager.default
         let documentsURL = fileManager.urls(for: .documentDirectory, in: .userDomainMask).first!
-        do {
-            let destinationURL = documentsURL.appendingPathComponent(url.lastPathComponent)
-            try fileManager.copyItem(at: url, to: destinationURL)
+        let destinationURL = documentsURL.appendingPathComponent(url.lastPathComponent)
+        if LCCopyTree(url.path, destinationURL.path, 0, 0, nil) == 0 {
             print("Successfully copied main bundle to Documents.")
-        } catch {
-            print("Error copying main bundle \(error)")
+        } else {
+            print("Error copying main bundle \(String(cString: strerror(errno)))")
         }
     }
     
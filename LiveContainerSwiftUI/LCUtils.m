@@ -7,6 +7,8 @@
 #import "LCUtils.h"
 #import "../LiveContainer/LCSharedUtils.h"
 #import "LCAppInfo.h"
+#import "LCCopy.h"
+#import "LCZipWriter.h"
 #import "../MultitaskSupport/DecoratedAppSceneViewController.h"
 #import "../ZSign/zsigner.h"
 #import "LiveContainerSwiftUI-Swift.h"
@@ -229,8 +231,8 @@
     NSString *tmpExecPath = [path stringByAppendingPathComponent:@"LiveContainer.tmp"];
     NSString *tmpLibPath = [path stringByAppendingPathComponent:@"TestJITLess.dylib"];
     NSString *tmpInfoPath = [path stringByAppendingPathComponent:@"Info.plist"];
-    [NSFileManager.defaultManager copyItemAtPath:NSBundle.mainBundle.executablePath toPath:tmpExecPath error:nil];
-    [NSFileManager.defaultManager copyItemAtPath:[NSBundle.mainBundle.bundlePath stringByAppendingPathComponent:@"Frameworks/TestJITLess.dylib"] toPath:tmpLibPath error:nil];
+    LCCopyFile(NSBundle.mainBundle.executablePath.fileSystemRepresentation, tmpExecPath.fileSystemRepresentation, 0, NULL);
+    LCCopyFile([NSBundle.mainBundle.bundlePath stringByAppendingPathComponent:@"Frameworks/TestJITLess.dylib"].fileSystemRepresentation, tmpLibPath.fileSystemRepresentation, 0, NULL);
     NSMutableDictionary *info = NSBundle.mainBundle.infoDictionary.mutableCopy;
     info[@"CFBundleExecutable"] = @"LiveContainer.tmp";
     [info writeBinToFile:tmpInfoPath atomically:YES];
@@ -280,8 +282,11 @@
     NSURL *tmpIPAPath = [tmpPath URLByAppendingPathComponent:[NSString stringWithFormat:@"%@.ipa", newBundleName]];
     
 
-    [manager copyItemAtURL:bundlePath toURL:[tmpPayloadPath URLByAppendingPathComponent:@"App.app"] error:error];
-    if (*error) return nil;
+    // cloned, only the Info.plist and the executable patched below take up space of their own
+    if (LCCopyTree(bundlePath.fileSystemRepresentation, [tmpPayloadPath URLByAppendingPathComponent:@"App.app"].fileSystemRepresentation, 0, 0, NULL) != 0) {
+        *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        return nil;
+    }
     
     NSURL *infoPath = [tmpPayloadPath URLByAppendingPathComponent:@"App.app/Info.plist"];
     NSMutableDictionary *infoDict = [NSMutableDictionary dictionaryWithContentsOfURL:infoPath];
@@ -404,19 +409,19 @@
     
     [infoDict writeToURL:infoPath error:error];
     
-    dlopen("/System/Library/PrivateFrameworks/PassKitCore.framework/PassKitCore", RTLD_GLOBAL);
-    NSData *zipData = [[NSClassFromString(@"PKZipArchiver") new] zippedDataForURL:tmpPayloadPath.URLByDeletingLastPathComponent];
-    if (!zipData) return nil;
-
-    [manager removeItemAtURL:tmpPayloadPath error:error];
-    if (*error) return nil;
-    
     if([manager fileExistsAtPath:tmpIPAPath.path]) {
         [manager removeItemAtURL:tmpIPAPath error:error];
         if (*error) return nil;
     }
 
-    [zipData writeToURL:tmpIPAPath options:0 error:error];
+    // streamed to disk, with files and large files' blocks deflated in parallel and images/asset catalogs stored as they are
+    char zipError[256];
+    if (LCZipWriteFolder(tmpPayloadPath.URLByDeletingLastPathComponent.fileSystemRepresentation, tmpIPAPath.fileSystemRepresentation, 0, 6, NULL, zipError, sizeof(zipError)) != 0) {
+        *error = [NSError errorWithDomain:@"archiveIPAWithBundleName" code:-1 userInfo:@{NSLocalizedDescriptionKey:@(zipError)}];
+        return nil;
+    }
+
+    [manager removeItemAtURL:tmpPayloadPath error:error];
     if (*error) return nil;
 
     return tmpIPAPath;
@@ -0,0 +1,1001 @@
+#include "LCZip.h"
+#include "LCCopy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define LCZ_EOCD_SIGNATURE 0x06054b50
+#define LCZ_EOCD64_SIGNATURE 0x06064b50
+#define LCZ_EOCD64_LOCATOR_SIGNATURE 0x07064b50
+#define LCZ_CENTRAL_SIGNATURE 0x02014b50
+#define LCZ_LOCAL_SIGNATURE 0x04034b50
+#define LCZ_EOCD_SIZE 22
+#define LCZ_EOCD64_LOCATOR_SIZE 20
+#define LCZ_EOCD64_SIZE 56
+#define LCZ_CENTRAL_SIZE 46
+#define LCZ_LOCAL_SIZE 30
+#define LCZ_EXTRA_ZIP64 0x0001
+#define LCZ_EXTRA_TIMESTAMP 0x5455
+#define LCZ_METHOD_STORED 0
+#define LCZ_METHOD_DEFLATED 8
+#define LCZ_FLAG_ENCRYPTED 0x1
+#define LCZ_HOST_UNIX 3
+#define LCZ_MH_MAGIC_64 0xfeedfacf
+#define LCZ_FAT_CIGAM 0xbebafeca       // fat headers are big endian, these are their first 4 bytes read little endian
+#define LCZ_FAT_CIGAM_64 0xbfbafeca
+
+#define LCZ_READ_BUFFER_SIZE (4 << 20)
+#define LCZ_WORKER_READ_BUFFER_SIZE (1 << 20)
+#define LCZ_MAX_THREADS 64
+#define LCZ_LOCAL_EXTRA_GUESS 64
+#define LCZ_WRITE_BUFFER_SIZE (1 << 20)
+#define LCZ_BUFFER_ALIGNMENT 16384
+
+static uint16_t readLE16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t readLE32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t readLE64(const uint8_t *p) {
+    return (uint64_t)readLE32(p) | (uint64_t)readLE32(p + 4) << 32;
+}
+
+static int setError(LCZipArchive *zip, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(zip->error, sizeof(zip->error), format, args);
+    va_end(args);
+    return -1;
+}
+
+static bool preadFully(int fd, void *buffer, size_t size, uint64_t offset) {
+    uint8_t *p = buffer;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void *buffer, size_t size) {
+    const uint8_t *p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static time_t dosTimeToUnix(uint16_t dosTime, uint16_t dosDate) {
+    struct tm tm = {0};
+    tm.tm_sec = (dosTime & 0x1f) * 2;
+    tm.tm_min = (dosTime >> 5) & 0x3f;
+    tm.tm_hour = dosTime >> 11;
+    tm.tm_mday = dosDate & 0x1f;
+    tm.tm_mon = ((dosDate >> 5) & 0xf) - 1;
+    tm.tm_year = (dosDate >> 9) + 80;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// Fills in the ZIP64 sizes and offset the 32-bit fields saturated on, and the unix mtime if there is one
+static bool parseExtraFields(LCZipEntry *entry, const uint8_t *extra, size_t extraLength, bool wideUncompressed, bool wideCompressed, bool wideOffset) {
+    while (extraLength >= 4) {
+        uint16_t tag = readLE16(extra), size = readLE16(extra + 2);
+        if ((size_t)size + 4 > extraLength) {
+            break;
+        }
+        const uint8_t *data = extra + 4, *end = data + size;
+        if (tag == LCZ_EXTRA_ZIP64) {
+            if (wideUncompressed) {
+                if (data + 8 > end) return false;
+                entry->uncompressedSize = readLE64(data);
+                data += 8;
+            }
+            if (wideCompressed) {
+                if (data + 8 > end) return false;
+                entry->compressedSize = readLE64(data);
+                data += 8;
+            }
+            if (wideOffset) {
+                if (data + 8 > end) return false;
+                entry->localHeaderOffset = readLE64(data);
+            }
+            wideUncompressed = wideCompressed = wideOffset = false;
+        } else if (tag == LCZ_EXTRA_TIMESTAMP && size >= 5 && (data[0] & 1)) {
+            entry->mtime = (time_t)(int32_t)readLE32(data + 1);
+        }
+        extra += 4 + size;
+        extraLength -= 4 + size;
+    }
+    return !wideUncompressed && !wideCompressed && !wideOffset;
+}
+
+static int compareEntryOffsets(const void *a, const void *b) {
+    uint64_t x = ((const LCZipEntry *)a)->localHeaderOffset, y = ((const LCZipEntry *)b)->localHeaderOffset;
+    return x < y ? -1 : x > y;
+}
+
+int LCZipOpen(LCZipArchive *zip, const char *path, bool *notZip) {
+    memset(zip, 0, sizeof(*zip));
+    zip->fd = -1;
+    if (notZip) {
+        *notZip = false;
+    }
+
+    zip->fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (zip->fd < 0 || fstat(zip->fd, &st) != 0) {
+        return setError(zip, "Can't open %s: %s", path, strerror(errno));
+    }
+    zip->fileSize = (uint64_t)st.st_size;
+
+    // the end of central directory record sits within the last 64K + 22 bytes, after an optional comment
+    size_t tailSize = (size_t)(zip->fileSize < 0xffff + LCZ_EOCD_SIZE + LCZ_EOCD64_LOCATOR_SIZE ? zip->fileSize : 0xffff + LCZ_EOCD_SIZE + LCZ_EOCD64_LOCATOR_SIZE);
+    uint8_t *tail = malloc(tailSize ? tailSize : 1);
+    if (!tail) {
+        return setError(zip, "Out of memory");
+    }
+    if (!preadFully(zip->fd, tail, tailSize, zip->fileSize - tailSize)) {
+        free(tail);
+        return setError(zip, "Can't read %s: %s", path, strerror(errno));
+    }
+    const uint8_t *eocd = NULL;
+    for (size_t i = tailSize >= LCZ_EOCD_SIZE ? tailSize - LCZ_EOCD_SIZE + 1 : 0; i-- > 0;) {
+        if (readLE32(tail + i) == LCZ_EOCD_SIGNATURE) {
+            eocd = tail + i;
+            break;
+        }
+    }
+    if (!eocd) {
+        free(tail);
+        if (notZip) {
+            *notZip = true;
+        }
+        return setError(zip, "%s is not a zip archive", path);
+    }
+
+    uint64_t entryCount = readLE16(eocd + 10);
+    uint64_t centralSize = readLE32(eocd + 12);
+    uint64_t centralOffset = readLE32(eocd + 16);
+    uint64_t eocdOffset = zip->fileSize - tailSize + (uint64_t)(eocd - tail);
+    if (eocd - tail >= LCZ_EOCD64_LOCATOR_SIZE && readLE32(eocd - LCZ_EOCD64_LOCATOR_SIZE) == LCZ_EOCD64_LOCATOR_SIGNATURE) {
+        uint64_t eocd64Offset = readLE64(eocd - LCZ_EOCD64_LOCATOR_SIZE + 8);
+        uint8_t eocd64[LCZ_EOCD64_SIZE];
+        if (!preadFully(zip->fd, eocd64, sizeof(eocd64), eocd64Offset) || readLE32(eocd64) != LCZ_EOCD64_SIGNATURE) {
+            free(tail);
+            return setError(zip, "Broken zip64 end of central directory in %s", path);
+        }
+        entryCount = readLE64(eocd64 + 32);
+        centralSize = readLE64(eocd64 + 40);
+        centralOffset = readLE64(eocd64 + 48);
+        eocdOffset = eocd64Offset;
+    }
+    free(tail);
+    // zip64 fields are attacker controlled, compare by subtraction so the sums can't wrap
+    if (centralSize > eocdOffset || centralOffset > eocdOffset - centralSize || entryCount > centralSize / LCZ_CENTRAL_SIZE) {
+        return setError(zip, "Broken central directory in %s", path);
+    }
+
+    uint8_t *central = malloc(centralSize ? centralSize : 1);
+    if (!central) {
+        return setError(zip, "Out of memory");
+    }
+    if (!preadFully(zip->fd, central, centralSize, centralOffset)) {
+        free(central);
+        return setError(zip, "Can't read the central directory of %s: %s", path, strerror(errno));
+    }
+
+    // names are copied out NUL terminated, the central directory itself is not kept
+    zip->entries = calloc(entryCount ? entryCount : 1, sizeof(LCZipEntry));
+    zip->names = malloc(centralSize + 1);
+    if (!zip->entries || !zip->names) {
+        free(central);
+        return setError(zip, "Out of memory");
+    }
+    size_t namesLength = 0;
+    const uint8_t *p = central, *end = central + centralSize;
+    for (uint64_t i = 0; i < entryCount; i++) {
+        if (p + LCZ_CENTRAL_SIZE > end || readLE32(p) != LCZ_CENTRAL_SIGNATURE) {
+            free(central);
+            return setError(zip, "Broken central directory entry %llu in %s", (unsigned long long)i, path);
+        }
+        uint16_t nameLength = readLE16(p + 28), extraLength = readLE16(p + 30), commentLength = readLE16(p + 32);
+        if (p + LCZ_CENTRAL_SIZE + nameLength + extraLength + commentLength > end) {
+            free(central);
+            return setError(zip, "Broken central directory entry %llu in %s", (unsigned long long)i, path);
+        }
+
+        LCZipEntry *entry = &zip->entries[i];
+        entry->versionMadeBy = readLE16(p + 4);
+        entry->flags = readLE16(p + 8);
+        entry->method = readLE16(p + 10);
+        entry->mtime = dosTimeToUnix(readLE16(p + 12), readLE16(p + 14));
+        entry->crc32 = readLE32(p + 16);
+        entry->compressedSize = readLE32(p + 20);
+        entry->uncompressedSize = readLE32(p + 24);
+        entry->externalAttributes = readLE32(p + 38);
+        entry->localHeaderOffset = readLE32(p + 42);
+        memcpy(zip->names + namesLength, p + LCZ_CENTRAL_SIZE, nameLength);
+        entry->name = zip->names + namesLength;
+        namesLength += nameLength;
+        zip->names[namesLength++] = '\0';
+        if (!parseExtraFields(entry, p + LCZ_CENTRAL_SIZE + nameLength, extraLength,
+                              entry->uncompressedSize == 0xffffffff, entry->compressedSize == 0xffffffff, entry->localHeaderOffset == 0xffffffff) ||
+            centralOffset < LCZ_LOCAL_SIZE || entry->compressedSize > centralOffset - LCZ_LOCAL_SIZE ||
+            entry->localHeaderOffset > centralOffset - LCZ_LOCAL_SIZE - entry->compressedSize) {
+            free(central);
+            return setError(zip, "Broken central directory entry %s in %s", entry->name, path);
+        }
+        zip->totalCompressed += entry->compressedSize;
+        zip->totalUncompressed += entry->uncompressedSize;
+        p += LCZ_CENTRAL_SIZE + nameLength + extraLength + commentLength;
+        zip->entryCount++;
+    }
+    free(central);
+
+    qsort(zip->entries, zip->entryCount, sizeof(LCZipEntry), compareEntryOffsets);
+    return 0;
+}
+
+void LCZipClose(LCZipArchive *zip) {
+    if (zip->fd >= 0) {
+        close(zip->fd);
+    }
+    free(zip->entries);
+    free(zip->names);
+    zip->fd = -1;
+    zip->entries = NULL;
+    zip->names = NULL;
+    zip->entryCount = 0;
+}
+
+// Forward-only window over the archive. Every byte is read once as long as the callers move forward.
+typedef struct LCZipStream {
+    int fd;
+    uint64_t fileSize;
+    uint8_t *buffer;
+    size_t capacity;
+    uint64_t limit;         // soft end of the wanted range, 0 to fill the whole buffer
+    uint64_t bufferOffset;  // archive offset of buffer[0]
+    size_t length;
+} LCZipStream;
+
+// Makes at least minimum bytes at offset available, returns how many are buffered from there
+static size_t streamFetch(LCZipStream *stream, uint64_t offset, size_t minimum) {
+    if (offset < stream->bufferOffset || offset > stream->bufferOffset + stream->length) {
+        stream->bufferOffset = offset;
+        stream->length = 0;
+    }
+    size_t available = (size_t)(stream->bufferOffset + stream->length - offset);
+    if (available >= minimum && available > 0) {
+        return available;
+    }
+    memmove(stream->buffer, stream->buffer + (offset - stream->bufferOffset), available);
+    stream->bufferOffset = offset;
+    stream->length = available;
+    size_t wanted = stream->capacity;
+    if (stream->limit > offset && stream->limit - offset < wanted) {
+        wanted = (size_t)(stream->limit - offset) > minimum ? (size_t)(stream->limit - offset) : minimum;
+    }
+    while (stream->length < wanted && stream->bufferOffset + stream->length < stream->fileSize) {
+        ssize_t n = pread(stream->fd, stream->buffer + stream->length, wanted - stream->length, (off_t)(stream->bufferOffset + stream->length));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        stream->length += n;
+        if (stream->length >= minimum) {
+            break;
+        }
+    }
+    return stream->length;
+}
+
+static bool isSafeName(const char *name) {
+    if (name[0] == '/' || name[0] == '\0') {
+        return false;
+    }
+    for (const char *component = name; component; component = strchr(component, '/'), component = component ? component + 1 : NULL) {
+        if (component[0] == '.' && component[1] == '.' && (component[2] == '/' || component[2] == '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// mkdir -p for the parent of path, skipped when it is the same parent as last time
+static bool makeParents(char *path, char *lastParent) {
+    char *slash = strrchr(path, '/');
+    if (!slash) {
+        return true;
+    }
+    *slash = '\0';
+    if (!strcmp(path, lastParent)) {
+        *slash = '/';
+        return true;
+    }
+    bool ok = true;
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        for (char *p = path + 1; *p; p++) {
+            if (*p != '/') {
+                continue;
+            }
+            *p = '\0';
+            mkdir(path, 0755);
+            *p = '/';
+        }
+        ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+    }
+    if (ok) {
+        snprintf(lastParent, PATH_MAX, "%s", path);
+    }
+    *slash = '/';
+    return ok;
+}
+
+static mode_t entryMode(const LCZipEntry *entry, bool directory) {
+    mode_t mode = (mode_t)(entry->externalAttributes >> 16);
+    if ((entry->versionMadeBy >> 8) != LCZ_HOST_UNIX || (mode & 0777) == 0) {
+        return directory ? (S_IFDIR | 0755) : (S_IFREG | 0644);
+    }
+    return mode;
+}
+
+// Shared by every extractor of one LCZipExtractAll call
+typedef struct LCZipJob {
+    LCZipArchive *zip;
+    const char *destination;
+    const uint8_t *skip;            // optional, entries flagged here are left out entirely
+    const LCZipEntry **pending;     // entries with data, largest first so the long inflates start early
+    size_t pendingCount;
+    size_t next;
+    uint64_t completed;
+    int failed;
+    pthread_mutex_t lock;           // serializes progress callbacks and the first error
+    LCZipProgressHandler progress;
+    void *context;
+} LCZipJob;
+
+typedef struct LCZipExtractor {
+    LCZipJob *job;
+    LCZipStream stream;
+    z_stream inflater;
+    uint8_t *output;
+    void *observed;                 // observer state of the entry being written
+    bool boundedReads;
+    char error[sizeof(((LCZipArchive *)0)->error)];
+} LCZipExtractor;
+
+static int extractorError(LCZipExtractor *ex, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(ex->error, sizeof(ex->error), format, args);
+    va_end(args);
+    return -1;
+}
+
+static bool extractorInit(LCZipExtractor *ex, LCZipJob *job, size_t readBufferSize) {
+    memset(ex, 0, sizeof(*ex));
+    ex->job = job;
+    ex->stream.fd = job->zip->fd;
+    ex->stream.fileSize = job->zip->fileSize;
+    ex->stream.capacity = readBufferSize;
+    if (posix_memalign((void **)&ex->stream.buffer, LCZ_BUFFER_ALIGNMENT, readBufferSize) != 0) {
+        ex->stream.buffer = NULL;
+        return false;
+    }
+    if (posix_memalign((void **)&ex->output, LCZ_BUFFER_ALIGNMENT, LCZ_WRITE_BUFFER_SIZE) != 0) {
+        ex->output = NULL;
+        return false;
+    }
+    return inflateInit2(&ex->inflater, -MAX_WBITS) == Z_OK;
+}
+
+static void extractorDestroy(LCZipExtractor *ex) {
+    if (ex->inflater.state) {
+        inflateEnd(&ex->inflater);
+    }
+    free(ex->stream.buffer);
+    free(ex->output);
+}
+
+// Keeps the first error of the job in zip->error
+static void jobFail(LCZipJob *job, LCZipExtractor *ex) {
+    pthread_mutex_lock(&job->lock);
+    if (!job->failed) {
+        snprintf(job->zip->error, sizeof(job->zip->error), "%s", ex->error);
+    }
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void jobAdvance(LCZipJob *job, uint64_t consumed) {
+    __atomic_fetch_add(&job->completed, consumed, __ATOMIC_RELAXED);
+    // a busy lock means another worker is reporting right now, the next chunk catches up
+    if (job->progress && pthread_mutex_trylock(&job->lock) == 0) {
+        job->progress(__atomic_load_n(&job->completed, __ATOMIC_RELAXED), job->zip->totalCompressed, job->context);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+// Streams the entry's data into fd (or into link when it is a symlink target), checking size and CRC
+static int extractData(LCZipExtractor *ex, const LCZipEntry *entry, uint64_t dataOffset, int fd, char *link, size_t linkSize) {
+    uint64_t remaining = entry->compressedSize, written = 0;
+    uint32_t crc = (uint32_t)crc32(0, NULL, 0);
+    bool deflated = entry->method == LCZ_METHOD_DEFLATED, finished = false;
+    if (deflated) {
+        inflateReset(&ex->inflater);
+    }
+
+    #define EMIT(data, size) do { \
+        crc = (uint32_t)crc32(crc, (data), (uInt)(size)); \
+        if (link) { \
+            if (written + (size) >= linkSize) return extractorError(ex, "Symlink target too long in %s", entry->name); \
+            memcpy(link + written, (data), (size)); \
+        } else if (!writeFully(fd, (data), (size))) { \
+            return extractorError(ex, "Can't write %s: %s", entry->name, strerror(errno)); \
+        } else if (ex->observed) { \
+            ex->job->zip->observer->write(ex->observed, (data), (size)); \
+        } \
+        written += (size); \
+    } while (0)
+
+    uint64_t offset = dataOffset;
+    while (remaining > 0 || (deflated && !finished)) {
+        if (__atomic_load_n(&ex->job->failed, __ATOMIC_RELAXED)) {
+            return extractorError(ex, "Cancelled");
+        }
+        size_t available = remaining > 0 ? streamFetch(&ex->stream, offset, 1) : 0;
+        if (remaining > 0 && available == 0) {
+            return extractorError(ex, "Unexpected end of archive in %s", entry->name);
+        }
+        size_t chunk = (size_t)(available < remaining ? available : remaining);
+        const uint8_t *input = ex->stream.buffer + (offset - ex->stream.bufferOffset);
+        if (!deflated) {
+            EMIT(input, chunk);
+        } else {
+            ex->inflater.next_in = (Bytef *)input;
+            ex->inflater.avail_in = (uInt)(chunk < UINT_MAX ? chunk : UINT_MAX);
+            chunk = ex->inflater.avail_in;
+            do {
+                ex->inflater.next_out = ex->output;
+                ex->inflater.avail_out = LCZ_WRITE_BUFFER_SIZE;
+                int ret = inflate(&ex->inflater, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && !(ret == Z_BUF_ERROR && chunk == 0)) {
+                    return extractorError(ex, "Corrupt deflate data in %s", entry->name);
+                }
+                size_t produced = LCZ_WRITE_BUFFER_SIZE - ex->inflater.avail_out;
+                if (produced) {
+                    EMIT(ex->output, produced);
+                }
+                if (ret == Z_STREAM_END) {
+                    finished = true;
+                    break;
+                }
+                if (chunk == 0 && produced == 0) {
+                    return extractorError(ex, "Truncated deflate data in %s", entry->name);
+                }
+            } while (ex->inflater.avail_out == 0 || ex->inflater.avail_in > 0);
+        }
+        offset += chunk;
+        remaining -= chunk;
+        if (chunk) {
+            jobAdvance(ex->job, chunk);
+        }
+    }
+    #undef EMIT
+
+    if (written != entry->uncompressedSize || crc != entry->crc32) {
+        return extractorError(ex, "Checksum mismatch in %s", entry->name);
+    }
+    if (link) {
+        link[written] = '\0';
+    }
+    return 0;
+}
+
+// Validates the entry and builds its output path. With lastParent the folders are created as well, that's the
+// ordered part: parents exist before any file is written into them. Returns 1 when there is no data to write.
+static int prepareEntry(LCZipExtractor *ex, const LCZipEntry *entry, char *path, char *lastParent) {
+    if (!isSafeName(entry->name)) {
+        return extractorError(ex, "Refusing to extract %s outside of the destination", entry->name);
+    }
+    if (entry->flags & LCZ_FLAG_ENCRYPTED) {
+        return extractorError(ex, "%s is encrypted", entry->name);
+    }
+
+    size_t nameLength = strlen(entry->name);
+    bool directory = entry->name[nameLength - 1] == '/';
+    mode_t mode = entryMode(entry, directory);
+    if (snprintf(path, PATH_MAX, "%s/%.*s", ex->job->destination, (int)(directory ? nameLength - 1 : nameLength), entry->name) >= PATH_MAX) {
+        return extractorError(ex, "Path too long: %s", entry->name);
+    }
+    if (lastParent && !makeParents(path, lastParent)) {
+        return extractorError(ex, "Can't create the folder for %s: %s", entry->name, strerror(errno));
+    }
+    if (directory || S_ISDIR(mode)) {
+        if (lastParent && mkdir(path, (mode & 0777) | 0700) != 0 && errno != EEXIST) {
+            return extractorError(ex, "Can't create %s: %s", entry->name, strerror(errno));
+        }
+        return 1;
+    }
+    if (entry->method != LCZ_METHOD_STORED && entry->method != LCZ_METHOD_DEFLATED) {
+        return extractorError(ex, "%s uses unsupported compression method %d", entry->name, entry->method);
+    }
+    return 0;
+}
+
+static int writeEntry(LCZipExtractor *ex, const LCZipEntry *entry, const char *path) {
+    uint8_t local[LCZ_LOCAL_SIZE];
+    if (ex->boundedReads) {
+        // workers jump between entries, so only read this one: its header with the usual name and extra, then the data
+        ex->stream.limit = entry->localHeaderOffset + LCZ_LOCAL_SIZE + strlen(entry->name) + LCZ_LOCAL_EXTRA_GUESS + entry->compressedSize;
+    }
+    if (streamFetch(&ex->stream, entry->localHeaderOffset, LCZ_LOCAL_SIZE) < LCZ_LOCAL_SIZE) {
+        return extractorError(ex, "Unexpected end of archive in %s", entry->name);
+    }
+    memcpy(local, ex->stream.buffer + (entry->localHeaderOffset - ex->stream.bufferOffset), LCZ_LOCAL_SIZE);
+    if (readLE32(local) != LCZ_LOCAL_SIGNATURE) {
+        return extractorError(ex, "Broken local header for %s", entry->name);
+    }
+    // the local name and extra lengths may differ from the central directory, so the data offset comes from here
+    uint64_t dataOffset = entry->localHeaderOffset + LCZ_LOCAL_SIZE + readLE16(local + 26) + readLE16(local + 28);
+
+    mode_t mode = entryMode(entry, false);
+    if (S_ISLNK(mode)) {
+        char target[PATH_MAX];
+        if (extractData(ex, entry, dataOffset, -1, target, sizeof(target)) != 0) {
+            return -1;
+        }
+        unlink(path);
+        if (symlink(target, path) != 0) {
+            return extractorError(ex, "Can't create symlink %s: %s", entry->name, strerror(errno));
+        }
+        return 0;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 && (errno == EACCES || errno == EEXIST)) {
+        unlink(path);
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    }
+    if (fd < 0) {
+        return extractorError(ex, "Can't create %s: %s", entry->name, strerror(errno));
+    }
+    const LCZipObserver *observer = ex->job->zip->observer;
+    ex->observed = observer ? observer->begin(entry, path, observer->context) : NULL;
+    int ret = extractData(ex, entry, dataOffset, fd, NULL, 0);
+    if (ex->observed) {
+        observer->end(ex->observed, ret == 0);
+        ex->observed = NULL;
+    }
+    if (ret == 0) {
+        struct timespec times[2] = {{entry->mtime, 0}, {entry->mtime, 0}};
+        futimens(fd, times);
+        fchmod(fd, mode & 0777);
+    }
+    close(fd);
+    return ret;
+}
+
+static int extractSequential(LCZipJob *job) {
+    LCZipArchive *zip = job->zip;
+    LCZipExtractor ex;
+    if (!extractorInit(&ex, job, LCZ_READ_BUFFER_SIZE)) {
+        extractorDestroy(&ex);
+        return setError(zip, "Out of memory");
+    }
+#ifdef __APPLE__
+    fcntl(zip->fd, F_RDAHEAD, 1);
+#else
+    posix_fadvise(zip->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    char lastParent[PATH_MAX] = "", path[PATH_MAX];
+    int ret = 0;
+    for (size_t i = 0; i < zip->entryCount && ret >= 0; i++) {
+        if (job->skip && job->skip[i]) {
+            continue;
+        }
+        ret = prepareEntry(&ex, &zip->entries[i], path, lastParent);
+        if (ret == 0) {
+            ret = writeEntry(&ex, &zip->entries[i], path);
+        }
+    }
+    if (ret < 0) {
+        jobFail(job, &ex);
+    }
+    extractorDestroy(&ex);
+    return ret < 0 ? -1 : 0;
+}
+
+static void *extractWorker(void *arg) {
+    LCZipJob *job = arg;
+    LCZipExtractor ex;
+    if (!extractorInit(&ex, job, LCZ_WORKER_READ_BUFFER_SIZE)) {
+        extractorDestroy(&ex);
+        // the other workers still drain the queue, only give up if nobody could start
+        return (void *)1;
+    }
+    ex.boundedReads = true;
+    char path[PATH_MAX];
+    size_t i;
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED) && (i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->pendingCount) {
+        const LCZipEntry *entry = job->pending[i];
+        if (prepareEntry(&ex, entry, path, NULL) < 0 || writeEntry(&ex, entry, path) != 0) {
+            jobFail(job, &ex);
+            break;
+        }
+    }
+    extractorDestroy(&ex);
+    return NULL;
+}
+
+static int compareEntrySizesDescending(const void *a, const void *b) {
+    uint64_t x = (*(const LCZipEntry **)a)->compressedSize, y = (*(const LCZipEntry **)b)->compressedSize;
+    return x > y ? -1 : x < y;
+}
+
+// Folders first, in archive order on this thread, then every worker claims whole entries and preads them on its
+// own. Memory stays at one read and one output buffer per worker no matter how large the entries are.
+static int extractParallel(LCZipJob *job, int threadCount) {
+    LCZipArchive *zip = job->zip;
+    LCZipExtractor ex;
+    memset(&ex, 0, sizeof(ex));
+    ex.job = job;
+    job->pending = malloc((zip->entryCount ? zip->entryCount : 1) * sizeof(LCZipEntry *));
+    char lastParent[PATH_MAX] = "", path[PATH_MAX];
+    for (size_t i = 0; i < zip->entryCount; i++) {
+        if (job->skip && job->skip[i]) {
+            continue;
+        }
+        int ret = prepareEntry(&ex, &zip->entries[i], path, lastParent);
+        if (ret < 0) {
+            jobFail(job, &ex);
+            free(job->pending);
+            return -1;
+        }
+        if (ret == 0) {
+            job->pending[job->pendingCount++] = &zip->entries[i];
+        }
+    }
+    qsort(job->pending, job->pendingCount, sizeof(LCZipEntry *), compareEntrySizesDescending);
+
+    if ((size_t)threadCount > job->pendingCount) {
+        threadCount = job->pendingCount ? (int)job->pendingCount : 1;
+    }
+    pthread_t threads[LCZ_MAX_THREADS];
+    int started = 0;
+    for (; started < threadCount - 1 && started < LCZ_MAX_THREADS; started++) {
+        if (pthread_create(&threads[started], NULL, extractWorker, job) != 0) {
+            break;
+        }
+    }
+    // the calling thread works too, so a failed pthread_create only costs parallelism
+    bool workerFailed = extractWorker(job) != NULL;
+    for (int i = 0; i < started; i++) {
+        void *result = NULL;
+        pthread_join(threads[i], &result);
+        workerFailed &= result != NULL;
+    }
+    free(job->pending);
+    job->pending = NULL;
+    if (workerFailed && !job->failed) {
+        return setError(zip, "Out of memory");
+    }
+    return job->failed ? -1 : 0;
+}
+
+static int extractEntries(LCZipArchive *zip, const char *destination, int threadCount, const uint8_t *skip, LCZipProgressHandler progress, void *context) {
+    LCZipJob job = {0};
+    job.zip = zip;
+    job.destination = destination;
+    job.skip = skip;
+    job.progress = progress;
+    job.context = context;
+    pthread_mutex_init(&job.lock, NULL);
+    if (threadCount <= 0) {
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    // skipped entries count as done, so progress still runs up to totalCompressed
+    for (size_t i = 0; skip && i < zip->entryCount; i++) {
+        job.completed += skip[i] ? zip->entries[i].compressedSize : 0;
+    }
+
+    mkdir(destination, 0755);
+    int ret = threadCount > 1 ? extractParallel(&job, threadCount) : extractSequential(&job);
+    if (ret == 0 && progress) {
+        progress(job.completed, zip->totalCompressed, context);
+    }
+    pthread_mutex_destroy(&job.lock);
+    return ret;
+}
+
+int LCZipExtractAll(LCZipArchive *zip, const char *destination, int threadCount, LCZipProgressHandler progress, void *context) {
+    return extractEntries(zip, destination, threadCount, NULL, progress, context);
+}
+
+bool LCZipFindBundle(const LCZipArchive *zip, char *prefix, size_t size) {
+    for (size_t i = 0; i < zip->entryCount; i++) {
+        const char *name = zip->entries[i].name;
+        const char *bundleEnd = strncmp(name, "Payload/", 8) == 0 ? strchr(name + 8, '/') : NULL;
+        if (bundleEnd && bundleEnd - name >= 12 && strncmp(bundleEnd - 4, ".app", 4) == 0 && (size_t)(bundleEnd - name) + 1 < size) {
+            memcpy(prefix, name, bundleEnd - name + 1);
+            prefix[bundleEnd - name + 1] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+int LCZipExtractEntry(LCZipArchive *zip, const char *name, const char *destination) {
+    uint8_t *skip = malloc(zip->entryCount ? zip->entryCount : 1);
+    if (!skip) {
+        return setError(zip, "Out of memory");
+    }
+    bool found = false;
+    for (size_t i = 0; i < zip->entryCount; i++) {
+        skip[i] = strcmp(zip->entries[i].name, name) != 0;
+        found |= !skip[i];
+    }
+    int ret = found ? extractEntries(zip, destination, 1, skip, NULL, NULL) : setError(zip, "%s is not in the archive", name);
+    free(skip);
+    return ret;
+}
+
+// Regular files of the bundle, the only entries the manifest and updates care about
+static bool isManifestEntry(const LCZipEntry *entry, const char *prefix, size_t prefixLength) {
+    size_t nameLength = strlen(entry->name);
+    return nameLength > prefixLength && strncmp(entry->name, prefix, prefixLength) == 0 && entry->name[nameLength - 1] != '/' &&
+        !strchr(entry->name, '\n') && S_ISREG(entryMode(entry, false)) && !(entry->flags & LCZ_FLAG_ENCRYPTED) && isSafeName(entry->name);
+}
+
+int LCZipWriteManifest(LCZipArchive *zip, const char *destination) {
+    char prefix[PATH_MAX], path[PATH_MAX];
+    if (!LCZipFindBundle(zip, prefix, sizeof(prefix))) {
+        return setError(zip, "No app bundle in the archive");
+    }
+    if (snprintf(path, sizeof(path), "%s/%s" LC_ZIP_MANIFEST_NAME, destination, prefix) >= (int)sizeof(path)) {
+        return setError(zip, "Path too long: %s", prefix);
+    }
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        return setError(zip, "Can't create %s: %s", path, strerror(errno));
+    }
+    // one line per file: CRC, size and mtime in the archive, size and mtime on disk, then the path inside the bundle,
+    // which may contain spaces, last. A file reused from the previous install is on disk as it was there.
+    size_t prefixLength = strlen(prefix);
+    char filePath[PATH_MAX];
+    bool ok = fprintf(fp, "LCInstallManifest 2\n") > 0;
+    for (size_t i = 0; ok && i < zip->entryCount; i++) {
+        const LCZipEntry *entry = &zip->entries[i];
+        if (!isManifestEntry(entry, prefix, prefixLength)) {
+            continue;
+        }
+        struct stat st;
+        if (snprintf(filePath, sizeof(filePath), "%s/%s", destination, entry->name) >= (int)sizeof(filePath) || lstat(filePath, &st) != 0) {
+            continue;
+        }
+        ok = fprintf(fp, "%08x %llu %lld %llu %lld %s\n", entry->crc32, (unsigned long long)entry->uncompressedSize, (long long)entry->mtime,
+                     (unsigned long long)st.st_size, (long long)st.st_mtime, entry->name + prefixLength) > 0;
+    }
+    ok &= fclose(fp) == 0;
+    if (!ok) {
+        unlink(path);
+        return setError(zip, "Can't write %s", path);
+    }
+    return 0;
+}
+
+typedef struct LCZipManifestEntry {
+    const char *name;
+    uint32_t crc32;
+    uint64_t size;
+    time_t mtime;
+    uint64_t installedSize;     // what is on disk, differs from the above once LiveContainer signed a Mach-O
+    time_t installedMtime;
+} LCZipManifestEntry;
+
+typedef struct LCZipManifest {
+    char *data;
+    LCZipManifestEntry *entries;   // sorted by name
+    size_t entryCount;
+} LCZipManifest;
+
+static int compareManifestNames(const void *a, const void *b) {
+    return strcmp(((const LCZipManifestEntry *)a)->name, ((const LCZipManifestEntry *)b)->name);
+}
+
+static bool loadManifest(LCZipManifest *manifest, const char *bundlePath) {
+    memset(manifest, 0, sizeof(*manifest));
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/" LC_ZIP_MANIFEST_NAME, bundlePath);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    manifest->data = malloc((size_t)st.st_size + 1);
+    bool ok = manifest->data && preadFully(fd, manifest->data, (size_t)st.st_size, 0);
+    close(fd);
+    if (!ok) {
+        free(manifest->data);
+        return false;
+    }
+    manifest->data[st.st_size] = '\0';
+
+    size_t lines = 0;
+    for (const char *p = manifest->data; (p = strchr(p, '\n')); p++) {
+        lines++;
+    }
+    // version 1 had no installed stamp, its files only count as installed while they still are what was extracted
+    char *line = manifest->data, *next;
+    bool stamped = strncmp(line, "LCInstallManifest 2\n", 20) == 0;
+    if ((!stamped && strncmp(line, "LCInstallManifest 1\n", 20) != 0) || !(manifest->entries = malloc((lines ? lines : 1) * sizeof(LCZipManifestEntry)))) {
+        free(manifest->data);
+        return false;
+    }
+    for (line += 20; (next = strchr(line, '\n')); line = next + 1) {
+        *next = '\0';
+        LCZipManifestEntry *entry = &manifest->entries[manifest->entryCount];
+        char *end;
+        entry->crc32 = (uint32_t)strtoul(line, &end, 16);
+        entry->size = strtoull(end, &end, 10);
+        entry->mtime = (time_t)strtoll(end, &end, 10);
+        entry->installedSize = stamped ? strtoull(end, &end, 10) : entry->size;
+        entry->installedMtime = stamped ? (time_t)strtoll(end, &end, 10) : entry->mtime;
+        if (*end == ' ' && end[1]) {
+            entry->name = end + 1;
+            manifest->entryCount++;
+        }
+    }
+    qsort(manifest->entries, manifest->entryCount, sizeof(LCZipManifestEntry), compareManifestNames);
+    return true;
+}
+
+// The installed file still is what the manifest describes, exactly as extracted or as LiveContainer last signed it
+static bool isReusable(const char *path, const LCZipManifestEntry *recorded) {
+    struct stat st;
+    return lstat(path, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size == recorded->installedSize && st.st_mtime == recorded->installedMtime;
+}
+
+static bool isMachO(const char *path) {
+    uint8_t magic[4];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    bool ok = fd >= 0 && preadFully(fd, magic, sizeof(magic), 0);
+    if (fd >= 0) {
+        close(fd);
+    }
+    uint32_t value = ok ? readLE32(magic) : 0;
+    return value == LCZ_MH_MAGIC_64 || value == LCZ_FAT_CIGAM || value == LCZ_FAT_CIGAM_64;
+}
+
+bool LCZipStampManifest(const char *bundlePath) {
+    LCZipManifest manifest;
+    if (!loadManifest(&manifest, bundlePath)) {
+        return false;
+    }
+    char path[PATH_MAX], tmpPath[PATH_MAX];
+    bool ok = snprintf(path, sizeof(path), "%s/" LC_ZIP_MANIFEST_NAME, bundlePath) < (int)sizeof(path) &&
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path) < (int)sizeof(tmpPath);
+    FILE *fp = ok ? fopen(tmpPath, "w") : NULL;
+    ok = fp && fprintf(fp, "LCInstallManifest 2\n") > 0;
+    char filePath[PATH_MAX];
+    for (size_t i = 0; ok && i < manifest.entryCount; i++) {
+        LCZipManifestEntry *entry = &manifest.entries[i];
+        struct stat st;
+        // only Mach-Os take the new stamp, anything else that changed is extracted again on the next update
+        if (snprintf(filePath, sizeof(filePath), "%s/%s", bundlePath, entry->name) < (int)sizeof(filePath) && lstat(filePath, &st) == 0 &&
+            S_ISREG(st.st_mode) && ((uint64_t)st.st_size != entry->installedSize || st.st_mtime != entry->installedMtime) && isMachO(filePath)) {
+            entry->installedSize = (uint64_t)st.st_size;
+            entry->installedMtime = st.st_mtime;
+        }
+        ok = fprintf(fp, "%08x %llu %lld %llu %lld %s\n", entry->crc32, (unsigned long long)entry->size, (long long)entry->mtime,
+                     (unsigned long long)entry->installedSize, (long long)entry->installedMtime, entry->name) > 0;
+    }
+    if (fp) {
+        ok &= fclose(fp) == 0;
+    }
+    ok = ok && rename(tmpPath, path) == 0;
+    if (!ok) {
+        unlink(tmpPath);
+    }
+    free(manifest.entries);
+    free(manifest.data);
+    return ok;
+}
+
+int LCZipExtractUpdate(LCZipArchive *zip, const char *destination, const char *installedBundle, int threadCount,
+                       LCZipProgressHandler progress, void *context, LCZipUpdateStats *stats) {
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    char prefix[PATH_MAX];
+    LCZipManifest manifest;
+    // without a manifest (installed before there were any, or not from a zip) everything is extracted
+    if (!LCZipFindBundle(zip, prefix, sizeof(prefix)) || !loadManifest(&manifest, installedBundle)) {
+        return extractEntries(zip, destination, threadCount, NULL, progress, context);
+    }
+    uint8_t *skip = calloc(zip->entryCount ? zip->entryCount : 1, 1);
+    if (!skip) {
+        free(manifest.entries);
+        free(manifest.data);
+        return setError(zip, "Out of memory");
+    }
+
+    // reused files are in place before anything is extracted, a file that can't be copied is simply extracted
+    mkdir(destination, 0755);
+    size_t prefixLength = strlen(prefix);
+    char source[PATH_MAX], path[PATH_MAX], lastParent[PATH_MAX] = "";
+    const LCZipObserver *observer = zip->observer;
+    for (size_t i = 0; i < zip->entryCount; i++) {
+        const LCZipEntry *entry = &zip->entries[i];
+        if (!isManifestEntry(entry, prefix, prefixLength)) {
+            continue;
+        }
+        LCZipManifestEntry key = {.name = entry->name + prefixLength};
+        const LCZipManifestEntry *recorded = bsearch(&key, manifest.entries, manifest.entryCount, sizeof(LCZipManifestEntry), compareManifestNames);
+        if (!recorded || recorded->crc32 != entry->crc32 || recorded->size != entry->uncompressedSize ||
+            snprintf(source, sizeof(source), "%s/%s", installedBundle, key.name) >= (int)sizeof(source) ||
+            snprintf(path, sizeof(path), "%s/%s", destination, entry->name) >= (int)sizeof(path) ||
+            !isReusable(source, recorded) || !makeParents(path, lastParent)) {
+            continue;
+        }
+        // a copy, cloned where the file system can, so signing the update never writes into the installed app
+        unlink(path);
+        if (LCCopyFile(source, path, 0, NULL) != 0) {
+            unlink(path);
+            continue;
+        }
+        // the manifest written after this update records the new entry's mtime
+        struct timespec times[2] = {{entry->mtime, 0}, {entry->mtime, 0}};
+        utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+        chmod(path, entryMode(entry, false) & 0777);
+        skip[i] = 1;
+        if (stats) {
+            stats->reusedFiles++;
+            stats->reusedBytes += entry->uncompressedSize;
+        }
+        if (observer && observer->reused) {
+            observer->reused(entry, path, observer->context);
+        }
+    }
+    free(manifest.entries);
+    free(manifest.data);
+
+    int ret = extractEntries(zip, destination, threadCount, skip, progress, context);
+    free(skip);
+    return ret;
+}
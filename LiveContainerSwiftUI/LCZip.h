@@ -0,0 +1,79 @@
+#pragma once
+// ZIP (IPA) extraction driven by the central directory, kept free of Foundation so it can also run headless on Linux
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct LCZipEntry {
+    const char *name;
+    uint64_t localHeaderOffset;
+    uint64_t compressedSize;
+    uint64_t uncompressedSize;
+    uint32_t crc32;
+    uint32_t externalAttributes;
+    uint16_t versionMadeBy;
+    uint16_t flags;
+    uint16_t method;
+    time_t mtime;
+} LCZipEntry;
+
+// Sees the data of regular files as it is written, so callers can look at it without reading the files back. begin
+// returns the entry's state or NULL to skip it. Entries may be observed concurrently, one entry's calls come in order
+// from a single thread and end is called for every non-NULL state.
+typedef struct LCZipObserver {
+    void *(*begin)(const LCZipEntry *entry, const char *path, void *context);
+    void (*write)(void *state, const void *bytes, size_t size);
+    void (*end)(void *state, bool success);
+    // optional, called instead of the above for files LCZipExtractUpdate took over from the installed bundle
+    void (*reused)(const LCZipEntry *entry, const char *path, void *context);
+    void *context;
+} LCZipObserver;
+
+typedef struct LCZipArchive {
+    int fd;
+    uint64_t fileSize;
+    LCZipEntry *entries;        // sorted by localHeaderOffset, i.e. in file order
+    size_t entryCount;
+    char *names;
+    uint64_t totalCompressed;
+    uint64_t totalUncompressed;
+    const LCZipObserver *observer;  // optional, set after LCZipOpen
+    char error[256];
+} LCZipArchive;
+
+// What LCZipExtractUpdate took over from the installed bundle instead of extracting
+typedef struct LCZipUpdateStats {
+    size_t reusedFiles;
+    uint64_t reusedBytes;       // uncompressed
+} LCZipUpdateStats;
+
+// Lists every file of the app as name, CRC, size and mtime in the archive and size and mtime on disk, so the next update
+// can tell what changed
+#define LC_ZIP_MANIFEST_NAME ".LCInstallManifest"
+
+// completed and total count compressed bytes. With several threads it is called from the workers, one at a time.
+typedef void (*LCZipProgressHandler)(uint64_t completed, uint64_t total, void *context);
+
+// Returns 0 on success, -1 with error filled otherwise. notZip tells a file without a central directory apart from a broken one.
+// LCZipClose has to be called either way.
+int LCZipOpen(LCZipArchive *zip, const char *path, bool *notZip);
+void LCZipClose(LCZipArchive *zip);
+// Extracts every entry below destination, returns 0 or -1 with zip->error filled. threadCount 1 reads the archive in one
+// sequential pass, more threads inflate whole entries concurrently with pread, 0 uses one thread per CPU.
+int LCZipExtractAll(LCZipArchive *zip, const char *destination, int threadCount, LCZipProgressHandler progress, void *context);
+
+// Finds the first Payload/<name>.app/ folder of an IPA and copies it, including the trailing slash, into prefix
+bool LCZipFindBundle(const LCZipArchive *zip, char *prefix, size_t size);
+// Extracts a single entry below destination, returns 0 or -1 with zip->error filled
+int LCZipExtractEntry(LCZipArchive *zip, const char *name, const char *destination);
+// Writes the manifest of the extracted app into <destination>/Payload/<name>.app, returns 0 or -1 with zip->error filled
+int LCZipWriteManifest(LCZipArchive *zip, const char *destination);
+// Records the Mach-Os of bundlePath as they are now, call it once LiveContainer patched or signed them. Until then
+// LCZipExtractUpdate treats them like any other modified file. Returns false if there is no manifest or it can't be written.
+bool LCZipStampManifest(const char *bundlePath);
+// LCZipExtractAll for an update of installedBundle. Files whose CRC and size match its manifest and whose size and mtime
+// on disk are still the recorded ones are copied from there, cloned where the file system can, instead of inflated.
+// Anything else is extracted again. Reused Mach-Os are the ones LiveContainer signed, signing the update redoes them.
+int LCZipExtractUpdate(LCZipArchive *zip, const char *destination, const char *installedBundle, int threadCount,
+                       LCZipProgressHandler progress, void *context, LCZipUpdateStats *stats);
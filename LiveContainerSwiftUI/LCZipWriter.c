@@ -0,0 +1,715 @@
+#include "LCZipWriter.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define LCZW_LOCAL_SIGNATURE 0x04034b50
+#define LCZW_DESCRIPTOR_SIGNATURE 0x08074b50
+#define LCZW_CENTRAL_SIGNATURE 0x02014b50
+#define LCZW_EOCD_SIGNATURE 0x06054b50
+#define LCZW_EOCD64_SIGNATURE 0x06064b50
+#define LCZW_EOCD64_LOCATOR_SIGNATURE 0x07064b50
+#define LCZW_EXTRA_ZIP64 0x0001
+#define LCZW_EXTRA_TIMESTAMP 0x5455
+#define LCZW_METHOD_STORED 0
+#define LCZW_METHOD_DEFLATED 8
+#define LCZW_FLAG_DESCRIPTOR 0x0008
+#define LCZW_FLAG_UTF8 0x0800
+#define LCZW_HOST_UNIX 3
+#define LCZW_VERSION 20
+#define LCZW_VERSION_ZIP64 45
+#define LCZW_DOS_DIRECTORY 0x10
+#define LCZW_MAX32 0xffffffffu
+#define LCZW_MAX16 0xffffu
+// a zip64 local header is needed before the compressed size is known, so leave room for deflate growing the data
+#define LCZW_ZIP64_THRESHOLD 0xff000000u
+
+#define LCZW_CHUNK_SIZE (1 << 20)
+#define LCZW_DICTIONARY_SIZE 32768
+#define LCZW_CHUNKS_PER_THREAD 4
+#define LCZW_MAX_THREADS 64
+#define LCZW_OUTPUT_BUFFER_SIZE (1 << 20)
+
+typedef struct LCZWEntry {
+    char *name;                 // relative to the folder, '/' terminated for folders
+    char *path;
+    uint64_t size;
+    mode_t mode;
+    time_t mtime;
+    bool stored;
+    bool zip64;                 // the local header carries a zip64 extra and the descriptor 8-byte sizes
+    size_t firstChunk;
+    size_t chunkCount;
+    uint32_t crc32;
+    uint64_t compressedSize;
+    uint64_t localHeaderOffset;
+} LCZWEntry;
+
+typedef struct LCZWChunk {
+    LCZWEntry *entry;
+    uint64_t offset;
+    uint32_t length;
+    bool last;
+    bool done;
+    uint8_t *data;              // what goes into the archive, owned until the writer has it out
+    size_t dataLength;
+    uint32_t crc32;
+} LCZWChunk;
+
+// Shared by the workers and the writer of one LCZipWriteFolder call
+typedef struct LCZWJob {
+    LCZWEntry *entries;         // sorted by name once the walk is done
+    size_t entryCount;
+    size_t entryCapacity;
+    LCZWChunk *chunks;          // in archive order
+    size_t chunkCount;
+    size_t nextChunk;           // next one to claim
+    size_t written;             // chunks the writer is done with, workers stay within window of it
+    size_t window;
+    int level;
+    bool failed;
+    char error[256];
+    pthread_mutex_t lock;       // guards claiming, done, written and failed
+    pthread_cond_t changed;
+    int fd;
+    uint8_t *output;
+    size_t outputLength;
+    uint64_t offset;            // bytes in the archive so far
+} LCZWJob;
+
+typedef struct LCZWWorker {
+    LCZWJob *job;
+    z_stream deflater;
+    uint8_t *input;             // dictionary and chunk
+} LCZWWorker;
+
+static void writeLE16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void writeLE32(uint8_t *p, uint32_t v) {
+    writeLE16(p, (uint16_t)v);
+    writeLE16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void writeLE64(uint8_t *p, uint64_t v) {
+    writeLE32(p, (uint32_t)v);
+    writeLE32(p + 4, (uint32_t)(v >> 32));
+}
+
+// Keeps the first error, callers hold the lock or run before the workers start
+static void jobFailLocked(LCZWJob *job, const char *format, ...) {
+    if (!job->failed) {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(job->error, sizeof(job->error), format, args);
+        va_end(args);
+    }
+    job->failed = true;
+    pthread_cond_broadcast(&job->changed);
+}
+
+static bool preadFully(int fd, void *buffer, size_t size, uint64_t offset) {
+    uint8_t *p = buffer;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void *buffer, size_t size) {
+    const uint8_t *p = buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Formats that are compressed already, deflating them again costs time and gains nothing
+static bool isCompressedAsset(const char *name) {
+    static const char *const extensions[] = {
+        "png", "jpg", "jpeg", "gif", "heic", "webp", "car", "mp4", "m4v", "mov", "m4a", "mp3", "aac", "ogg",
+        "zip", "ipa", "gz", "bz2", "xz", "lzfse", "7z",
+    };
+    const char *dot = strrchr(name, '.');
+    if (!dot || strchr(dot, '/')) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+        if (!strcasecmp(dot + 1, extensions[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool addEntry(LCZWJob *job, const char *name, const char *path, const struct stat *st) {
+    if (job->entryCount == job->entryCapacity) {
+        size_t capacity = job->entryCapacity ? job->entryCapacity * 2 : 256;
+        LCZWEntry *entries = realloc(job->entries, capacity * sizeof(LCZWEntry));
+        if (!entries) {
+            return false;
+        }
+        job->entries = entries;
+        job->entryCapacity = capacity;
+    }
+    LCZWEntry *entry = &job->entries[job->entryCount];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = strdup(name);
+    entry->path = strdup(path);
+    entry->mode = st->st_mode;
+    entry->mtime = st->st_mtime;
+    entry->size = S_ISREG(st->st_mode) ? (uint64_t)st->st_size : 0;
+    entry->stored = !S_ISREG(st->st_mode) || entry->size == 0 || isCompressedAsset(name);
+    if (!entry->name || !entry->path) {
+        free(entry->name);
+        free(entry->path);
+        return false;
+    }
+    job->entryCount++;
+    return true;
+}
+
+// path is a PATH_MAX buffer of which the first rootLength bytes are the folder being archived
+static bool walkFolder(LCZWJob *job, char *path, size_t length, size_t rootLength) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        jobFailLocked(job, "Can't open %s: %s", path, strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    struct dirent *item;
+    while (ok && (item = readdir(dir))) {
+        if (!strcmp(item->d_name, ".") || !strcmp(item->d_name, "..")) {
+            continue;
+        }
+        size_t nameLength = strlen(item->d_name);
+        if (length + nameLength + 3 > PATH_MAX) {
+            jobFailLocked(job, "Path too long: %s/%s", path, item->d_name);
+            ok = false;
+            break;
+        }
+        path[length] = '/';
+        memcpy(path + length + 1, item->d_name, nameLength + 1);
+        size_t childLength = length + 1 + nameLength;
+
+        struct stat st;
+        if (lstat(path, &st) != 0) {
+            jobFailLocked(job, "Can't read %s: %s", path, strerror(errno));
+            ok = false;
+        } else if (S_ISDIR(st.st_mode)) {
+            path[childLength] = '/';
+            path[childLength + 1] = '\0';
+            ok = addEntry(job, path + rootLength + 1, path, &st);
+            path[childLength] = '\0';
+            if (!ok) {
+                jobFailLocked(job, "Out of memory");
+            } else {
+                ok = walkFolder(job, path, childLength, rootLength);
+            }
+        } else if (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode)) {
+            if (!addEntry(job, path + rootLength + 1, path, &st)) {
+                jobFailLocked(job, "Out of memory");
+                ok = false;
+            }
+        }
+        path[length] = '\0';
+    }
+    closedir(dir);
+    return ok;
+}
+
+static int compareEntryNames(const void *a, const void *b) {
+    return strcmp(((const LCZWEntry *)a)->name, ((const LCZWEntry *)b)->name);
+}
+
+// Reads the chunk and deflates it on its own, primed with the 32K in front of it so the ratio barely suffers. Every
+// chunk but the last of an entry ends with a sync flush: byte aligned and not final, so the pieces join into one stream.
+static bool processChunk(LCZWWorker *worker, LCZWChunk *chunk) {
+    LCZWJob *job = worker->job;
+    LCZWEntry *entry = chunk->entry;
+    int fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        pthread_mutex_lock(&job->lock);
+        jobFailLocked(job, "Can't open %s: %s", entry->path, strerror(errno));
+        pthread_mutex_unlock(&job->lock);
+        return false;
+    }
+    size_t dictionaryLength = entry->stored ? 0 : (size_t)(chunk->offset < LCZW_DICTIONARY_SIZE ? chunk->offset : LCZW_DICTIONARY_SIZE);
+    uint8_t *input = entry->stored ? malloc(chunk->length ? chunk->length : 1) : worker->input;
+    bool ok = input && preadFully(fd, input, dictionaryLength + chunk->length, chunk->offset - dictionaryLength);
+    int error = errno;
+    close(fd);
+    if (!ok) {
+        if (entry->stored) {
+            free(input);
+        }
+        pthread_mutex_lock(&job->lock);
+        jobFailLocked(job, "Can't read %s: %s", entry->path, input ? (error ? strerror(error) : "the file shrank") : "out of memory");
+        pthread_mutex_unlock(&job->lock);
+        return false;
+    }
+    chunk->crc32 = (uint32_t)crc32(crc32(0, NULL, 0), input + dictionaryLength, chunk->length);
+    if (entry->stored) {
+        chunk->data = input;
+        chunk->dataLength = chunk->length;
+        return true;
+    }
+
+    z_stream *zs = &worker->deflater;
+    deflateReset(zs);
+    if (dictionaryLength) {
+        deflateSetDictionary(zs, input, (uInt)dictionaryLength);
+    }
+    size_t capacity = deflateBound(zs, chunk->length) + 16;
+    chunk->data = malloc(capacity);
+    zs->next_in = input + dictionaryLength;
+    zs->avail_in = chunk->length;
+    zs->next_out = chunk->data;
+    zs->avail_out = chunk->data ? (uInt)capacity : 0;
+    int flush = chunk->last ? Z_FINISH : Z_SYNC_FLUSH;
+    int ret = chunk->data ? deflate(zs, flush) : Z_MEM_ERROR;
+    if ((chunk->last && ret != Z_STREAM_END) || (!chunk->last && (ret != Z_OK || zs->avail_in != 0 || zs->avail_out == 0))) {
+        free(chunk->data);
+        chunk->data = NULL;
+        pthread_mutex_lock(&job->lock);
+        jobFailLocked(job, "Can't compress %s", entry->name);
+        pthread_mutex_unlock(&job->lock);
+        return false;
+    }
+    chunk->dataLength = capacity - zs->avail_out;
+    return true;
+}
+
+static bool workerInit(LCZWWorker *worker, LCZWJob *job) {
+    memset(worker, 0, sizeof(*worker));
+    worker->job = job;
+    worker->input = malloc(LCZW_DICTIONARY_SIZE + LCZW_CHUNK_SIZE);
+    return worker->input && deflateInit2(&worker->deflater, job->level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+static void workerDestroy(LCZWWorker *worker) {
+    if (worker->deflater.state) {
+        deflateEnd(&worker->deflater);
+    }
+    free(worker->input);
+}
+
+// Claims chunks in archive order, never more than window ahead of the writer so memory stays bounded
+static void *compressWorker(void *arg) {
+    LCZWJob *job = arg;
+    LCZWWorker worker;
+    if (!workerInit(&worker, job)) {
+        workerDestroy(&worker);
+        // the writer compresses whatever nobody claims, so this only costs parallelism
+        return NULL;
+    }
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+        while (!job->failed && job->nextChunk < job->chunkCount && job->nextChunk >= job->written + job->window) {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        if (job->failed || job->nextChunk >= job->chunkCount) {
+            break;
+        }
+        LCZWChunk *chunk = &job->chunks[job->nextChunk++];
+        pthread_mutex_unlock(&job->lock);
+        bool ok = processChunk(&worker, chunk);
+        pthread_mutex_lock(&job->lock);
+        if (!ok) {
+            break;
+        }
+        chunk->done = true;
+        pthread_cond_broadcast(&job->changed);
+    }
+    pthread_mutex_unlock(&job->lock);
+    workerDestroy(&worker);
+    return NULL;
+}
+
+static bool emit(LCZWJob *job, const void *data, size_t size) {
+    job->offset += size;
+    if (job->outputLength + size > LCZW_OUTPUT_BUFFER_SIZE) {
+        if (!writeFully(job->fd, job->output, job->outputLength)) {
+            return false;
+        }
+        job->outputLength = 0;
+        if (size > LCZW_OUTPUT_BUFFER_SIZE) {
+            return writeFully(job->fd, data, size);
+        }
+    }
+    memcpy(job->output + job->outputLength, data, size);
+    job->outputLength += size;
+    return true;
+}
+
+static void dosTime(time_t mtime, uint16_t *time, uint16_t *date) {
+    struct tm tm;
+    if (!localtime_r(&mtime, &tm) || tm.tm_year < 80) {
+        *time = 0;
+        *date = (1 << 5) | 1;
+        return;
+    }
+    *time = (uint16_t)(tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2);
+    *date = (uint16_t)((tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday);
+}
+
+static uint32_t externalAttributes(const LCZWEntry *entry) {
+    return (uint32_t)entry->mode << 16 | (S_ISDIR(entry->mode) ? LCZW_DOS_DIRECTORY : 0);
+}
+
+static bool hasDescriptor(const LCZWEntry *entry) {
+    return entry->chunkCount > 0;
+}
+
+static bool writeLocalHeader(LCZWJob *job, LCZWEntry *entry) {
+    uint8_t header[30 + 9 + 20];
+    size_t nameLength = strlen(entry->name);
+    uint16_t time, date;
+    dosTime(entry->mtime, &time, &date);
+    entry->localHeaderOffset = job->offset;
+    entry->zip64 = entry->size >= LCZW_ZIP64_THRESHOLD;
+    bool descriptor = hasDescriptor(entry);
+    size_t extraLength = 9 + (entry->zip64 ? 20 : 0);
+    writeLE32(header, LCZW_LOCAL_SIGNATURE);
+    writeLE16(header + 4, entry->zip64 ? LCZW_VERSION_ZIP64 : LCZW_VERSION);
+    writeLE16(header + 6, LCZW_FLAG_UTF8 | (descriptor ? LCZW_FLAG_DESCRIPTOR : 0));
+    writeLE16(header + 8, entry->stored ? LCZW_METHOD_STORED : LCZW_METHOD_DEFLATED);
+    writeLE16(header + 10, time);
+    writeLE16(header + 12, date);
+    // with a descriptor CRC and sizes follow the data, entries without data are complete here
+    writeLE32(header + 14, descriptor ? 0 : entry->crc32);
+    writeLE32(header + 18, entry->zip64 ? LCZW_MAX32 : descriptor ? 0 : (uint32_t)entry->compressedSize);
+    writeLE32(header + 22, entry->zip64 ? LCZW_MAX32 : descriptor ? 0 : (uint32_t)entry->size);
+    writeLE16(header + 26, (uint16_t)nameLength);
+    writeLE16(header + 28, (uint16_t)extraLength);
+    uint8_t *extra = header + 30;
+    writeLE16(extra, LCZW_EXTRA_TIMESTAMP);
+    writeLE16(extra + 2, 5);
+    extra[4] = 1;
+    writeLE32(extra + 5, (uint32_t)entry->mtime);
+    if (entry->zip64) {
+        writeLE16(extra + 9, LCZW_EXTRA_ZIP64);
+        writeLE16(extra + 11, 16);
+        writeLE64(extra + 13, 0);
+        writeLE64(extra + 21, 0);
+    }
+    return emit(job, header, 30) && emit(job, entry->name, nameLength) && emit(job, extra, extraLength);
+}
+
+static bool writeDescriptor(LCZWJob *job, const LCZWEntry *entry) {
+    uint8_t descriptor[24];
+    writeLE32(descriptor, LCZW_DESCRIPTOR_SIGNATURE);
+    writeLE32(descriptor + 4, entry->crc32);
+    if (entry->zip64) {
+        writeLE64(descriptor + 8, entry->compressedSize);
+        writeLE64(descriptor + 16, entry->size);
+        return emit(job, descriptor, 24);
+    }
+    writeLE32(descriptor + 8, (uint32_t)entry->compressedSize);
+    writeLE32(descriptor + 12, (uint32_t)entry->size);
+    return emit(job, descriptor, 16);
+}
+
+static bool writeCentralDirectory(LCZWJob *job) {
+    uint64_t centralOffset = job->offset;
+    for (size_t i = 0; i < job->entryCount; i++) {
+        const LCZWEntry *entry = &job->entries[i];
+        uint8_t header[46], extra[9 + 28];
+        size_t nameLength = strlen(entry->name), extraLength = 9;
+        bool wideSize = entry->size >= LCZW_MAX32, wideCompressed = entry->compressedSize >= LCZW_MAX32, wideOffset = entry->localHeaderOffset >= LCZW_MAX32;
+        bool zip64 = entry->zip64 || wideSize || wideCompressed || wideOffset;
+        uint16_t time, date;
+        dosTime(entry->mtime, &time, &date);
+        writeLE32(header, LCZW_CENTRAL_SIGNATURE);
+        writeLE16(header + 4, LCZW_HOST_UNIX << 8 | (zip64 ? LCZW_VERSION_ZIP64 : LCZW_VERSION));
+        writeLE16(header + 6, zip64 ? LCZW_VERSION_ZIP64 : LCZW_VERSION);
+        writeLE16(header + 8, LCZW_FLAG_UTF8 | (hasDescriptor(entry) ? LCZW_FLAG_DESCRIPTOR : 0));
+        writeLE16(header + 10, entry->stored ? LCZW_METHOD_STORED : LCZW_METHOD_DEFLATED);
+        writeLE16(header + 12, time);
+        writeLE16(header + 14, date);
+        writeLE32(header + 16, entry->crc32);
+        writeLE32(header + 20, wideCompressed ? LCZW_MAX32 : (uint32_t)entry->compressedSize);
+        writeLE32(header + 24, wideSize ? LCZW_MAX32 : (uint32_t)entry->size);
+        writeLE16(header + 28, (uint16_t)nameLength);
+        writeLE16(header + 32, 0);
+        writeLE16(header + 34, 0);
+        writeLE16(header + 36, 0);
+        writeLE32(header + 38, externalAttributes(entry));
+        writeLE32(header + 42, wideOffset ? LCZW_MAX32 : (uint32_t)entry->localHeaderOffset);
+        writeLE16(extra, LCZW_EXTRA_TIMESTAMP);
+        writeLE16(extra + 2, 5);
+        extra[4] = 1;
+        writeLE32(extra + 5, (uint32_t)entry->mtime);
+        if (wideSize || wideCompressed || wideOffset) {
+            // only the fields that saturated, in this order
+            uint8_t *p = extra + 13;
+            if (wideSize) {
+                writeLE64(p, entry->size);
+                p += 8;
+            }
+            if (wideCompressed) {
+                writeLE64(p, entry->compressedSize);
+                p += 8;
+            }
+            if (wideOffset) {
+                writeLE64(p, entry->localHeaderOffset);
+                p += 8;
+            }
+            writeLE16(extra + 9, LCZW_EXTRA_ZIP64);
+            writeLE16(extra + 11, (uint16_t)(p - extra - 13));
+            extraLength = (size_t)(p - extra);
+        }
+        writeLE16(header + 30, (uint16_t)extraLength);
+        if (!emit(job, header, sizeof(header)) || !emit(job, entry->name, nameLength) || !emit(job, extra, extraLength)) {
+            return false;
+        }
+    }
+
+    uint64_t centralSize = job->offset - centralOffset;
+    bool zip64 = job->entryCount >= LCZW_MAX16 || centralOffset >= LCZW_MAX32 || centralSize >= LCZW_MAX32;
+    if (zip64) {
+        uint8_t eocd64[56 + 20];
+        uint64_t eocd64Offset = job->offset;
+        writeLE32(eocd64, LCZW_EOCD64_SIGNATURE);
+        writeLE64(eocd64 + 4, 44);
+        writeLE16(eocd64 + 12, LCZW_HOST_UNIX << 8 | LCZW_VERSION_ZIP64);
+        writeLE16(eocd64 + 14, LCZW_VERSION_ZIP64);
+        writeLE32(eocd64 + 16, 0);
+        writeLE32(eocd64 + 20, 0);
+        writeLE64(eocd64 + 24, job->entryCount);
+        writeLE64(eocd64 + 32, job->entryCount);
+        writeLE64(eocd64 + 40, centralSize);
+        writeLE64(eocd64 + 48, centralOffset);
+        writeLE32(eocd64 + 56, LCZW_EOCD64_LOCATOR_SIGNATURE);
+        writeLE32(eocd64 + 60, 0);
+        writeLE64(eocd64 + 64, eocd64Offset);
+        writeLE32(eocd64 + 72, 1);
+        if (!emit(job, eocd64, sizeof(eocd64))) {
+            return false;
+        }
+    }
+    uint8_t eocd[22];
+    uint16_t count = zip64 ? LCZW_MAX16 : (uint16_t)job->entryCount;
+    writeLE32(eocd, LCZW_EOCD_SIGNATURE);
+    writeLE16(eocd + 4, 0);
+    writeLE16(eocd + 6, 0);
+    writeLE16(eocd + 8, count);
+    writeLE16(eocd + 10, count);
+    writeLE32(eocd + 12, zip64 ? LCZW_MAX32 : (uint32_t)centralSize);
+    writeLE32(eocd + 16, zip64 ? LCZW_MAX32 : (uint32_t)centralOffset);
+    writeLE16(eocd + 20, 0);
+    return emit(job, eocd, sizeof(eocd)) && writeFully(job->fd, job->output, job->outputLength);
+}
+
+// The writer emits the entries in order, compressing whatever chunk it waits for that nobody claimed yet
+static bool writeEntries(LCZWJob *job, LCZWWorker *worker) {
+    for (size_t i = 0; i < job->entryCount; i++) {
+        LCZWEntry *entry = &job->entries[i];
+        if (S_ISLNK(entry->mode)) {
+            char target[PATH_MAX];
+            ssize_t length = readlink(entry->path, target, sizeof(target));
+            if (length < 0) {
+                pthread_mutex_lock(&job->lock);
+                jobFailLocked(job, "Can't read %s: %s", entry->path, strerror(errno));
+                pthread_mutex_unlock(&job->lock);
+                return false;
+            }
+            entry->size = entry->compressedSize = (uint64_t)length;
+            entry->crc32 = (uint32_t)crc32(crc32(0, NULL, 0), (const Bytef *)target, (uInt)length);
+            if (!writeLocalHeader(job, entry) || !emit(job, target, (size_t)length)) {
+                return false;
+            }
+            continue;
+        }
+        entry->crc32 = (uint32_t)crc32(0, NULL, 0);
+        if (!writeLocalHeader(job, entry)) {
+            return false;
+        }
+        for (size_t c = entry->firstChunk; c < entry->firstChunk + entry->chunkCount; c++) {
+            LCZWChunk *chunk = &job->chunks[c];
+            pthread_mutex_lock(&job->lock);
+            while (!job->failed && !chunk->done) {
+                if (job->nextChunk == c) {
+                    job->nextChunk++;
+                    pthread_mutex_unlock(&job->lock);
+                    bool ok = processChunk(worker, chunk);
+                    pthread_mutex_lock(&job->lock);
+                    chunk->done = ok;
+                } else {
+                    pthread_cond_wait(&job->changed, &job->lock);
+                }
+            }
+            bool failed = job->failed;
+            pthread_mutex_unlock(&job->lock);
+            if (failed) {
+                return false;
+            }
+
+            bool ok = emit(job, chunk->data, chunk->dataLength);
+            entry->crc32 = (uint32_t)crc32_combine(entry->crc32, chunk->crc32, chunk->length);
+            entry->compressedSize += chunk->dataLength;
+            free(chunk->data);
+            chunk->data = NULL;
+            pthread_mutex_lock(&job->lock);
+            job->written = c + 1;
+            pthread_cond_broadcast(&job->changed);
+            pthread_mutex_unlock(&job->lock);
+            if (!ok) {
+                return false;
+            }
+        }
+        if (hasDescriptor(entry) && !writeDescriptor(job, entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int LCZipWriteFolder(const char *folder, const char *output, int threadCount, int level, LCZipWriterStats *stats, char *error, size_t errorSize) {
+    LCZWJob job = {0};
+    job.level = level;
+    job.fd = -1;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.changed, NULL);
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+    if (threadCount <= 0) {
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threadCount > LCZW_MAX_THREADS) {
+        threadCount = LCZW_MAX_THREADS;
+    }
+
+    char path[PATH_MAX];
+    size_t rootLength = strlen(folder);
+    while (rootLength > 1 && folder[rootLength - 1] == '/') {
+        rootLength--;
+    }
+    if (rootLength + 2 > PATH_MAX) {
+        jobFailLocked(&job, "Path too long: %s", folder);
+    } else {
+        memcpy(path, folder, rootLength);
+        path[rootLength] = '\0';
+        walkFolder(&job, path, rootLength, rootLength);
+    }
+
+    // split files into chunks, in name order so the archive comes out the same every time
+    if (!job.failed) {
+        qsort(job.entries, job.entryCount, sizeof(LCZWEntry), compareEntryNames);
+        for (size_t i = 0; i < job.entryCount; i++) {
+            job.chunkCount += S_ISREG(job.entries[i].mode) ? (size_t)((job.entries[i].size + LCZW_CHUNK_SIZE - 1) / LCZW_CHUNK_SIZE) : 0;
+        }
+        job.chunks = calloc(job.chunkCount ? job.chunkCount : 1, sizeof(LCZWChunk));
+        job.output = malloc(LCZW_OUTPUT_BUFFER_SIZE);
+        if (!job.chunks || !job.output) {
+            jobFailLocked(&job, "Out of memory");
+        }
+    }
+    size_t chunkIndex = 0;
+    for (size_t i = 0; !job.failed && i < job.entryCount; i++) {
+        LCZWEntry *entry = &job.entries[i];
+        entry->firstChunk = chunkIndex;
+        for (uint64_t offset = 0; S_ISREG(entry->mode) && offset < entry->size; offset += LCZW_CHUNK_SIZE) {
+            LCZWChunk *chunk = &job.chunks[chunkIndex++];
+            chunk->entry = entry;
+            chunk->offset = offset;
+            chunk->length = (uint32_t)(entry->size - offset < LCZW_CHUNK_SIZE ? entry->size - offset : LCZW_CHUNK_SIZE);
+            chunk->last = offset + chunk->length == entry->size;
+            entry->chunkCount++;
+        }
+    }
+
+    if (!job.failed) {
+        job.fd = open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (job.fd < 0) {
+            jobFailLocked(&job, "Can't create %s: %s", output, strerror(errno));
+        }
+    }
+    LCZWWorker worker = {0};
+    if (!job.failed && !workerInit(&worker, &job)) {
+        jobFailLocked(&job, "Out of memory");
+    }
+    if (!job.failed) {
+        job.window = (size_t)threadCount * LCZW_CHUNKS_PER_THREAD;
+        pthread_t threads[LCZW_MAX_THREADS];
+        int started = 0;
+        for (; started < threadCount - 1; started++) {
+            if (pthread_create(&threads[started], NULL, compressWorker, &job) != 0) {
+                break;
+            }
+        }
+        // the calling thread writes, and compresses too when the workers fall behind
+        bool ok = writeEntries(&job, &worker) && writeCentralDirectory(&job);
+        pthread_mutex_lock(&job.lock);
+        if (!ok) {
+            jobFailLocked(&job, "Can't write %s: %s", output, strerror(errno));
+        }
+        pthread_mutex_unlock(&job.lock);
+        for (int i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    workerDestroy(&worker);
+
+    if (job.fd >= 0 && close(job.fd) != 0 && !job.failed) {
+        jobFailLocked(&job, "Can't write %s: %s", output, strerror(errno));
+    }
+    if (job.failed && job.fd >= 0) {
+        unlink(output);
+    }
+    if (stats && !job.failed) {
+        stats->entries = job.entryCount;
+        for (size_t i = 0; i < job.entryCount; i++) {
+            stats->storedFiles += S_ISREG(job.entries[i].mode) && job.entries[i].stored && job.entries[i].size > 0;
+            stats->uncompressedBytes += job.entries[i].size;
+            stats->compressedBytes += job.entries[i].compressedSize;
+        }
+    }
+    if (error && errorSize) {
+        snprintf(error, errorSize, "%s", job.error);
+    }
+    for (size_t i = 0; i < job.chunkCount; i++) {
+        free(job.chunks[i].data);
+    }
+    for (size_t i = 0; i < job.entryCount; i++) {
+        free(job.entries[i].name);
+        free(job.entries[i].path);
+    }
+    free(job.chunks);
+    free(job.entries);
+    free(job.output);
+    pthread_cond_destroy(&job.changed);
+    pthread_mutex_destroy(&job.lock);
+    return job.failed ? -1 : 0;
+}
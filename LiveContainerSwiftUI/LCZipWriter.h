@@ -0,0 +1,17 @@
+#pragma once
+// ZIP (IPA) creation that deflates entries, and 1MB blocks of large entries, concurrently, kept free of Foundation so it
+// can also run headless on Linux
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct LCZipWriterStats {
+    size_t entries;
+    size_t storedFiles;             // already compressed assets (PNG, CAR, MP4...), written as they are
+    uint64_t uncompressedBytes;
+    uint64_t compressedBytes;
+} LCZipWriterStats;
+
+// Archives everything below folder into a new file at output, with names relative to folder. level is a zlib level,
+// threadCount 0 uses one thread per CPU. Returns 0, or -1 with error filled and output removed. stats is optional.
+int LCZipWriteFolder(const char *folder, const char *output, int threadCount, int level, LCZipWriterStats *stats, char *error, size_t errorSize);
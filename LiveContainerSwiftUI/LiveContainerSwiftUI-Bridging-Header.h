@@ -10,6 +10,8 @@
 #include "../LiveContainer/LCSharedUtils.h"
 #include "LCUtils.h"
 #include "unarchive.h"
+#include "LCCopy.h"
+#include "LCBlobStore.h"
 #include "../MultitaskSupport/AppSceneViewController.h"
 #include "../MultitaskSupport/DecoratedAppSceneViewController.h"
 #include "../MultitaskSupport/LCStatusBarManager.h"
@@ -25,13 +25,7 @@ struct LiveContainerSwiftUIApp : SwiftUI.App {
         do {
             // load apps
             try fm.createDirectory(at: LCPath.bundlePath, withIntermediateDirectories: true)
-            let appDirs = try fm.contentsOfDirectory(atPath: LCPath.bundlePath.path)
-            for appDir in appDirs {
-                if !appDir.hasSuffix(".app") {
-                    continue
-                }
-                let newApp = LCAppInfo(bundlePath: "\(LCPath.bundlePath.path)/\(appDir)")!
-                newApp.relativeBundlePath = appDir
+            for newApp in LCAppInfo.appInfos(inFolder: LCPath.bundlePath.path) {
                 newApp.isShared = false
                 if newApp.isHidden {
                     tempHiddenApps.append(LCAppModel(appInfo: newApp))
@@ -42,13 +36,7 @@ struct LiveContainerSwiftUIApp : SwiftUI.App {
             }
             if LCPath.lcGroupDocPath != LCPath.docPath {
                 try fm.createDirectory(at: LCPath.lcGroupBundlePath, withIntermediateDirectories: true)
-                let appDirsShared = try fm.contentsOfDirectory(atPath: LCPath.lcGroupBundlePath.path)
-                for appDir in appDirsShared {
-                    if !appDir.hasSuffix(".app") {
-                        continue
-                    }
-                    let newApp = LCAppInfo(bundlePath: "\(LCPath.lcGroupBundlePath.path)/\(appDir)")!
-                    newApp.relativeBundlePath = appDir
+                for newApp in LCAppInfo.appInfos(inFolder: LCPath.lcGroupBundlePath.path) {
                     newApp.isShared = true
                     if newApp.isHidden {
                         tempHiddenApps.append(LCAppModel(appInfo: newApp))
@@ -83,6 +71,13 @@ struct LiveContainerSwiftUIApp : SwiftUI.App {
             NSLog("[LC] error:\(error)")
         }
         
+        // refcounts drift when apps are removed or re-signed behind our back, only the primary LiveContainer manages apps
+        if DataManager.shared.model.multiLCStatus != 2 {
+            DispatchQueue.global(qos: .background).async {
+                LCUtils.checkBlobStores()
+            }
+        }
+        
         DataManager.shared.model.apps = tempApps
         DataManager.shared.model.hiddenApps = tempHiddenApps
         if let tempURLSchemes {
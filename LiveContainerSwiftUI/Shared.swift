@@ -43,6 +43,8 @@ struct LCPath {
     public static let lcGroupDataPath = lcGroupDocPath.appendingPathComponent("Data/Application")
     public static let lcGroupAppGroupPath = lcGroupDocPath.appendingPathComponent("Data/AppGroup")
     public static let lcGroupTweakPath = lcGroupDocPath.appendingPathComponent("Tweaks")
+    public static let blobStorePath = docPath.appendingPathComponent(".LCBlobStore")
+    public static let lcGroupBlobStorePath = lcGroupDocPath.appendingPathComponent(".LCBlobStore")
     
     public static func ensureAppGroupPaths() throws {
         let fm = FileManager()
@@ -597,9 +599,7 @@ extension LCUtils {
         info["CFBundleExecutable"] = "LiveContainer.tmp";
         let nsInfo = info as NSDictionary
         nsInfo.write(to: tmpInfoPath, atomically: true)
-        do {
-            try fm.copyItem(at: Bundle.main.executableURL!, to: tmpExecPath)
-        } catch {
+        guard LCCopyFile(Bundle.main.executableURL!.path, tmpExecPath.path, 0, nil) == 0 else {
             return nil
         }
         LCPatchAppBundleFixupARM64eSlice(url)
@@ -716,7 +716,10 @@ extension LCUtils {
             
             let tmpPath = tmpDir.appendingPathComponent(fileURL.lastPathComponent)
             tmpPaths.append(tmpPath)
-            try fm.copyItem(at: fileURL, to: tmpPath)
+            let copied = fileType == FileAttributeType.typeDirectory ? LCCopyTree(fileURL.path, tmpPath.path, 0, 0, nil) : LCCopyFile(fileURL.path, tmpPath.path, 0, nil)
+            guard copied == 0 else {
+                throw POSIXError(POSIXErrorCode(rawValue: errno) ?? .EIO)
+            }
         }
         
         if tmpPaths.isEmpty {
@@ -796,6 +799,48 @@ extension LCUtils {
         }
     }
     
+    // blobs are cloned into bundles, so each bundle folder has its store next to it
+    public static func blobStorePath(forBundle bundlePath: String) -> URL {
+        if bundlePath.hasPrefix(LCPath.lcGroupBundlePath.path + "/") {
+            return LCPath.lcGroupBlobStorePath
+        }
+        return LCPath.blobStorePath
+    }
+    
+    // replace files other installed apps have too with clones of one shared copy
+    public static func shareBundleFiles(bundlePath: String) async {
+        await Task.detached(priority: .utility) {
+            var stats = LCBlobStoreStats()
+            if LCBlobStoreAdd(LCUtils.blobStorePath(forBundle: bundlePath).path, bundlePath, 0, 0, &stats) != 0 {
+                NSLog("[LC] can't share files of \(bundlePath): \(String(cString: strerror(errno)))")
+                return
+            }
+            NSLog("[LC] shared \(stats.sharedFiles) of \(stats.files) files (\(stats.sharedBytes) bytes) of \(bundlePath)")
+        }.value
+    }
+    
+    // call before the bundle is removed or moved to the other bundle folder
+    public static func releaseBundleFiles(bundlePath: String) {
+        if LCBlobStoreRelease(blobStorePath(forBundle: bundlePath).path, bundlePath, nil) != 0 {
+            NSLog("[LC] can't release shared files of \(bundlePath): \(String(cString: strerror(errno)))")
+        }
+    }
+    
+    public static func checkBlobStores() {
+        var stores = [(LCPath.blobStorePath, LCPath.bundlePath)]
+        if LCPath.lcGroupDocPath != LCPath.docPath {
+            stores.append((LCPath.lcGroupBlobStorePath, LCPath.lcGroupBundlePath))
+        }
+        for (storePath, bundleRoot) in stores where FileManager.default.fileExists(atPath: storePath.path) {
+            var report = LCBlobStoreCheckReport()
+            if LCBlobStoreCheck(storePath.path, bundleRoot.path, 0, &report) != 0 {
+                NSLog("[LC] can't check \(storePath.path): \(String(cString: strerror(errno)))")
+            } else if report.fixedRefcounts + report.staleRefs + report.restoredBlobs + report.removedBlobs > 0 {
+                NSLog("[LC] repaired \(storePath.path): \(report.fixedRefcounts) refcounts, \(report.staleRefs) stale refs, \(report.restoredBlobs) restored, \(report.removedBlobs) removed")
+            }
+        }
+    }
+    
     public static func authenticateUser() async throws -> Bool {
         if DataManager.shared.model.isHiddenAppUnlocked {
             return true
@@ -1,3 +1,7 @@
 #import <Foundation/Foundation.h>
 
-extern int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progress);
+// hashCodePages keeps the code page hashes of every Mach-O in an IPA for the forced sign that follows the install.
+// installedBundlePath is the version an update replaces, files the IPA didn't change are taken over from there.
+extern int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progress, BOOL hashCodePages, NSString* installedBundlePath);
+// Only extracts Payload/*.app/Info.plist, so the app can be looked at before the rest. Fails for anything but a zip.
+extern BOOL extractInfoPlist(NSString* fileToExtract, NSString* extractionPath);
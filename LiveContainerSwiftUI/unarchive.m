@@ -2,6 +2,8 @@
 
 #include "archive.h"
 #include "archive_entry.h"
+#include "LCZip.h"
+#include "LCPageHash.h"
 
 static int
 copy_data(struct archive *ar, struct archive *aw, NSProgress *progress)
@@ -22,11 +24,31 @@ copy_data(struct archive *ar, struct archive *aw, NSProgress *progress)
       fprintf(stderr, "%s\n", archive_error_string(aw));
       return (r);
     }
-    progress.completedUnitCount += size;
+    progress.completedUnitCount = archive_filter_bytes(ar, -1);
   }
 }
 
-int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progress)
+static void updateZipProgress(uint64_t completed, uint64_t total, void *context)
+{
+    NSProgress *progress = (__bridge NSProgress *)context;
+    // every small entry calls back, only publish steps of 1MB to keep KVO observers quiet
+    if (completed == total || completed - (uint64_t)progress.completedUnitCount >= (1 << 20)) {
+        progress.completedUnitCount = (int64_t)completed;
+    }
+}
+
+BOOL extractInfoPlist(NSString* fileToExtract, NSString* extractionPath)
+{
+    LCZipArchive zip;
+    char name[PATH_MAX];
+    BOOL ok = LCZipOpen(&zip, fileToExtract.fileSystemRepresentation, NULL) == 0 &&
+        LCZipFindBundle(&zip, name, sizeof(name) - 10) &&
+        LCZipExtractEntry(&zip, strcat(name, "Info.plist"), extractionPath.fileSystemRepresentation) == 0;
+    LCZipClose(&zip);
+    return ok;
+}
+
+int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progress, BOOL hashCodePages, NSString* installedBundlePath)
 {
     struct archive *a;
     struct archive *ext;
@@ -34,34 +56,46 @@ int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progr
     int flags;
     int r;
 
+    // IPAs are zips: sizes and offsets come from the central directory, then one sequential pass extracts everything
+    LCZipArchive zip;
+    bool notZip = false;
+    if (LCZipOpen(&zip, fileToExtract.fileSystemRepresentation, &notZip) == 0) {
+        progress.totalUnitCount = (int64_t)zip.totalCompressed;
+        // Mach-Os are hashed while they are written, so signing doesn't have to read them back
+        if (hashCodePages)
+            zip.observer = &LCPageHashZipObserver;
+        if (installedBundlePath) {
+            LCZipUpdateStats stats;
+            r = LCZipExtractUpdate(&zip, extractionPath.fileSystemRepresentation, installedBundlePath.fileSystemRepresentation, 0, updateZipProgress, (__bridge void *)progress, &stats);
+            NSLog(@"[LC] update kept %zu files (%llu bytes) of %@", stats.reusedFiles, stats.reusedBytes, installedBundlePath.lastPathComponent);
+        } else {
+            r = LCZipExtractAll(&zip, extractionPath.fileSystemRepresentation, 0, updateZipProgress, (__bridge void *)progress);
+        }
+        if (r != 0)
+            fprintf(stderr, "%s\n", zip.error);
+        // the next update diffs against this, without it that one extracts everything
+        else if (LCZipWriteManifest(&zip, extractionPath.fileSystemRepresentation) != 0)
+            fprintf(stderr, "%s\n", zip.error);
+        LCZipClose(&zip);
+        return r == 0 ? 0 : 1;
+    }
+    LCZipClose(&zip);
+    if (!notZip) {
+        fprintf(stderr, "%s\n", zip.error);
+        return 1;
+    }
+
     /* Select which attributes we want to restore. */
     flags = ARCHIVE_EXTRACT_TIME;
     flags |= ARCHIVE_EXTRACT_PERM;
     flags |= ARCHIVE_EXTRACT_ACL;
     flags |= ARCHIVE_EXTRACT_FFLAGS;
 
-    // Calculate decompressed size
-    a = archive_read_new();
-    archive_read_support_format_all(a);
-    archive_read_support_filter_all(a);
-    if ((r = archive_read_open_filename(a, fileToExtract.fileSystemRepresentation, 10240))) {
-        archive_read_free(a);
-        return 1;
-    }
-    while ((r = archive_read_next_header(a, &entry)) != ARCHIVE_EOF) {
-        if (r < ARCHIVE_OK)
-            fprintf(stderr, "%s\n", archive_error_string(a));
-        if (r < ARCHIVE_WARN) {
-            archive_read_close(a);
-            archive_read_free(a);
-            return 1;
-        }
-        progress.totalUnitCount += archive_entry_size(entry);
-    }
-    archive_read_close(a);
-    archive_read_free(a);
+    // Other formats: report the archive bytes consumed against the file size, so one pass is enough
+    NSNumber *fileSize = nil;
+    [[NSURL fileURLWithPath:fileToExtract] getResourceValue:&fileSize forKey:NSURLFileSizeKey error:nil];
+    progress.totalUnitCount = fileSize.longLongValue;
 
-    // Re-open the archive and extract
     a = archive_read_new();
     archive_read_support_format_all(a);
     archive_read_support_filter_all(a);
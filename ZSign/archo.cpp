@@ -2,8 +2,8 @@
 #include "json.h"
 #include "archo.h"
 #include "signing.h"
-
-uint64_t ZArchO::s_uExecSegLimit = 0;
+#include "verify.h"
+#include "trace.h"
 
 ZArchO::ZArchO()
 {
@@ -22,6 +22,8 @@ ZArchO::ZArchO()
 	m_pCodeSignSegment = NULL;
 	m_pLinkEditSegment = NULL;
 	m_uLoadCommandsFreeSpace = 0;
+	m_uExecSegLimit = 0;
+	dirty_ranges_reset(&m_Dirty);
 }
 
 bool ZArchO::Init(uint8_t* pBase, uint32_t uLength)
@@ -43,71 +45,34 @@ bool ZArchO::Init(uint8_t* pBase, uint32_t uLength)
 	m_bBigEndian = (MH_CIGAM == m_pHeader->magic || MH_CIGAM_64 == m_pHeader->magic) ? true : false;
 	m_uHeaderSize = m_b64Bit ? sizeof(mach_header_64) : sizeof(mach_header);
 
-	uint8_t* pLoadCommand = m_pBase + m_uHeaderSize;
-	for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-		load_command* plc = (load_command*)pLoadCommand;
-		switch (BO(plc->cmd)) {
-		case LC_SEGMENT:
-		{
-			segment_command* seglc = (segment_command*)pLoadCommand;
-			if (0 == strcmp("__TEXT", seglc->segname)) {
-				s_uExecSegLimit = seglc->vmsize;
-				for (uint32_t j = 0; j < BO(seglc->nsects); j++) {
-					section* sect = (section*)((pLoadCommand + sizeof(segment_command)) + sizeof(section) * j);
-					if (0 == strcmp("__text", sect->sectname)) {
-						if (BO(sect->offset) > (BO(m_pHeader->sizeofcmds) + m_uHeaderSize)) {
-							m_uLoadCommandsFreeSpace = BO(sect->offset) - BO(m_pHeader->sizeofcmds) - m_uHeaderSize;
-						}
-					} else if (0 == strcmp("__info_plist", sect->sectname)) {
-						m_strInfoPlist.append((const char*)m_pBase + BO(sect->offset), BO(sect->size));
-					}
-				}
-			} else if (0 == strcmp("__LINKEDIT", seglc->segname)) {
-				m_pLinkEditSegment = pLoadCommand;
-			}
-		}
-		break;
-		case LC_SEGMENT_64:
-		{
-			segment_command_64* seglc = (segment_command_64*)pLoadCommand;
-			if (0 == strcmp("__TEXT", seglc->segname)) {
-				s_uExecSegLimit = seglc->vmsize;
-				for (uint32_t j = 0; j < BO(seglc->nsects); j++) {
-					section_64* sect = (section_64*)((pLoadCommand + sizeof(segment_command_64)) + sizeof(section_64) * j);
-					if (0 == strcmp("__text", sect->sectname)) {
-						if (BO(sect->offset) > (BO(m_pHeader->sizeofcmds) + m_uHeaderSize)) {
-							m_uLoadCommandsFreeSpace = BO(sect->offset) - BO(m_pHeader->sizeofcmds) - m_uHeaderSize;
-						}
-					} else if (0 == strcmp("__info_plist", sect->sectname)) {
-						m_strInfoPlist.append((const char*)m_pBase + BO(sect->offset), BO((uint32_t)sect->size));
-					}
-				}
-			} else if (0 == strcmp("__LINKEDIT", seglc->segname)) {
-				m_pLinkEditSegment = pLoadCommand;
-			}
-		}
-		break;
-		case LC_ENCRYPTION_INFO:
-		case LC_ENCRYPTION_INFO_64:
-		{
-			encryption_info_command* crypt_cmd = (encryption_info_command*)pLoadCommand;
-			if (BO(crypt_cmd->cryptid) >= 1) {
-				m_bEncrypted = true;
-			}
-		}
-		break;
-		case LC_CODE_SIGNATURE:
-		{
-			codesignature_command* pcslc = (codesignature_command*)pLoadCommand;
-			m_pCodeSignSegment = pLoadCommand;
-			m_uCodeLength = BO(pcslc->dataoff);
-			m_pSignBase = m_pBase + m_uCodeLength;
+	if (!macho_view_init(&m_View, m_pBase, m_uLength)) {
+		return false;
+	}
+
+	const macho_view_segment* pTextSeg = macho_view_text_segment(&m_View);
+	if (NULL != pTextSeg) {
+		m_uExecSegLimit = pTextSeg->vmsize;
+	}
+	m_uLoadCommandsFreeSpace = macho_view_free_space(&m_View);
+	if (m_View.infoplistsection.cmdoff > 0 && (uint64_t)m_View.infoplistsection.offset + m_View.infoplistsection.size <= m_uLength) {
+		m_strInfoPlist.append((const char*)m_pBase + m_View.infoplistsection.offset, (uint32_t)m_View.infoplistsection.size);
+	}
+
+	const macho_view_segment* pLinkEditSeg = macho_view_linkedit_segment(&m_View);
+	if (NULL != pLinkEditSeg) {
+		m_pLinkEditSegment = m_pBase + pLinkEditSeg->cmdoff;
+	}
+
+	m_bEncrypted = macho_view_is_encrypted(&m_View);
+
+	if (m_View.codesignature > 0) {
+		m_pCodeSignSegment = m_pBase + m_View.codesignature;
+		m_uCodeLength = m_View.codesigdataoff;
+		m_pSignBase = m_pBase + m_uCodeLength;
+		// a dataoff past the end of the slice would have the SuperBlob header read out of bounds
+		if ((uint64_t)m_uCodeLength + sizeof(CS_SuperBlob) <= m_uLength) {
 			m_uSignLength = ZSign::GetCodeSignatureLength(m_pSignBase);
 		}
-		break;
-		}
-
-		pLoadCommand += BO(plc->cmdsize);
 	}
 
 	return true;
@@ -362,9 +327,20 @@ bool ZArchO::BuildCodeSignature(ZSignAsset* pSignAsset,
 	uint8_t* pCodeSlots256Data = NULL;
 	uint32_t uCodeSlots1DataLength = 0;
 	uint32_t uCodeSlots256DataLength = 0;
+	string strCodeSlots1;
+	string strCodeSlots256;
 	if (!bForce) {
 		ZSign::GetCodeSignatureExistsCodeSlotsData(m_pSignBase, pCodeSlots1Data, uCodeSlots1DataLength, pCodeSlots256Data, uCodeSlots256DataLength);
+	} else if (!m_strCachedCodeSlots256.empty()) {
+		// hashed while the file was extracted, whatever was patched since lives in front of the first section
+		dirty_ranges_add(&m_Dirty, 0, m_uHeaderSize + BO(m_pHeader->sizeofcmds) + m_uLoadCommandsFreeSpace);
+		pCodeSlots1Data = (uint8_t*)m_strCachedCodeSlots1.data();
+		pCodeSlots256Data = (uint8_t*)m_strCachedCodeSlots256.data();
+		uCodeSlots1DataLength = (uint32_t)m_strCachedCodeSlots1.size();
+		uCodeSlots256DataLength = (uint32_t)m_strCachedCodeSlots256.size();
 	}
+	RehashDirtyCodeSlots(false, pCodeSlots1Data, uCodeSlots1DataLength, strCodeSlots1);
+	RehashDirtyCodeSlots(true, pCodeSlots256Data, uCodeSlots256DataLength, strCodeSlots256);
 
 	uint64_t uExecSegFlags = 0;
 	if (MH_EXECUTE == m_uFileType) {
@@ -386,7 +362,7 @@ bool ZArchO::BuildCodeSignature(ZSignAsset* pSignAsset,
 			m_uCodeLength,
 			pCodeSlots1Data,
 			uCodeSlots1DataLength,
-			s_uExecSegLimit,
+			m_uExecSegLimit,
 			uExecSegFlags,
 			strBundleId,
 			pSignAsset->m_strTeamId,
@@ -405,7 +381,7 @@ bool ZArchO::BuildCodeSignature(ZSignAsset* pSignAsset,
 		m_uCodeLength,
 		pCodeSlots256Data,
 		uCodeSlots256DataLength,
-		s_uExecSegLimit,
+		m_uExecSegLimit,
 		uExecSegFlags,
 		strBundleId,
 		pSignAsset->m_strTeamId,
@@ -529,6 +505,77 @@ bool ZArchO::BuildCodeSignature(ZSignAsset* pSignAsset,
 	return true;
 }
 
+void ZArchO::MarkLoadCommandsDirty()
+{
+	dirty_ranges_add(&m_Dirty, 0, m_uHeaderSize + BO(m_pHeader->sizeofcmds));
+}
+
+bool ZArchO::SetCachedCodeSlots(uint32_t uCodeLength, const string& strCodeSlots1, const string& strCodeSlots256)
+{
+	uint32_t uPageSize = 4096;
+	uint32_t uCodeSlots = (m_uCodeLength + uPageSize - 1) / uPageSize;
+	if (NULL == m_pSignBase || uCodeLength != m_uCodeLength || 0 == uCodeSlots ||
+		strCodeSlots1.size() != uCodeSlots * 20 || strCodeSlots256.size() != uCodeSlots * 32) {
+		return false;
+	}
+
+	// spot check the last page, the header pages may have been patched since the hashes were taken
+	uint32_t uOffset = uPageSize * (uCodeSlots - 1);
+	if (uOffset >= m_uHeaderSize + BO(m_pHeader->sizeofcmds) + m_uLoadCommandsFreeSpace) {
+		string strSHASum;
+		ZSHA::SHA256(m_pBase + uOffset, m_uCodeLength - uOffset, strSHASum);
+		if (0 != strCodeSlots256.compare(32 * (uCodeSlots - 1), 32, strSHASum)) {
+			return false;
+		}
+	}
+
+	m_strCachedCodeSlots1 = strCodeSlots1;
+	m_strCachedCodeSlots256 = strCodeSlots256;
+	return true;
+}
+
+// the binary was taken over unchanged from an earlier install, the code slots of its own signature still hold
+bool ZArchO::UseEmbeddedCodeSlots()
+{
+	uint8_t* pCodeSlots1Data = NULL;
+	uint8_t* pCodeSlots256Data = NULL;
+	uint32_t uCodeSlots1DataLength = 0;
+	uint32_t uCodeSlots256DataLength = 0;
+	if (NULL == m_pSignBase || !ZSign::GetCodeSignatureExistsCodeSlotsData(m_pSignBase, pCodeSlots1Data, uCodeSlots1DataLength, pCodeSlots256Data, uCodeSlots256DataLength)) {
+		return false;
+	}
+	return SetCachedCodeSlots(m_uCodeLength, string((const char*)pCodeSlots1Data, uCodeSlots1DataLength), string((const char*)pCodeSlots256Data, uCodeSlots256DataLength));
+}
+
+void ZArchO::RehashDirtyCodeSlots(bool bAlternate, uint8_t*& pCodeSlotsData, uint32_t uCodeSlotsDataLength, string& strCodeSlots)
+{
+	uint32_t uHashSize = bAlternate ? 32 : 20;
+	uint32_t uPageSize = 4096;
+	uint32_t uCodeSlots = (m_uCodeLength + uPageSize - 1) / uPageSize;
+	if (NULL == pCodeSlotsData || 0 == m_Dirty.count || uCodeSlotsDataLength != uCodeSlots * uHashSize) {
+		return;
+	}
+
+	// the existing slots are reused, only rehash the pages we modified in place
+	ZTraceSpan span("RehashDirtyPages", m_uCodeLength);
+	strCodeSlots.assign((const char*)pCodeSlotsData, uCodeSlotsDataLength);
+	for (uint32_t i = 0; i < uCodeSlots; i++) {
+		uint32_t uOffset = uPageSize * i;
+		uint32_t uLength = min(uPageSize, m_uCodeLength - uOffset);
+		if (!dirty_ranges_intersects(&m_Dirty, uOffset, uLength)) {
+			continue;
+		}
+		string strSHASum;
+		if (bAlternate) {
+			ZSHA::SHA256(m_pBase + uOffset, uLength, strSHASum);
+		} else {
+			ZSHA::SHA1(m_pBase + uOffset, uLength, strSHASum);
+		}
+		strCodeSlots.replace(uHashSize * i, uHashSize, strSHASum);
+	}
+	pCodeSlotsData = (uint8_t*)strCodeSlots.data();
+}
+
 bool ZArchO::Sign(ZSignAsset* pSignAsset, 
 					bool bForce, 
 					const string& strBundleId, 
@@ -542,6 +589,8 @@ bool ZArchO::Sign(ZSignAsset* pSignAsset,
 		return false;
 	}
 
+	ZTraceSpan span("SignArch", m_uLength);
+
 	string strCodeResourcesSHA1;
 	string strCodeResourcesSHA256;
 	if (strCodeResourcesData.empty()) {
@@ -572,6 +621,7 @@ bool ZArchO::Sign(ZSignAsset* pSignAsset,
 
 uint32_t ZArchO::ReallocCodeSignSpace(const string& strNewFile)
 {
+	ZTraceSpan span("ReallocArch", m_uLength, strNewFile.c_str());
 	ZFile::RemoveFile(strNewFile.c_str());
 
 	uint32_t uNewLength = m_uCodeLength + ZUtil::ByteAlign(((m_uCodeLength / 4096) + 1) * (20 + 32), 4096) + 16384; //16K May Be Enough
@@ -631,16 +681,27 @@ uint32_t ZArchO::ReallocCodeSignSpace(const string& strNewFile)
 	return uNewLength;
 }
 
+bool ZArchO::VerifySignature(uint32_t uSampleStride, const string& strBundleFolder)
+{
+	if (NULL == m_pSignBase || m_uSignLength <= 0) {
+		return ZLog::Error(">>> Arch is not signed!\n");
+	}
+	if ((uint64_t)m_uCodeLength + m_uSignLength > m_uLength) {
+		return ZLog::Error(">>> Code signature runs past the end of the arch!\n");
+	}
+	return ZVerify::VerifyCodeSignature(m_pBase, m_uCodeLength, m_pSignBase, m_uSignLength, uSampleStride, strBundleFolder);
+}
+
 bool ZArchO::InjectDylib(bool bWeakInject, const char* szDylibFile)
 {
 	if (NULL == m_pHeader) {
 		return false;
 	}
 
-	uint8_t* pLoadCommand = m_pBase + m_uHeaderSize;
-	for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
-		load_command* plc = (load_command*)pLoadCommand;
-		uint32_t uLoadType = BO(plc->cmd);
+	uint32_t uCursor = 0;
+	for (uint32_t uCmdOff; 0 != (uCmdOff = macho_view_next_dylib(&m_View, &uCursor));) {
+		uint8_t* pLoadCommand = m_pBase + uCmdOff;
+		uint32_t uLoadType = BO(((load_command*)pLoadCommand)->cmd);
 		if (LC_LOAD_DYLIB == uLoadType || LC_LOAD_WEAK_DYLIB == uLoadType) {
 			dylib_command* dlc = (dylib_command*)pLoadCommand;
 			const char* szDylib = (const char*)(pLoadCommand + BO(dlc->dylib.name.offset));
@@ -650,11 +711,11 @@ bool ZArchO::InjectDylib(bool bWeakInject, const char* szDylibFile)
 					const char* oldLoadType = bWeakInject ? "LC_LOAD_DYLIB" : "LC_LOAD_WEAK_DYLIB";
 					const char* newLoadType = bWeakInject ? "LC_LOAD_WEAK_DYLIB" : "LC_LOAD_DYLIB";
 					ZLog::WarnV(">>>\t\t %s -> %s\n", oldLoadType, newLoadType);
+					MarkLoadCommandsDirty();
 				}
 				return true;
 			}
 		}
-		pLoadCommand += BO(plc->cmdsize);
 	}
 
 	uint32_t uDylibFileLength = (uint32_t)strlen(szDylibFile);
@@ -682,7 +743,13 @@ bool ZArchO::InjectDylib(bool bWeakInject, const char* szDylibFile)
 
 	m_pHeader->ncmds = BO(BO(m_pHeader->ncmds) + 1);
 	m_pHeader->sizeofcmds = BO(BO(m_pHeader->sizeofcmds) + uDylibCommandSize);
+	MarkLoadCommandsDirty();
 
+	// the new command moved the end of the load commands, index them again
+	if (!macho_view_init(&m_View, m_pBase, m_uLength)) {
+		return ZLog::Error(">>> Can't index the load commands after injecting the dylib!\n");
+	}
+	m_uLoadCommandsFreeSpace = macho_view_free_space(&m_View);
 	return true;
 }
 
@@ -728,4 +795,5 @@ void ZArchO::RemoveDylibs(set<string> setDylibs)
 	memset(pLoadCommand, 0, old_load_command_size);
 	memcpy(pLoadCommand, new_load_command_data, new_load_command_size);
 	free(new_load_command_data);
+	dirty_ranges_add(&m_Dirty, 0, m_uHeaderSize + old_load_command_size);
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "mach-o.h"
+#include "macho_view.h"
+#include "dirty_ranges.h"
 #include "openssl.h"
 
 class ZArchO
@@ -21,13 +23,18 @@ public:
 	void PrintInfo();
 	bool IsExecute();
 	bool InjectDylib(bool bWeakInject, const char* szDylibFile);
+	bool VerifySignature(uint32_t uSampleStride, const string& strBundleFolder);
 	void RemoveDylibs(set<string> setDylibs);
 	uint32_t ReallocCodeSignSpace(const string& strNewFile);
+	void MarkLoadCommandsDirty();
+	bool SetCachedCodeSlots(uint32_t uCodeLength, const string& strCodeSlots1, const string& strCodeSlots256);
+	bool UseEmbeddedCodeSlots();
 
 private:
 	uint32_t	BO(uint32_t uVal);
 	const char* GetFileType(uint32_t uFileType);
 	const char* GetArch(int cpuType, int cpuSubType);
+	void		RehashDirtyCodeSlots(bool bAlternate, uint8_t*& pCodeSlotsData, uint32_t uCodeSlotsDataLength, string& strCodeSlots);
 	bool		BuildCodeSignature(ZSignAsset* pSignAsset, 
 									bool bForce, 
 									const string& strBundleId, 
@@ -54,7 +61,9 @@ public:
 	uint32_t		m_uFileType;
 	mach_header*	m_pHeader;
 	uint32_t		m_uHeaderSize;
-
-private:
-	static uint64_t s_uExecSegLimit;
+	macho_view		m_View;
+	dirty_ranges	m_Dirty;
+	string			m_strCachedCodeSlots1;
+	string			m_strCachedCodeSlots256;
+	uint64_t		m_uExecSegLimit;
 };
@@ -0,0 +1,235 @@
+#include "batch.h"
+#include "macho.h"
+#include "trace.h"
+#include <thread>
+
+ZBatchSign::ZBatchSign(ZSignAsset* pSignAsset)
+{
+	m_pSignAsset = pSignAsset;
+	m_uThreads = 0;
+	m_uMemoryLimit = 0;
+	m_bEnableCache = false;
+	m_uInFlight = 0;
+	m_uRemaining = 0;
+}
+
+ZBatchSign::~ZBatchSign()
+{
+	for (ZBundle* pBundle : m_arrBundles) {
+		delete pBundle;
+	}
+	for (uint32_t uSession : m_arrSessions) {
+		if (uSession > 0) {
+			ZLog::EndSession(uSession);
+		}
+	}
+}
+
+void ZBatchSign::SetLimits(uint32_t uThreads, uint64_t uMemoryLimit)
+{
+	m_uThreads = uThreads;
+	m_uMemoryLimit = uMemoryLimit;
+}
+
+void ZBatchSign::AddApp(const string& strFolder)
+{
+	ZAppResult result;
+	result.strAppPath = strFolder;
+	result.bSuccess = false;
+	result.nSigned = 0;
+	result.uElapse = 0;
+	m_arrResults.push_back(result);
+	m_arrBundles.push_back(new ZBundle());
+	m_arrSessions.push_back(ZLog::BeginSession(false));
+}
+
+bool ZBatchSign::ConfigureSign(bool bForce, bool bEnableCache)
+{
+	m_bEnableCache = bEnableCache;
+	m_arrTasks.clear();
+	m_arrAppBegin.assign(m_arrBundles.size(), 0);
+
+	bool bRet = true;
+	for (size_t i = 0; i < m_arrBundles.size(); i++) {
+		ZBundle* pBundle = m_arrBundles[i];
+		ZAppResult& result = m_arrResults[i];
+		uint32_t uPrevSession = ZLog::SetSession(m_arrSessions[i]);
+		ZTraceSpan span("ConfigureApp", 0, result.strAppPath.c_str());
+		bool bConfigured = pBundle->ConfigureFolderSign(m_pSignAsset, result.strAppPath, "", "", "", "", bForce, false, bEnableCache, true);
+		ZLog::SetSession(uPrevSession);
+		if (!bConfigured) {
+			result.arrLogs = ZLog::EndSession(m_arrSessions[i]);
+			m_arrSessions[i] = 0;
+			for (const string& strLog : result.arrLogs) {
+				result.strError += strLog;
+			}
+			if (result.strError.empty()) {
+				result.strError = ">>> Can't configure app folder!\n";
+			}
+			bRet = false;
+			continue;
+		}
+
+		result.bSuccess = true;
+		AddNodeTasks(i, pBundle->config, SIZE_MAX);
+	}
+	return bRet;
+}
+
+// one task per file plus one for the folder's executable, which waits for the files and nested folders
+size_t ZBatchSign::AddNodeTasks(size_t uApp, jvalue& jvNode, size_t uParent)
+{
+	ZBundle* pBundle = m_arrBundles[uApp];
+	string strFolder = jvNode["path"];
+	string strExePath = pBundle->m_strAppFolder;
+	if ("/" != strFolder) {
+		strExePath += "/" + strFolder;
+	}
+	strExePath += "/" + string(jvNode["bundle_executable"].as_cstr());
+
+	size_t uTask = m_arrTasks.size();
+	m_arrTasks.push_back({ uApp, &jvNode, "", (uint64_t)max<int64_t>(ZFile::GetFileSize(strExePath.c_str()), 0), uParent, 0 });
+
+	if (jvNode.has("folders")) {
+		for (size_t i = 0; i < jvNode["folders"].size(); i++) {
+			AddNodeTasks(uApp, jvNode["folders"][i], uTask);
+			m_arrTasks[uTask].nPending++;
+		}
+	}
+
+	if (jvNode.has("files")) {
+		for (size_t i = 0; i < jvNode["files"].size(); i++) {
+			string strFile = jvNode["files"][i];
+			int64_t nSize = ZFile::GetFileSizeV("%s/%s", pBundle->m_strAppFolder.c_str(), strFile.c_str());
+			m_arrTasks.push_back({ uApp, &jvNode, strFile, (uint64_t)max<int64_t>(nSize, 0), uTask, 0 });
+			m_arrTasks[uTask].nPending++;
+		}
+	}
+	return uTask;
+}
+
+int ZBatchSign::GetSignCount()
+{
+	return (int)m_arrTasks.size();
+}
+
+void ZBatchSign::RunTask(size_t uTask)
+{
+	ZSignTask& task = m_arrTasks[uTask];
+	ZBundle* pBundle = m_arrBundles[task.uApp];
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (!m_arrResults[task.uApp].bSuccess) {
+			return; // a bundle executable of this app already failed
+		}
+		if (0 == m_arrAppBegin[task.uApp]) {
+			m_arrAppBegin[task.uApp] = ZUtil::GetMicroSecond();
+		}
+	}
+
+	bool bRet = true;
+	string strFailedFiles;
+	uint32_t uPrevSession = ZLog::SetSession(m_arrSessions[task.uApp]);
+	if (!task.strFile.empty()) {
+		if (!pBundle->SignFile(task.strFile)) {
+			strFailedFiles = task.strFile + "\n";
+		}
+	} else {
+		bRet = pBundle->SignFolderExecutable(*task.pNode, strFailedFiles);
+	}
+	ZLog::SetSession(uPrevSession);
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		ZAppResult& result = m_arrResults[task.uApp];
+		result.nSigned++;
+		result.strFailedFiles += strFailedFiles;
+		result.uElapse = ZUtil::GetMicroSecond() - m_arrAppBegin[task.uApp];
+		if (!bRet) {
+			result.bSuccess = false;
+			string strError;
+			result.strError += ZUtil::StringFormatV(strError, "Sign failed! %s\n", (*task.pNode)["path"].as_cstr());
+		}
+	}
+
+	if (progressHandler) {
+		progressHandler(task.uApp);
+	}
+}
+
+void ZBatchSign::WorkerLoop()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while (m_uRemaining > 0) {
+		// first ready task that fits in the memory budget, anything fits when nothing else is mapped
+		auto it = m_arrReady.begin();
+		if (m_uMemoryLimit > 0 && m_uInFlight > 0) {
+			while (it != m_arrReady.end() && m_uInFlight + m_arrTasks[*it].uCost > m_uMemoryLimit) {
+				it++;
+			}
+		}
+		if (it == m_arrReady.end()) {
+			m_cond.wait(lock);
+			continue;
+		}
+
+		size_t uTask = *it;
+		m_arrReady.erase(it);
+		uint64_t uCost = m_arrTasks[uTask].uCost;
+		m_uInFlight += uCost;
+
+		lock.unlock();
+		RunTask(uTask);
+		lock.lock();
+
+		m_uInFlight -= uCost;
+		m_uRemaining--;
+		size_t uParent = m_arrTasks[uTask].uParent;
+		if (SIZE_MAX != uParent && 0 == --m_arrTasks[uParent].nPending) {
+			m_arrReady.push_back(uParent);
+		}
+		m_cond.notify_all();
+	}
+}
+
+bool ZBatchSign::StartSign()
+{
+	m_arrReady.clear();
+	m_uInFlight = 0;
+	m_uRemaining = m_arrTasks.size();
+	for (size_t i = 0; i < m_arrTasks.size(); i++) {
+		if (0 == m_arrTasks[i].nPending) {
+			m_arrReady.push_back(i);
+		}
+	}
+
+	uint32_t uThreads = (m_uThreads > 0) ? m_uThreads : max(1u, thread::hardware_concurrency());
+	uThreads = (uint32_t)min<size_t>(uThreads, max<size_t>(1, m_arrTasks.size()));
+	vector<thread> arrThreads;
+	for (uint32_t i = 1; i < uThreads; i++) {
+		arrThreads.emplace_back(&ZBatchSign::WorkerLoop, this);
+	}
+	WorkerLoop();
+	for (thread& t : arrThreads) {
+		t.join();
+	}
+	ZFile::ClearMapCache();
+
+	bool bRet = true;
+	for (size_t i = 0; i < m_arrBundles.size(); i++) {
+		ZAppResult& result = m_arrResults[i];
+		if (m_arrSessions[i] > 0) {
+			result.arrLogs = ZLog::EndSession(m_arrSessions[i]);
+			m_arrSessions[i] = 0;
+		}
+		if (!result.bSuccess) {
+			bRet = false;
+			continue;
+		}
+		if (m_bEnableCache) {
+			m_arrBundles[i]->config.style_write_to_file("%s/zsign_cache.json", m_arrBundles[i]->m_strAppFolder.c_str());
+		}
+	}
+	return bRet;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "common.h"
+#include "openssl.h"
+#include "bundle.h"
+#include <deque>
+#include <condition_variable>
+
+// Signs several app bundles with one identity. Every binary of every app is scheduled on one shared
+// worker pool, nested bundles are still signed before the bundle that contains them.
+class ZBatchSign
+{
+public:
+	struct ZAppResult
+	{
+		string		strAppPath;
+		bool		bSuccess;
+		int			nSigned;
+		string		strFailedFiles;	// newline separated, same as ZBundle::signFailedFiles
+		string		strError;
+		vector<string>	arrLogs;	// everything logged while configuring and signing this app
+		uint64_t	uElapse;		// microseconds from the first to the last binary of this app
+	};
+
+public:
+	ZBatchSign(ZSignAsset* pSignAsset);
+	~ZBatchSign();
+
+public:
+	// uThreads = 0 uses one worker per CPU, uMemoryLimit caps the bytes of binaries mapped at once (0 = no limit)
+	void SetLimits(uint32_t uThreads, uint64_t uMemoryLimit);
+	void AddApp(const string& strFolder);
+	bool ConfigureSign(bool bForce, bool bEnableCache);
+	int GetSignCount();
+	bool StartSign();
+	const vector<ZAppResult>& GetResults() { return m_arrResults; }
+
+public:
+	std::function<void(size_t uAppIndex)> progressHandler;
+
+private:
+	struct ZSignTask
+	{
+		size_t		uApp;
+		jvalue*		pNode;
+		string		strFile;	// empty for the bundle executable of pNode
+		uint64_t	uCost;	// file size, counted against the memory limit while signing
+		size_t		uParent;
+		int			nPending;
+	};
+
+	size_t AddNodeTasks(size_t uApp, jvalue& jvNode, size_t uParent);
+	void RunTask(size_t uTask);
+	void WorkerLoop();
+
+private:
+	ZSignAsset*			m_pSignAsset;
+	uint32_t			m_uThreads;
+	uint64_t			m_uMemoryLimit;
+	bool				m_bEnableCache;
+	vector<ZBundle*>	m_arrBundles;
+	vector<ZAppResult>	m_arrResults;
+	vector<uint64_t>	m_arrAppBegin;
+	vector<uint32_t>	m_arrSessions;
+	vector<ZSignTask>	m_arrTasks;
+
+	mutex				m_mutex;
+	condition_variable	m_cond;
+	deque<size_t>		m_arrReady;
+	uint64_t			m_uInFlight;
+	size_t				m_uRemaining;
+};
@@ -0,0 +1,639 @@
+#include "fixture.h"
+#include "macho.h"
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <zlib.h>
+
+#define FIXTURE_PAGE_SIZE	16384
+
+void ZFixture::FillRandom(uint8_t* pData, size_t sSize, uint32_t uSeed)
+{
+	uint64_t x = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)uSeed * 0xBF58476D1CE4E5B9ULL);
+	size_t i = 0;
+	for (; i + 8 <= sSize; i += 8) { // xorshift64*, fast enough that generating never dominates a run
+		x ^= x >> 12;
+		x ^= x << 25;
+		x ^= x >> 27;
+		uint64_t v = x * 0x2545F4914F6CDD1DULL;
+		memcpy(pData + i, &v, 8);
+	}
+	for (; i < sSize; i++) {
+		pData[i] = (uint8_t)(x >> ((i % 8) * 8));
+	}
+}
+
+static uint64_t AlignUp(uint64_t uValue, uint64_t uAlign)
+{
+	return (uValue + uAlign - 1) / uAlign * uAlign;
+}
+
+static void AppendSegment(string& strCmds, const char* szName, uint64_t uVMAddr, uint64_t uVMSize, uint64_t uFileOff, uint64_t uFileSize, int nProt, const vector<section_64>& arrSections)
+{
+	segment_command_64 seg;
+	memset(&seg, 0, sizeof(seg));
+	seg.cmd = LC_SEGMENT_64;
+	seg.cmdsize = (uint32_t)(sizeof(segment_command_64) + arrSections.size() * sizeof(section_64));
+	memcpy(seg.segname, szName, min(strlen(szName), sizeof(seg.segname))); // not NUL terminated when all 16 bytes are used
+	seg.vmaddr = uVMAddr;
+	seg.vmsize = uVMSize;
+	seg.fileoff = uFileOff;
+	seg.filesize = uFileSize;
+	seg.maxprot = nProt;
+	seg.initprot = nProt;
+	seg.nsects = (uint32_t)arrSections.size();
+	strCmds.append((const char*)&seg, sizeof(seg));
+	for (const section_64& sect : arrSections) {
+		strCmds.append((const char*)&sect, sizeof(sect));
+	}
+}
+
+static void AppendDylib(string& strCmds, uint32_t uCmd, const string& strName)
+{
+	dylib_command dc;
+	memset(&dc, 0, sizeof(dc));
+	dc.cmd = uCmd;
+	dc.cmdsize = (uint32_t)AlignUp(sizeof(dylib_command) + strName.size() + 1, 8);
+	dc.dylib.name.offset = sizeof(dylib_command);
+	dc.dylib.timestamp = 2;
+	dc.dylib.current_version = 0x10000;
+	dc.dylib.compatibility_version = 0x10000;
+	strCmds.append((const char*)&dc, sizeof(dc));
+	strCmds.append(strName);
+	strCmds.append(dc.cmdsize - sizeof(dylib_command) - strName.size(), 0);
+}
+
+bool ZFixture::GenerateSlice(const ZSliceSpec& spec, string& strOutput)
+{
+	bool bExecute = (MH_EXECUTE == spec.uFileType);
+	vector<string> arrDylibs;
+	for (uint32_t i = 0; i < spec.uDylibs; i++) {
+		string strName;
+		ZUtil::StringFormatV(strName, "/usr/lib/libbench%u.dylib", i);
+		arrDylibs.push_back(strName);
+	}
+	arrDylibs.insert(arrDylibs.end(), spec.arrDylibs.begin(), spec.arrDylibs.end());
+
+	// load commands are laid out first with placeholder offsets, their size decides where __text starts
+	uint32_t uNCmds = 0;
+	uint32_t uCmdsSize = 0;
+	{
+		uNCmds = (bExecute ? 1 : 0) + 3 + 1 + (uint32_t)arrDylibs.size() + (bExecute ? 0 : 1) + (spec.bCodeSignature ? 1 : 0);
+		uCmdsSize = (bExecute ? sizeof(segment_command_64) : 0) + sizeof(segment_command_64) + sizeof(section_64) + 2 * sizeof(segment_command_64) + sizeof(uuid_command);
+		for (const string& strName : arrDylibs) {
+			uCmdsSize += (uint32_t)AlignUp(sizeof(dylib_command) + strName.size() + 1, 8);
+		}
+		if (!bExecute) {
+			uCmdsSize += (uint32_t)AlignUp(sizeof(dylib_command) + spec.strInstallName.size() + 1, 8);
+		}
+		if (spec.bCodeSignature) {
+			uCmdsSize += sizeof(codesignature_command);
+		}
+	}
+
+	uint64_t uTextOff = AlignUp(sizeof(mach_header_64) + uCmdsSize + spec.uHeaderPad, 16);
+	uint64_t uDataSize = FIXTURE_PAGE_SIZE;
+	uint64_t uFixedSize = uDataSize + spec.uLinkEditSize + spec.uLinkEditSlack;
+	uint64_t uTextSize = AlignUp(max<uint64_t>(uTextOff + FIXTURE_PAGE_SIZE, (spec.uSliceSize > uFixedSize) ? spec.uSliceSize - uFixedSize : 0), FIXTURE_PAGE_SIZE);
+	uint64_t uDataOff = uTextSize;
+	uint64_t uLinkEditOff = uDataOff + uDataSize;
+	uint64_t uCodeLength = AlignUp(uLinkEditOff + spec.uLinkEditSize + spec.uLinkEditSlack, 16);
+	uint64_t uSignSize = 0;
+	if (spec.bCodeSignature) { // same estimate ZArchO uses when it has to grow the signature
+		uSignSize = ZUtil::ByteAlign((uint32_t)(((uCodeLength / 4096) + 1) * (20 + 32)), 4096) + 16384;
+	}
+	uint64_t uLength = uCodeLength + uSignSize;
+	if (uLength > 0xFFFFFFFFULL) {
+		return ZLog::Error(">>> Fixture slice is too large!\n");
+	}
+
+	uint64_t uBaseAddr = bExecute ? 0x100000000ULL : 0;
+	string strCmds;
+	if (bExecute) {
+		AppendSegment(strCmds, "__PAGEZERO", 0, 0x100000000ULL, 0, 0, 0, {});
+	}
+
+	section_64 text;
+	memset(&text, 0, sizeof(text));
+	memcpy(text.sectname, "__text", strlen("__text"));
+	memcpy(text.segname, "__TEXT", strlen("__TEXT"));
+	text.addr = uBaseAddr + uTextOff;
+	text.size = uTextSize - uTextOff;
+	text.offset = (uint32_t)uTextOff;
+	text.align = 2;
+	text.flags = 0x80000400; // S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS
+	AppendSegment(strCmds, "__TEXT", uBaseAddr, uTextSize, 0, uTextSize, 5, { text });
+	AppendSegment(strCmds, "__DATA", uBaseAddr + uDataOff, uDataSize, uDataOff, uDataSize, 3, {});
+	AppendSegment(strCmds, "__LINKEDIT", uBaseAddr + uLinkEditOff, AlignUp(uLength - uLinkEditOff, FIXTURE_PAGE_SIZE), uLinkEditOff, uLength - uLinkEditOff, 1, {});
+
+	if (!bExecute) {
+		AppendDylib(strCmds, LC_ID_DYLIB, spec.strInstallName);
+	}
+	for (const string& strName : arrDylibs) {
+		AppendDylib(strCmds, LC_LOAD_DYLIB, strName);
+	}
+
+	uuid_command uc;
+	uc.cmd = LC_UUID;
+	uc.cmdsize = sizeof(uuid_command);
+	FillRandom(uc.uuid, sizeof(uc.uuid), spec.uSeed);
+	strCmds.append((const char*)&uc, sizeof(uc));
+
+	if (spec.bCodeSignature) {
+		codesignature_command cs;
+		cs.cmd = LC_CODE_SIGNATURE;
+		cs.cmdsize = sizeof(codesignature_command);
+		cs.dataoff = (uint32_t)uCodeLength;
+		cs.datasize = (uint32_t)uSignSize;
+		strCmds.append((const char*)&cs, sizeof(cs));
+	}
+
+	if (strCmds.size() != uCmdsSize) {
+		return ZLog::Error(">>> Fixture load commands size mismatch!\n");
+	}
+
+	mach_header_64 header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MH_MAGIC_64;
+	header.cputype = (cpu_type_t)spec.uCpuType;
+	header.cpusubtype = (cpu_subtype_t)spec.uCpuSubType;
+	header.filetype = spec.uFileType;
+	header.ncmds = uNCmds;
+	header.sizeofcmds = uCmdsSize;
+	header.flags = MH_DYLDLINK | MH_TWOLEVEL | (bExecute ? MH_PIE : MH_NO_REEXPORTED_DYLIBS);
+
+	strOutput.clear();
+	strOutput.resize((size_t)uLength, 0);
+	uint8_t* pBase = (uint8_t*)&strOutput[0];
+	memcpy(pBase, &header, sizeof(header));
+	memcpy(pBase + sizeof(header), strCmds.data(), strCmds.size());
+	FillRandom(pBase + uTextOff, (size_t)(uTextSize - uTextOff), spec.uSeed * 3 + 1);
+	FillRandom(pBase + uDataOff, (size_t)uDataSize, spec.uSeed * 3 + 2);
+	FillRandom(pBase + uLinkEditOff, spec.uLinkEditSize, spec.uSeed * 3 + 3);
+	return true;
+}
+
+bool ZFixture::GenerateMachO(const char* szFile, const vector<ZSliceSpec>& arrSlices, bool bSigned)
+{
+	if (arrSlices.empty()) {
+		return false;
+	}
+
+	string strOutput;
+	if (1 == arrSlices.size()) {
+		if (!GenerateSlice(arrSlices[0], strOutput)) {
+			return false;
+		}
+	} else {
+		vector<string> arrData(arrSlices.size());
+		for (size_t i = 0; i < arrSlices.size(); i++) {
+			if (!GenerateSlice(arrSlices[i], arrData[i])) {
+				return false;
+			}
+		}
+
+		fat_header fath;
+		fath.magic = BE((uint32_t)FAT_MAGIC);
+		fath.nfat_arch = BE((uint32_t)arrSlices.size());
+		strOutput.append((const char*)&fath, sizeof(fath));
+
+		uint64_t uOffset = AlignUp(sizeof(fat_header) + arrSlices.size() * sizeof(fat_arch), FIXTURE_PAGE_SIZE);
+		for (size_t i = 0; i < arrSlices.size(); i++) {
+			fat_arch arch;
+			arch.cputype = (cpu_type_t)BE((uint32_t)arrSlices[i].uCpuType);
+			arch.cpusubtype = (cpu_subtype_t)BE((uint32_t)arrSlices[i].uCpuSubType);
+			arch.offset = BE((uint32_t)uOffset);
+			arch.size = BE((uint32_t)arrData[i].size());
+			arch.align = BE((uint32_t)14);
+			strOutput.append((const char*)&arch, sizeof(arch));
+			uOffset = AlignUp(uOffset + arrData[i].size(), FIXTURE_PAGE_SIZE);
+		}
+
+		for (size_t i = 0; i < arrData.size(); i++) {
+			strOutput.resize((size_t)AlignUp(strOutput.size(), FIXTURE_PAGE_SIZE), 0);
+			strOutput += arrData[i];
+		}
+	}
+
+	if (!ZFile::WriteFile(szFile, strOutput)) {
+		return ZLog::ErrorV(">>> Can't write fixture! %s\n", szFile);
+	}
+
+	if (bSigned && arrSlices[0].bCodeSignature) {
+		ZSignAsset adhoc;
+		adhoc.Init("", "", "", "", "", true, false, false);
+		ZMachO macho;
+		if (!macho.Init(szFile) || !macho.Sign(&adhoc, true, "", "", "", "")) {
+			return ZLog::ErrorV(">>> Can't sign fixture! %s\n", szFile);
+		}
+	}
+	return true;
+}
+
+string ZFixture::SymbolName(uint32_t uIndex)
+{
+	string strName;
+	ZUtil::StringFormatV(strName, "_lc_bench_symbol_%05u", uIndex);
+	return strName;
+}
+
+uint64_t ZFixture::SymbolOffset(uint32_t uIndex, bool bExportTrie)
+{
+	return FIXTURE_PAGE_SIZE + (uint64_t)uIndex * 16 + (bExportTrie ? 4 : 0);
+}
+
+static void AppendUleb(string& strData, uint64_t uValue, size_t sWidth = 0)
+{
+	size_t i = 0;
+	do {
+		uint8_t byte = uValue & 0x7f;
+		uValue >>= 7;
+		i++;
+		if (uValue || i < sWidth) {
+			byte |= 0x80;
+		}
+		strData.push_back((char)byte);
+	} while (uValue || i < sWidth);
+}
+
+bool ZFixture::GenerateSymbolImage(const char* szFile, uint32_t uSymbols, bool bShuffle, uint32_t uSeed)
+{
+	if (uSymbols > 25500) { // the trie root has one edge per hundred symbols and at most 255 children
+		return ZLog::Error(">>> Too many fixture symbols!\n");
+	}
+	const uint64_t uBaseAddr = 0x100000000ULL;
+
+	vector<uint32_t> arrSymtab;
+	for (uint32_t i = 0; i < uSymbols; i++) {
+		if (3 != i % 4) {
+			arrSymtab.push_back(i);
+		}
+	}
+	if (bShuffle) {
+		vector<uint32_t> arrRandom(arrSymtab.size());
+		FillRandom((uint8_t*)arrRandom.data(), arrRandom.size() * sizeof(uint32_t), uSeed);
+		for (size_t i = arrSymtab.size(); i > 1; i--) {
+			swap(arrSymtab[i - 1], arrSymtab[arrRandom[i - 1] % i]);
+		}
+	}
+
+	string strSyms;
+	string strStrings(1, 0);
+	for (uint32_t uIndex : arrSymtab) {
+		uint32_t uStrx = (uint32_t)strStrings.size();
+		uint8_t type[4] = { 0x0f, 1, 0, 0 }; // N_SECT | N_EXT in __text
+		uint64_t uValue = uBaseAddr + SymbolOffset(uIndex, false);
+		strSyms.append((const char*)&uStrx, 4);
+		strSyms.append((const char*)type, 4);
+		strSyms.append((const char*)&uValue, 8);
+		strStrings += SymbolName(uIndex);
+		strStrings.push_back(0);
+	}
+
+	// root -> "_lc_bench_symbol_NNN" per hundred symbols -> "NN" leaves, child offsets use fixed width ulebs so
+	// the trie can be written in one pass and patched
+	string strTrie;
+	vector<pair<size_t, size_t>> arrPatches;
+	uint32_t uGroups = (uSymbols + 99) / 100;
+	strTrie.push_back(0);
+	strTrie.push_back((char)uGroups);
+	vector<size_t> arrGroupSlots;
+	for (uint32_t g = 0; g < uGroups; g++) {
+		string strEdge;
+		ZUtil::StringFormatV(strEdge, "_lc_bench_symbol_%03u", g);
+		strTrie.append(strEdge.c_str(), strEdge.size() + 1);
+		arrGroupSlots.push_back(strTrie.size());
+		AppendUleb(strTrie, 0, 4);
+	}
+	for (uint32_t g = 0; g < uGroups; g++) {
+		arrPatches.push_back({ arrGroupSlots[g], strTrie.size() });
+		vector<uint32_t> arrMembers;
+		for (uint32_t i = g * 100; i < min(uSymbols, g * 100 + 100); i++) {
+			if (i & 1) {
+				arrMembers.push_back(i);
+			}
+		}
+		strTrie.push_back(0);
+		strTrie.push_back((char)arrMembers.size());
+		vector<size_t> arrLeafSlots;
+		for (uint32_t uIndex : arrMembers) {
+			string strEdge;
+			ZUtil::StringFormatV(strEdge, "%02u", uIndex % 100);
+			strTrie.append(strEdge.c_str(), strEdge.size() + 1);
+			arrLeafSlots.push_back(strTrie.size());
+			AppendUleb(strTrie, 0, 4);
+		}
+		for (size_t j = 0; j < arrMembers.size(); j++) {
+			arrPatches.push_back({ arrLeafSlots[j], strTrie.size() });
+			string strTerminal;
+			AppendUleb(strTerminal, 0); // flags, regular export
+			AppendUleb(strTerminal, SymbolOffset(arrMembers[j], true));
+			AppendUleb(strTrie, strTerminal.size());
+			strTrie += strTerminal;
+			strTrie.push_back(0);
+		}
+	}
+	for (const pair<size_t, size_t>& patch : arrPatches) {
+		string strOffset;
+		AppendUleb(strOffset, patch.second, 4);
+		if (strOffset.size() != 4) {
+			return ZLog::Error(">>> Fixture export trie is too large!\n");
+		}
+		memcpy(&strTrie[patch.first], strOffset.data(), 4);
+	}
+
+	uint32_t uCmdsSize = sizeof(segment_command_64) + sizeof(uuid_command) + 24 + 16;
+	uint64_t uSymOff = AlignUp(FIXTURE_PAGE_SIZE + (uint64_t)uSymbols * 16, FIXTURE_PAGE_SIZE);
+	uint64_t uStrOff = uSymOff + strSyms.size();
+	uint64_t uTrieOff = AlignUp(uStrOff + strStrings.size(), 8);
+	uint64_t uLength = uTrieOff + strTrie.size();
+
+	string strCmds;
+	AppendSegment(strCmds, "__TEXT", uBaseAddr, uSymOff, 0, uSymOff, 5, {});
+	uuid_command uc;
+	uc.cmd = LC_UUID;
+	uc.cmdsize = sizeof(uuid_command);
+	FillRandom(uc.uuid, sizeof(uc.uuid), uSeed);
+	strCmds.append((const char*)&uc, sizeof(uc));
+	uint32_t symtab[6] = { LC_SYMTAB, 24, (uint32_t)uSymOff, (uint32_t)arrSymtab.size(), (uint32_t)uStrOff, (uint32_t)strStrings.size() };
+	strCmds.append((const char*)symtab, sizeof(symtab));
+	uint32_t exports[4] = { 0x80000033, 16, (uint32_t)uTrieOff, (uint32_t)strTrie.size() }; // LC_DYLD_EXPORTS_TRIE
+	strCmds.append((const char*)exports, sizeof(exports));
+
+	mach_header_64 header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MH_MAGIC_64;
+	header.cputype = CPU_TYPE_ARM64;
+	header.cpusubtype = CPU_SUBTYPE_ARM64_ALL;
+	header.filetype = MH_DYLIB;
+	header.ncmds = 4;
+	header.sizeofcmds = uCmdsSize;
+	header.flags = MH_DYLDLINK | MH_TWOLEVEL;
+
+	string strOutput((size_t)uLength, 0);
+	memcpy(&strOutput[0], &header, sizeof(header));
+	memcpy(&strOutput[sizeof(header)], strCmds.data(), strCmds.size());
+	memcpy(&strOutput[uSymOff], strSyms.data(), strSyms.size());
+	memcpy(&strOutput[uStrOff], strStrings.data(), strStrings.size());
+	memcpy(&strOutput[uTrieOff], strTrie.data(), strTrie.size());
+	if (!ZFile::WriteFile(szFile, strOutput)) {
+		return ZLog::ErrorV(">>> Can't write fixture! %s\n", szFile);
+	}
+	return true;
+}
+
+static bool WriteInfoPlist(const string& strFolder, const string& strExecutable, const string& strBundleId, const char* szPackageType)
+{
+	jvalue jvInfo;
+	jvInfo["CFBundleDevelopmentRegion"] = "en";
+	jvInfo["CFBundleExecutable"] = strExecutable;
+	jvInfo["CFBundleIdentifier"] = strBundleId;
+	jvInfo["CFBundleInfoDictionaryVersion"] = "6.0";
+	jvInfo["CFBundleName"] = strExecutable;
+	jvInfo["CFBundlePackageType"] = szPackageType;
+	jvInfo["CFBundleShortVersionString"] = "1.0";
+	jvInfo["CFBundleVersion"] = "1";
+	jvInfo["MinimumOSVersion"] = "15.0";
+	return jvInfo.style_write_plist_to_file("%s/Info.plist", strFolder.c_str());
+}
+
+static vector<ZFixture::ZSliceSpec> BinarySlices(const ZFixture::ZAppSpec& app, ZFixture::ZSliceSpec spec)
+{
+	vector<ZFixture::ZSliceSpec> arrSlices;
+	arrSlices.push_back(spec);
+	if (app.bFat) {
+		spec.uCpuSubType = CPU_SUBTYPE_ARM64E;
+		spec.uSeed += 0x10000;
+		arrSlices.push_back(spec);
+	}
+	return arrSlices;
+}
+
+bool ZFixture::GenerateApp(const string& strAppFolder, const ZAppSpec& spec)
+{
+	ZFile::RemoveFolder(strAppFolder.c_str());
+	if (!ZFile::CreateFolder(strAppFolder.c_str()) || !ZFile::CreateFolderV("%s/Frameworks", strAppFolder.c_str())) {
+		return ZLog::ErrorV(">>> Can't create fixture app! %s\n", strAppFolder.c_str());
+	}
+
+	uint32_t uSeed = spec.uSeed * 100003;
+	ZSliceSpec exec;
+	for (uint32_t i = 0; i < spec.uFrameworks; i++) {
+		string strName;
+		ZUtil::StringFormatV(strName, "BenchKit%u", i);
+		string strFolder = strAppFolder + "/Frameworks/" + strName + ".framework";
+		ZFile::CreateFolder(strFolder.c_str());
+		if (!WriteInfoPlist(strFolder, strName, spec.strBundleId + "." + strName, "FMWK")) {
+			return false;
+		}
+
+		ZSliceSpec framework;
+		framework.uFileType = MH_DYLIB;
+		framework.uSliceSize = spec.uFrameworkSize;
+		framework.strInstallName = "@rpath/" + strName + ".framework/" + strName;
+		framework.uSeed = ++uSeed;
+		if (!GenerateMachO((strFolder + "/" + strName).c_str(), BinarySlices(spec, framework), spec.bSigned)) {
+			return false;
+		}
+		exec.arrDylibs.push_back(framework.strInstallName);
+	}
+
+	for (uint32_t i = 0; i < spec.uDylibs; i++) {
+		string strName;
+		ZUtil::StringFormatV(strName, "libbench%u.dylib", i);
+		ZSliceSpec dylib;
+		dylib.uFileType = MH_DYLIB;
+		dylib.uSliceSize = spec.uDylibSize;
+		dylib.strInstallName = "@rpath/" + strName;
+		dylib.uSeed = ++uSeed;
+		if (!GenerateMachO((strAppFolder + "/Frameworks/" + strName).c_str(), BinarySlices(spec, dylib), spec.bSigned)) {
+			return false;
+		}
+		exec.arrDylibs.push_back(dylib.strInstallName);
+	}
+
+	// resources are spread like an asset catalog export, a few localizations and many small files per folder
+	string strResource;
+	strResource.resize(spec.uResourceSize);
+	for (uint32_t i = 0; i < spec.uResources; i++) {
+		string strPath;
+		if (0 == i % 16) {
+			ZUtil::StringFormatV(strPath, "%s/%s.lproj", strAppFolder.c_str(), (0 == (i / 16) % 2) ? "Base" : "en");
+			ZFile::CreateFolder(strPath.c_str());
+			ZUtil::StringFormatV(strPath, "%s/%s.lproj/Strings%u.strings", strAppFolder.c_str(), (0 == (i / 16) % 2) ? "Base" : "en", i);
+		} else {
+			ZUtil::StringFormatV(strPath, "%s/Assets%u", strAppFolder.c_str(), i / 64);
+			ZFile::CreateFolder(strPath.c_str());
+			ZUtil::StringFormatV(strPath, "%s/Assets%u/res%u.dat", strAppFolder.c_str(), i / 64, i);
+		}
+		FillRandom((uint8_t*)&strResource[0], strResource.size(), ++uSeed);
+		for (size_t j = strResource.size() - strResource.size() * spec.uRedundancy / 100; j < strResource.size(); j++) {
+			strResource[j] = "<key>BenchAssetName</key><string>asset</string>\n"[j % 48];
+		}
+		if (!ZFile::WriteFile(strPath.c_str(), strResource)) {
+			return ZLog::ErrorV(">>> Can't write fixture resource! %s\n", strPath.c_str());
+		}
+	}
+
+	if (!WriteInfoPlist(strAppFolder, spec.strName, spec.strBundleId, "APPL")) {
+		return false;
+	}
+	exec.uSliceSize = spec.uExecSize;
+	exec.uSeed = spec.uSeed;
+	return GenerateMachO((strAppFolder + "/" + spec.strName).c_str(), BinarySlices(spec, exec), spec.bSigned);
+}
+
+static void AppendLE16(string& strData, uint16_t uValue)
+{
+	strData.append((const char*)&uValue, 2);
+}
+
+static void AppendLE32(string& strData, uint32_t uValue)
+{
+	strData.append((const char*)&uValue, 4);
+}
+
+// Zips the app as Payload/<name>.app the way iTunes exports do: unix modes, deflate for everything, no ZIP64,
+// so fixtures stay under 4GB.
+bool ZFixture::GenerateIpa(const string& strAppFolder, const string& strIpaFile, int nLevel)
+{
+	vector<string> arrFiles;
+	ZFile::EnumFolder(strAppFolder.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
+		if (!bFolder) {
+			arrFiles.push_back(strPath);
+		}
+		return false;
+	});
+	sort(arrFiles.begin(), arrFiles.end());
+
+	FILE* fp = fopen(strIpaFile.c_str(), "wb");
+	if (NULL == fp) {
+		return ZLog::ErrorV(">>> Can't create fixture ipa! %s\n", strIpaFile.c_str());
+	}
+
+	string strPrefix = "Payload/" + strAppFolder.substr(strAppFolder.rfind('/') + 1) + "/";
+	string strCentral;
+	string strCompressed;
+	uint64_t uOffset = 0;
+	for (const string& strFile : arrFiles) {
+		string strData;
+		struct stat st;
+		if (!ZFile::ReadFile(strFile.c_str(), strData) || 0 != stat(strFile.c_str(), &st)) {
+			fclose(fp);
+			return ZLog::ErrorV(">>> Can't read fixture file! %s\n", strFile.c_str());
+		}
+
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		deflateInit2(&zs, nLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+		strCompressed.resize(deflateBound(&zs, strData.size()));
+		zs.next_in = (Bytef*)strData.data();
+		zs.avail_in = (uInt)strData.size();
+		zs.next_out = (Bytef*)&strCompressed[0];
+		zs.avail_out = (uInt)strCompressed.size();
+		deflate(&zs, Z_FINISH);
+		strCompressed.resize(zs.total_out);
+		deflateEnd(&zs);
+
+		string strName = strPrefix + strFile.substr(strAppFolder.size() + 1);
+		uint32_t uCRC = (uint32_t)crc32(0, (const Bytef*)strData.data(), (uInt)strData.size());
+		string strLocal;
+		AppendLE32(strLocal, 0x04034b50);
+		AppendLE16(strLocal, 20);
+		AppendLE16(strLocal, 0);
+		AppendLE16(strLocal, 8);
+		AppendLE32(strLocal, 0x58210000); // 2024-01-01 00:00
+		AppendLE32(strLocal, uCRC);
+		AppendLE32(strLocal, (uint32_t)strCompressed.size());
+		AppendLE32(strLocal, (uint32_t)strData.size());
+		AppendLE16(strLocal, (uint16_t)strName.size());
+		AppendLE16(strLocal, 0);
+		strLocal += strName;
+
+		AppendLE32(strCentral, 0x02014b50);
+		AppendLE16(strCentral, 0x031e); // made by unix
+		strCentral.append(strLocal, 4, 26);
+		AppendLE16(strCentral, 0);
+		AppendLE16(strCentral, 0);
+		AppendLE16(strCentral, 0);
+		AppendLE32(strCentral, (uint32_t)(st.st_mode & 0xffff) << 16);
+		AppendLE32(strCentral, (uint32_t)uOffset);
+		strCentral += strName;
+
+		fwrite(strLocal.data(), 1, strLocal.size(), fp);
+		fwrite(strCompressed.data(), 1, strCompressed.size(), fp);
+		uOffset += strLocal.size() + strCompressed.size();
+		if (uOffset >= 0xffffffffULL) {
+			fclose(fp);
+			return ZLog::ErrorV(">>> Fixture ipa is too large! %s\n", strIpaFile.c_str());
+		}
+	}
+
+	string strEnd;
+	AppendLE32(strEnd, 0x06054b50);
+	AppendLE32(strEnd, 0);
+	AppendLE16(strEnd, (uint16_t)min<size_t>(arrFiles.size(), 0xffff));
+	AppendLE16(strEnd, (uint16_t)min<size_t>(arrFiles.size(), 0xffff));
+	AppendLE32(strEnd, (uint32_t)strCentral.size());
+	AppendLE32(strEnd, (uint32_t)uOffset);
+	AppendLE16(strEnd, 0);
+	fwrite(strCentral.data(), 1, strCentral.size(), fp);
+	fwrite(strEnd.data(), 1, strEnd.size(), fp);
+	bool bRet = (0 == ferror(fp));
+	fclose(fp);
+	return bRet;
+}
+
+// A throwaway key and certificate that CMS signing accepts: the issuer name is copied from the Apple WWDR CA,
+// which is all ZSignAsset looks at to pick the chain. Nothing signed with it will validate on a device.
+bool ZFixture::GenerateIdentity(ZSignAsset& asset)
+{
+	EVP_PKEY* evpPKey = EVP_RSA_gen(2048);
+	if (NULL == evpPKey) {
+		return ZSignAsset::CMSError();
+	}
+
+	BIO* bioCA = BIO_new_mem_buf(ZSignAsset::s_szAppleDevCACert, (int)strlen(ZSignAsset::s_szAppleDevCACert));
+	X509* x509CA = PEM_read_bio_X509(bioCA, NULL, 0, NULL);
+	BIO_free(bioCA);
+	if (NULL == x509CA) {
+		EVP_PKEY_free(evpPKey);
+		return ZSignAsset::CMSError();
+	}
+
+	const char* szTeamId = "BENCH00000";
+	const char* szSubjectCN = "Apple Development: ZSign Bench (BENCH00000)";
+	X509* x509Cert = X509_new();
+	X509_set_version(x509Cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(x509Cert), 1);
+	X509_gmtime_adj(X509_getm_notBefore(x509Cert), 0);
+	X509_gmtime_adj(X509_getm_notAfter(x509Cert), 365 * 24 * 3600L);
+	X509_set_pubkey(x509Cert, evpPKey);
+	X509_NAME* pName = X509_get_subject_name(x509Cert);
+	X509_NAME_add_entry_by_txt(pName, "UID", MBSTRING_ASC, (const unsigned char*)szTeamId, -1, -1, 0);
+	X509_NAME_add_entry_by_txt(pName, "CN", MBSTRING_ASC, (const unsigned char*)szSubjectCN, -1, -1, 0);
+	X509_NAME_add_entry_by_txt(pName, "OU", MBSTRING_ASC, (const unsigned char*)szTeamId, -1, -1, 0);
+	X509_set_issuer_name(x509Cert, X509_get_subject_name(x509CA));
+	X509_free(x509CA);
+	if (0 == X509_sign(x509Cert, evpPKey, EVP_sha256())) {
+		X509_free(x509Cert);
+		EVP_PKEY_free(evpPKey);
+		return ZSignAsset::CMSError();
+	}
+
+	jvalue jvEntitlements;
+	jvEntitlements["application-identifier"] = string(szTeamId) + ".com.zsign.bench";
+	jvEntitlements["com.apple.developer.team-identifier"] = szTeamId;
+	jvEntitlements["get-task-allow"] = true;
+	jvEntitlements.style_write_plist(asset.m_strEntitleData);
+
+	asset.m_bAdhoc = false;
+	asset.m_bSHA256Only = false;
+	asset.m_bSingleBinary = false;
+	asset.m_strTeamId = szTeamId;
+	asset.m_strSubjectCN = szSubjectCN;
+	asset.m_x509Cert = x509Cert;
+	asset.m_evpPKey = evpPKey;
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "common.h"
+#include "mach-o.h"
+#include "openssl.h"
+
+// Synthetic inputs for the ZSign benchmarks. Everything is derived from a seed, so the same spec always
+// produces byte identical files and timings stay comparable between runs.
+class ZFixture
+{
+public:
+	struct ZSliceSpec
+	{
+		uint32_t		uCpuType = CPU_TYPE_ARM64;
+		uint32_t		uCpuSubType = CPU_SUBTYPE_ARM64_ALL;
+		uint32_t		uFileType = MH_EXECUTE;
+		uint64_t		uSliceSize = 4 * 1024 * 1024;
+		uint32_t		uDylibs = 8;			// LC_LOAD_DYLIB commands for system libraries
+		vector<string>	arrDylibs;				// extra LC_LOAD_DYLIB names, e.g. embedded frameworks
+		uint32_t		uHeaderPad = 4096;		// free space after the load commands
+		uint32_t		uLinkEditSize = 64 * 1024;
+		uint32_t		uLinkEditSlack = 0;		// zero bytes between the __LINKEDIT data and the signature
+		bool			bCodeSignature = true;	// reserve LC_CODE_SIGNATURE space, else signing has to realloc
+		string			strInstallName;			// LC_ID_DYLIB for MH_DYLIB
+		uint32_t		uSeed = 1;
+	};
+
+	struct ZAppSpec
+	{
+		string		strName = "Bench";
+		string		strBundleId = "com.zsign.bench";
+		uint32_t	uFrameworks = 4;
+		uint32_t	uDylibs = 4;
+		uint32_t	uResources = 256;
+		uint64_t	uExecSize = 8 * 1024 * 1024;
+		uint64_t	uFrameworkSize = 2 * 1024 * 1024;
+		uint64_t	uDylibSize = 512 * 1024;
+		uint32_t	uResourceSize = 16 * 1024;
+		uint32_t	uRedundancy = 0;			// percent of every resource that is repetitive text, so it deflates
+		bool		bFat = false;				// arm64 + arm64e slices for every binary
+		bool		bSigned = false;			// ad-hoc sign every binary after writing it
+		uint32_t	uSeed = 1;
+	};
+
+public:
+	static bool GenerateSlice(const ZSliceSpec& spec, string& strOutput);
+	static bool GenerateMachO(const char* szFile, const vector<ZSliceSpec>& arrSlices, bool bSigned);
+	// Thin dylib with an LC_SYMTAB and an export trie: symbol i is in the symtab unless i % 4 == 3 and in the
+	// trie if i is odd, the trie offset of a symbol in both is its symtab offset + 4. bShuffle permutes the symtab.
+	static bool GenerateSymbolImage(const char* szFile, uint32_t uSymbols, bool bShuffle, uint32_t uSeed);
+	static string SymbolName(uint32_t uIndex);
+	static uint64_t SymbolOffset(uint32_t uIndex, bool bExportTrie);
+	static bool GenerateApp(const string& strAppFolder, const ZAppSpec& spec);
+	static bool GenerateIpa(const string& strAppFolder, const string& strIpaFile, int nLevel);
+	static bool GenerateIdentity(ZSignAsset& asset);
+	static void FillRandom(uint8_t* pData, size_t sSize, uint32_t uSeed);
+};
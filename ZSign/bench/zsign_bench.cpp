@@ -0,0 +1,1896 @@
+// Benchmarks for the portable ZSign and install sources on synthetic fixtures, not part of the ZSign target.
+// Build with the two commands below, indented lines continue the one above.
+// gcc -O2 -c LiveContainerSwiftUI/LCZip.c LiveContainerSwiftUI/LCPageHash.c LiveContainerSwiftUI/LCCopy.c
+//     LiveContainerSwiftUI/LCZipWriter.c LiveContainerSwiftUI/LCBlobStore.c LiveContainerSwiftUI/LCAppCatalog.c
+//     LiveContainer/LCContainerLock.c LiveContainer/LCLaunchManifest.c LiveContainer/LCBundlePatch.c
+//     LiveContainer/LCSymbolIndex.c LiveContainer/LCSigScan.c LiveContainer/LCArm64.c -Wno-deprecated-declarations
+// g++ -std=c++17 -O2 -IZSign -IZSign/common -IZSign/bench -ILiveContainerSwiftUI -ILiveContainer ZSign/bench/zsign_bench.cpp ZSign/bench/fixture.cpp
+//     ZSign/batch.cpp ZSign/bundle.cpp ZSign/macho.cpp ZSign/archo.cpp ZSign/signing.cpp ZSign/openssl.cpp ZSign/verify.cpp
+//     ZSign/common/*.cpp LCZip.o LCPageHash.o LCCopy.o LCZipWriter.o LCBlobStore.o LCAppCatalog.o
+//     LCContainerLock.o LCLaunchManifest.o LCBundlePatch.o LCSymbolIndex.o LCSigScan.o
+//     LCArm64.o -lcrypto -lz -lpthread -o zsign-bench
+#include "common.h"
+#include "json.h"
+#include "mach-o.h"
+#include "openssl.h"
+#include "signing.h"
+#include "macho.h"
+#include "bundle.h"
+#include "trace.h"
+#include "reader.h"
+#include "fixture.h"
+#include <chrono>
+#include <thread>
+#include <zlib.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+extern "C" {
+#include "LCZip.h"
+#include "LCPageHash.h"
+#include "LCCopy.h"
+#include "LCZipWriter.h"
+#include "LCBlobStore.h"
+#include "LCAppCatalog.h"
+#include "LCContainerLock.h"
+#include "LCLaunchManifest.h"
+#include "LCBundlePatch.h"
+#include "LCSymbolIndex.h"
+#include "LCSigScan.h"
+#include "LCArm64.h"
+}
+
+extern "C" {
+const char* getDocumentsDirectory() { return ZFile::GetTempFolder(); }
+void writeToNSLog(const char*) {}
+void refreshFile(const char*) {}
+}
+
+// Every case regenerates its input before each iteration, only the call under test is timed.
+// Results are keyed by case name, so the JSON diffs cleanly between runs.
+class ZSignBench
+{
+public:
+	ZSignBench();
+
+public:
+	bool Init(const string& strWorkFolder);
+	bool Run(const string& strFilter);
+	void GetReport(jvalue& jvReport);
+
+public:
+	uint32_t				m_uIterations;
+	uint64_t				m_uSliceSize;
+	int						m_nThreads;
+	ZFixture::ZAppSpec		m_appSpec;
+	string					m_strMachO;
+
+private:
+	bool Measure(const char* szName, uint64_t uBytes, function<bool()> setup, function<bool()> run);
+	bool BenchMachOSign(const char* szName, ZSignAsset* pSignAsset, bool bFat, bool bSigned, bool bForce);
+	bool BenchMachORealloc(const char* szName, bool bFat);
+	bool BenchMachOView(const char* szName, bool bShared);
+	bool BenchCMS();
+	bool BenchSHAFile();
+	bool BenchSHARepeat();
+	bool BenchSHASmall(const char* szName, int nBackend);
+	bool GenerateSmallFiles(vector<string>& arrFiles, uint64_t& uBytes);
+	bool BenchCodeResources();
+	bool BenchSignNode();
+	bool GenerateBenchIpa(string& strIpaFile);
+	bool BenchIpaExtract(const char* szName, int nThreads);
+	bool BenchIpaInstall(const char* szName, bool bHashCodePages);
+	bool GenerateBenchUpdateIpa(string& strIpaFile);
+	bool InstallBenchIpa(const string& strIpaFile, const string& strOutput, const char* szInstalledBundle);
+	bool BenchIpaUpdate(const char* szName, bool bDelta);
+	bool BenchIpaPack(const char* szName, int nThreads);
+	bool BenchCopyTree(const char* szName, int nThreads, int nFlags);
+	bool BenchCopyFile();
+	bool BenchBundleFixup(const char* szName, int nThreads);
+	bool BenchBlobStore(const char* szName, int nStage);
+	bool GenerateCatalogApps(const string& strFolder, uint64_t& uBytes);
+	bool BenchAppCatalog(const char* szName, bool bMapped);
+	bool BenchContainerLock(const char* szName, int nProcesses);
+	bool BenchLaunchManifest(const char* szName, bool bMapped);
+	bool BenchSymbolIndex(const char* szName, bool bIndexed);
+	bool BenchSigScan(const char* szName, bool bScanner);
+	bool BenchArm64Decode(const char* szName, bool bTable);
+	bool BenchArm64Xref(const char* szName, int nThreads, bool bLookup);
+	vector<ZFixture::ZSliceSpec> Slices(bool bFat, bool bCodeSignature);
+
+private:
+	string			m_strWorkFolder;
+	ZSignAsset		m_adhocAsset;
+	ZSignAsset		m_identityAsset;
+	jvalue			m_jvResults;
+};
+
+ZSignBench::ZSignBench()
+{
+	m_uIterations = 5;
+	m_uSliceSize = 32 * 1024 * 1024;
+	m_nThreads = 0;
+	m_jvResults = jvalue(jvalue::E_OBJECT);
+}
+
+bool ZSignBench::Init(const string& strWorkFolder)
+{
+	m_strWorkFolder = strWorkFolder;
+	if (!ZFile::CreateFolder(m_strWorkFolder.c_str())) {
+		return ZLog::ErrorV(">>> Can't create work folder! %s\n", m_strWorkFolder.c_str());
+	}
+	if (!m_adhocAsset.Init("", "", "", "", "", true, false, false)) {
+		return false;
+	}
+	if (!ZFixture::GenerateIdentity(m_identityAsset)) {
+		return ZLog::Error(">>> Can't generate bench identity!\n");
+	}
+	return true;
+}
+
+bool ZSignBench::Measure(const char* szName, uint64_t uBytes, function<bool()> setup, function<bool()> run)
+{
+	vector<uint64_t> arrSamples;
+	uint64_t uMinorFaults = 0;
+	uint64_t uMajorFaults = 0;
+	for (uint32_t i = 0; i < m_uIterations; i++) {
+		if (!setup()) {
+			return ZLog::ErrorV(">>> Bench setup failed! %s\n", szName);
+		}
+		struct rusage usageBegin;
+		struct rusage usageEnd;
+		getrusage(RUSAGE_SELF, &usageBegin);
+		auto begin = chrono::steady_clock::now();
+		bool bRet = run();
+		auto end = chrono::steady_clock::now();
+		getrusage(RUSAGE_SELF, &usageEnd);
+		if (!bRet) {
+			return ZLog::ErrorV(">>> Bench failed! %s\n", szName);
+		}
+		arrSamples.push_back((uint64_t)chrono::duration_cast<chrono::microseconds>(end - begin).count());
+		uMinorFaults += (uint64_t)(usageEnd.ru_minflt - usageBegin.ru_minflt);
+		uMajorFaults += (uint64_t)(usageEnd.ru_majflt - usageBegin.ru_majflt);
+	}
+	if (arrSamples.empty()) {
+		return false;
+	}
+
+	sort(arrSamples.begin(), arrSamples.end());
+	uint64_t uTotal = 0;
+	for (uint64_t uSample : arrSamples) {
+		uTotal += uSample;
+	}
+	uint64_t uMedian = arrSamples[arrSamples.size() / 2];
+
+	jvalue& jvResult = m_jvResults[szName];
+	jvResult["bytes"] = (int64_t)uBytes;
+	jvResult["iterations"] = (int64_t)arrSamples.size();
+	jvResult["min_us"] = (int64_t)arrSamples.front();
+	jvResult["median_us"] = (int64_t)uMedian;
+	jvResult["mean_us"] = (int64_t)(uTotal / arrSamples.size());
+	jvResult["max_us"] = (int64_t)arrSamples.back();
+	jvResult["mb_per_s"] = (int64_t)((uMedian > 0) ? (uBytes * 1000000 / uMedian) >> 20 : 0);
+	jvResult["minor_faults"] = (int64_t)(uMinorFaults / arrSamples.size()); // per iteration
+	jvResult["major_faults"] = (int64_t)(uMajorFaults / arrSamples.size());
+
+	fprintf(stderr, "%-24s %10llu us median, %10llu us min, %6lld MB/s, %8lld faults\n", szName, (unsigned long long)uMedian,
+			(unsigned long long)arrSamples.front(), (long long)jvResult["mb_per_s"].as_int64(), (long long)jvResult["minor_faults"].as_int64());
+	return true;
+}
+
+vector<ZFixture::ZSliceSpec> ZSignBench::Slices(bool bFat, bool bCodeSignature)
+{
+	ZFixture::ZSliceSpec spec;
+	spec.uSliceSize = m_uSliceSize;
+	spec.bCodeSignature = bCodeSignature;
+	vector<ZFixture::ZSliceSpec> arrSlices = { spec };
+	if (bFat) {
+		spec.uCpuSubType = CPU_SUBTYPE_ARM64E;
+		spec.uSeed++;
+		arrSlices.push_back(spec);
+	}
+	return arrSlices;
+}
+
+bool ZSignBench::BenchMachOSign(const char* szName, ZSignAsset* pSignAsset, bool bFat, bool bSigned, bool bForce)
+{
+	string strFile = m_strWorkFolder + "/" + szName;
+	vector<ZFixture::ZSliceSpec> arrSlices = Slices(bFat, true);
+	unique_ptr<ZMachO> pMachO;
+	return Measure(szName, m_uSliceSize * arrSlices.size(), [&]() {
+		pMachO.reset(new ZMachO());
+		return ZFixture::GenerateMachO(strFile.c_str(), arrSlices, bSigned) && pMachO->Init(strFile.c_str());
+	}, [&]() {
+		return pMachO->Sign(pSignAsset, bForce, "com.zsign.bench", "", "", "");
+	});
+}
+
+bool ZSignBench::BenchMachORealloc(const char* szName, bool bFat)
+{
+	string strFile = m_strWorkFolder + "/" + szName;
+	vector<ZFixture::ZSliceSpec> arrSlices = Slices(bFat, false);
+	unique_ptr<ZMachO> pMachO;
+	return Measure(szName, m_uSliceSize * arrSlices.size(), [&]() {
+		pMachO.reset(new ZMachO());
+		return ZFixture::GenerateMachO(strFile.c_str(), arrSlices, false) && pMachO->Init(strFile.c_str());
+	}, [&]() {
+		return pMachO->ReallocCodeSignSpace();
+	});
+}
+
+// The questions the install path asks about every executable slice: is it encrypted, where are __text, LC_ID_DYLIB,
+// the dylinker and the signature, and which dylibs are duplicated. "walks" answers them with a load command walk per
+// question like the per-function walks did, "shared" builds one macho_view and reads the rest from it.
+bool ZSignBench::BenchMachOView(const char* szName, bool bShared)
+{
+	const uint32_t uFiles = 64;
+	ZFixture::ZSliceSpec spec;
+	spec.uSliceSize = 256 * 1024;
+	spec.uDylibs = 200;
+	spec.uHeaderPad = 16 * 1024;
+	vector<string> arrFiles;
+	ZFile::CreateFolderV("%s/MachOView", m_strWorkFolder.c_str());
+	for (uint32_t i = 0; i < uFiles; i++) {
+		arrFiles.push_back(m_strWorkFolder + "/MachOView/" + to_string(i));
+		spec.uSeed = i + 1;
+		if (!ZFixture::GenerateMachO(arrFiles.back().c_str(), { spec }, false)) {
+			return false;
+		}
+	}
+
+	uint64_t uPasses = 0;
+	uint64_t uAnswers = 0;
+	auto walk = [&](uint8_t* pBase, function<void(load_command*)> visit) {
+		mach_header_64* pHeader = (mach_header_64*)pBase;
+		uint8_t* pLoadCommand = pBase + sizeof(mach_header_64);
+		for (uint32_t i = 0; i < pHeader->ncmds; i++) {
+			visit((load_command*)pLoadCommand);
+			pLoadCommand += ((load_command*)pLoadCommand)->cmdsize;
+		}
+		uPasses++;
+	};
+	auto dedup = [&](uint8_t* pBase, const vector<uint32_t>& arrDylibs) {
+		set<string> setPaths;
+		for (uint32_t uCmdOff : arrDylibs) {
+			dylib_command* dlc = (dylib_command*)(pBase + uCmdOff);
+			uAnswers += setPaths.insert((const char*)dlc + dlc->dylib.name.offset).second ? 0 : 1;
+		}
+	};
+
+	bool bRet = Measure(szName, (uint64_t)uFiles * spec.uSliceSize, [&]() {
+		uPasses = 0;
+		return true;
+	}, [&]() {
+		for (const string& strFile : arrFiles) {
+			size_t sSize = 0;
+			uint8_t* pBase = (uint8_t*)ZFile::MapFile(strFile.c_str(), 0, 0, &sSize, true);
+			if (NULL == pBase) {
+				return false;
+			}
+			vector<uint32_t> arrDylibs;
+			if (bShared) {
+				macho_view view;
+				macho_view_init(&view, pBase, sSize);
+				uPasses++;
+				uAnswers += macho_view_is_encrypted(&view) + view.textsection.offset + view.iddylib + view.dylinker + view.codesignature;
+				uint32_t uCursor = 0;
+				for (uint32_t uCmdOff; 0 != (uCmdOff = macho_view_next_dylib(&view, &uCursor));) {
+					arrDylibs.push_back(uCmdOff);
+				}
+			} else {
+				walk(pBase, [&](load_command* plc) {
+					if (LC_ENCRYPTION_INFO_64 == plc->cmd) {
+						uAnswers += ((encryption_info_command*)plc)->cryptid;
+					}
+				});
+				walk(pBase, [&](load_command* plc) {
+					if (LC_SEGMENT_64 == plc->cmd && 0 == strcmp("__TEXT", ((segment_command_64*)plc)->segname)) {
+						section_64* sect = (section_64*)((segment_command_64*)plc + 1);
+						for (uint32_t j = 0; j < ((segment_command_64*)plc)->nsects; j++) {
+							uAnswers += (0 == strcmp("__text", sect[j].sectname)) ? sect[j].offset : 0;
+						}
+					} else if (LC_ID_DYLIB == plc->cmd || LC_LOAD_DYLINKER == plc->cmd || LC_CODE_SIGNATURE == plc->cmd) {
+						uAnswers += plc->cmdsize;
+					}
+				});
+				walk(pBase, [&](load_command* plc) {
+					if (LC_LOAD_DYLIB == plc->cmd || LC_LOAD_WEAK_DYLIB == plc->cmd || LC_REEXPORT_DYLIB == plc->cmd) {
+						arrDylibs.push_back((uint32_t)((uint8_t*)plc - pBase));
+					}
+				});
+			}
+			dedup(pBase, arrDylibs);
+			ZFile::UnmapFile(pBase, sSize);
+		}
+		return true;
+	});
+	ZLog::PrintV(">>> %s: %llu load command passes per slice\n", szName, (unsigned long long)(uPasses / uFiles));
+	return bRet;
+}
+
+bool ZSignBench::BenchCMS()
+{
+	// code directories of a 32MB slice, the CMS cost is dominated by the RSA signature, not their size
+	string strCodeDirectory;
+	string strAltnateCodeDirectory;
+	strCodeDirectory.resize(8192 * 20 + 512);
+	strAltnateCodeDirectory.resize(8192 * 32 + 512);
+	ZFixture::FillRandom((uint8_t*)&strCodeDirectory[0], strCodeDirectory.size(), 7);
+	ZFixture::FillRandom((uint8_t*)&strAltnateCodeDirectory[0], strAltnateCodeDirectory.size(), 8);
+
+	string strOutput;
+	return Measure("cms.generate", strCodeDirectory.size() + strAltnateCodeDirectory.size(), []() {
+		return true;
+	}, [&]() {
+		return ZSign::SlotBuildCMSSignature(&m_identityAsset, strCodeDirectory, strAltnateCodeDirectory, strOutput);
+	});
+}
+
+bool ZSignBench::BenchSHAFile()
+{
+	// larger than the hashing window, so it is read through windowed mappings
+	string strFile = m_strWorkFolder + "/sha.file.large";
+	string strData;
+	strData.resize((size_t)(m_uSliceSize * 4));
+	ZFixture::FillRandom((uint8_t*)&strData[0], strData.size(), 9);
+	if (!ZFile::WriteFile(strFile.c_str(), strData)) {
+		return false;
+	}
+
+	string strSHA1;
+	string strSHA256;
+	return Measure("sha.file.large", strData.size(), []() {
+		return true;
+	}, [&]() {
+		return ZSHA::SHAFile(strFile.c_str(), strSHA1, strSHA256);
+	});
+}
+
+bool ZSignBench::BenchSHARepeat()
+{
+	// every enclosing bundle rehashes the changed files of its nested bundles (binaries, Info.plist, CodeResources),
+	// three levels deep here
+	string strAppFolder = m_strWorkFolder + "/SHARepeat/" + m_appSpec.strName + ".app";
+	ZFile::CreateFolderV("%s/SHARepeat", m_strWorkFolder.c_str());
+	if (!ZFixture::GenerateApp(strAppFolder, m_appSpec)) {
+		return false;
+	}
+
+	vector<string> arrFiles;
+	uint64_t uBytes = 0;
+	string strFrameworks = strAppFolder + "/Frameworks";
+	ZFile::EnumFolder(strFrameworks.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
+		if (!bFolder) {
+			arrFiles.push_back(strPath);
+			uBytes += (uint64_t)ZFile::GetFileSize(strPath.c_str());
+		}
+		return false;
+	});
+
+	return Measure("sha.file.repeat", uBytes * 3, []() {
+		ZFile::ClearMapCache();
+		return true;
+	}, [&]() {
+		string strSHA1;
+		string strSHA256;
+		for (int i = 0; i < 3; i++) {
+			for (const string& strFile : arrFiles) {
+				if (!ZSHA::SHABase64File(strFile.c_str(), strSHA1, strSHA256)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	});
+}
+
+bool ZSignBench::GenerateSmallFiles(vector<string>& arrFiles, uint64_t& uBytes)
+{
+	// resource heavy bundles: 16 small files, 1K to 8K, per configured resource
+	string strFolder = m_strWorkFolder + "/SHASmall";
+	uint32_t uCount = m_appSpec.uResources * 16;
+	arrFiles.clear();
+	uBytes = 0;
+	string strData;
+	for (uint32_t i = 0; i < uCount; i++) {
+		if (0 == (i % 256)) {
+			ZFile::CreateFolderV("%s/%u", strFolder.c_str(), i / 256);
+		}
+		string strFile;
+		ZUtil::StringFormatV(strFile, "%s/%u/res_%u.bin", strFolder.c_str(), i / 256, i);
+		strData.resize((i % 8 + 1) * 1024);
+		ZFixture::FillRandom((uint8_t*)&strData[0], strData.size(), i + 1);
+		if (!ZFile::WriteFile(strFile.c_str(), strData)) {
+			return false;
+		}
+		arrFiles.push_back(strFile);
+		uBytes += strData.size();
+	}
+	return true;
+}
+
+bool ZSignBench::BenchSHASmall(const char* szName, int nBackend)
+{
+	// nBackend < 0 is the one mapping per file path
+	vector<string> arrFiles;
+	uint64_t uBytes = 0;
+	if (!GenerateSmallFiles(arrFiles, uBytes)) {
+		return false;
+	}
+	if (nBackend >= 0) {
+		if (ZBatchReader::E_BACKEND_URING == nBackend && !ZBatchReader::IsUringAvailable()) {
+			return true;
+		}
+
+		vector<string> arrSHA1;
+		vector<string> arrSHA256;
+		if (!ZSHA::SHABase64Files(arrFiles, arrSHA1, arrSHA256, nBackend)) {
+			return false;
+		}
+		for (size_t i = 0; i < arrFiles.size(); i++) {
+			string strSHA1;
+			string strSHA256;
+			ZSHA::SHABase64File(arrFiles[i].c_str(), strSHA1, strSHA256);
+			if (strSHA1 != arrSHA1[i] || strSHA256 != arrSHA256[i]) {
+				return ZLog::ErrorV(">>> %s: digest mismatch! %s\n", szName, arrFiles[i].c_str());
+			}
+		}
+	}
+
+	return Measure(szName, uBytes, []() {
+		ZFile::ClearMapCache();
+		return true;
+	}, [&]() {
+		if (nBackend >= 0) {
+			vector<string> arrSHA1;
+			vector<string> arrSHA256;
+			return ZSHA::SHABase64Files(arrFiles, arrSHA1, arrSHA256, nBackend);
+		}
+		string strSHA1;
+		string strSHA256;
+		for (const string& strFile : arrFiles) {
+			if (!ZSHA::SHABase64File(strFile.c_str(), strSHA1, strSHA256)) {
+				return false;
+			}
+		}
+		return true;
+	});
+}
+
+static uint64_t GetFolderSize(const string& strFolder)
+{
+	uint64_t uSize = 0;
+	ZFile::EnumFolder(strFolder.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
+		if (!bFolder) {
+			uSize += (uint64_t)ZFile::GetFileSize(strPath.c_str());
+		}
+		return false;
+	});
+	return uSize;
+}
+
+bool ZSignBench::BenchCodeResources()
+{
+	string strAppFolder = m_strWorkFolder + "/CodeResources/" + m_appSpec.strName + ".app";
+	ZFile::CreateFolderV("%s/CodeResources", m_strWorkFolder.c_str());
+	if (!ZFixture::GenerateApp(strAppFolder, m_appSpec)) {
+		return false;
+	}
+
+	// the bundle is only read, generating it once is enough
+	jvalue jvCodeRes;
+	return Measure("bundle.coderesources", GetFolderSize(strAppFolder), []() {
+		return true;
+	}, [&]() {
+		ZBundle bundle;
+		return bundle.GenerateCodeResources(strAppFolder, jvCodeRes);
+	});
+}
+
+bool ZSignBench::BenchSignNode()
+{
+	string strAppFolder = m_strWorkFolder + "/SignNode/" + m_appSpec.strName + ".app";
+	ZFile::CreateFolderV("%s/SignNode", m_strWorkFolder.c_str());
+	if (!ZFixture::GenerateApp(strAppFolder, m_appSpec)) {
+		return false;
+	}
+
+	unique_ptr<ZBundle> pBundle;
+	return Measure("bundle.signnode", GetFolderSize(strAppFolder), [&]() {
+		pBundle.reset(new ZBundle());
+		return ZFixture::GenerateApp(strAppFolder, m_appSpec) &&
+				pBundle->ConfigureFolderSign(&m_adhocAsset, strAppFolder, "", "", "", "", true, false, false, true);
+	}, [&]() {
+		return pBundle->SignNode(pBundle->config) && pBundle->signFailedFiles.empty();
+	});
+}
+
+bool ZSignBench::GenerateBenchIpa(string& strIpaFile)
+{
+	// game-like IPA: the configured app with half of every resource compressible, deflated at the default level
+	string strAppFolder = m_strWorkFolder + "/Ipa/" + m_appSpec.strName + ".app";
+	strIpaFile = m_strWorkFolder + "/Ipa/" + m_appSpec.strName + ".ipa";
+	ZFile::CreateFolderV("%s/Ipa", m_strWorkFolder.c_str());
+	if (ZFile::IsFileExists(strIpaFile.c_str())) {
+		return true;
+	}
+	ZFixture::ZAppSpec spec = m_appSpec;
+	spec.uRedundancy = 50;
+	return ZFixture::GenerateApp(strAppFolder, spec) && ZFixture::GenerateIpa(strAppFolder, strIpaFile, Z_DEFAULT_COMPRESSION);
+}
+
+bool ZSignBench::BenchIpaExtract(const char* szName, int nThreads)
+{
+	string strIpaFile;
+	string strOutput = m_strWorkFolder + "/Ipa/Extracted";
+	if (!GenerateBenchIpa(strIpaFile)) {
+		return false;
+	}
+
+	LCZipArchive zip;
+	if (0 != LCZipOpen(&zip, strIpaFile.c_str(), NULL)) {
+		ZLog::ErrorV(">>> %s\n", zip.error);
+		LCZipClose(&zip);
+		return false;
+	}
+	uint64_t uBytes = zip.totalUncompressed;
+	LCZipClose(&zip);
+
+	return Measure(szName, uBytes, [&]() {
+		ZFile::RemoveFolder(strOutput.c_str());
+		return true;
+	}, [&]() {
+		LCZipArchive zip;
+		bool bRet = (0 == LCZipOpen(&zip, strIpaFile.c_str(), NULL) && 0 == LCZipExtractAll(&zip, strOutput.c_str(), nThreads, NULL, NULL));
+		if (!bRet) {
+			ZLog::ErrorV(">>> %s\n", zip.error);
+		}
+		LCZipClose(&zip);
+		return bRet;
+	});
+}
+
+// extract + forced sign as an install does, optionally with the code pages hashed while they are extracted
+bool ZSignBench::BenchIpaInstall(const char* szName, bool bHashCodePages)
+{
+	string strIpaFile;
+	string strOutput = m_strWorkFolder + "/Ipa/Installed";
+	string strAppFolder = strOutput + "/Payload/" + m_appSpec.strName + ".app";
+	if (!GenerateBenchIpa(strIpaFile)) {
+		return false;
+	}
+
+	LCZipArchive zip;
+	if (0 != LCZipOpen(&zip, strIpaFile.c_str(), NULL)) {
+		ZLog::ErrorV(">>> %s\n", zip.error);
+		LCZipClose(&zip);
+		return false;
+	}
+	uint64_t uBytes = zip.totalUncompressed;
+	LCZipClose(&zip);
+
+	int nThreads = (m_nThreads > 0) ? m_nThreads : (int)thread::hardware_concurrency();
+	return Measure(szName, uBytes, [&]() {
+		ZFile::RemoveFolder(strOutput.c_str());
+		return true;
+	}, [&]() {
+		LCZipArchive zip;
+		bool bRet = (0 == LCZipOpen(&zip, strIpaFile.c_str(), NULL));
+		if (bRet) {
+			zip.observer = bHashCodePages ? &LCPageHashZipObserver : NULL;
+			bRet = (0 == LCZipExtractAll(&zip, strOutput.c_str(), nThreads, NULL, NULL));
+		}
+		if (!bRet) {
+			ZLog::ErrorV(">>> %s\n", zip.error);
+		}
+		LCZipClose(&zip);
+
+		ZBundle bundle;
+		return bRet && bundle.ConfigureFolderSign(&m_adhocAsset, strAppFolder, "", "", "", "", true, false, false, true) &&
+				bundle.SignNode(bundle.config) && bundle.signFailedFiles.empty();
+	});
+}
+
+// the bench IPA with every 20th resource changed, like a game update that ships new assets
+bool ZSignBench::GenerateBenchUpdateIpa(string& strIpaFile)
+{
+	string strBaseIpaFile;
+	string strAppFolder = m_strWorkFolder + "/Ipa/" + m_appSpec.strName + ".app";
+	strIpaFile = m_strWorkFolder + "/Ipa/" + m_appSpec.strName + "-update.ipa";
+	if (!GenerateBenchIpa(strBaseIpaFile)) {
+		return false;
+	}
+	if (ZFile::IsFileExists(strIpaFile.c_str())) {
+		return true;
+	}
+
+	vector<string> arrResources;
+	ZFile::EnumFolder(strAppFolder.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
+		if (!bFolder && ZFile::IsPathSuffix(strPath, ".dat")) {
+			arrResources.push_back(strPath);
+		}
+		return false;
+	});
+	sort(arrResources.begin(), arrResources.end());
+	for (size_t i = 0; i < arrResources.size(); i += 20) {
+		string strData;
+		if (!ZFile::ReadFile(arrResources[i].c_str(), strData) || strData.empty()) {
+			return false;
+		}
+		strData[0] ^= 0xff;
+		ZFile::WriteFile(arrResources[i].c_str(), strData);
+	}
+	return ZFixture::GenerateIpa(strAppFolder, strIpaFile, Z_DEFAULT_COMPRESSION);
+}
+
+// what an install does: extract with the code pages hashed, record the manifest, the forced sign, then stamp the signed Mach-Os
+bool ZSignBench::InstallBenchIpa(const string& strIpaFile, const string& strOutput, const char* szInstalledBundle)
+{
+	LCZipArchive zip;
+	bool bRet = (0 == LCZipOpen(&zip, strIpaFile.c_str(), NULL));
+	if (bRet) {
+		int nThreads = (m_nThreads > 0) ? m_nThreads : (int)thread::hardware_concurrency();
+		zip.observer = &LCPageHashZipObserver;
+		bRet = (0 == (szInstalledBundle ? LCZipExtractUpdate(&zip, strOutput.c_str(), szInstalledBundle, nThreads, NULL, NULL, NULL)
+										: LCZipExtractAll(&zip, strOutput.c_str(), nThreads, NULL, NULL))) &&
+				0 == LCZipWriteManifest(&zip, strOutput.c_str());
+	}
+	if (!bRet) {
+		ZLog::ErrorV(">>> %s\n", zip.error);
+	}
+	LCZipClose(&zip);
+
+	ZBundle bundle;
+	string strAppFolder = strOutput + "/Payload/" + m_appSpec.strName + ".app";
+	return bRet && bundle.ConfigureFolderSign(&m_adhocAsset, strAppFolder, "", "", "", "", true, false, false, true) &&
+			bundle.SignNode(bundle.config) && bundle.signFailedFiles.empty() && LCZipStampManifest(strAppFolder.c_str());
+}
+
+// installs the update over a signed install of the original IPA, either from scratch or reusing the unchanged files
+bool ZSignBench::BenchIpaUpdate(const char* szName, bool bDelta)
+{
+	string strBaseIpaFile;
+	string strIpaFile;
+	string strInstalled = m_strWorkFolder + "/Ipa/Previous";
+	string strInstalledBundle = strInstalled + "/Payload/" + m_appSpec.strName + ".app";
+	string strOutput = m_strWorkFolder + "/Ipa/Updated";
+	if (!GenerateBenchUpdateIpa(strIpaFile) || !GenerateBenchIpa(strBaseIpaFile)) {
+		return false;
+	}
+
+	LCZipArchive zip;
+	if (0 != LCZipOpen(&zip, strIpaFile.c_str(), NULL)) {
+		ZLog::ErrorV(">>> %s\n", zip.error);
+		LCZipClose(&zip);
+		return false;
+	}
+	uint64_t uBytes = zip.totalUncompressed;
+	LCZipClose(&zip);
+
+	// the previous install is redone every iteration so no run depends on what the one before left behind
+	return Measure(szName, uBytes, [&]() {
+		ZFile::RemoveFolder(strOutput.c_str());
+		ZFile::RemoveFolder(strInstalled.c_str());
+		return InstallBenchIpa(strBaseIpaFile, strInstalled, NULL);
+	}, [&]() {
+		return InstallBenchIpa(strIpaFile, strOutput, bDelta ? strInstalledBundle.c_str() : NULL);
+	});
+}
+
+// nThreads < 0 packs with the fixture writer instead, one deflate stream per file on one thread like the system archiver
+bool ZSignBench::BenchIpaPack(const char* szName, int nThreads)
+{
+	string strPackFolder = m_strWorkFolder + "/Pack";
+	string strAppFolder = strPackFolder + "/Payload/" + m_appSpec.strName + ".app";
+	string strIpaFile = m_strWorkFolder + "/Packed.ipa";
+	if (!ZFile::IsFolder(strAppFolder.c_str()) && !ZFixture::GenerateApp(strAppFolder, m_appSpec)) {
+		return false;
+	}
+
+	char szError[256] = {0};
+	LCZipWriterStats stats = {};
+	bool bRet = Measure(szName, GetFolderSize(strAppFolder), [&]() {
+		ZFile::RemoveFile(strIpaFile.c_str());
+		return true;
+	}, [&]() {
+		if (nThreads < 0) {
+			return ZFixture::GenerateIpa(strAppFolder, strIpaFile, 6);
+		}
+		return 0 == LCZipWriteFolder(strPackFolder.c_str(), strIpaFile.c_str(), nThreads, 6, &stats, szError, sizeof(szError));
+	});
+	if (!bRet && szError[0]) {
+		ZLog::ErrorV(">>> %s\n", szError);
+	}
+	ZLog::PrintV(">>> %s: %llu bytes packed\n", szName, (unsigned long long)ZFile::GetFileSize(strIpaFile.c_str()));
+	return bRet;
+}
+
+// the fixture app copied within the work folder, so the result depends on what its file system can clone
+bool ZSignBench::BenchCopyTree(const char* szName, int nThreads, int nFlags)
+{
+	string strAppFolder = m_strWorkFolder + "/Copy/" + m_appSpec.strName + ".app";
+	string strOutput = m_strWorkFolder + "/Copy/Copied.app";
+	ZFile::CreateFolderV("%s/Copy", m_strWorkFolder.c_str());
+	if (!ZFile::IsFolder(strAppFolder.c_str()) && !ZFixture::GenerateApp(strAppFolder, m_appSpec)) {
+		return false;
+	}
+
+	LCCopyStats stats;
+	bool bRet = Measure(szName, GetFolderSize(strAppFolder), [&]() {
+		ZFile::RemoveFolder(strOutput.c_str());
+		return true;
+	}, [&]() {
+		return 0 == LCCopyTree(strAppFolder.c_str(), strOutput.c_str(), nThreads, nFlags, &stats);
+	});
+	ZLog::PrintV(">>> %s: %zu cloned, %zu range, %zu buffered\n", szName, stats.files[LCCopyMethodClone], stats.files[LCCopyMethodRange], stats.files[LCCopyMethodBuffer]);
+	return bRet;
+}
+
+// Marks the arm64e slice of every framework and dylib in a fat app as CPU_SUBTYPE_LIB64, the setup clears the bit
+// again so every iteration has the same work. nThreads < 0 is the serial walk that maps each binary, patches it and
+// syncs the whole file.
+bool ZSignBench::BenchBundleFixup(const char* szName, int nThreads)
+{
+	string strAppFolder = m_strWorkFolder + "/BundleFixup/" + m_appSpec.strName + ".app";
+	ZFile::CreateFolderV("%s/BundleFixup", m_strWorkFolder.c_str());
+	ZFixture::ZAppSpec spec = m_appSpec;
+	spec.bFat = true;
+	spec.uFrameworks = 48;
+	spec.uDylibs = 48;
+	spec.uFrameworkSize = 1024 * 1024;
+	spec.uDylibSize = 256 * 1024;
+	spec.uResources = 64;
+	if (!ZFile::IsFileExists(strAppFolder.c_str()) && !ZFixture::GenerateApp(strAppFolder, spec)) {
+		return false;
+	}
+
+	auto isBinary = [](const string& strPath) {
+		string strName = ZUtil::GetBaseName(strPath.c_str());
+		return (strName.size() > 6 && 0 == strName.compare(strName.size() - 6, 6, ".dylib")) ||
+				string::npos != strPath.find("/" + strName + ".framework/" + strName);
+	};
+	vector<string> arrBinaries;
+	uint64_t uBytes = 0;
+	ZFile::EnumFolder((strAppFolder + "/Frameworks").c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
+		if (!bFolder && isBinary(strPath)) {
+			arrBinaries.push_back(strPath);
+			uBytes += (uint64_t)ZFile::GetFileSize(strPath.c_str());
+		}
+		return false;
+	});
+
+	auto fixupMapped = [](uint8_t* pBase, bool bSet) {
+		fat_header* pFat = (fat_header*)pBase;
+		fat_arch* pArch = (fat_arch*)(pFat + 1);
+		for (uint32_t i = 0; FAT_CIGAM == pFat->magic && i < LE((uint32_t)pFat->nfat_arch); i++) {
+			if (CPU_TYPE_ARM64 == LE((uint32_t)pArch[i].cputype) && CPU_SUBTYPE_ARM64E == (LE((uint32_t)pArch[i].cpusubtype) & ~CPU_SUBTYPE_LIB64)) {
+				mach_header_64* pHeader = (mach_header_64*)(pBase + LE((uint32_t)pArch[i].offset));
+				pHeader->cpusubtype = bSet ? (pHeader->cpusubtype | CPU_SUBTYPE_LIB64) : (pHeader->cpusubtype & ~CPU_SUBTYPE_LIB64);
+				pArch[i].cpusubtype = LE((uint32_t)pHeader->cpusubtype);
+				break;
+			}
+		}
+	};
+	auto mapAndFixup = [&](const string& strFile, bool bSet, bool bSync) {
+		size_t sSize = 0;
+		uint8_t* pBase = (uint8_t*)ZFile::MapFile(strFile.c_str(), 0, 0, &sSize, false);
+		if (NULL == pBase) {
+			return false;
+		}
+		fixupMapped(pBase, bSet);
+		if (bSync) {
+			msync(pBase, sSize, MS_SYNC);
+		}
+		return ZFile::UnmapFile(pBase, sSize);
+	};
+
+	size_t sPatched = 0;
+	bool bRet = Measure(szName, uBytes, [&]() {
+		for (const string& strFile : arrBinaries) {
+			if (!mapAndFixup(strFile, false, false)) {
+				return false;
+			}
+		}
+		return true;
+	}, [&]() {
+		if (nThreads < 0) {
+			sPatched = 0;
+			ZFile::EnumFolder(strAppFolder.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
+				if (!bFolder && isBinary(strPath)) {
+					sPatched += mapAndFixup(strPath, true, true) ? 1 : 0;
+				}
+				return false;
+			});
+			return arrBinaries.size() == sPatched;
+		}
+		char** ppPaths = NULL;
+		size_t sCount = LCBundleCollectMachOs(strAppFolder.c_str(), &ppPaths, NULL, NULL);
+		LCBundlePatchStats stats = {};
+		LCBundleFixupARM64eSlices(ppPaths, sCount, nThreads, &stats);
+		LCBundleFreePaths(ppPaths, sCount);
+		sPatched = stats.patched;
+		return arrBinaries.size() == stats.patched && 0 == stats.failed;
+	});
+	ZLog::PrintV(">>> %s: %zu of %zu binaries patched\n", szName, sPatched, arrBinaries.size());
+	return bRet;
+}
+
+bool ZSignBench::BenchCopyFile()
+{
+	string strFile = m_strWorkFolder + "/Copy/large.bin";
+	string strOutput = m_strWorkFolder + "/Copy/large.copy";
+	ZFile::CreateFolderV("%s/Copy", m_strWorkFolder.c_str());
+	ZFixture::ZSliceSpec spec;
+	spec.uSliceSize = m_appSpec.uExecSize;
+	if (!ZFixture::GenerateMachO(strFile.c_str(), { spec }, false)) {
+		return false;
+	}
+
+	return Measure("copy.file.zfile", (uint64_t)ZFile::GetFileSize(strFile.c_str()), [&]() {
+		ZFile::RemoveFile(strOutput.c_str());
+		return true;
+	}, [&]() {
+		return ZFile::CopyFile(strFile.c_str(), strOutput.c_str());
+	});
+}
+
+// nStage 0 adds the app to an empty store, 1 adds a second copy that shares everything, 2 checks the store holding both.
+// Falls back to copies where the work folder can't clone, which still times hashing and bookkeeping.
+bool ZSignBench::BenchBlobStore(const char* szName, int nStage)
+{
+	string strStore = m_strWorkFolder + "/Blob/Store";
+	string strFirst = m_strWorkFolder + "/Blob/Apps/First.app";
+	string strSecond = m_strWorkFolder + "/Blob/Apps/Second.app";
+	ZFile::CreateFolderV("%s/Blob/Apps", m_strWorkFolder.c_str());
+	if (!ZFile::IsFolder(strFirst.c_str()) && !ZFixture::GenerateApp(strFirst, m_appSpec)) {
+		return false;
+	}
+
+	LCBlobStoreStats stats = {};
+	LCBlobStoreCheckReport report = {};
+	bool bRet = Measure(szName, GetFolderSize(strFirst), [&]() {
+		ZFile::RemoveFolder(strStore.c_str());
+		ZFile::RemoveFolder(strSecond.c_str());
+		if (0 == nStage) {
+			return true;
+		}
+		return 0 == LCCopyTree(strFirst.c_str(), strSecond.c_str(), 0, 0, NULL) &&
+			   0 == LCBlobStoreAdd(strStore.c_str(), strFirst.c_str(), m_nThreads, LC_BLOB_COPY_FALLBACK, NULL) &&
+			   (1 == nStage || 0 == LCBlobStoreAdd(strStore.c_str(), strSecond.c_str(), m_nThreads, LC_BLOB_COPY_FALLBACK, NULL));
+	}, [&]() {
+		if (2 == nStage) {
+			return 0 == LCBlobStoreCheck(strStore.c_str(), (m_strWorkFolder + "/Blob/Apps").c_str(), 0, &report);
+		}
+		return 0 == LCBlobStoreAdd(strStore.c_str(), (0 == nStage) ? strFirst.c_str() : strSecond.c_str(), m_nThreads, LC_BLOB_COPY_FALLBACK, &stats);
+	});
+	if (2 == nStage) {
+		ZLog::PrintV(">>> %s: %zu bundles, %zu blobs, %zu refcounts fixed\n", szName, report.bundles, report.blobs, report.fixedRefcounts);
+	} else {
+		ZLog::PrintV(">>> %s: %zu files, %zu shared, %zu new blobs\n", szName, stats.files, stats.sharedFiles, stats.newBlobs);
+	}
+	return bRet;
+}
+
+// Bundles with only the two plists the app list reads, sized like a typical Info.plist and LCAppInfo.plist
+bool ZSignBench::GenerateCatalogApps(const string& strFolder, uint64_t& uBytes)
+{
+	uBytes = 0;
+	ZFile::CreateFolder(strFolder.c_str());
+	for (int i = 0; i < 200; i++) {
+		string strInfo(6 * 1024 + (i * 37) % 4096, 'i');
+		string strAppInfo(1024 + (i * 13) % 1024, 'a');
+		if (!ZFile::CreateFolderV("%s/App%03d.app", strFolder.c_str(), i) ||
+			!ZFile::WriteFileV(strInfo.data(), strInfo.size(), "%s/App%03d.app/Info.plist", strFolder.c_str(), i) ||
+			!ZFile::WriteFileV(strAppInfo.data(), strAppInfo.size(), "%s/App%03d.app/LCAppInfo.plist", strFolder.c_str(), i)) {
+			return ZLog::Error(">>> Can't generate catalog apps!\n");
+		}
+		uBytes += strInfo.size() + strAppInfo.size();
+	}
+	return true;
+}
+
+// Both list the folder, then either read every bundle's plists or check every bundle against the mapped catalog.
+// Parsing the plists isn't timed, so the gap on device is larger than here.
+bool ZSignBench::BenchAppCatalog(const char* szName, bool bMapped)
+{
+	string strFolder = m_strWorkFolder + "/Catalog";
+	string strCatalog = strFolder + "/" LC_APP_CATALOG_NAME;
+	uint64_t uBytes = 0;
+	ZFile::RemoveFolder(strFolder.c_str());
+	if (!GenerateCatalogApps(strFolder, uBytes)) {
+		return false;
+	}
+
+	size_t uLoaded = 0;
+	return Measure(szName, uBytes, [&]() {
+		if (!bMapped) {
+			return true;
+		}
+		// what the launcher writes after its first start
+		vector<LCAppCatalogEntry> arrEntries;
+		vector<string> arrNames, arrAppInfos;
+		for (int i = 0; i < 200; i++) {
+			arrNames.emplace_back();
+			ZUtil::StringFormatV(arrNames.back(), "App%03d.app", i);
+			arrAppInfos.emplace_back();
+			ZFile::ReadFileV(arrAppInfos.back(), "%s/%s/LCAppInfo.plist", strFolder.c_str(), arrNames.back().c_str());
+		}
+		for (int i = 0; i < 200; i++) {
+			LCAppCatalogEntry entry = {};
+			entry.bundleName = arrNames[i].c_str();
+			LCAppCatalogStampFile((strFolder + "/" + arrNames[i] + "/Info.plist").c_str(), &entry.infoPlist);
+			LCAppCatalogStampFile((strFolder + "/" + arrNames[i] + "/LCAppInfo.plist").c_str(), &entry.appInfo);
+			entry.fields[LCAppCatalogFieldAppInfo] = arrAppInfos[i].data();
+			entry.fieldLengths[LCAppCatalogFieldAppInfo] = (uint32_t)arrAppInfos[i].size();
+			arrEntries.push_back(entry);
+		}
+		return 0 == LCAppCatalogWrite(strCatalog.c_str(), arrEntries.data(), arrEntries.size());
+	}, [&]() {
+		LCAppCatalog catalog = {};
+		if (bMapped && 0 != LCAppCatalogOpen(&catalog, strCatalog.c_str())) {
+			return false;
+		}
+		DIR* dir = opendir(strFolder.c_str());
+		if (NULL == dir) {
+			LCAppCatalogClose(&catalog);
+			return false;
+		}
+		uLoaded = 0;
+		string strData;
+		struct dirent* entry;
+		while (NULL != (entry = readdir(dir))) {
+			if (!ZFile::IsPathSuffix(entry->d_name, ".app")) {
+				continue;
+			}
+			string strBundle = strFolder + "/" + entry->d_name;
+			LCAppCatalogEntry item;
+			if (bMapped && LCAppCatalogFind(&catalog, entry->d_name, &item) && LCAppCatalogIsCurrent(&item, strBundle.c_str())) {
+				strData.assign((const char*)item.fields[LCAppCatalogFieldAppInfo], item.fieldLengths[LCAppCatalogFieldAppInfo]);
+				uLoaded++;
+				continue;
+			}
+			ZFile::ReadFileV(strData, "%s/Info.plist", strBundle.c_str());
+			ZFile::ReadFileV(strData, "%s/LCAppInfo.plist", strBundle.c_str());
+		}
+		closedir(dir);
+		LCAppCatalogClose(&catalog);
+		return !bMapped || 200 == uLoaded;
+	});
+}
+
+static bool IsLockOwnerAlive(uint64_t uOwner, void*)
+{
+	return 0 == kill((pid_t)(uOwner >> 32), 0) || EPERM == errno;
+}
+
+// Every process locks and looks up the same containers, storing its pid as both value and owner, so a torn read shows
+// up as a value that doesn't match its owner. Once they are gone the sweep has to free every slot.
+bool ZSignBench::BenchContainerLock(const char* szName, int nProcesses)
+{
+	const int nKeys = 512;
+	const int nOps = 20000;
+	string strTable = m_strWorkFolder + "/containerLock.table";
+	ZFile::RemoveFile(strTable.c_str());
+
+	size_t uFreed = 0;
+	bool bRet = Measure(szName, (uint64_t)nProcesses * nOps, [&]() {
+		return true;
+	}, [&]() {
+		vector<pid_t> arrChildren;
+		for (int p = 0; p < nProcesses; p++) {
+			pid_t pid = fork();
+			if (0 == pid) {
+				LCContainerLockTable table;
+				if (!LCContainerLockOpen(&table, strTable.c_str())) {
+					_exit(2);
+				}
+				uint64_t uOwner = (uint64_t)getpid() << 32;
+				char szValue[LC_CONTAINER_LOCK_VALUE_SIZE];
+				snprintf(szValue, sizeof(szValue), "livecontainer%d", (int)getpid());
+				int nTorn = 0;
+				for (int i = 0; i < nOps; i++) {
+					char szKey[LC_CONTAINER_LOCK_KEY_SIZE];
+					int nKey = (i / 2 * 7919 + p) % nKeys;
+					snprintf(szKey, sizeof(szKey), "%08X-0000-0000-0000-%012X", nKey, nKey);
+					if (i & 1) {
+						LCContainerLockSet(&table, szKey, szValue, uOwner, IsLockOwnerAlive, NULL);
+						continue;
+					}
+					char szRead[LC_CONTAINER_LOCK_VALUE_SIZE];
+					char szExpected[LC_CONTAINER_LOCK_VALUE_SIZE];
+					uint64_t uRead = 0;
+					if (LCContainerLockGet(&table, szKey, szRead, sizeof(szRead), &uRead)) {
+						snprintf(szExpected, sizeof(szExpected), "livecontainer%d", (int)(uRead >> 32));
+						nTorn += (0 != strcmp(szRead, szExpected));
+					}
+				}
+				LCContainerLockClose(&table);
+				_exit(nTorn > 0 ? 1 : 0);
+			}
+			if (pid < 0) {
+				return false;
+			}
+			arrChildren.push_back(pid);
+		}
+		bool bOK = true;
+		for (pid_t pid : arrChildren) {
+			int status = 0;
+			waitpid(pid, &status, 0);
+			bOK &= WIFEXITED(status) && 0 == WEXITSTATUS(status);
+		}
+		LCContainerLockTable table;
+		if (!bOK || !LCContainerLockOpen(&table, strTable.c_str())) {
+			return ZLog::Error(">>> Container lock table returned torn slots!\n");
+		}
+		uFreed = LCContainerLockSweep(&table, IsLockOwnerAlive, NULL);
+		LCContainerLockClose(&table);
+		return (size_t)nKeys == uFreed;
+	});
+	ZLog::PrintV(">>> %s: %d processes, %zu slots swept\n", szName, nProcesses, uFreed);
+	return bRet;
+}
+
+// What the bootstrap reads before it can jump to the guest, 1000 launches of an app with a few containers.
+// "plists" parses the binary Info.plist and LCAppInfo.plist like the bootstrap does without a current manifest,
+// "mapped" maps the manifest and reads the same values plus the symbol offsets the hooks need.
+bool ZSignBench::BenchLaunchManifest(const char* szName, bool bMapped)
+{
+	const int nLaunches = 1000;
+	const int nContainers = 4;
+	const int nSymbols = 3;
+	string strBundle = m_strWorkFolder + "/Launch/App.app";
+	string strManifest = strBundle + "/" LC_LAUNCH_MANIFEST_NAME;
+	string strBookmark(1024, 'b');
+	ZFile::CreateFolderV("%s/Launch/App.app", m_strWorkFolder.c_str());
+
+	vector<string> arrFolders;
+	vector<string> arrHomes;
+	for (int i = 0; i < nContainers; i++) {
+		arrFolders.emplace_back();
+		ZUtil::StringFormatV(arrFolders.back(), "%08X-0000-0000-0000-000000000000", i);
+		arrHomes.push_back((nContainers - 1 == i) ? "" : "Data/Application/" + arrFolders.back());
+	}
+
+	jvalue jvInfo;
+	jvInfo["CFBundleExecutable"] = "App";
+	jvInfo["CFBundleIdentifier"] = "com.zsign.bench.launch";
+	jvInfo["CFBundleName"] = "App";
+	jvInfo["CFBundleShortVersionString"] = "1.0";
+	jvInfo["CFBundleVersion"] = "1";
+	for (int i = 0; i < 200; i++) {
+		string strKey;
+		ZUtil::StringFormatV(strKey, "NSBenchUsageDescription%d", i);
+		jvInfo[strKey] = "This app uses this to benchmark the launch path.";
+	}
+	jvalue jvAppInfo;
+	jvAppInfo["LCDataUUID"] = arrFolders[0];
+	jvAppInfo["LCOrignalBundleIdentifier"] = "com.zsign.bench.original";
+	jvAppInfo["LCTweakFolder"] = "Bench";
+	jvAppInfo["doSymlinkInbox"] = true;
+	jvAppInfo["LCOrientationLock"] = 1;
+	for (int i = 0; i < nContainers; i++) {
+		jvalue& jvContainer = jvAppInfo["LCContainers"][i];
+		jvContainer["folderName"] = arrFolders[i];
+		jvContainer["name"] = arrFolders[i];
+		if (nContainers - 1 == i) {
+			jvContainer["bookmarkData"].assign_data(strBookmark);
+		}
+	}
+	string strInfo;
+	string strAppInfo;
+	if (!jvInfo.write_bplist(strInfo) || !jvAppInfo.write_bplist(strAppInfo) ||
+		!ZFile::WriteFileV(strInfo.data(), strInfo.size(), "%s/Info.plist", strBundle.c_str()) ||
+		!ZFile::WriteFileV(strAppInfo.data(), strAppInfo.size(), "%s/LCAppInfo.plist", strBundle.c_str())) {
+		return ZLog::Error(">>> Can't generate launch bundle!\n");
+	}
+
+	vector<LCLaunchManifestContainer> arrContainers;
+	for (int i = 0; i < nContainers; i++) {
+		bool bBookmark = (nContainers - 1 == i);
+		arrContainers.push_back({ arrFolders[i].c_str(), arrHomes[i].c_str(), bBookmark ? strBookmark.data() : NULL, bBookmark ? (uint32_t)strBookmark.size() : 0 });
+	}
+	vector<string> arrSymbolNames;
+	vector<LCLaunchManifestSymbol> arrSymbols;
+	for (int i = 0; i < nSymbols; i++) {
+		arrSymbolNames.emplace_back();
+		ZUtil::StringFormatV(arrSymbolNames.back(), "__ZN5bench6SymbolE%d", i);
+	}
+	for (int i = 0; i < nSymbols; i++) {
+		LCLaunchManifestSymbol symbol = { arrSymbolNames[i].c_str(), {}, (uint64_t)(i + 1) * 0x1000 };
+		symbol.uuid[0] = (uint8_t)i;
+		arrSymbols.push_back(symbol);
+	}
+	auto setField = [](LCLaunchManifest& manifest, LCLaunchManifestField field, const char* szValue) {
+		manifest.fields[field] = szValue;
+		manifest.fieldLengths[field] = (uint32_t)strlen(szValue);
+	};
+	LCLaunchManifest manifest = {};
+	LCLaunchManifestStampFile((strBundle + "/Info.plist").c_str(), &manifest.infoPlist);
+	LCLaunchManifestStampFile((strBundle + "/LCAppInfo.plist").c_str(), &manifest.appInfo);
+	setField(manifest, LCLaunchManifestFieldExecutable, "App");
+	setField(manifest, LCLaunchManifestFieldBundleIdentifier, "com.zsign.bench.launch");
+	setField(manifest, LCLaunchManifestFieldOriginalBundleIdentifier, "com.zsign.bench.original");
+	setField(manifest, LCLaunchManifestFieldDefaultContainer, arrFolders[0].c_str());
+	setField(manifest, LCLaunchManifestFieldTweakFolder, "Bench");
+	manifest.flags = LCLaunchFlagSymlinkInbox;
+	manifest.orientationLock = 1;
+	manifest.containers = arrContainers.data();
+	manifest.containerCount = arrContainers.size();
+	manifest.symbols = arrSymbols.data();
+	manifest.symbolCount = arrSymbols.size();
+	if (!LCLaunchManifestWrite(&manifest, strManifest.c_str())) {
+		return ZLog::Error(">>> Can't write launch manifest!\n");
+	}
+
+	return Measure(szName, (uint64_t)nLaunches * (strInfo.size() + strAppInfo.size()), [&]() {
+		return true;
+	}, [&]() {
+		string strExecutable;
+		for (int i = 0; i < nLaunches; i++) {
+			if (!bMapped) {
+				jvalue jvReadInfo;
+				jvalue jvReadAppInfo;
+				if (!jvReadAppInfo.read_plist_from_file("%s/LCAppInfo.plist", strBundle.c_str()) ||
+					!jvReadInfo.read_plist_from_file("%s/Info.plist", strBundle.c_str())) {
+					return false;
+				}
+				strExecutable = jvReadInfo["CFBundleExecutable"].as_cstr();
+				const jvalue& jvContainers = jvReadAppInfo["LCContainers"];
+				bool bFound = false;
+				for (size_t j = 0; j < jvContainers.size(); j++) {
+					if (jvContainers[j]["folderName"] == arrFolders[nContainers - 1]) {
+						bFound = jvContainers[j]["bookmarkData"].is_data();
+					}
+				}
+				if (!bFound || strExecutable != "App") {
+					return false;
+				}
+				continue;
+			}
+			LCLaunchManifest launch;
+			if (!LCLaunchManifestOpen(&launch, strManifest.c_str())) {
+				return false;
+			}
+			bool bOK = LCLaunchManifestIsCurrent(&launch, strBundle.c_str()) && (launch.flags & LCLaunchFlagSymlinkInbox);
+			strExecutable.assign((const char*)launch.fields[LCLaunchManifestFieldExecutable], launch.fieldLengths[LCLaunchManifestFieldExecutable]);
+			const LCLaunchManifestContainer* pContainer = LCLaunchManifestFindContainer(&launch, arrFolders[0].c_str());
+			bOK = bOK && pContainer && arrHomes[0] == pContainer->homePath;
+			pContainer = LCLaunchManifestFindContainer(&launch, arrFolders[nContainers - 1].c_str());
+			bOK = bOK && pContainer && strBookmark.size() == pContainer->bookmarkLength;
+			for (int j = 0; bOK && j < nSymbols; j++) {
+				uint64_t uOffset = 0;
+				bOK = LCLaunchManifestFindSymbol(&launch, arrSymbols[j].name, arrSymbols[j].uuid, &uOffset) && arrSymbols[j].offset == uOffset;
+			}
+			LCLaunchManifestClose(&launch);
+			if (!bOK || strExecutable != "App") {
+				return false;
+			}
+		}
+		return true;
+	});
+}
+
+bool ZSignBench::BenchSymbolIndex(const char* szName, bool bIndexed)
+{
+	const uint32_t uSymbols = 20000;
+	const int nLaunches = 100;
+	string strImage = m_strWorkFolder + "/Symbols/image.dylib";
+	string strShuffled = m_strWorkFolder + "/Symbols/shuffled.dylib";
+	string strIndex = m_strWorkFolder + "/Symbols/image.lcsi";
+	ZFile::CreateFolderV("%s/Symbols", m_strWorkFolder.c_str());
+	if (!ZFixture::GenerateSymbolImage(strImage.c_str(), uSymbols, false, 1) ||
+		!ZFixture::GenerateSymbolImage(strShuffled.c_str(), uSymbols, true, 1)) {
+		return false;
+	}
+
+	// the offline builder has to agree with the fixture and be independent of symtab order
+	size_t sSize = 0;
+	size_t sShuffledSize = 0;
+	void* pImage = ZFile::MapFile(strImage.c_str(), 0, 0, &sSize, true);
+	void* pShuffled = ZFile::MapFile(strShuffled.c_str(), 0, 0, &sShuffledSize, true);
+	if (NULL == pImage || NULL == pShuffled) {
+		return ZLog::Error(">>> Can't map symbol fixture!\n");
+	}
+	LCSymbolIndex* pIndex = LCSymbolIndexCreate(pImage, sSize);
+	LCSymbolIndex* pShuffledIndex = LCSymbolIndexCreate(pShuffled, sShuffledSize);
+	ZFile::UnmapFile(pImage, sSize);
+	ZFile::UnmapFile(pShuffled, sShuffledSize);
+	string strShuffledIndex = strIndex + ".shuffled";
+	bool bWritten = pIndex && pShuffledIndex && LCSymbolIndexWrite(pIndex, strIndex.c_str()) && LCSymbolIndexWrite(pShuffledIndex, strShuffledIndex.c_str());
+	bool bValid = bWritten && uSymbols == LCSymbolIndexCount(pIndex); // every symbol is in the symtab, the trie or both
+	for (uint32_t i = 0; bValid && i < uSymbols; i++) {
+		bValid = (ZFixture::SymbolOffset(i, 3 == i % 4) == LCSymbolIndexLookup(pIndex, ZFixture::SymbolName(i).c_str()));
+	}
+	bValid = bValid && 0 == LCSymbolIndexLookup(pIndex, ZFixture::SymbolName(uSymbols).c_str());
+	if (pIndex) {
+		LCSymbolIndexClose(pIndex);
+	}
+	if (pShuffledIndex) {
+		LCSymbolIndexClose(pShuffledIndex);
+	}
+	string strData;
+	string strShuffledData;
+	ZFile::ReadFile(strIndex.c_str(), strData);
+	ZFile::ReadFile(strShuffledIndex.c_str(), strShuffledData);
+	if (!bValid || strData.empty() || strData != strShuffledData) {
+		return ZLog::ErrorV(">>> Symbol index doesn't match the fixture! %s\n", szName);
+	}
+
+	// a launch resolves a handful of symbols and LCFindSymbolOffset maps the image for each of them, the scan then
+	// does what litehook_find_symbol_file does while the indexed path only needs the UUID to open the index
+	vector<string> arrLookups;
+	for (uint32_t i = 0; i < 8; i++) {
+		uint32_t uIndex = (i * 2477 + 1) % uSymbols;
+		arrLookups.push_back(ZFixture::SymbolName((3 == uIndex % 4) ? uIndex - 1 : uIndex));
+	}
+	return Measure(szName, (uint64_t)nLaunches * arrLookups.size() * sSize, [&]() {
+		return true;
+	}, [&]() {
+		for (int n = 0; n < nLaunches; n++) {
+			for (const string& strName : arrLookups) {
+				uint8_t* pBase = (uint8_t*)ZFile::MapFile(strImage.c_str(), 0, 0, &sSize, true);
+				if (NULL == pBase) {
+					return false;
+				}
+				uint64_t uValue = 0;
+				if (bIndexed) {
+					uuid_command* uc = (uuid_command*)macho_view_find_command(pBase, LC_UUID);
+					LCSymbolIndex* pLaunchIndex = uc ? LCSymbolIndexOpen(strIndex.c_str(), uc->uuid) : NULL;
+					if (pLaunchIndex) {
+						uValue = LCSymbolIndexLookup(pLaunchIndex, strName.c_str());
+						LCSymbolIndexClose(pLaunchIndex);
+					}
+				} else {
+					const uint32_t* symtab = (const uint32_t*)macho_view_find_command(pBase, LC_SYMTAB);
+					for (uint32_t i = 0; symtab && i < symtab[3] && !uValue; i++) {
+						const uint8_t* nl = pBase + symtab[2] + (size_t)i * 16;
+						uint32_t uStrx;
+						memcpy(&uStrx, nl, 4);
+						if (0 == strcmp((const char*)pBase + symtab[4] + uStrx, strName.c_str())) {
+							memcpy(&uValue, nl + 8, 8);
+						}
+					}
+				}
+				ZFile::UnmapFile(pBase, sSize);
+				if (0 == uValue) {
+					return false;
+				}
+			}
+		}
+		return true;
+	});
+}
+
+bool ZSignBench::BenchSigScan(const char* szName, bool bScanner)
+{
+	// same signatures and window as searchDyldFunctions
+	static const uint8_t mmapSig[] = { 0xB0, 0x18, 0x80, 0xD2, 0x01, 0x10, 0x00, 0xD4 };
+	static const uint8_t fcntlSig[] = { 0x90, 0x0B, 0x80, 0xD2, 0x01, 0x10, 0x00, 0xD4 };
+	static const uint8_t syscallSig[] = { 0x01, 0x10, 0x00, 0xD4 };
+	static const uint8_t branch[] = { 0x10, 0x00, 0x00, 0x14 }; // b #0x40, what Dopamine leaves in front of the svc
+	const size_t sWindow = 0x80000;
+	const int nScans = 50;
+
+	// a plain dyld with both signatures late in the window, and one where fcntl was replaced by a Dopamine hook
+	struct ZDyldImage
+	{
+		vector<uint8_t> arrData;
+		size_t arrExpected[3];
+	} images[2];
+	for (int i = 0; i < 2; i++) {
+		ZDyldImage& image = images[i];
+		image.arrData.resize(sWindow);
+		ZFixture::FillRandom(image.arrData.data(), sWindow, i + 1);
+		for (size_t j = 0; j + 4 <= sWindow; j += 4) {
+			if (0 == memcmp(&image.arrData[j], syscallSig, 4)) {
+				image.arrData[j] ^= 0xFF;
+			}
+		}
+		memcpy(&image.arrData[0x7A000], mmapSig, sizeof(mmapSig));
+		image.arrExpected[1] = 0x7A000;
+		if (0 == i) {
+			memcpy(&image.arrData[0x7E000], fcntlSig, sizeof(fcntlSig));
+			image.arrExpected[0] = 0x7E000;
+			image.arrExpected[2] = 0;
+		} else {
+			memcpy(&image.arrData[0x60000], branch, sizeof(branch));
+			memcpy(&image.arrData[0x60004], syscallSig, sizeof(syscallSig));
+			image.arrExpected[0] = 0;
+			image.arrExpected[2] = 0x60004;
+		}
+	}
+
+	// the searchDyldFunction loop this replaced, one pass per signature plus one for the Dopamine fallback
+	auto loop = [&](const uint8_t* pBase, const uint8_t* pSig, size_t sLength) -> size_t {
+		for (size_t i = 0; i < sWindow; i += 4) {
+			if (pBase[i] == pSig[0] && 0 == memcmp(pBase + i, pSig, sLength)) {
+				return i;
+			}
+		}
+		return 0;
+	};
+	auto searchLoop = [&](const uint8_t* pBase, size_t* pFound) {
+		pFound[0] = loop(pBase, fcntlSig, sizeof(fcntlSig));
+		pFound[1] = loop(pBase, mmapSig, sizeof(mmapSig));
+		pFound[2] = 0;
+		if (0 == pFound[0]) {
+			for (size_t i = 4; i < sWindow; i += 4) {
+				uint32_t uPrev;
+				memcpy(&uPrev, pBase + i - 4, 4);
+				if (0 == memcmp(pBase + i, syscallSig, 4) && 0x5 == uPrev >> 26) {
+					pFound[2] = i;
+					break;
+				}
+			}
+		}
+	};
+
+	struct ZScanResult
+	{
+		const uint8_t* pBase;
+		size_t arrFound[3];
+	};
+	LCSigPattern patterns[] = {
+		{ fcntlSig, NULL, sizeof(fcntlSig) },
+		{ mmapSig, NULL, sizeof(mmapSig) },
+		{ syscallSig, NULL, sizeof(syscallSig) },
+	};
+	LCSigScanner* pScanner = LCSigScannerCreate(patterns, 3);
+	auto searchScanner = [&](const uint8_t* pBase, size_t* pFound) {
+		ZScanResult result = { pBase, { 0, 0, 0 } };
+		LCSigScannerScan(pScanner, pBase, sWindow, 4, [](size_t uIndex, size_t uOffset, void* pContext) {
+			ZScanResult* pResult = (ZScanResult*)pContext;
+			if (0 == pResult->arrFound[uIndex]) {
+				uint32_t uPrev = 0;
+				if (2 == uIndex && uOffset >= 4) {
+					memcpy(&uPrev, pResult->pBase + uOffset - 4, 4);
+				}
+				if (2 != uIndex || 0x5 == uPrev >> 26) {
+					pResult->arrFound[uIndex] = uOffset;
+				}
+			}
+			return !(pResult->arrFound[0] && pResult->arrFound[1]);
+		}, &result);
+		memcpy(pFound, result.arrFound, sizeof(result.arrFound));
+		if (pFound[0]) {
+			pFound[2] = 0; // the fallback is only consulted without a fcntl match
+		}
+	};
+
+	for (ZDyldImage& image : images) {
+		size_t arrLoop[3];
+		size_t arrScanner[3];
+		searchLoop(image.arrData.data(), arrLoop);
+		searchScanner(image.arrData.data(), arrScanner);
+		if (0 != memcmp(arrLoop, image.arrExpected, sizeof(arrLoop)) || 0 != memcmp(arrScanner, image.arrExpected, sizeof(arrScanner))) {
+			LCSigScannerFree(pScanner);
+			return ZLog::ErrorV(">>> Signature scan doesn't match the fixture! %s\n", szName);
+		}
+	}
+
+	bool bRet = Measure(szName, (uint64_t)nScans * 2 * sWindow, [&]() {
+		return true;
+	}, [&]() {
+		for (int n = 0; n < nScans; n++) {
+			for (ZDyldImage& image : images) {
+				size_t arrFound[3];
+				if (bScanner) {
+					searchScanner(image.arrData.data(), arrFound);
+				} else {
+					searchLoop(image.arrData.data(), arrFound);
+				}
+				if (0 != memcmp(arrFound, image.arrExpected, sizeof(arrFound))) {
+					return false;
+				}
+			}
+		}
+		return true;
+	});
+	LCSigScannerFree(pScanner);
+	return bRet;
+}
+
+// The hand-written helpers utils.m had before the decode table, the tbnz one read 16 bits of imm14.
+// They were called from other files, so they are kept out of line here as well.
+static uint64_t BitopsEmulateADRP(uint32_t uInsn, uint64_t uPC)
+{
+	if ((uInsn & 0x9F000000) != 0x90000000) {
+		return 0;
+	}
+	int32_t nImm = (uInsn & 0xFFFFE0) >> 3;
+	nImm |= (uInsn & 0x60000000) >> 29;
+	if (uInsn & 0x800000) {
+		nImm |= 0xFFE00000;
+	}
+	return (uPC & ~(0xFFFULL)) + ((int64_t)nImm << 12);
+}
+
+__attribute__((noinline)) static uint64_t BitopsEmulateADRPAdd(uint32_t uInsn, uint32_t uAdd, uint64_t uPC)
+{
+	uint64_t uTarget = BitopsEmulateADRP(uInsn, uPC);
+	if (!uTarget || (uAdd & 0xFF000000) != 0x91000000 || ((uAdd >> 22) & 3) > 1 || (uInsn & 0x1F) != ((uAdd >> 5) & 0x1F)) {
+		return 0;
+	}
+	uint32_t uImm = (uAdd & 0x3FFC00) >> 10;
+	return uTarget + (((uAdd >> 22) & 3) ? uImm << 12 : uImm);
+}
+
+__attribute__((noinline)) static uint64_t BitopsEmulateADRPLdr(uint32_t uInsn, uint32_t uLdr, uint64_t uPC)
+{
+	uint64_t uTarget = BitopsEmulateADRP(uInsn, uPC);
+	if (!uTarget || (uInsn & 0x1F) != ((uLdr >> 5) & 0x1F) || (uLdr & 0xFFC00000) != 0xF9400000) {
+		return 0;
+	}
+	return uTarget + (((uLdr >> 10) & 0xFFF) << 3);
+}
+
+__attribute__((noinline)) static uint64_t BitopsTBNZTarget(uint32_t uInsn, uint64_t uPC)
+{
+	return ((uInsn & 0xFF000000) == 0x37000000) ? uPC + ((uInsn >> 5) & 0xFFFF) * 4 : 0;
+}
+
+// the same probes through LCArm64Decode
+static uint64_t TableEmulateADRPAdd(uint32_t uInsn, uint32_t uAdd, uint64_t uPC)
+{
+	LCArm64Insn adrp;
+	LCArm64Insn add;
+	if (!LCArm64Decode(uInsn, uPC, &adrp) || LCArm64OpADRP != adrp.op || !adrp.target ||
+		!LCArm64Decode(uAdd, 0, &add) || LCArm64OpADDImm != add.op || 8 != add.size || adrp.rd != add.rn) {
+		return 0;
+	}
+	return adrp.target + (uint64_t)add.imm;
+}
+
+static uint64_t TableEmulateADRPLdr(uint32_t uInsn, uint32_t uLdr, uint64_t uPC)
+{
+	LCArm64Insn adrp;
+	LCArm64Insn ldr;
+	if (!LCArm64Decode(uInsn, uPC, &adrp) || LCArm64OpADRP != adrp.op || !adrp.target ||
+		!LCArm64Decode(uLdr, 0, &ldr) || LCArm64OpLDRImm != ldr.op || 8 != ldr.size || adrp.rd != ldr.rn) {
+		return 0;
+	}
+	return adrp.target + (uint64_t)ldr.imm;
+}
+
+static uint64_t TableTBNZTarget(uint32_t uInsn, uint64_t uPC)
+{
+	LCArm64Insn insn;
+	return (LCArm64Decode(uInsn, uPC, &insn) && LCArm64OpTBNZ == insn.op) ? insn.target : 0;
+}
+
+bool ZSignBench::BenchArm64Decode(const char* szName, bool bTable)
+{
+	if (m_strMachO.empty()) {
+		return true;
+	}
+	const int nPasses = 20;
+	size_t sSize = 0;
+	uint8_t* pBase = (uint8_t*)ZFile::MapFile(m_strMachO.c_str(), 0, 0, &sSize, true);
+	if (NULL == pBase) {
+		return ZLog::ErrorV(">>> Can't map Mach-O! %s\n", m_strMachO.c_str());
+	}
+	macho_view view;
+	macho_view_init(&view, pBase, sSize);
+	if (CPU_TYPE_ARM64 != view.cputype || 0 == view.textsection.cmdoff || view.textsection.offset + view.textsection.size > sSize) {
+		ZFile::UnmapFile(pBase, sSize);
+		return ZLog::ErrorV(">>> Not a thin arm64 Mach-O with __text! %s\n", m_strMachO.c_str());
+	}
+	const uint32_t* pCode = (const uint32_t*)(pBase + view.textsection.offset);
+	size_t sCount = view.textsection.size / 4;
+	uint64_t uTextAddr = view.textsegment.vmaddr + view.textsection.offset - view.textsegment.fileoff;
+
+	// the probes overwriteMainCFBundle, overwriteMainNSBundle and performHookDyldApi run, at every instruction
+	auto probe = [&](bool bUseTable, uint64_t* pFound) {
+		uint64_t uSum = 0;
+		for (size_t i = 0; i + 1 < sCount; i++) {
+			uint64_t uPC = uTextAddr + i * 4;
+			uint64_t uAdd = bUseTable ? TableEmulateADRPAdd(pCode[i], pCode[i + 1], uPC) : BitopsEmulateADRPAdd(pCode[i], pCode[i + 1], uPC);
+			uint64_t uLdr = bUseTable ? TableEmulateADRPLdr(pCode[i], pCode[i + 1], uPC) : BitopsEmulateADRPLdr(pCode[i], pCode[i + 1], uPC);
+			uint64_t uTBNZ = bUseTable ? TableTBNZTarget(pCode[i], uPC) : BitopsTBNZTarget(pCode[i], uPC);
+			if (pFound) {
+				pFound[i * 3] = uAdd;
+				pFound[i * 3 + 1] = uLdr;
+				pFound[i * 3 + 2] = uTBNZ;
+			}
+			uSum += uAdd + uLdr + uTBNZ;
+		}
+		return uSum;
+	};
+
+	// the table has to resolve every adrp pair exactly like the old helpers did, and tbnz with a signed imm14
+	vector<uint64_t> arrBitops(sCount * 3, 0);
+	vector<uint64_t> arrTable(sCount * 3, 0);
+	probe(false, arrBitops.data());
+	probe(true, arrTable.data());
+	uint64_t uPairs = 0;
+	bool bValid = true;
+	for (size_t i = 0; i + 1 < sCount; i++) {
+		uint64_t uPC = uTextAddr + i * 4;
+		int64_t nOffset = (int64_t)((uint64_t)((pCode[i] >> 5) & 0x3FFF) << 50) >> 48;
+		uint64_t uTBNZ = ((pCode[i] & 0x7F000000) == 0x37000000) ? uPC + nOffset : 0;
+		bValid = bValid && arrBitops[i * 3] == arrTable[i * 3] && arrBitops[i * 3 + 1] == arrTable[i * 3 + 1] && uTBNZ == arrTable[i * 3 + 2];
+		uPairs += (arrBitops[i * 3] ? 1 : 0) + (arrBitops[i * 3 + 1] ? 1 : 0);
+	}
+	if (!bValid || 0 == uPairs) {
+		ZFile::UnmapFile(pBase, sSize);
+		return ZLog::ErrorV(">>> Decode table doesn't match the old helpers! %s\n", szName);
+	}
+
+	volatile uint64_t uSink = 0;
+	bool bRet = Measure(szName, (uint64_t)nPasses * sCount * 4, [&]() {
+		return true;
+	}, [&]() {
+		for (int n = 0; n < nPasses; n++) {
+			uSink = uSink + probe(bTable, NULL);
+		}
+		return true;
+	});
+	ZLog::PrintV(">>> %s: %llu instructions, %llu adrp pairs\n", szName, (unsigned long long)sCount, (unsigned long long)uPairs);
+	ZFile::UnmapFile(pBase, sSize);
+	return bRet;
+}
+
+__attribute__((noinline)) static uint64_t BitopsBranchImm26Target(uint32_t uInsn, uint64_t uPC)
+{
+	// b and bl
+	return ((uInsn & 0x7C000000) == 0x14000000) ? uPC + ((int64_t)((uint64_t)(uInsn & 0x3FFFFFF) << 38) >> 36) : 0;
+}
+
+// what answering "who references X" takes without an index: a walk over all of __text per target
+static size_t ScanArm64Refs(const uint32_t* pCode, size_t sCount, uint64_t uTextAddr, uint64_t uTarget, vector<uint64_t>* pPCs)
+{
+	size_t sFound = 0;
+	for (size_t i = 0; i < sCount; i++) {
+		uint64_t uPC = uTextAddr + i * 4;
+		uint64_t uRef = BitopsBranchImm26Target(pCode[i], uPC);
+		if (uTarget != uRef && i + 1 < sCount) {
+			uRef = BitopsEmulateADRPAdd(pCode[i], pCode[i + 1], uPC);
+			if (!uRef) {
+				uRef = BitopsEmulateADRPLdr(pCode[i], pCode[i + 1], uPC);
+			}
+			uPC += 4;
+		}
+		if (uTarget == uRef) {
+			sFound++;
+			if (pPCs) {
+				pPCs->push_back(uPC);
+			}
+		}
+	}
+	return sFound;
+}
+
+bool ZSignBench::BenchArm64Xref(const char* szName, int nThreads, bool bLookup)
+{
+	if (m_strMachO.empty()) {
+		return true;
+	}
+	size_t sSize = 0;
+	uint8_t* pBase = (uint8_t*)ZFile::MapFile(m_strMachO.c_str(), 0, 0, &sSize, true);
+	if (NULL == pBase) {
+		return ZLog::ErrorV(">>> Can't map Mach-O! %s\n", m_strMachO.c_str());
+	}
+	macho_view view;
+	if (!macho_view_init(&view, pBase, sSize) || CPU_TYPE_ARM64 != view.cputype || 0 == view.textsection.cmdoff ||
+		view.textsection.offset + view.textsection.size > sSize) {
+		ZFile::UnmapFile(pBase, sSize);
+		return ZLog::ErrorV(">>> Not a thin arm64 Mach-O with __text! %s\n", m_strMachO.c_str());
+	}
+	const uint32_t* pCode = (const uint32_t*)(pBase + view.textsection.offset);
+	size_t sCount = view.textsection.size / 4;
+	uint64_t uTextAddr = view.textsegment.vmaddr + view.textsection.offset - view.textsegment.fileoff;
+
+	// the chunked build has to produce exactly the single threaded index, pairs straddling a chunk edge included
+	LCArm64XrefIndex* pSerial = LCArm64XrefIndexBuild(pCode, sCount, uTextAddr, 1);
+	LCArm64XrefIndex* pChunked = LCArm64XrefIndexBuild(pCode, sCount, uTextAddr, 7);
+	bool bValid = NULL != pSerial && NULL != pChunked && LCArm64XrefIndexCount(pSerial) == LCArm64XrefIndexCount(pChunked);
+	const LCArm64Xref* pSerialRefs = NULL;
+	const LCArm64Xref* pChunkedRefs = NULL;
+	if (bValid) {
+		LCArm64XrefIndexLookup(pSerial, 0, &pSerialRefs);
+		LCArm64XrefIndexLookup(pChunked, 0, &pChunkedRefs);
+		for (size_t i = 0; bValid && i < LCArm64XrefIndexCount(pSerial); i++) {
+			bValid = pSerialRefs[i].target == pChunkedRefs[i].target && pSerialRefs[i].pc == pChunkedRefs[i].pc &&
+					 pSerialRefs[i].adrpPc == pChunkedRefs[i].adrpPc && pSerialRefs[i].kind == pChunkedRefs[i].kind;
+		}
+	}
+
+	// look up everything b/bl lands on, and check that each hit of the linear walk is in the index
+	vector<uint64_t> arrTargets;
+	for (size_t i = 0; i < sCount; i++) {
+		uint64_t uTarget = BitopsBranchImm26Target(pCode[i], uTextAddr + i * 4);
+		if (uTarget) {
+			arrTargets.push_back(uTarget);
+		}
+	}
+	sort(arrTargets.begin(), arrTargets.end());
+	arrTargets.erase(unique(arrTargets.begin(), arrTargets.end()), arrTargets.end());
+	// the walk is quadratic, a few hundred targets are plenty to compare against
+	if (arrTargets.size() > 256) {
+		vector<uint64_t> arrSampled;
+		for (size_t i = 0; i < 256; i++) {
+			arrSampled.push_back(arrTargets[i * arrTargets.size() / 256]);
+		}
+		arrTargets.swap(arrSampled);
+	}
+	uint64_t uRefs = 0;
+	for (size_t t = 0; bValid && t < arrTargets.size(); t++) {
+		vector<uint64_t> arrPCs;
+		ScanArm64Refs(pCode, sCount, uTextAddr, arrTargets[t], &arrPCs);
+		const LCArm64Xref* pRefs = NULL;
+		size_t sRefs = LCArm64XrefIndexLookup(pSerial, arrTargets[t], &pRefs);
+		for (uint64_t uPC : arrPCs) {
+			bool bFound = false;
+			for (size_t r = 0; r < sRefs && !bFound; r++) {
+				bFound = pRefs[r].target == arrTargets[t] && pRefs[r].pc == uPC;
+			}
+			bValid = bValid && bFound;
+		}
+		uRefs += sRefs;
+	}
+	uint64_t uXrefs = (NULL != pSerial) ? LCArm64XrefIndexCount(pSerial) : 0;
+	LCArm64XrefIndexFree(pSerial);
+	LCArm64XrefIndexFree(pChunked);
+	if (!bValid || arrTargets.empty()) {
+		ZFile::UnmapFile(pBase, sSize);
+		return ZLog::ErrorV(">>> Xref index doesn't match a linear walk! %s\n", szName);
+	}
+
+	volatile uint64_t uSink = 0;
+	bool bRet = Measure(szName, (uint64_t)sCount * 4, [&]() {
+		return true;
+	}, [&]() {
+		if (nThreads > 0) {
+			LCArm64XrefIndex* pIndex = LCArm64XrefIndexBuild(pCode, sCount, uTextAddr, nThreads);
+			if (NULL == pIndex) {
+				return false;
+			}
+			uSink = uSink + LCArm64XrefIndexCount(pIndex);
+			LCArm64XrefIndexFree(pIndex);
+		} else if (bLookup) {
+			// the build is part of the cost, a caller asks its questions right after
+			LCArm64XrefIndex* pIndex = LCArm64XrefIndexBuild(pCode, sCount, uTextAddr, 0);
+			if (NULL == pIndex) {
+				return false;
+			}
+			for (uint64_t uTarget : arrTargets) {
+				uSink = uSink + LCArm64XrefIndexLookup(pIndex, uTarget, NULL);
+			}
+			LCArm64XrefIndexFree(pIndex);
+		} else {
+			for (uint64_t uTarget : arrTargets) {
+				uSink = uSink + ScanArm64Refs(pCode, sCount, uTextAddr, uTarget, NULL);
+			}
+		}
+		return true;
+	});
+	ZLog::PrintV(">>> %s: %llu instructions, %llu xrefs, %llu targets with %llu refs\n", szName, (unsigned long long)sCount,
+				 (unsigned long long)uXrefs, (unsigned long long)arrTargets.size(), (unsigned long long)uRefs);
+	ZFile::UnmapFile(pBase, sSize);
+	return bRet;
+}
+
+bool ZSignBench::Run(const string& strFilter)
+{
+	vector<pair<const char*, function<bool()>>> arrCases = {
+		{ "macho.sign.thin", [&]() { return BenchMachOSign("macho.sign.thin", &m_adhocAsset, false, false, true); } },
+		{ "macho.sign.fat", [&]() { return BenchMachOSign("macho.sign.fat", &m_adhocAsset, true, false, true); } },
+		{ "macho.resign.thin", [&]() { return BenchMachOSign("macho.resign.thin", &m_adhocAsset, false, true, false); } },
+		{ "macho.sign.cms", [&]() { return BenchMachOSign("macho.sign.cms", &m_identityAsset, false, false, true); } },
+		{ "macho.realloc.thin", [&]() { return BenchMachORealloc("macho.realloc.thin", false); } },
+		{ "macho.realloc.fat", [&]() { return BenchMachORealloc("macho.realloc.fat", true); } },
+		{ "macho.view.walks", [&]() { return BenchMachOView("macho.view.walks", false); } },
+		{ "macho.view.shared", [&]() { return BenchMachOView("macho.view.shared", true); } },
+		{ "cms.generate", [&]() { return BenchCMS(); } },
+		{ "sha.file.large", [&]() { return BenchSHAFile(); } },
+		{ "sha.file.repeat", [&]() { return BenchSHARepeat(); } },
+		{ "sha.small.mmap", [&]() { return BenchSHASmall("sha.small.mmap", -1); } },
+		{ "sha.small.pread", [&]() { return BenchSHASmall("sha.small.pread", ZBatchReader::E_BACKEND_PREAD); } },
+		{ "sha.small.uring", [&]() { return BenchSHASmall("sha.small.uring", ZBatchReader::E_BACKEND_URING); } },
+		{ "bundle.coderesources", [&]() { return BenchCodeResources(); } },
+		{ "bundle.signnode", [&]() { return BenchSignNode(); } },
+		{ "ipa.extract.serial", [&]() { return BenchIpaExtract("ipa.extract.serial", 1); } },
+		{ "ipa.extract.parallel", [&]() { return BenchIpaExtract("ipa.extract.parallel", (m_nThreads > 0) ? m_nThreads : (int)thread::hardware_concurrency()); } },
+		{ "ipa.install.twopass", [&]() { return BenchIpaInstall("ipa.install.twopass", false); } },
+		{ "ipa.install.streamed", [&]() { return BenchIpaInstall("ipa.install.streamed", true); } },
+		{ "ipa.update.full", [&]() { return BenchIpaUpdate("ipa.update.full", false); } },
+		{ "ipa.update.delta", [&]() { return BenchIpaUpdate("ipa.update.delta", true); } },
+		{ "ipa.pack.fixture", [&]() { return BenchIpaPack("ipa.pack.fixture", -1); } },
+		{ "ipa.pack.serial", [&]() { return BenchIpaPack("ipa.pack.serial", 1); } },
+		{ "ipa.pack.parallel", [&]() { return BenchIpaPack("ipa.pack.parallel", (m_nThreads > 0) ? m_nThreads : (int)thread::hardware_concurrency()); } },
+		{ "copy.tree.buffer", [&]() { return BenchCopyTree("copy.tree.buffer", 1, LC_COPY_NO_CLONE | LC_COPY_NO_RANGE); } },
+		{ "copy.tree.parallel", [&]() { return BenchCopyTree("copy.tree.parallel", m_nThreads, LC_COPY_NO_CLONE | LC_COPY_NO_RANGE); } },
+		{ "copy.tree.clone", [&]() { return BenchCopyTree("copy.tree.clone", m_nThreads, 0); } },
+		{ "copy.file.zfile", [&]() { return BenchCopyFile(); } },
+		{ "bundle.fixup.mapped", [&]() { return BenchBundleFixup("bundle.fixup.mapped", -1); } },
+		{ "bundle.fixup.serial", [&]() { return BenchBundleFixup("bundle.fixup.serial", 1); } },
+		{ "bundle.fixup.parallel", [&]() { return BenchBundleFixup("bundle.fixup.parallel", m_nThreads); } },
+		{ "blob.add.first", [&]() { return BenchBlobStore("blob.add.first", 0); } },
+		{ "blob.add.shared", [&]() { return BenchBlobStore("blob.add.shared", 1); } },
+		{ "blob.check", [&]() { return BenchBlobStore("blob.check", 2); } },
+		{ "catalog.load.plists", [&]() { return BenchAppCatalog("catalog.load.plists", false); } },
+		{ "catalog.load.mapped", [&]() { return BenchAppCatalog("catalog.load.mapped", true); } },
+		{ "lock.table.single", [&]() { return BenchContainerLock("lock.table.single", 1); } },
+		{ "lock.table.contended", [&]() { return BenchContainerLock("lock.table.contended", (m_nThreads > 0) ? m_nThreads : 8); } },
+		{ "launch.manifest.plists", [&]() { return BenchLaunchManifest("launch.manifest.plists", false); } },
+		{ "launch.manifest.mapped", [&]() { return BenchLaunchManifest("launch.manifest.mapped", true); } },
+		{ "symbol.lookup.scan", [&]() { return BenchSymbolIndex("symbol.lookup.scan", false); } },
+		{ "symbol.lookup.index", [&]() { return BenchSymbolIndex("symbol.lookup.index", true); } },
+		{ "sigscan.dyld.loop", [&]() { return BenchSigScan("sigscan.dyld.loop", false); } },
+		{ "sigscan.dyld.scanner", [&]() { return BenchSigScan("sigscan.dyld.scanner", true); } },
+		{ "arm64.decode.bitops", [&]() { return BenchArm64Decode("arm64.decode.bitops", false); } },
+		{ "arm64.decode.table", [&]() { return BenchArm64Decode("arm64.decode.table", true); } },
+		{ "arm64.xref.build.1", [&]() { return BenchArm64Xref("arm64.xref.build.1", 1, false); } },
+		{ "arm64.xref.build.n", [&]() { return BenchArm64Xref("arm64.xref.build.n", (m_nThreads > 0) ? m_nThreads : 4, false); } },
+		{ "arm64.xref.lookup.scan", [&]() { return BenchArm64Xref("arm64.xref.lookup.scan", 0, false); } },
+		{ "arm64.xref.lookup.index", [&]() { return BenchArm64Xref("arm64.xref.lookup.index", 0, true); } },
+	};
+
+	bool bRet = true;
+	for (auto& item : arrCases) {
+		if (strFilter.empty() || string::npos != string(item.first).find(strFilter)) {
+			bRet &= item.second();
+		}
+	}
+	return bRet;
+}
+
+void ZSignBench::GetReport(jvalue& jvReport)
+{
+	jvReport["version"] = 1;
+	jvReport["config"]["iterations"] = (int64_t)m_uIterations;
+	jvReport["config"]["slice_size"] = (int64_t)m_uSliceSize;
+	jvReport["config"]["threads"] = (int64_t)((m_nThreads > 0) ? m_nThreads : (int)thread::hardware_concurrency());
+	jvReport["config"]["app"]["frameworks"] = (int64_t)m_appSpec.uFrameworks;
+	jvReport["config"]["app"]["dylibs"] = (int64_t)m_appSpec.uDylibs;
+	jvReport["config"]["app"]["resources"] = (int64_t)m_appSpec.uResources;
+	jvReport["config"]["app"]["exec_size"] = (int64_t)m_appSpec.uExecSize;
+	jvReport["config"]["app"]["framework_size"] = (int64_t)m_appSpec.uFrameworkSize;
+	jvReport["config"]["app"]["dylib_size"] = (int64_t)m_appSpec.uDylibSize;
+	jvReport["config"]["app"]["resource_size"] = (int64_t)m_appSpec.uResourceSize;
+	jvReport["config"]["app"]["fat"] = m_appSpec.bFat;
+	jvReport["benchmarks"] = m_jvResults;
+}
+
+const struct option options[] = {
+	{ "output", required_argument, NULL, 'o' },
+	{ "work", required_argument, NULL, 'w' },
+	{ "iterations", required_argument, NULL, 'i' },
+	{ "size", required_argument, NULL, 's' },
+	{ "frameworks", required_argument, NULL, 'F' },
+	{ "dylibs", required_argument, NULL, 'D' },
+	{ "resources", required_argument, NULL, 'R' },
+	{ "fat", no_argument, NULL, 'A' },
+	{ "threads", required_argument, NULL, 'j' },
+	{ "macho", required_argument, NULL, 'm' },
+	{ "bench", required_argument, NULL, 'b' },
+	{ "trace", required_argument, NULL, 't' },
+	{ "keep", no_argument, NULL, 'k' },
+	{ "debug", no_argument, NULL, 'd' },
+	{ "help", no_argument, NULL, 'h' },
+	{ }
+};
+
+int usage()
+{
+	printf("Usage: zsign-bench [-options]\n");
+	printf("options:\n");
+	printf("-o, --output\t\tWrite the JSON report to this file. (default: stdout)\n");
+	printf("-w, --work\t\tFolder for generated fixtures. (default: temp folder)\n");
+	printf("-i, --iterations\tTimed runs per case. (default: 5)\n");
+	printf("-s, --size\t\tMegabytes per Mach-O slice. (default: 32)\n");
+	printf("-F, --frameworks\tFrameworks in the fixture app. (default: 4)\n");
+	printf("-D, --dylibs\t\tLoose dylibs in the fixture app. (default: 4)\n");
+	printf("-R, --resources\t\tResource files in the fixture app. (default: 256)\n");
+	printf("-A, --fat\t\tUse arm64 + arm64e binaries in the fixture app.\n");
+	printf("-j, --threads\t\tThreads for the parallel cases. (default: one per CPU)\n");
+	printf("-m, --macho\t\tThin arm64 Mach-O for the arm64.* cases, e.g. CydiaSubstrate. (default: skip them)\n");
+	printf("-b, --bench\t\tOnly run cases whose name contains this string.\n");
+	printf("-t, --trace\t\tWrite a Chrome trace of the run to this file.\n");
+	printf("-k, --keep\t\tKeep the work folder.\n");
+	printf("-d, --debug\t\tShow ZSign output.\n");
+	printf("-h, --help\t\tShow help.\n");
+	return -1;
+}
+
+int main(int argc, char* argv[])
+{
+	ZSignBench bench;
+	string strOutputFile;
+	string strWorkFolder;
+	string strFilter;
+	string strTraceFile;
+	bool bKeep = false;
+
+	// ZSign output stays off stdout, the report may go there. Warnings and errors are still captured and shown on failure.
+	ZLog::SetLogLever(ZLog::E_NONE);
+	uint32_t uSession = ZLog::BeginSession();
+
+	int opt = 0;
+	int argslot = -1;
+	while (-1 != (opt = getopt_long(argc, argv, "o:w:i:s:F:D:R:Aj:m:b:t:kdh", options, &argslot))) {
+		switch (opt) {
+			case 'o':
+				strOutputFile = ZFile::GetFullPath(optarg);
+				break;
+			case 'w':
+				strWorkFolder = ZFile::GetFullPath(optarg);
+				break;
+			case 'i':
+				bench.m_uIterations = (uint32_t)max(1, atoi(optarg));
+				break;
+			case 's':
+				bench.m_uSliceSize = (uint64_t)max(1, atoi(optarg)) * 1024 * 1024;
+				break;
+			case 'F':
+				bench.m_appSpec.uFrameworks = (uint32_t)atoi(optarg);
+				break;
+			case 'D':
+				bench.m_appSpec.uDylibs = (uint32_t)atoi(optarg);
+				break;
+			case 'R':
+				bench.m_appSpec.uResources = (uint32_t)atoi(optarg);
+				break;
+			case 'A':
+				bench.m_appSpec.bFat = true;
+				break;
+			case 'j':
+				bench.m_nThreads = atoi(optarg);
+				break;
+			case 'm':
+				bench.m_strMachO = ZFile::GetFullPath(optarg);
+				break;
+			case 'b':
+				strFilter = optarg;
+				break;
+			case 't':
+				strTraceFile = ZFile::GetFullPath(optarg);
+				break;
+			case 'k':
+				bKeep = true;
+				break;
+			case 'd':
+				ZLog::SetLogLever(ZLog::E_DEBUG);
+				break;
+			case 'h':
+			case '?':
+			default:
+				return usage();
+		}
+	}
+
+	if (strWorkFolder.empty()) {
+		ZUtil::StringFormatV(strWorkFolder, "%s/zsign_bench_%llu", ZFile::GetTempFolder(), (unsigned long long)ZUtil::GetMicroSecond());
+	}
+
+	if (!strTraceFile.empty()) {
+		ZTrace::Start(strTraceFile.c_str());
+	}
+	bool bRet = bench.Init(strWorkFolder) && bench.Run(strFilter);
+	ZTrace::Stop();
+
+	vector<string> arrLogs = ZLog::EndSession(uSession);
+	if (!bRet) {
+		for (const string& strLog : arrLogs) {
+			fprintf(stderr, "%s", strLog.c_str());
+		}
+	}
+
+	jvalue jvReport;
+	bench.GetReport(jvReport);
+	string strReport;
+	jvReport.style_write(strReport);
+	if (strOutputFile.empty()) {
+		printf("%s\n", strReport.c_str());
+	} else if (!ZFile::WriteFile(strOutputFile.c_str(), strReport)) {
+		fprintf(stderr, ">>> Can't write report! %s\n", strOutputFile.c_str());
+		bRet = false;
+	}
+
+	if (!bKeep) {
+		ZFile::RemoveFolder(strWorkFolder.c_str());
+	}
+	return bRet ? 0 : -1;
+}
@@ -2,6 +2,7 @@
 #include "base64.h"
 #include "common.h"
 #include "macho.h"
+#include "trace.h"
 #include "sys/stat.h"
 #include "sys/types.h"
 
@@ -43,7 +44,9 @@ bool ZBundle::GetSignFolderInfo(const string& strFolder, jvalue& jvNode, bool bG
 {
 	string strInfoPlistData;
 	string strInfoPlistPath = strFolder + "/Info.plist";
+	ZTraceSpan span("ReadInfoPlist", 0, strInfoPlistPath.c_str());
 	ZFile::ReadFile(strInfoPlistPath.c_str(), strInfoPlistData);
+	span.SetBytes(strInfoPlistData.size());
 
 	jvalue jvInfo;
 	jvInfo.read_plist(strInfoPlistData);
@@ -80,6 +83,7 @@ bool ZBundle::GetSignFolderInfo(const string& strFolder, jvalue& jvNode, bool bG
 
 bool ZBundle::GetObjectsToSign(const string& strFolder, jvalue& jvInfo)
 {
+	ZTraceSpan span("ScanBundle", 0, strFolder.c_str());
 	ZFile::EnumFolder(strFolder.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
 		if (bFolder) {
 			if (ZFile::IsPathSuffix(strPath, ".app") ||
@@ -130,11 +134,20 @@ bool ZBundle::GenerateCodeResources(const string& strFolder, jvalue& jvCodeRes)
 	jvCodeRes["files"] = jvalue(jvalue::E_OBJECT);
 	jvCodeRes["files2"] = jvalue(jvalue::E_OBJECT);
 
-	for (string strKey : setFiles) {
-		string strFile = strFolder + "/" + strKey;
-		string strSHA1Base64;
-		string strSHA256Base64;
-		ZSHA::SHABase64File(strFile.c_str(), strSHA1Base64, strSHA256Base64);
+	vector<string> arrKeys(setFiles.begin(), setFiles.end());
+	vector<string> arrFiles;
+	for (const string& strKey : arrKeys) {
+		arrFiles.push_back(strFolder + "/" + strKey);
+	}
+
+	vector<string> arrSHA1Base64;
+	vector<string> arrSHA256Base64;
+	ZSHA::SHABase64Files(arrFiles, arrSHA1Base64, arrSHA256Base64);
+
+	for (size_t i = 0; i < arrKeys.size(); i++) {
+		string strKey = arrKeys[i];
+		const string& strSHA1Base64 = arrSHA1Base64[i];
+		const string& strSHA256Base64 = arrSHA256Base64[i];
 
 #ifdef _WIN32
 		strKey = ic.A2U8(strKey);
@@ -248,24 +261,52 @@ bool ZBundle::SignNode(jvalue& jvNode)
 	if (jvNode.has("files")) {
 		for (size_t i = 0; i < jvNode["files"].size(); i++) {
 			string strFile = jvNode["files"][i];
-			ZLog::PrintV(">>> SignFile: \t%s\n", strFile.c_str());
-			ZMachO macho;
-			if (macho.InitV("%s/%s", m_strAppFolder.c_str(), strFile.c_str())) {
-				if (!macho.Sign(m_pSignAsset, m_bForceSign, config["bundle_id"], "", "", "")) {
-                    signFailedFiles += strFile;
-                    signFailedFiles += "\n";
-                }
-                if(progressHandler) {
-                    progressHandler();
-                }
-			} else {
-//				return false;
+			if (!SignFile(strFile)) {
                 signFailedFiles += strFile;
                 signFailedFiles += "\n";
 			}
 		}
 	}
 
+	return SignFolderExecutable(jvNode, signFailedFiles);
+}
+
+bool ZBundle::SignFile(const string& strFile)
+{
+	ZLog::PrintV(">>> SignFile: \t%s\n", strFile.c_str());
+	ZTraceSpan span("SignFile", 0, strFile.c_str());
+	ZMachO macho;
+	if (!macho.InitV("%s/%s", m_strAppFolder.c_str(), strFile.c_str())) {
+		return false;
+	}
+	LoadCodeSlots(macho, strFile);
+	bool bRet = macho.Sign(m_pSignAsset, m_bForceSign, m_strBundleId, "", "", "");
+	if (progressHandler) {
+		progressHandler();
+	}
+	return bRet;
+}
+
+// page hashes LiveContainer took while extracting the app, or the marker for a binary an update kept, see
+// LiveContainerSwiftUI/LCPageHash.h
+void ZBundle::LoadCodeSlots(ZMachO& macho, const string& strFile)
+{
+	string strSlotsName = strFile;
+	ZUtil::StringReplace(strSlotsName, "/", ":");
+	string strSlotsFile = m_strAppFolder + "/.LCCodeSlots/" + strSlotsName + ".slots";
+	if (!m_bForceSign) {
+		return;
+	}
+	if (ZFile::IsFileExists(strSlotsFile.c_str())) {
+		macho.LoadCodeSlots(strSlotsFile, strFile);
+	} else if (ZFile::IsFileExistsV("%s/.LCCodeSlots/%s.embedded", m_strAppFolder.c_str(), strSlotsName.c_str())) {
+		macho.UseEmbeddedCodeSlots();
+	}
+}
+
+// signs the bundle executable of a folder node, nested folders and files must already be signed
+bool ZBundle::SignFolderExecutable(jvalue& jvNode, string& strFailedFiles)
+{
 	jbase64 b64;
 	string strInfoSHA1;
 	string strInfoSHA256;
@@ -292,14 +333,15 @@ bool ZBundle::SignNode(jvalue& jvNode)
 	}
 
 	string strExePath = strBaseFolder + "/" + strBundleExe;
+	ZTraceSpan span("SignBundle", 0, strFolder.c_str());
 	ZLog::PrintV(">>> SignFolder: %s, (%s)\n", ("/" == strFolder) ? ZUtil::GetBaseName(m_strAppFolder.c_str()) : strFolder.c_str(), strBundleExe.c_str());
 
 	ZMachO macho;
 	if (!macho.Init(strExePath.c_str())) {
 		ZLog::ErrorV(">>> Can't parse BundleExecute file! %s\n", strExePath.c_str());
 //		return false;
-        signFailedFiles += strExePath;
-        signFailedFiles += "\n";
+        strFailedFiles += strExePath;
+        strFailedFiles += "\n";
         return true;
 	}
 
@@ -318,13 +360,19 @@ bool ZBundle::SignNode(jvalue& jvNode)
 //			return false;
 //		}
 	} else if (jvNode.has("changed")) { // use existsed
+		vector<string> arrRealFiles;
 		for (size_t i = 0; i < jvNode["changed"].size(); i++) {
-			string strFile = jvNode["changed"][i].as_cstr();
-			string strRealFile = m_strAppFolder + "/" + strFile;
+			arrRealFiles.push_back(m_strAppFolder + "/" + jvNode["changed"][i].as_cstr());
+		}
 
-			string strFileSHA1;
-			string strFileSHA256;
-			if (!ZSHA::SHABase64File(strRealFile.c_str(), strFileSHA1, strFileSHA256)) {
+		vector<string> arrSHA1;
+		vector<string> arrSHA256;
+		ZSHA::SHABase64Files(arrRealFiles, arrSHA1, arrSHA256);
+		for (size_t i = 0; i < jvNode["changed"].size(); i++) {
+			string strFile = jvNode["changed"][i].as_cstr();
+			const string& strFileSHA1 = arrSHA1[i];
+			const string& strFileSHA256 = arrSHA256[i];
+			if (strFileSHA1.empty() || strFileSHA256.empty()) {
 				ZLog::ErrorV(">>> Can't get changed file SHASum! %s", strFile.c_str());
 				return false;
 			}
@@ -350,7 +398,7 @@ bool ZBundle::SignNode(jvalue& jvNode)
 	}
 
 	bool bForceSign = m_bForceSign;
-	if ("/" == strFolder) { // inject dylib
+	if ("/" == strFolder) { // inject dylib, the touched load command pages are rehashed on sign
 		for (const string& strDylibFile : m_arrInjectDylibs) {
 			if (macho.InjectDylib(m_bWeakInject, strDylibFile.c_str())) {
 				bForceSign = true;
@@ -358,10 +406,14 @@ bool ZBundle::SignNode(jvalue& jvNode)
 		}
 	}
 
+	LoadCodeSlots(macho, ("/" == strFolder) ? strBundleExe : strFolder + "/" + strBundleExe);
 	if (!macho.Sign(m_pSignAsset, bForceSign, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResData)) {
 		return false;
 	}
 
+	if ("/" == strFolder) { // the root is signed last, the hashes are only good for this run
+		ZFile::RemoveFolderV("%s/.LCCodeSlots", m_strAppFolder.c_str());
+	}
 	return true;
 }
 
@@ -565,7 +617,10 @@ bool ZBundle::SignFolder(ZSignAsset* pSignAsset,
 	ZLog::PrintV(">>> SubjectCN: \t%s\n", m_pSignAsset->m_strSubjectCN.c_str());
 	ZLog::PrintV(">>> ReadCache: \t%s\n", m_bForceSign ? "NO" : "YES");
 
-	if (SignNode(jvRoot)) {
+	m_strBundleId = jvRoot["bundle_id"].as_cstr();
+	bool bRet = SignNode(jvRoot);
+	ZFile::ClearMapCache();
+	if (bRet) {
 		if (bEnableCache) {
 			ZFile::CreateFolder("./.zsign_cache");
 			jvRoot.style_write_to_file("./.zsign_cache/%s.json", strCacheName.c_str());
@@ -663,6 +718,7 @@ bool ZBundle::ConfigureFolderSign(ZSignAsset *pSignAsset,
     ZLog::PrintV(">>> ReadCache: \t%s\n", m_bForceSign ? "NO" : "YES");
     
     config = jvRoot;
+    m_strBundleId = config["bundle_id"].as_cstr();
     
     return true;
 }
@@ -689,7 +745,9 @@ int ZBundle::GetSignCount() {
 }
 
 bool ZBundle::StartSign(bool enableCache) {
-    if (SignNode(config))
+    bool bRet = SignNode(config);
+    ZFile::ClearMapCache();
+    if (bRet)
     {
         if (enableCache)
         {
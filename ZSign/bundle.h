@@ -4,6 +4,8 @@
 #include "openssl.h"
 #include <vector>
 
+class ZMachO;
+
 class ZBundle
 {
 public:
@@ -25,6 +27,9 @@ public:
 
 private:
 	bool SignNode(jvalue& jvNode);
+	bool SignFile(const string& strFile);
+	bool SignFolderExecutable(jvalue& jvNode, string& strFailedFiles);
+	void LoadCodeSlots(ZMachO& macho, const string& strFile);
 	void GetNodeChangedFiles(jvalue& jvNode);
 	void GetChangedFiles(jvalue& jvNode, vector<string>& arrChangedFiles);
 	bool ModifyPluginsBundleId(const string& strOldBundleId, const string& strNewBundleId);
@@ -46,6 +51,10 @@ private:
 	ZSignAsset*		m_pSignAsset;
 	vector<string>	m_arrInjectDylibs;
     jvalue config;
+	string			m_strBundleId;
+
+	friend class ZBatchSign;
+	friend class ZSignBench;
 
 public:
 	string			m_strAppFolder;
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Byte ranges modified by in-place Mach-O edits, shared by ZSign and LiveContainer.
+ * Writers record what they touched so the mapping can be flushed, and the code
+ * signature rehashed, page by page instead of for the whole file.
+ */
+
+#define DIRTY_RANGES_MAX	16
+
+typedef struct dirty_ranges {
+	uint32_t	count;
+	uint64_t	begin[DIRTY_RANGES_MAX];
+	uint64_t	end[DIRTY_RANGES_MAX];
+} dirty_ranges;
+
+static inline void dirty_ranges_reset(dirty_ranges* pRanges)
+{
+	memset(pRanges, 0, sizeof(dirty_ranges));
+}
+
+/* Ranges are kept sorted and merged; once full, the last one is widened instead of dropping data. */
+static inline void dirty_ranges_add(dirty_ranges* pRanges, uint64_t uOffset, uint64_t uLength)
+{
+	if (uLength <= 0) {
+		return;
+	}
+	uint64_t uBegin = uOffset;
+	uint64_t uEnd = uOffset + uLength;
+
+	uint32_t i = 0;
+	while (i < pRanges->count && pRanges->end[i] < uBegin) {
+		i++;
+	}
+	uint32_t j = i;
+	while (j < pRanges->count && pRanges->begin[j] <= uEnd) {
+		uBegin = pRanges->begin[j] < uBegin ? pRanges->begin[j] : uBegin;
+		uEnd = pRanges->end[j] > uEnd ? pRanges->end[j] : uEnd;
+		j++;
+	}
+
+	if (i == j && pRanges->count >= DIRTY_RANGES_MAX) {
+		uint32_t k = (i < pRanges->count) ? i : pRanges->count - 1;
+		pRanges->begin[k] = pRanges->begin[k] < uBegin ? pRanges->begin[k] : uBegin;
+		pRanges->end[k] = pRanges->end[k] > uEnd ? pRanges->end[k] : uEnd;
+		return;
+	}
+
+	// replace [i, j) with the merged range
+	uint32_t uTail = pRanges->count - j;
+	if (i + 1 != j) {
+		memmove(&pRanges->begin[i + 1], &pRanges->begin[j], uTail * sizeof(uint64_t));
+		memmove(&pRanges->end[i + 1], &pRanges->end[j], uTail * sizeof(uint64_t));
+	}
+	pRanges->begin[i] = uBegin;
+	pRanges->end[i] = uEnd;
+	pRanges->count = i + 1 + uTail;
+}
+
+static inline bool dirty_ranges_intersects(const dirty_ranges* pRanges, uint64_t uOffset, uint64_t uLength)
+{
+	for (uint32_t i = 0; i < pRanges->count; i++) {
+		if (pRanges->begin[i] < uOffset + uLength && pRanges->end[i] > uOffset) {
+			return true;
+		}
+	}
+	return false;
+}
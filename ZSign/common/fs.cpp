@@ -1,5 +1,13 @@
 #include "fs.h"
 #include "Utils.hpp"
+#ifdef __APPLE__
+#include <copyfile.h>
+#elif !defined(_WIN32)
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
 #if !defined(S_ISREG) && defined(S_IFMT) && defined(S_IFREG)
 #define S_ISREG(m) (((m)&S_IFMT) == S_IFREG)
 #endif
@@ -13,7 +21,7 @@ bool ZFile::IsRegularFile(const char* path)
 	return S_ISREG(st.st_mode);
 }
 
-void* ZFile::MapFile(const char* path, size_t offset, size_t size, size_t* psize, bool ro)
+void* ZFile::MapFile(const char* path, size_t offset, size_t size, size_t* psize, bool ro, int nFlags)
 {
 	void* base = NULL;
 
@@ -22,16 +30,16 @@ void* ZFile::MapFile(const char* path, size_t offset, size_t size, size_t* psize
 	HANDLE hFile = ::CreateFileA(path, ro ? GENERIC_READ : (GENERIC_READ | GENERIC_WRITE), ro ? FILE_SHARE_READ : (FILE_SHARE_READ | FILE_SHARE_WRITE), NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 	if (INVALID_HANDLE_VALUE != hFile) {
 		if (size <= 0) {
-			size = ::GetFileSize(hFile, NULL);
+			size = ::GetFileSize(hFile, NULL) - offset;
 		}
 
 		if (NULL != psize) {
 			*psize = size;
 		}
 
-		HANDLE hMap = ::CreateFileMapping(hFile, NULL, ro ? PAGE_READONLY : PAGE_READWRITE, 0, (DWORD)size, NULL);
+		HANDLE hMap = ::CreateFileMapping(hFile, NULL, ro ? PAGE_READONLY : PAGE_READWRITE, 0, (DWORD)(offset + size), NULL);
 		if (NULL != hMap) {
-			base = ::MapViewOfFile(hMap, ro ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, size);
+			base = ::MapViewOfFile(hMap, ro ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, (DWORD)((uint64_t)offset >> 32), (DWORD)offset, size);
 			if (NULL != base) {
 				s_mapFiles[base] = hMap;
 			} else {
@@ -42,7 +50,10 @@ void* ZFile::MapFile(const char* path, size_t offset, size_t size, size_t* psize
 	}
 
 #else
-    refreshFile(path);
+    if (!(nFlags & E_MAP_NO_REFRESH)) {
+        refreshFile(path);
+    }
+    nFlags &= ~E_MAP_NO_REFRESH;
     int fd = open(path, ro ? O_RDONLY : O_RDWR);
     if (fd <= 0)
     {
@@ -61,16 +72,25 @@ void* ZFile::MapFile(const char* path, size_t offset, size_t size, size_t* psize
 		if (size <= 0) {
 			struct stat st = { 0 };
 			fstat(fd, &st);
-			size = st.st_size;
+			size = (st.st_size > (off_t)offset) ? (size_t)(st.st_size - offset) : 0;
 		}
 
 		if (NULL != psize) {
 			*psize = size;
 		}
 
-		base = mmap(NULL, size, ro ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+		int nMapFlags = MAP_SHARED;
+#ifdef MAP_POPULATE
+		if (nFlags & E_MAP_POPULATE) {
+			nMapFlags |= MAP_POPULATE;
+			nFlags &= ~E_MAP_POPULATE;
+		}
+#endif
+		base = mmap(NULL, size, ro ? PROT_READ : PROT_READ | PROT_WRITE, nMapFlags, fd, offset);
 		if (MAP_FAILED == base) {
 			base = NULL;
+		} else if (E_MAP_DEFAULT != nFlags) {
+			AdviseMap(base, size, nFlags);
 		}
 		close(fd);
 	}
@@ -96,6 +116,276 @@ bool ZFile::UnmapFile(void* base, size_t size)
 #endif
 }
 
+bool ZFile::AdviseMap(void* base, size_t size, int nFlags)
+{
+	if (NULL == base || size <= 0) {
+		return false;
+	}
+
+#ifdef _WIN32
+	return true;
+#else
+	// madvise wants a page aligned start, widen the range down to it
+	size_t sPageSize = (size_t)sysconf(_SC_PAGESIZE);
+	uint8_t* pStart = (uint8_t*)((uintptr_t)base & ~(uintptr_t)(sPageSize - 1));
+	size_t sLength = size + (size_t)((uint8_t*)base - pStart);
+
+	bool bRet = true;
+	if (nFlags & E_MAP_SEQUENTIAL) {
+		bRet &= (0 == madvise(pStart, sLength, MADV_SEQUENTIAL));
+	} else if (nFlags & E_MAP_RANDOM) {
+		bRet &= (0 == madvise(pStart, sLength, MADV_RANDOM));
+	}
+
+	if (nFlags & E_MAP_WILLNEED) {
+		bRet &= (0 == madvise(pStart, sLength, MADV_WILLNEED));
+	}
+
+	if (nFlags & E_MAP_POPULATE) {
+#ifdef MADV_POPULATE_READ
+		if (0 == madvise(pStart, sLength, MADV_POPULATE_READ)) {
+			return bRet;
+		}
+#endif
+		// no populate advice here, read one byte per page to fault them in
+		volatile uint8_t uSink = 0;
+		for (size_t i = 0; i < sLength; i += sPageSize) {
+			uSink ^= pStart[i];
+		}
+		(void)uSink;
+	}
+	return bRet;
+#endif
+}
+
+bool ZFile::MapFileWindows(const char* path, size_t window, int nFlags, map_window_callback callback)
+{
+#ifdef _WIN32
+
+	size_t size = 0;
+	uint8_t* base = (uint8_t*)MapFile(path, 0, 0, &size, true, nFlags);
+	if (NULL == base) {
+		return (0 == size);
+	}
+	callback(base, 0, size);
+	UnmapFile(base, size);
+	return true;
+
+#else
+
+	refreshFile(path);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st = { 0 };
+	fstat(fd, &st);
+	size_t size = (size_t)st.st_size;
+
+	// windows start on page boundaries, so each one can be mapped on its own and dropped once it is consumed
+	size_t sPageSize = (size_t)sysconf(_SC_PAGESIZE);
+	window = max(window, sPageSize);
+	window -= window % sPageSize;
+
+	bool bRet = true;
+	for (size_t offset = 0; offset < size; offset += window) {
+		size_t length = min(window, size - offset);
+		void* base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, (off_t)offset);
+		if (MAP_FAILED == base) {
+			bRet = false;
+			break;
+		}
+		if (E_MAP_DEFAULT != nFlags) {
+			AdviseMap(base, length, nFlags);
+		}
+		bool bStop = callback((const uint8_t*)base, offset, length);
+		munmap(base, length);
+		if (bStop) {
+			break;
+		}
+	}
+	close(fd);
+	return bRet;
+
+#endif
+}
+
+// Read only mappings of files hashed more than once in a sign, e.g. nested binaries listed as changed by every
+// enclosing bundle. An entry is matched by inode, size and mtime, so a rewritten or replaced file maps again.
+#define MAP_CACHE_MAX_ENTRIES	64
+#define MAP_CACHE_MAX_BYTES		(64 * 1024 * 1024)
+#define MAP_CACHE_MAX_FILE		(8 * 1024 * 1024)
+#define MAP_CACHE_ADVISE_SIZE	(1024 * 1024)
+
+struct ZMapCacheEntry
+{
+	string		strPath;
+	uint64_t	uInode;
+	int64_t		nMTime;
+	size_t		sSize;
+	void*		pBase;
+	uint32_t	uRefs;
+	uint64_t	uLastUse;
+	bool		bCached; // false: too large or stale, unmapped on the last release
+};
+
+struct ZMapCache
+{
+	mutex					mtx;
+	vector<ZMapCacheEntry>	arrEntries;
+	size_t					sBytes = 0;
+	uint64_t				uClock = 0;
+};
+
+static ZMapCache& MapCache()
+{
+	static ZMapCache* s_pCache = new ZMapCache();
+	return *s_pCache;
+}
+
+static bool StatMapKey(const char* path, uint64_t& uInode, int64_t& nMTime, size_t& sSize)
+{
+	struct stat st = { 0 };
+	if (0 != stat(path, &st)) {
+		return false;
+	}
+	uInode = (uint64_t)st.st_ino;
+	sSize = (size_t)st.st_size;
+#if defined(__APPLE__)
+	nMTime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	nMTime = (int64_t)st.st_mtime;
+#else
+	nMTime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+// caller holds the cache lock
+static void TrimMapCache(ZMapCache& cache, size_t sMaxEntries, size_t sMaxBytes)
+{
+	while (true) {
+		size_t sEntries = 0;
+		auto itOldest = cache.arrEntries.end();
+		for (auto it = cache.arrEntries.begin(); it != cache.arrEntries.end(); it++) {
+			if (it->bCached) {
+				sEntries++;
+				if (0 == it->uRefs && (itOldest == cache.arrEntries.end() || it->uLastUse < itOldest->uLastUse)) {
+					itOldest = it;
+				}
+			}
+		}
+		if ((sEntries <= sMaxEntries && cache.sBytes <= sMaxBytes) || itOldest == cache.arrEntries.end()) {
+			break;
+		}
+		cache.sBytes -= itOldest->sSize;
+		ZFile::UnmapFile(itOldest->pBase, itOldest->sSize);
+		cache.arrEntries.erase(itOldest);
+	}
+}
+
+const uint8_t* ZFile::MapFileCached(const char* path, size_t* psize)
+{
+	if (NULL != psize) {
+		*psize = 0;
+	}
+
+	uint64_t uInode = 0;
+	int64_t nMTime = 0;
+	size_t sSize = 0;
+	if (!StatMapKey(path, uInode, nMTime, sSize)) {
+		return NULL;
+	}
+	if (NULL != psize) {
+		*psize = sSize;
+	}
+	if (sSize <= 0 || sSize > MAP_CACHE_MAX_FILE) {
+		return NULL;
+	}
+
+	ZMapCache& cache = MapCache();
+	{
+		lock_guard<mutex> lock(cache.mtx);
+		for (ZMapCacheEntry& entry : cache.arrEntries) {
+			if (entry.bCached && entry.strPath == path) {
+				if (entry.uInode == uInode && entry.nMTime == nMTime && entry.sSize == sSize) {
+					entry.uRefs++;
+					entry.uLastUse = ++cache.uClock;
+					return (const uint8_t*)entry.pBase;
+				}
+				entry.bCached = false; // changed on disk, the mapping goes away with its last user
+				cache.sBytes -= entry.sSize;
+				break;
+			}
+		}
+		cache.arrEntries.erase(remove_if(cache.arrEntries.begin(), cache.arrEntries.end(), [](const ZMapCacheEntry& entry) {
+			if (!entry.bCached && 0 == entry.uRefs) {
+				ZFile::UnmapFile(entry.pBase, entry.sSize);
+				return true;
+			}
+			return false;
+		}), cache.arrEntries.end());
+	}
+
+	size_t sMapSize = 0;
+	void* pBase = MapFile(path, 0, 0, &sMapSize, true, (sSize > MAP_CACHE_ADVISE_SIZE) ? (E_MAP_SEQUENTIAL | E_MAP_WILLNEED) : E_MAP_DEFAULT);
+	if (NULL == pBase) {
+		return NULL;
+	}
+	if (NULL != psize) {
+		*psize = sMapSize;
+	}
+
+	ZMapCacheEntry entry;
+	entry.strPath = path;
+	entry.uInode = uInode;
+	entry.nMTime = nMTime;
+	entry.sSize = sMapSize;
+	entry.pBase = pBase;
+	entry.uRefs = 1;
+	entry.bCached = (sMapSize == sSize);
+#ifdef __APPLE__
+	// refreshFile replaced the file while mapping it, key the entry by the new one
+	entry.bCached = entry.bCached && StatMapKey(path, entry.uInode, entry.nMTime, sSize) && (sMapSize == sSize);
+#endif
+
+	lock_guard<mutex> lock(cache.mtx);
+	entry.uLastUse = ++cache.uClock;
+	if (entry.bCached) {
+		cache.sBytes += entry.sSize;
+	}
+	cache.arrEntries.push_back(entry);
+	TrimMapCache(cache, MAP_CACHE_MAX_ENTRIES, MAP_CACHE_MAX_BYTES);
+	return (const uint8_t*)pBase;
+}
+
+void ZFile::UnmapFileCached(const void* base)
+{
+	if (NULL == base) {
+		return;
+	}
+
+	ZMapCache& cache = MapCache();
+	lock_guard<mutex> lock(cache.mtx);
+	for (auto it = cache.arrEntries.begin(); it != cache.arrEntries.end(); it++) {
+		if (it->pBase == base && it->uRefs > 0) {
+			if (0 == --it->uRefs && !it->bCached) {
+				UnmapFile(it->pBase, it->sSize);
+				cache.arrEntries.erase(it);
+			}
+			return;
+		}
+	}
+}
+
+void ZFile::ClearMapCache()
+{
+	ZMapCache& cache = MapCache();
+	lock_guard<mutex> lock(cache.mtx);
+	TrimMapCache(cache, 0, 0);
+}
+
 bool ZFile::WriteFile(const char* szFile, const char* szData, size_t sLen)
 {
 	if (NULL == szFile) {
@@ -206,8 +496,10 @@ bool ZFile::IsFolder(const char* szFolder)
 #ifdef _WIN32
 	return ::PathIsDirectoryA(szFolder);
 #else
-	struct stat st;
-	stat(szFolder, &st);
+	struct stat st = { 0 };
+	if (0 != stat(szFolder, &st)) {
+		return false;
+	}
 	return S_ISDIR(st.st_mode);
 #endif
 }
@@ -344,37 +636,50 @@ bool ZFile::CopyFile(const char* szSrcFile, const char* szDestFile)
 {
 #ifdef _WIN32
 	return ::CopyFileA(szSrcFile, szDestFile, FALSE) ? true : false;
-#else 
-
-	int src_id = -1;
-	int dest_fd = -1;
-	ssize_t sum_readed = 0;
-	ssize_t sum_written = 0;
-	src_id = open(szSrcFile, O_RDONLY);
-	if (-1 != src_id) {
-		dest_fd = open(szDestFile, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-		if (-1 != dest_fd) {
-			char buffer[4096];
-			ssize_t bytes_read = read(src_id, buffer, sizeof(buffer));
-			while (bytes_read > 0) {
-				sum_readed += bytes_read;
-				ssize_t bytes_written = write(dest_fd, buffer, bytes_read);
-				if (bytes_written != bytes_read) {
-					break;
-				}
-				sum_written += bytes_written;
-				bytes_read = read(src_id, buffer, sizeof(buffer));
-			}
-			close(dest_fd);
-		}
-		close(src_id);
-	}
+#elif defined(__APPLE__)
+	// clones on APFS, copies the data otherwise
+	unlink(szDestFile);
+	return 0 == copyfile(szSrcFile, szDestFile, NULL, COPYFILE_CLONE);
+#else
 
-	if (-1 == src_id || -1 == dest_fd || sum_readed != sum_written) {
+	int src_fd = open(szSrcFile, O_RDONLY);
+	if (-1 == src_fd) {
+		return false;
+	}
+	struct stat st;
+	int dest_fd = (0 == fstat(src_fd, &st)) ? open(szDestFile, O_CREAT | O_WRONLY | O_TRUNC, 0644) : -1;
+	if (-1 == dest_fd) {
+		close(src_fd);
 		return false;
 	}
 
-	return true;
+	// shared extents where the file system has them (btrfs, xfs), then an in-kernel copy, then a large buffer
+	bool bRet = (0 == ioctl(dest_fd, FICLONE, src_fd));
+	off_t sum_copied = 0;
+	while (!bRet) {
+		ssize_t bytes_copied = copy_file_range(src_fd, NULL, dest_fd, NULL, (size_t)min((off_t)(1 << 30), st.st_size - sum_copied), 0);
+		if (bytes_copied > 0) {
+			sum_copied += bytes_copied;
+		}
+		bRet = (sum_copied == st.st_size);
+		if (bytes_copied <= 0) {
+			break;
+		}
+	}
+	if (!bRet && 0 == sum_copied) {
+		vector<char> buffer(1024 * 1024);
+		ssize_t bytes_read = 0;
+		while ((bytes_read = read(src_fd, buffer.data(), buffer.size())) > 0) {
+			if (write(dest_fd, buffer.data(), bytes_read) != bytes_read) {
+				break;
+			}
+			sum_copied += bytes_read;
+		}
+		bRet = (0 == bytes_read && sum_copied == st.st_size);
+	}
+	close(dest_fd);
+	close(src_fd);
+	return bRet;
 
 #endif
 }
@@ -2,9 +2,21 @@
 #include "common.h"
 
 typedef function<bool (bool bFolder, const string& strPath)> enum_folder_callback;
+typedef function<bool (const uint8_t* pData, size_t sOffset, size_t sSize)> map_window_callback;
 
 class ZFile
 {
+public:
+	enum eMapFlags
+	{
+		E_MAP_DEFAULT = 0,
+		E_MAP_SEQUENTIAL = 1,	// read front to back, read ahead aggressively and drop pages behind
+		E_MAP_RANDOM = 2,		// only a few pages are touched, don't read ahead
+		E_MAP_WILLNEED = 4,		// start reading the whole range in now
+		E_MAP_POPULATE = 8,		// fault the whole range in before returning
+		E_MAP_NO_REFRESH = 16	// map the file as is, refreshFile would replace it with a writable copy
+	};
+
 public:
 	static bool		ReadFile(const char* szFile, string& strData);
 	static bool		ReadFileV(string& strData, const char* szPath, ...);
@@ -34,8 +46,13 @@ public:
 	static bool		CopyFileV(const char* szSrcFile, const char* szDestPath, ...);
 	static string	GetFullPath(const char* szPath);
 	static string	GetRealPathV(const char* szPath, ...);
-	static void*	MapFile(const char* path, size_t offset, size_t size, size_t* psize, bool ro);
+	static void*	MapFile(const char* path, size_t offset, size_t size, size_t* psize, bool ro, int nFlags = E_MAP_DEFAULT);
 	static bool		UnmapFile(void* base, size_t size);
+	static bool		AdviseMap(void* base, size_t size, int nFlags);
+	static bool		MapFileWindows(const char* path, size_t window, int nFlags, map_window_callback callback);
+	static const uint8_t* MapFileCached(const char* path, size_t* psize); // read only, NULL with *psize set if too large to cache
+	static void		UnmapFileCached(const void* base);
+	static void		ClearMapCache();
 	static bool		IsPathSuffix(const string& strPath, const char* suffix);
 	static const char* GetTempFolder();
 	static bool		EnumFolder(const char* szFolder, bool bRecursive, enum_folder_callback filter, enum_folder_callback callback);
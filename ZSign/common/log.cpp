@@ -1,37 +1,107 @@
 #include "log.h"
-#include "../Utils.hpp"
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 
 int ZLog::g_nLogLevel = ZLog::E_INFO;
 
-void ZLog::_Print(const char* szLog, int nColor)
+// Every logging thread formats straight into its own single producer ring, nothing is locked on that path.
+// A drain thread merges the rings by sequence number, then writes the console and the session captures.
+#define LOG_RING_SLOTS	64
+#define LOG_LINE_SIZE	1024
+
+struct ZLogLine
+{
+	uint64_t	uSeq;
+	uint32_t	uSession;
+	int			nColor;
+	bool		bConsole;
+	bool		bContinue;	// tail of a line longer than LOG_LINE_SIZE
+	char		szLog[LOG_LINE_SIZE];
+};
+
+struct ZLogRing
+{
+	atomic<uint64_t>	uHead;
+	atomic<uint64_t>	uTail;
+	atomic<bool>		bDetached;
+	ZLogLine			arrLines[LOG_RING_SLOTS];
+};
+
+struct ZLogState
 {
-	if (g_nLogLevel <= E_NONE) {
+	mutex							ringsMutex;
+	vector<ZLogRing*>				arrRings;
+	mutex							drainMutex; // single consumer, also guards mapSessions
+	condition_variable				drainCond;
+	atomic<uint64_t>				uCommitted;
+	atomic<bool>					bDrainWaiting; // the drain thread is parked on drainCond
+	map<uint32_t, vector<string>>	mapSessions;
+	atomic<uint64_t>				uSeq;
+	atomic<uint32_t>				uNextSession;
+	once_flag						startFlag;
+};
+
+// never destroyed, the drain thread and late loggers may outlive static destructors
+static ZLogState& LogState()
+{
+	static ZLogState* s_pState = new ZLogState();
+	return *s_pState;
+}
+
+struct ZLogRingOwner
+{
+	ZLogRing* pRing = NULL;
+	~ZLogRingOwner()
+	{
+		if (NULL != pRing) {
+			pRing->bDetached.store(true, memory_order_release);
+		}
+	}
+};
+
+static thread_local uint32_t t_uSession = 0;
+static thread_local ZLogRingOwner t_RingOwner;
+
+static void EmitLine(ZLogState& state, const ZLogLine& line)
+{
+	if (line.uSession > 0) {
+		auto it = state.mapSessions.find(line.uSession);
+		if (it != state.mapSessions.end()) {
+			if (line.bContinue && !it->second.empty()) {
+				it->second.back() += line.szLog;
+			} else {
+				it->second.push_back(line.szLog);
+			}
+		}
+	}
+
+	if (!line.bConsole) {
 		return;
 	}
 
 #ifdef _WIN32
 
-	string strLog = szLog;
 	HANDLE hConsole = ::GetStdHandle(STD_OUTPUT_HANDLE);
-	if (nColor > 0) {
-		::SetConsoleTextAttribute(hConsole, nColor);
+	if (line.nColor > 0) {
+		::SetConsoleTextAttribute(hConsole, line.nColor);
 	}
-	::WriteFile(hConsole, strLog.data(), (DWORD)strLog.size(), NULL, NULL);
-	if (nColor > 0) {
+	::WriteFile(hConsole, line.szLog, (DWORD)strlen(line.szLog), NULL, NULL);
+	if (line.nColor > 0) {
 		::SetConsoleTextAttribute(hConsole, 7);
 	}
 
 #else
 
 	const char* szColor = NULL;
-	switch (nColor) {
+	switch (line.nColor) {
 		case 6:
 			szColor = "\033[33m";
 			break;
 		case 10:
 			szColor = "\033[32m";
 			break;
-		case 12: 
+		case 12:
 			szColor = "\033[31m";
 			break;
 		default:
@@ -41,15 +111,201 @@ void ZLog::_Print(const char* szLog, int nColor)
 	if (NULL != szColor) {
 		write(STDOUT_FILENO, szColor, strlen(szColor));
 	}
-	write(STDOUT_FILENO, szLog, strlen(szLog));
+	write(STDOUT_FILENO, line.szLog, strlen(line.szLog));
 	if (NULL != szColor) {
 		write(STDOUT_FILENO, "\033[0m", 4);
 	}
-    writeToLogFile(szLog);
-	
+
 #endif
 }
 
+// caller holds drainMutex
+static void DrainRings(ZLogState& state)
+{
+	vector<ZLogRing*> arrRings;
+	{
+		lock_guard<mutex> lock(state.ringsMutex);
+		arrRings = state.arrRings;
+	}
+
+	vector<ZLogLine*> arrLines;
+	vector<uint64_t> arrHeads(arrRings.size());
+	for (size_t i = 0; i < arrRings.size(); i++) {
+		ZLogRing* pRing = arrRings[i];
+		arrHeads[i] = pRing->uHead.load(memory_order_acquire);
+		for (uint64_t t = pRing->uTail.load(memory_order_relaxed); t < arrHeads[i]; t++) {
+			arrLines.push_back(&pRing->arrLines[t % LOG_RING_SLOTS]);
+		}
+	}
+
+	sort(arrLines.begin(), arrLines.end(), [](const ZLogLine* a, const ZLogLine* b) { return a->uSeq < b->uSeq; });
+	for (ZLogLine* pLine : arrLines) {
+		EmitLine(state, *pLine);
+	}
+
+	bool bHasDetached = false;
+	for (size_t i = 0; i < arrRings.size(); i++) {
+		arrRings[i]->uTail.store(arrHeads[i], memory_order_release);
+		bHasDetached |= arrRings[i]->bDetached.load(memory_order_acquire);
+	}
+
+	if (bHasDetached) { // the owning thread is gone, nothing will be written to these rings again
+		lock_guard<mutex> lock(state.ringsMutex);
+		auto it = state.arrRings.begin();
+		while (it != state.arrRings.end()) {
+			ZLogRing* pRing = *it;
+			if (pRing->bDetached.load(memory_order_acquire) && pRing->uTail.load(memory_order_relaxed) == pRing->uHead.load(memory_order_acquire)) {
+				it = state.arrRings.erase(it);
+				delete pRing;
+			} else {
+				it++;
+			}
+		}
+	}
+}
+
+static void DrainThread()
+{
+	ZLogState& state = LogState();
+	unique_lock<mutex> lock(state.drainMutex);
+	while (true) {
+		uint64_t uCommitted = state.uCommitted.load();
+		DrainRings(state);
+		// no timeout, sleep until a producer commits a line. drainMutex stays held from setting the flag until wait
+		// releases it, so a producer that saw the flag can't notify before we are actually waiting
+		state.bDrainWaiting.store(true);
+		state.drainCond.wait(lock, [&]() { return state.uCommitted.load() != uCommitted; });
+		state.bDrainWaiting.store(false, memory_order_relaxed);
+	}
+}
+
+static ZLogRing* ThreadRing()
+{
+	if (NULL == t_RingOwner.pRing) {
+		ZLogState& state = LogState();
+		call_once(state.startFlag, [&state]() {
+			thread(DrainThread).detach();
+			atexit(ZLog::Flush);
+		});
+
+		ZLogRing* pRing = new ZLogRing();
+		pRing->uHead = 0;
+		pRing->uTail = 0;
+		pRing->bDetached = false;
+		lock_guard<mutex> lock(state.ringsMutex);
+		state.arrRings.push_back(pRing);
+		t_RingOwner.pRing = pRing;
+	}
+	return t_RingOwner.pRing;
+}
+
+static ZLogLine* ReserveLine(ZLogRing* pRing)
+{
+	uint64_t uHead = pRing->uHead.load(memory_order_relaxed);
+	while (uHead - pRing->uTail.load(memory_order_acquire) >= LOG_RING_SLOTS) {
+		ZLog::Flush(); // full, drain it from this thread instead of dropping lines
+	}
+	return &pRing->arrLines[uHead % LOG_RING_SLOTS];
+}
+
+static void CommitLine(ZLogRing* pRing, ZLogLine* pLine, uint64_t uSeq, int nColor, bool bConsole, bool bContinue)
+{
+	pLine->uSeq = uSeq;
+	pLine->uSession = t_uSession;
+	pLine->nColor = nColor;
+	pLine->bConsole = bConsole;
+	pLine->bContinue = bContinue;
+	pRing->uHead.store(pRing->uHead.load(memory_order_relaxed) + 1, memory_order_release);
+
+	// only wake the drain thread when it is parked, while it is busy it picks the line up on its next pass
+	ZLogState& state = LogState();
+	state.uCommitted.fetch_add(1);
+	if (state.bDrainWaiting.load()) {
+		{ lock_guard<mutex> lock(state.drainMutex); }
+		state.drainCond.notify_one();
+	}
+}
+
+void ZLog::_Print(const char* szLog, int nColor)
+{
+	bool bConsole = (g_nLogLevel > E_NONE);
+	if (!bConsole && 0 == t_uSession) {
+		return;
+	}
+
+	ZLogRing* pRing = ThreadRing();
+	size_t sLength = strlen(szLog);
+	size_t sChunks = max<size_t>(1, (sLength + LOG_LINE_SIZE - 2) / (LOG_LINE_SIZE - 1));
+	uint64_t uSeq = LogState().uSeq.fetch_add(sChunks, memory_order_relaxed);
+	for (size_t i = 0; i < sChunks; i++) {
+		ZLogLine* pLine = ReserveLine(pRing);
+		size_t sOffset = i * (LOG_LINE_SIZE - 1);
+		size_t sSize = min<size_t>(sLength - sOffset, LOG_LINE_SIZE - 1);
+		memcpy(pLine->szLog, szLog + sOffset, sSize);
+		pLine->szLog[sSize] = 0;
+		CommitLine(pRing, pLine, uSeq + i, nColor, bConsole, i > 0);
+	}
+}
+
+void ZLog::_PrintV(int nColor, const char* szFormat, va_list args)
+{
+	bool bConsole = (g_nLogLevel > E_NONE);
+	if (!bConsole && 0 == t_uSession) {
+		return;
+	}
+
+	ZLogRing* pRing = ThreadRing();
+	ZLogLine* pLine = ReserveLine(pRing);
+	vsnprintf(pLine->szLog, LOG_LINE_SIZE, szFormat, args);
+	CommitLine(pRing, pLine, LogState().uSeq.fetch_add(1, memory_order_relaxed), nColor, bConsole, false);
+}
+
+void ZLog::Flush()
+{
+	ZLogState& state = LogState();
+	lock_guard<mutex> lock(state.drainMutex);
+	DrainRings(state);
+}
+
+uint32_t ZLog::BeginSession(bool bAttach)
+{
+	ZLogState& state = LogState();
+	uint32_t uSession = 1 + state.uNextSession.fetch_add(1, memory_order_relaxed);
+	{
+		lock_guard<mutex> lock(state.drainMutex);
+		state.mapSessions[uSession];
+	}
+	if (bAttach) {
+		t_uSession = uSession;
+	}
+	return uSession;
+}
+
+uint32_t ZLog::SetSession(uint32_t uSession)
+{
+	uint32_t uPrevSession = t_uSession;
+	t_uSession = uSession;
+	return uPrevSession;
+}
+
+vector<string> ZLog::EndSession(uint32_t uSession)
+{
+	if (t_uSession == uSession) {
+		t_uSession = 0;
+	}
+
+	ZLogState& state = LogState();
+	lock_guard<mutex> lock(state.drainMutex);
+	DrainRings(state);
+	vector<string> arrLogs;
+	auto it = state.mapSessions.find(uSession);
+	if (it != state.mapSessions.end()) {
+		arrLogs.swap(it->second);
+		state.mapSessions.erase(it);
+	}
+	return arrLogs;
+}
+
 void ZLog::Print(int nLevel, const char* szLog)
 {
 	if (g_nLogLevel >= nLevel) {
@@ -60,8 +316,10 @@ void ZLog::Print(int nLevel, const char* szLog)
 void ZLog::PrintV(int nLevel, const char* szFormat, ...)
 {
 	if (g_nLogLevel >= nLevel) {
-		FORMAT_V(szFormat, szLog);
-		_Print(szLog);
+		va_list args;
+		va_start(args, szFormat);
+		_PrintV(0, szFormat, args);
+		va_end(args);
 	}
 }
 
@@ -73,8 +331,10 @@ bool ZLog::Error(const char* szLog)
 
 bool ZLog::ErrorV(const char* szFormat, ...)
 {
-	FORMAT_V(szFormat, szLog);
-	_Print(szLog, 12);
+	va_list args;
+	va_start(args, szFormat);
+	_PrintV(12, szFormat, args);
+	va_end(args);
 	return false;
 }
 
@@ -86,8 +346,10 @@ bool ZLog::Success(const char* szLog)
 
 bool ZLog::SuccessV(const char* szFormat, ...)
 {
-	FORMAT_V(szFormat, szLog);
-	_Print(szLog, 10);
+	va_list args;
+	va_start(args, szFormat);
+	_PrintV(10, szFormat, args);
+	va_end(args);
 	return true;
 }
 
@@ -98,8 +360,11 @@ bool ZLog::PrintResult(bool bSuccess, const char* szLog)
 
 bool ZLog::PrintResultV(bool bSuccess, const char* szFormat, ...)
 {
-	FORMAT_V(szFormat, szLog);
-	return bSuccess ? Success(szLog) : Error(szLog);
+	va_list args;
+	va_start(args, szFormat);
+	_PrintV(bSuccess ? 10 : 12, szFormat, args);
+	va_end(args);
+	return bSuccess;
 }
 
 bool ZLog::Warn(const char* szLog)
@@ -110,8 +375,10 @@ bool ZLog::Warn(const char* szLog)
 
 bool ZLog::WarnV(const char* szFormat, ...)
 {
-	FORMAT_V(szFormat, szLog);
-	_Print(szLog, 6);
+	va_list args;
+	va_start(args, szFormat);
+	_PrintV(6, szFormat, args);
+	va_end(args);
 	return false;
 }
 
@@ -125,8 +392,10 @@ void ZLog::Print(const char* szLog)
 void ZLog::PrintV(const char* szFormat, ...)
 {
 	if (g_nLogLevel >= E_INFO) {
-		FORMAT_V(szFormat, szLog);
-		_Print(szLog);
+		va_list args;
+		va_start(args, szFormat);
+		_PrintV(0, szFormat, args);
+		va_end(args);
 	}
 }
 
@@ -140,24 +409,9 @@ void ZLog::Debug(const char* szLog)
 void ZLog::DebugV(const char* szFormat, ...)
 {
 	if (g_nLogLevel >= E_DEBUG) {
-		FORMAT_V(szFormat, szLog);
-		_Print(szLog);
+		va_list args;
+		va_start(args, szFormat);
+		_PrintV(0, szFormat, args);
+		va_end(args);
 	}
 }
-
-vector<string> ZLog::logs;
-
-void ZLog::writeToLogFile(const std::string& message) {
-//    const char* documentsPath = getDocumentsDirectory();
-//    std::string logFilePath = std::string(documentsPath) + "/logs.txt";
-//
-//    std::ofstream logFile(logFilePath, std::ios_base::app);
-//    if (logFile.is_open()) {
-//        logFile << message;
-//        logFile.close();
-//    } else {
-//        std::cerr << "Failed to open log file: " << logFilePath << std::endl;
-//    }
-
-    logs.push_back(message);
-}
@@ -30,10 +30,17 @@ public:
 	static void Print(int nLevel, const char* szLog);
 	static void PrintV(int nLevel, const char* szFormat, ...);
 	static void SetLogLever(int nLogLevel) { g_nLogLevel = nLogLevel; }
-    static vector<std::string> logs;
+
+public:
+	// Lines logged by a thread attached to a session are also captured for it, e.g. to build an error for one sign.
+	// BeginSession attaches the calling thread by default, EndSession flushes, detaches and returns the captured lines.
+	static uint32_t BeginSession(bool bAttach = true);
+	static uint32_t SetSession(uint32_t uSession); // returns the previous session of this thread, 0 = none
+	static vector<string> EndSession(uint32_t uSession);
+	static void Flush();
 
 private:
 	static void _Print(const char* szLog, int nColor = 0);
-    static void writeToLogFile(const std::string& message);
+	static void _PrintV(int nColor, const char* szFormat, va_list args);
 	static int g_nLogLevel;
 };
@@ -0,0 +1,385 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * Load-command index of a single Mach-O slice, shared by ZSign and LiveContainer.
+ * macho_view_init() walks the load commands once; every query after that is O(1).
+ * Callers with a single question about a header use macho_view_find_command() instead, it stops at the first match.
+ * Segments and dylibs past the MACHO_VIEW_MAX_* limits are not indexed and set truncated, __TEXT and __LINKEDIT
+ * are always kept and macho_view_next_dylib() walks the load commands again in that case.
+ * Include the Mach-O definitions first (ZSign "mach-o.h" or <mach-o/loader.h>).
+ * Offsets are relative to the start of the slice, values are host byte order.
+ */
+
+#define MACHO_VIEW_MAX_SEGMENTS		32
+#define MACHO_VIEW_MAX_DYLIBS		256
+
+/* dylib_command shaped placeholders LiveContainer parks unused load commands under */
+#define MACHO_VIEW_CMD_DISABLED_DYLIB		0x114514
+#define MACHO_VIEW_CMD_DUPLICATED_DYLIB		0x114515
+
+typedef struct macho_view_segment {
+	char		segname[17];
+	uint32_t	cmdoff;
+	uint32_t	nsects;
+	uint32_t	sectoff;
+	uint64_t	vmaddr;
+	uint64_t	vmsize;
+	uint64_t	fileoff;
+	uint64_t	filesize;
+} macho_view_segment;
+
+typedef struct macho_view_section {
+	uint32_t	cmdoff;		/* offset of the section(_64) struct, 0 if absent */
+	uint32_t	offset;
+	uint64_t	size;
+} macho_view_section;
+
+typedef struct macho_view {
+	uint8_t*	base;
+	uint64_t	length;		/* 0 if unknown */
+	uint32_t	magic;
+	uint32_t	cputype;
+	uint32_t	cpusubtype;
+	uint32_t	filetype;
+	uint32_t	ncmds;
+	uint32_t	sizeofcmds;
+	uint32_t	flags;
+	uint32_t	headersize;
+	uint32_t	cmdsend;	/* end of the last load command */
+	bool		is64bit;
+	bool		bigendian;
+
+	bool				truncated;
+	uint32_t			nsegments;
+	macho_view_segment	segments[MACHO_VIEW_MAX_SEGMENTS];
+	macho_view_segment	textsegment;		/* cmdoff is 0 if absent */
+	macho_view_segment	linkeditsegment;
+	macho_view_section	textsection;		/* __TEXT,__text */
+	macho_view_section	infoplistsection;	/* __TEXT,__info_plist */
+
+	uint32_t	ndylibs;	/* LC_LOAD_*, LC_REEXPORT, LC_LAZY_LOAD and LiveContainer placeholders */
+	uint32_t	dylibs[MACHO_VIEW_MAX_DYLIBS];
+	uint32_t	iddylib;	/* command offsets below are 0 if absent */
+	uint32_t	dylinker;
+	uint32_t	uuid;
+	uint32_t	encryption;
+	uint32_t	cryptid;
+	uint32_t	codesignature;
+	uint32_t	codesigdataoff;
+	uint32_t	codesigdatasize;
+} macho_view;
+
+static inline uint32_t macho_view_bo(const macho_view* pView, uint32_t uValue)
+{
+	return pView->bigendian ? __builtin_bswap32(uValue) : uValue;
+}
+
+static inline uint64_t macho_view_bo64(const macho_view* pView, uint64_t uValue)
+{
+	return pView->bigendian ? __builtin_bswap64(uValue) : uValue;
+}
+
+static inline void macho_view_index_sections(macho_view* pView, const macho_view_segment* pSeg)
+{
+	uint64_t uSectSize = pView->is64bit ? sizeof(struct section_64) : sizeof(struct section);
+	for (uint32_t j = 0; j < pSeg->nsects; j++) {
+		uint64_t uSectEnd = pSeg->sectoff + uSectSize * (j + 1);
+		if (uSectEnd > pView->cmdsend) {
+			break;
+		}
+		uint32_t uSectOff = (uint32_t)(uSectEnd - uSectSize);
+		const char* szSectName = (const char*)pView->base + uSectOff;
+		macho_view_section* pSect = NULL;
+		if (0 == strncmp("__text", szSectName, 16)) {
+			pSect = &pView->textsection;
+		} else if (0 == strncmp("__info_plist", szSectName, 16)) {
+			pSect = &pView->infoplistsection;
+		}
+		if (NULL == pSect) {
+			continue;
+		}
+		pSect->cmdoff = uSectOff;
+		if (pView->is64bit) {
+			struct section_64* sect = (struct section_64*)(pView->base + uSectOff);
+			pSect->offset = macho_view_bo(pView, sect->offset);
+			pSect->size = macho_view_bo64(pView, sect->size);
+		} else {
+			struct section* sect = (struct section*)(pView->base + uSectOff);
+			pSect->offset = macho_view_bo(pView, sect->offset);
+			pSect->size = macho_view_bo(pView, sect->size);
+		}
+	}
+}
+
+static inline void macho_view_index_segment(macho_view* pView, uint32_t uCmdOff)
+{
+	macho_view_segment seg;
+	memset(&seg, 0, sizeof(macho_view_segment));
+	seg.cmdoff = uCmdOff;
+	if (pView->is64bit) {
+		struct segment_command_64* seglc = (struct segment_command_64*)(pView->base + uCmdOff);
+		memcpy(seg.segname, seglc->segname, 16);
+		seg.nsects = macho_view_bo(pView, seglc->nsects);
+		seg.sectoff = uCmdOff + sizeof(struct segment_command_64);
+		seg.vmaddr = macho_view_bo64(pView, seglc->vmaddr);
+		seg.vmsize = macho_view_bo64(pView, seglc->vmsize);
+		seg.fileoff = macho_view_bo64(pView, seglc->fileoff);
+		seg.filesize = macho_view_bo64(pView, seglc->filesize);
+	} else {
+		struct segment_command* seglc = (struct segment_command*)(pView->base + uCmdOff);
+		memcpy(seg.segname, seglc->segname, 16);
+		seg.nsects = macho_view_bo(pView, seglc->nsects);
+		seg.sectoff = uCmdOff + sizeof(struct segment_command);
+		seg.vmaddr = macho_view_bo(pView, seglc->vmaddr);
+		seg.vmsize = macho_view_bo(pView, seglc->vmsize);
+		seg.fileoff = macho_view_bo(pView, seglc->fileoff);
+		seg.filesize = macho_view_bo(pView, seglc->filesize);
+	}
+
+	if (0 == strcmp("__TEXT", seg.segname)) {
+		pView->textsegment = seg;
+		macho_view_index_sections(pView, &seg);
+	} else if (0 == strcmp("__LINKEDIT", seg.segname)) {
+		pView->linkeditsegment = seg;
+	}
+	if (pView->nsegments < MACHO_VIEW_MAX_SEGMENTS) {
+		pView->segments[pView->nsegments++] = seg;
+	} else {
+		pView->truncated = true;
+	}
+}
+
+/* Smallest cmdsize a command can have before its fixed fields are read, sizeof(struct load_command) for the rest.
+ * ZSign's mach-o.h and <mach-o/loader.h> name some of these structs differently, those are spelled out. */
+static inline uint32_t macho_view_command_min_size(uint32_t uCmd, bool b64Bit)
+{
+	switch (uCmd) {
+	case LC_SEGMENT:
+		return sizeof(struct segment_command);
+	case LC_SEGMENT_64:
+		return sizeof(struct segment_command_64);
+	case LC_ID_DYLIB:
+	case LC_LOAD_DYLIB:
+	case LC_LOAD_WEAK_DYLIB:
+	case LC_REEXPORT_DYLIB:
+	case LC_LAZY_LOAD_DYLIB:
+	case LC_LOAD_UPWARD_DYLIB:
+	case MACHO_VIEW_CMD_DISABLED_DYLIB:
+	case MACHO_VIEW_CMD_DUPLICATED_DYLIB:
+		return sizeof(struct dylib_command);
+	case LC_LOAD_DYLINKER:
+		return sizeof(struct load_command) + sizeof(uint32_t); /* name offset */
+	case LC_UUID:
+		return sizeof(struct uuid_command);
+	case LC_ENCRYPTION_INFO:
+		return sizeof(struct encryption_info_command);
+	case LC_ENCRYPTION_INFO_64:
+		return b64Bit ? sizeof(struct encryption_info_command_64) : sizeof(struct encryption_info_command);
+	case LC_CODE_SIGNATURE:
+		return sizeof(struct load_command) + 2 * sizeof(uint32_t); /* dataoff, datasize */
+	}
+	return sizeof(struct load_command);
+}
+
+static inline bool macho_view_is_dylib_command(uint32_t uCmd)
+{
+	switch (uCmd) {
+	case LC_LOAD_DYLIB:
+	case LC_LOAD_WEAK_DYLIB:
+	case LC_REEXPORT_DYLIB:
+	case LC_LAZY_LOAD_DYLIB:
+	case LC_LOAD_UPWARD_DYLIB:
+	case MACHO_VIEW_CMD_DISABLED_DYLIB:
+		return true;
+	}
+	return false;
+}
+
+/* Returns false if pBase is not a thin Mach-O or its load commands are truncated. */
+static inline bool macho_view_init(macho_view* pView, void* pBase, uint64_t uLength)
+{
+	memset(pView, 0, sizeof(macho_view));
+	if (NULL == pBase || (uLength > 0 && uLength < sizeof(struct mach_header))) {
+		return false;
+	}
+
+	pView->base = (uint8_t*)pBase;
+	pView->length = uLength;
+	struct mach_header* pHeader = (struct mach_header*)pBase;
+	pView->magic = pHeader->magic;
+	if (MH_MAGIC != pView->magic && MH_CIGAM != pView->magic && MH_MAGIC_64 != pView->magic && MH_CIGAM_64 != pView->magic) {
+		return false;
+	}
+	pView->is64bit = (MH_MAGIC_64 == pView->magic || MH_CIGAM_64 == pView->magic);
+	pView->bigendian = (MH_CIGAM == pView->magic || MH_CIGAM_64 == pView->magic);
+	pView->headersize = pView->is64bit ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+	pView->cputype = macho_view_bo(pView, (uint32_t)pHeader->cputype);
+	pView->cpusubtype = macho_view_bo(pView, (uint32_t)pHeader->cpusubtype);
+	pView->filetype = macho_view_bo(pView, pHeader->filetype);
+	pView->ncmds = macho_view_bo(pView, pHeader->ncmds);
+	pView->sizeofcmds = macho_view_bo(pView, pHeader->sizeofcmds);
+	pView->flags = macho_view_bo(pView, pHeader->flags);
+	/* the header is untrusted, every bound below is compared in 64-bit or by subtraction so it can't wrap */
+	uint64_t uCmdsEnd = (uint64_t)pView->headersize + pView->sizeofcmds;
+	if (uCmdsEnd > UINT32_MAX || (uLength > 0 && uCmdsEnd > uLength)) {
+		return false;
+	}
+	pView->cmdsend = (uint32_t)uCmdsEnd;
+
+	uint32_t uCmdOff = pView->headersize;
+	for (uint32_t i = 0; i < pView->ncmds; i++) {
+		if (pView->cmdsend - uCmdOff < sizeof(struct load_command)) {
+			return false;
+		}
+		struct load_command* plc = (struct load_command*)(pView->base + uCmdOff);
+		uint32_t uCmd = macho_view_bo(pView, plc->cmd);
+		uint32_t uCmdSize = macho_view_bo(pView, plc->cmdsize);
+		if (uCmdSize < macho_view_command_min_size(uCmd, pView->is64bit) || uCmdSize > pView->cmdsend - uCmdOff) {
+			return false;
+		}
+		if (LC_ID_DYLIB == uCmd || macho_view_is_dylib_command(uCmd)) {
+			/* callers read the path at name.offset, it has to start inside the command */
+			uint32_t uNameOff = macho_view_bo(pView, ((struct dylib_command*)plc)->dylib.name.offset);
+			if (uNameOff < sizeof(struct dylib_command) || uNameOff >= uCmdSize) {
+				return false;
+			}
+		}
+
+		switch (uCmd) {
+		case LC_SEGMENT:
+		case LC_SEGMENT_64:
+			macho_view_index_segment(pView, uCmdOff);
+			break;
+		case LC_ID_DYLIB:
+			pView->iddylib = uCmdOff;
+			break;
+		case LC_LOAD_DYLINKER:
+			pView->dylinker = uCmdOff;
+			break;
+		case LC_UUID:
+			if (0 == pView->uuid) {
+				pView->uuid = uCmdOff;
+			}
+			break;
+		case LC_ENCRYPTION_INFO:
+		case LC_ENCRYPTION_INFO_64:
+			if (0 == pView->encryption) {
+				pView->encryption = uCmdOff;
+				pView->cryptid = macho_view_bo(pView, ((struct encryption_info_command*)plc)->cryptid);
+			}
+			break;
+		case LC_CODE_SIGNATURE:
+			if (0 == pView->codesignature) {
+				uint32_t* pData = (uint32_t*)(plc + 1);
+				pView->codesignature = uCmdOff;
+				pView->codesigdataoff = macho_view_bo(pView, pData[0]);
+				pView->codesigdatasize = macho_view_bo(pView, pData[1]);
+			}
+			break;
+		}
+		if (macho_view_is_dylib_command(uCmd)) {
+			if (pView->ndylibs < MACHO_VIEW_MAX_DYLIBS) {
+				pView->dylibs[pView->ndylibs++] = uCmdOff;
+			} else {
+				pView->truncated = true;
+			}
+		}
+		uCmdOff += uCmdSize;
+	}
+	return true;
+}
+
+/*
+ * Iterates the dylib commands, start with *pCursor = 0. Returns the command offset, 0 after the last one.
+ * Comes from the index unless it was truncated, then the load commands are walked again from the header.
+ */
+static inline uint32_t macho_view_next_dylib(const macho_view* pView, uint32_t* pCursor)
+{
+	if (!pView->truncated) {
+		return (*pCursor < pView->ndylibs) ? pView->dylibs[(*pCursor)++] : 0;
+	}
+	uint32_t uCmdOff = (0 == *pCursor) ? pView->headersize : *pCursor;
+	while (uCmdOff <= pView->cmdsend && pView->cmdsend - uCmdOff >= sizeof(struct load_command)) {
+		struct load_command* plc = (struct load_command*)(pView->base + uCmdOff);
+		uint32_t uCmdSize = macho_view_bo(pView, plc->cmdsize);
+		if (uCmdSize < sizeof(struct load_command) || uCmdSize > pView->cmdsend - uCmdOff) {
+			break;
+		}
+		*pCursor = uCmdOff + uCmdSize;
+		if (macho_view_is_dylib_command(macho_view_bo(pView, plc->cmd))) {
+			return uCmdOff;
+		}
+		uCmdOff += uCmdSize;
+	}
+	*pCursor = pView->cmdsend;
+	return 0;
+}
+
+/*
+ * First load command of type uCmd, walking only as far as it has to. NULL if pBase is not a thin Mach-O, the load
+ * commands end before one is found, or the match is smaller than its fixed fields. Either byte order is accepted, the
+ * fields of the returned command are left in the byte order of the file.
+ */
+static inline void* macho_view_find_command(void* pBase, uint32_t uCmd)
+{
+	struct mach_header* pHeader = (struct mach_header*)pBase;
+	if (NULL == pBase || (MH_MAGIC != pHeader->magic && MH_CIGAM != pHeader->magic && MH_MAGIC_64 != pHeader->magic && MH_CIGAM_64 != pHeader->magic)) {
+		return NULL;
+	}
+	macho_view view; /* only the fields macho_view_bo reads */
+	view.bigendian = (MH_CIGAM == pHeader->magic || MH_CIGAM_64 == pHeader->magic);
+	bool b64Bit = (MH_MAGIC_64 == pHeader->magic || MH_CIGAM_64 == pHeader->magic);
+	uint32_t uHeaderSize = b64Bit ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+	uint64_t uCmdsEnd = (uint64_t)uHeaderSize + macho_view_bo(&view, pHeader->sizeofcmds);
+	uint32_t nCmds = macho_view_bo(&view, pHeader->ncmds);
+	uint64_t uCmdOff = uHeaderSize;
+	for (uint32_t i = 0; i < nCmds && uCmdOff + sizeof(struct load_command) <= uCmdsEnd; i++) {
+		struct load_command* plc = (struct load_command*)((uint8_t*)pBase + uCmdOff);
+		uint32_t uCmdSize = macho_view_bo(&view, plc->cmdsize);
+		if (uCmdSize < sizeof(struct load_command) || uCmdOff + uCmdSize > uCmdsEnd) {
+			break;
+		}
+		if (macho_view_bo(&view, plc->cmd) == uCmd) {
+			return (uCmdSize >= macho_view_command_min_size(uCmd, b64Bit)) ? plc : NULL;
+		}
+		uCmdOff += uCmdSize;
+	}
+	return NULL;
+}
+
+static inline void* macho_view_ptr(const macho_view* pView, uint32_t uOffset)
+{
+	return uOffset ? pView->base + uOffset : NULL;
+}
+
+static inline const uint8_t* macho_view_uuid(const macho_view* pView)
+{
+	return pView->uuid ? pView->base + pView->uuid + sizeof(struct load_command) : NULL;
+}
+
+static inline bool macho_view_is_encrypted(const macho_view* pView)
+{
+	return pView->encryption && pView->cryptid != 0;
+}
+
+/* Free bytes between the end of the load commands and __TEXT,__text */
+static inline uint32_t macho_view_free_space(const macho_view* pView)
+{
+	if (pView->textsection.offset > pView->cmdsend) {
+		return pView->textsection.offset - pView->cmdsend;
+	}
+	return 0;
+}
+
+static inline const macho_view_segment* macho_view_text_segment(const macho_view* pView)
+{
+	return pView->textsegment.cmdoff ? &pView->textsegment : NULL;
+}
+
+static inline const macho_view_segment* macho_view_linkedit_segment(const macho_view* pView)
+{
+	return pView->linkeditsegment.cmdoff ? &pView->linkeditsegment : NULL;
+}
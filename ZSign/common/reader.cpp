@@ -0,0 +1,433 @@
+#include "reader.h"
+#include <atomic>
+#include <thread>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define ZSIGN_URING 1
+#endif
+
+#define READER_CHUNK_SIZE		(128 * 1024)
+#define READER_FILES_IN_FLIGHT	32
+#define READER_FILES_PER_THREAD	16	// fewer files than this per worker aren't worth another thread
+
+struct ZReadJob
+{
+	const vector<string>*	pFiles;
+	read_chunk_callback*	pCallback;
+	atomic<size_t>			uNext;
+};
+
+static uint8_t* AllocChunk()
+{
+	void* pBuffer = NULL;
+#ifdef _WIN32
+	pBuffer = _aligned_malloc(READER_CHUNK_SIZE, 4096);
+#else
+	if (0 != posix_memalign(&pBuffer, 4096, READER_CHUNK_SIZE)) {
+		pBuffer = NULL;
+	}
+#endif
+	return (uint8_t*)pBuffer;
+}
+
+static void FreeChunk(uint8_t* pBuffer)
+{
+#ifdef _WIN32
+	_aligned_free(pBuffer);
+#else
+	free(pBuffer);
+#endif
+}
+
+static void PReadWorker(ZReadJob* pJob)
+{
+	uint8_t* pBuffer = AllocChunk();
+	if (NULL == pBuffer) {
+		return;
+	}
+
+	const vector<string>& arrFiles = *pJob->pFiles;
+	read_chunk_callback& callback = *pJob->pCallback;
+	while (true) {
+		size_t uIndex = pJob->uNext.fetch_add(1);
+		if (uIndex >= arrFiles.size()) {
+			break;
+		}
+
+#ifdef _WIN32
+		FILE* fp = NULL;
+		_fopen64(fp, arrFiles[uIndex].c_str(), "rb");
+		if (NULL == fp) {
+			callback(uIndex, NULL, 0, true, false);
+			continue;
+		}
+		while (true) {
+			size_t sRead = fread(pBuffer, 1, READER_CHUNK_SIZE, fp);
+			bool bLast = (sRead < READER_CHUNK_SIZE);
+			callback(uIndex, pBuffer, sRead, bLast, bLast ? (0 == ferror(fp)) : true);
+			if (bLast) {
+				break;
+			}
+		}
+		fclose(fp);
+#else
+		int fd = open(arrFiles[uIndex].c_str(), O_RDONLY);
+		if (fd < 0) {
+			callback(uIndex, NULL, 0, true, false);
+			continue;
+		}
+		off_t uOffset = 0;
+		while (true) {
+			ssize_t nRead = pread(fd, pBuffer, READER_CHUNK_SIZE, uOffset);
+			if (nRead < 0 && EINTR == errno) {
+				continue;
+			}
+			// a short read of a regular file is its end, that saves the extra read returning 0
+			bool bLast = (nRead < READER_CHUNK_SIZE);
+			callback(uIndex, pBuffer, (nRead > 0) ? (size_t)nRead : 0, bLast, nRead >= 0);
+			if (bLast) {
+				break;
+			}
+			uOffset += nRead;
+		}
+		close(fd);
+#endif
+	}
+
+	FreeChunk(pBuffer);
+}
+
+#ifdef ZSIGN_URING
+
+// Just enough of io_uring for openat and read, without liburing.
+class ZUring
+{
+public:
+	ZUring()
+	{
+		m_fd = -1;
+		m_pSQ = MAP_FAILED;
+		m_pCQ = MAP_FAILED;
+		m_pSQEs = (io_uring_sqe*)MAP_FAILED;
+		m_uToSubmit = 0;
+	}
+
+	~ZUring()
+	{
+		if (MAP_FAILED != (void*)m_pSQEs) {
+			munmap(m_pSQEs, m_sSQEsSize);
+		}
+		if (MAP_FAILED != m_pCQ && m_pCQ != m_pSQ) {
+			munmap(m_pCQ, m_sCQSize);
+		}
+		if (MAP_FAILED != m_pSQ) {
+			munmap(m_pSQ, m_sSQSize);
+		}
+		if (m_fd >= 0) {
+			close(m_fd);
+		}
+	}
+
+	bool Init(uint32_t uEntries)
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		m_fd = (int)syscall(__NR_io_uring_setup, uEntries, &params);
+		if (m_fd < 0) {
+			return false;
+		}
+
+		m_sSQSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		m_sCQSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool bSingleMap = (0 != (params.features & IORING_FEAT_SINGLE_MMAP));
+		if (bSingleMap) {
+			m_sSQSize = m_sCQSize = max(m_sSQSize, m_sCQSize);
+		}
+
+		m_pSQ = mmap(NULL, m_sSQSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+		if (MAP_FAILED == m_pSQ) {
+			return false;
+		}
+		m_pCQ = bSingleMap ? m_pSQ : mmap(NULL, m_sCQSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+		if (MAP_FAILED == m_pCQ) {
+			return false;
+		}
+		m_sSQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+		m_pSQEs = (io_uring_sqe*)mmap(NULL, m_sSQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+		if (MAP_FAILED == (void*)m_pSQEs) {
+			return false;
+		}
+
+		uint8_t* pSQ = (uint8_t*)m_pSQ;
+		uint8_t* pCQ = (uint8_t*)m_pCQ;
+		m_pSQHead = (uint32_t*)(pSQ + params.sq_off.head);
+		m_pSQTail = (uint32_t*)(pSQ + params.sq_off.tail);
+		m_uSQMask = *(uint32_t*)(pSQ + params.sq_off.ring_mask);
+		m_uSQEntries = params.sq_entries;
+		m_pSQArray = (uint32_t*)(pSQ + params.sq_off.array);
+		m_pCQHead = (uint32_t*)(pCQ + params.cq_off.head);
+		m_pCQTail = (uint32_t*)(pCQ + params.cq_off.tail);
+		m_uCQMask = *(uint32_t*)(pCQ + params.cq_off.ring_mask);
+		m_pCQEs = (io_uring_cqe*)(pCQ + params.cq_off.cqes);
+		return true;
+	}
+
+	bool Supports(const vector<uint8_t>& arrOps)
+	{
+		size_t sSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+		vector<uint8_t> arrProbe(sSize, 0);
+		io_uring_probe* pProbe = (io_uring_probe*)arrProbe.data();
+		if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, pProbe, 256) < 0) {
+			return false;
+		}
+		for (uint8_t uOp : arrOps) {
+			if (uOp > pProbe->last_op || 0 == (pProbe->ops[uOp].flags & IO_URING_OP_SUPPORTED)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// NULL when the submission queue is full, Submit then makes room
+	io_uring_sqe* GetSQE()
+	{
+		uint32_t uTail = *m_pSQTail + m_uToSubmit;
+		if (uTail - __atomic_load_n(m_pSQHead, __ATOMIC_ACQUIRE) >= m_uSQEntries) {
+			return NULL;
+		}
+		uint32_t uIndex = uTail & m_uSQMask;
+		m_pSQArray[uIndex] = uIndex;
+		m_uToSubmit++;
+		io_uring_sqe* pSQE = &m_pSQEs[uIndex];
+		memset(pSQE, 0, sizeof(io_uring_sqe));
+		return pSQE;
+	}
+
+	bool Submit(uint32_t uWait)
+	{
+		__atomic_store_n(m_pSQTail, *m_pSQTail + m_uToSubmit, __ATOMIC_RELEASE);
+		uint32_t uToSubmit = m_uToSubmit;
+		m_uToSubmit = 0;
+		while (true) {
+			int nRet = (int)syscall(__NR_io_uring_enter, m_fd, uToSubmit, uWait, (uWait > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+			if (nRet >= 0 || EINTR != errno) {
+				return (nRet >= 0);
+			}
+		}
+	}
+
+	template <typename F>
+	uint32_t Reap(F handler)
+	{
+		uint32_t uHead = *m_pCQHead;
+		uint32_t uTail = __atomic_load_n(m_pCQTail, __ATOMIC_ACQUIRE);
+		uint32_t uCount = 0;
+		for (; uHead != uTail; uHead++, uCount++) {
+			io_uring_cqe cqe = m_pCQEs[uHead & m_uCQMask];
+			__atomic_store_n(m_pCQHead, uHead + 1, __ATOMIC_RELEASE);
+			handler(cqe.user_data, cqe.res);
+		}
+		return uCount;
+	}
+
+private:
+	int				m_fd;
+	void*			m_pSQ;
+	void*			m_pCQ;
+	size_t			m_sSQSize;
+	size_t			m_sCQSize;
+	size_t			m_sSQEsSize;
+	io_uring_sqe*	m_pSQEs;
+	io_uring_cqe*	m_pCQEs;
+	uint32_t*		m_pSQHead;
+	uint32_t*		m_pSQTail;
+	uint32_t*		m_pSQArray;
+	uint32_t		m_uSQMask;
+	uint32_t		m_uSQEntries;
+	uint32_t*		m_pCQHead;
+	uint32_t*		m_pCQTail;
+	uint32_t		m_uCQMask;
+	uint32_t		m_uToSubmit;
+};
+
+struct ZUringSlot
+{
+	size_t		uIndex;
+	int			fd;
+	uint64_t	uOffset;
+	uint8_t*	pBuffer;
+	bool		bBusy;
+};
+
+#define URING_OP_OPEN	0
+#define URING_OP_READ	1
+
+static bool UringWorker(ZReadJob* pJob)
+{
+	ZUring ring;
+	if (!ring.Init(READER_FILES_IN_FLIGHT * 2)) {
+		return false;
+	}
+
+	vector<ZUringSlot> arrSlots(READER_FILES_IN_FLIGHT);
+	for (ZUringSlot& slot : arrSlots) {
+		slot.bBusy = false;
+		slot.pBuffer = AllocChunk();
+		if (NULL == slot.pBuffer) {
+			for (ZUringSlot& allocated : arrSlots) {
+				FreeChunk(allocated.pBuffer);
+				allocated.pBuffer = NULL;
+			}
+			return false;
+		}
+	}
+
+	const vector<string>& arrFiles = *pJob->pFiles;
+	read_chunk_callback& callback = *pJob->pCallback;
+	auto queueRead = [&](uint32_t uSlot) {
+		ZUringSlot& slot = arrSlots[uSlot];
+		io_uring_sqe* pSQE = ring.GetSQE();
+		pSQE->opcode = IORING_OP_READ;
+		pSQE->fd = slot.fd;
+		pSQE->addr = (uint64_t)(uintptr_t)slot.pBuffer;
+		pSQE->len = READER_CHUNK_SIZE;
+		pSQE->off = slot.uOffset;
+		pSQE->user_data = ((uint64_t)uSlot << 1) | URING_OP_READ;
+	};
+
+	// each slot holds one file at a time and has at most one request in flight, so the ring never overflows
+	bool bFilesLeft = true;
+	uint32_t uBusy = 0;
+	while (true) {
+		for (uint32_t i = 0; bFilesLeft && i < arrSlots.size(); i++) {
+			ZUringSlot& slot = arrSlots[i];
+			if (slot.bBusy) {
+				continue;
+			}
+			size_t uIndex = pJob->uNext.fetch_add(1);
+			if (uIndex >= arrFiles.size()) {
+				bFilesLeft = false;
+				break;
+			}
+			slot.uIndex = uIndex;
+			slot.fd = -1;
+			slot.uOffset = 0;
+			slot.bBusy = true;
+			uBusy++;
+
+			io_uring_sqe* pSQE = ring.GetSQE();
+			pSQE->opcode = IORING_OP_OPENAT;
+			pSQE->fd = AT_FDCWD;
+			pSQE->addr = (uint64_t)(uintptr_t)arrFiles[uIndex].c_str();
+			pSQE->open_flags = O_RDONLY | O_CLOEXEC;
+			pSQE->user_data = ((uint64_t)i << 1) | URING_OP_OPEN;
+		}
+
+		if (0 == uBusy) {
+			break;
+		}
+		if (!ring.Submit(1)) {
+			break;
+		}
+
+		ring.Reap([&](uint64_t uUserData, int nResult) {
+			uint32_t uSlot = (uint32_t)(uUserData >> 1);
+			ZUringSlot& slot = arrSlots[uSlot];
+			bool bDone = false;
+			if (URING_OP_OPEN == (uUserData & 1)) {
+				if (nResult < 0) {
+					callback(slot.uIndex, NULL, 0, true, false);
+					bDone = true;
+				} else {
+					slot.fd = nResult;
+					queueRead(uSlot);
+				}
+			} else {
+				bool bLast = (nResult < READER_CHUNK_SIZE);
+				callback(slot.uIndex, slot.pBuffer, (nResult > 0) ? (size_t)nResult : 0, bLast, nResult >= 0);
+				if (bLast) {
+					bDone = true;
+				} else {
+					slot.uOffset += nResult;
+					queueRead(uSlot);
+				}
+			}
+
+			if (bDone) {
+				if (slot.fd >= 0) {
+					close(slot.fd);
+				}
+				slot.bBusy = false;
+				uBusy--;
+			}
+		});
+	}
+
+	for (ZUringSlot& slot : arrSlots) {
+		if (slot.bBusy && slot.fd >= 0) {
+			close(slot.fd);
+		}
+		FreeChunk(slot.pBuffer);
+	}
+	return (0 == uBusy);
+}
+
+#endif
+
+bool ZBatchReader::IsUringAvailable()
+{
+#ifdef ZSIGN_URING
+	static int s_nAvailable = -1;
+	if (s_nAvailable < 0) {
+		ZUring ring;
+		s_nAvailable = (ring.Init(4) && ring.Supports({ IORING_OP_OPENAT, IORING_OP_READ })) ? 1 : 0;
+	}
+	return (1 == s_nAvailable);
+#else
+	return false;
+#endif
+}
+
+bool ZBatchReader::ReadFiles(const vector<string>& arrFiles, read_chunk_callback callback, uint32_t uThreads, int nBackend)
+{
+	if (arrFiles.empty()) {
+		return true;
+	}
+
+	if (0 == uThreads) {
+		uThreads = max(1u, thread::hardware_concurrency());
+	}
+	uThreads = (uint32_t)min<size_t>(uThreads, (arrFiles.size() + READER_FILES_PER_THREAD - 1) / READER_FILES_PER_THREAD);
+	uThreads = max(1u, uThreads);
+
+	bool bUring = (E_BACKEND_PREAD != nBackend) && IsUringAvailable();
+	if (E_BACKEND_URING == nBackend && !bUring) {
+		return ZLog::Error(">>> io_uring is not available!\n");
+	}
+
+	ZReadJob job;
+	job.pFiles = &arrFiles;
+	job.pCallback = &callback;
+	job.uNext = 0;
+
+	auto worker = [&job, bUring]() {
+#ifdef ZSIGN_URING
+		if (bUring && UringWorker(&job)) {
+			return;
+		}
+#endif
+		PReadWorker(&job); // also picks up whatever a failed ring left unclaimed
+	};
+
+	vector<thread> arrThreads;
+	for (uint32_t i = 1; i < uThreads; i++) {
+		arrThreads.emplace_back(worker);
+	}
+	worker();
+	for (thread& t : arrThreads) {
+		t.join();
+	}
+	return true;
+}
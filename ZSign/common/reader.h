@@ -0,0 +1,22 @@
+#pragma once
+#include "common.h"
+
+// Reads many files at once for hashing. Every worker keeps a few files in flight and streams their content
+// through recycled page aligned buffers, on Linux with batched io_uring opens and reads, elsewhere with plain reads.
+// Chunks of one file arrive in order on one thread, different files may be delivered concurrently.
+typedef function<void (size_t uIndex, const uint8_t* pData, size_t sSize, bool bLast, bool bOK)> read_chunk_callback;
+
+class ZBatchReader
+{
+public:
+	enum eBackend
+	{
+		E_BACKEND_AUTO = 0,
+		E_BACKEND_URING = 1,
+		E_BACKEND_PREAD = 2
+	};
+
+public:
+	static bool ReadFiles(const vector<string>& arrFiles, read_chunk_callback callback, uint32_t uThreads = 0, int nBackend = E_BACKEND_AUTO);
+	static bool IsUringAvailable();
+};
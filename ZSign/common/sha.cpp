@@ -1,7 +1,10 @@
 #include "sha.h"
 #include "base64.h"
+#include "reader.h"
 #include <openssl/sha.h>
 
+#define SHA_FILE_WINDOW_SIZE	(64 * 1024 * 1024)
+
 bool ZSHA::SHA1(uint8_t* data, size_t size, string& strOutput)
 {
 	strOutput.clear();
@@ -58,13 +61,33 @@ bool ZSHA::SHAFile(const char* szFile, string& strSHA1, string& strSHA256)
 	strSHA1.clear();
 	strSHA256.clear();
 	size_t sSize = 0;
-	uint8_t* pBase = (uint8_t*)ZFile::MapFile(szFile, 0, 0, &sSize, true);
+	uint8_t* pBase = (uint8_t*)ZFile::MapFileCached(szFile, &sSize);
+	if (NULL == pBase && sSize > 0) { // too large for the cache, hash it a window at a time
+		SHA_CTX ctx1;
+		SHA256_CTX ctx256;
+		SHA1_Init(&ctx1);
+		SHA256_Init(&ctx256);
+		bool bRet = ZFile::MapFileWindows(szFile, SHA_FILE_WINDOW_SIZE, ZFile::E_MAP_SEQUENTIAL | ZFile::E_MAP_WILLNEED, [&](const uint8_t* pData, size_t /*sOffset*/, size_t sLength) {
+			SHA1_Update(&ctx1, pData, sLength);
+			SHA256_Update(&ctx256, pData, sLength);
+			return false;
+		});
+		if (!bRet) {
+			return false;
+		}
+		uint8_t hash1[20];
+		uint8_t hash256[32];
+		SHA1_Final(hash1, &ctx1);
+		SHA256_Final(hash256, &ctx256);
+		strSHA1.append((const char*)hash1, 20);
+		strSHA256.append((const char*)hash256, 32);
+		return true;
+	}
+
 	// pBase may be NULL, but it's ok, because the file may be empty
 	ZSHA::SHA1(pBase, sSize, strSHA1);
 	ZSHA::SHA256(pBase, sSize, strSHA256);
-	if (NULL != pBase && sSize > 0) {
-		ZFile::UnmapFile(pBase, sSize);
-	}
+	ZFile::UnmapFileCached(pBase);
 	return (!strSHA1.empty() && !strSHA256.empty());
 }
 
@@ -90,6 +113,61 @@ bool ZSHA::SHABase64File(const char* szFile, string& strSHA1Base64, string& strS
 	return (!strSHA1Base64.empty() && !strSHA256Base64.empty());
 }
 
+// Same digests as SHABase64File for every file, but the reads are batched and hashed as they complete,
+// which is much cheaper than a map and unmap per file when there are thousands of small resources.
+bool ZSHA::SHABase64Files(const vector<string>& arrFiles, vector<string>& arrSHA1Base64, vector<string>& arrSHA256Base64, int nBackend)
+{
+	struct ZSHAState
+	{
+		SHA_CTX		ctx1;
+		SHA256_CTX	ctx256;
+		bool		bStarted = false;
+	};
+
+	arrSHA1Base64.assign(arrFiles.size(), string());
+	arrSHA256Base64.assign(arrFiles.size(), string());
+	vector<ZSHAState> arrStates(arrFiles.size());
+	bool bRet = ZBatchReader::ReadFiles(arrFiles, [&](size_t uIndex, const uint8_t* pData, size_t sSize, bool bLast, bool bOK) {
+		ZSHAState& state = arrStates[uIndex];
+		if (!state.bStarted) {
+			SHA1_Init(&state.ctx1);
+			SHA256_Init(&state.ctx256);
+			state.bStarted = true;
+		}
+		if (sSize > 0) {
+			SHA1_Update(&state.ctx1, pData, sSize);
+			SHA256_Update(&state.ctx256, pData, sSize);
+		}
+		if (!bLast) {
+			return;
+		}
+
+		// an unreadable file hashes as empty, like the mapped path
+		uint8_t hash1[20];
+		uint8_t hash256[32];
+		if (!bOK) {
+			SHA1_Init(&state.ctx1);
+			SHA256_Init(&state.ctx256);
+		}
+		SHA1_Final(hash1, &state.ctx1);
+		SHA256_Final(hash256, &state.ctx256);
+
+		jbase64 b64;
+		arrSHA1Base64[uIndex] = b64.encode(string((const char*)hash1, 20));
+		arrSHA256Base64[uIndex] = b64.encode(string((const char*)hash256, 32));
+	}, 0, nBackend);
+	if (!bRet) {
+		return false;
+	}
+
+	for (size_t i = 0; i < arrFiles.size(); i++) {
+		if (arrSHA1Base64[i].empty() || arrSHA256Base64[i].empty()) {
+			return false;
+		}
+	}
+	return true;
+}
+
 void ZSHA::Print(const char* prefix, const uint8_t* hash, uint32_t size, const char* suffix)
 {
 	ZLog::PrintV("%s", prefix);
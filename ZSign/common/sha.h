@@ -15,6 +15,7 @@ public:
 	static bool SHAFile(const char* szFile, string& strSHA1, string& strSHA256);
 	static bool SHABase64(const string& strData, string& strSHA1Base64, string& strSHA256Base64);
 	static bool SHABase64File(const char* szFile, string& strSHA1Base64, string& strSHA256Base64);
+	static bool SHABase64Files(const vector<string>& arrFiles, vector<string>& arrSHA1Base64, vector<string>& arrSHA256Base64, int nBackend = 0);
 	static void Print(const char* prefix, const uint8_t* hash, uint32_t size, const char* suffix = "\n");
 	static void Print(const char* prefix, const string& strSHASum, const char* suffix = "\n");
 	static void PrintData1(const char* prefix, const string& strData, const char* suffix = "\n");
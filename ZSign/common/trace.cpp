@@ -0,0 +1,197 @@
+#include "trace.h"
+#include <chrono>
+
+std::atomic<bool> ZTrace::s_bEnabled(false);
+
+struct ZTraceEvent
+{
+	const char*	szName;
+	string		strDetail;
+	uint64_t	uBegin;
+	uint64_t	uEnd;
+	uint64_t	uBytes;
+};
+
+// one buffer per thread, its lock is only contended while Stop collects the events
+struct ZTraceBuffer
+{
+	mutex				mtx;
+	uint32_t			uThreadId;
+	vector<ZTraceEvent>	arrEvents;
+};
+
+struct ZTraceState
+{
+	mutex								mtx;
+	string								strFile;
+	string								strDefaultFile;
+	uint64_t							uOrigin;
+	atomic<uint32_t>					uGeneration;
+	vector<shared_ptr<ZTraceBuffer>>	arrBuffers;
+};
+
+static ZTraceState& TraceState()
+{
+	static ZTraceState* s_pState = new ZTraceState();
+	return *s_pState;
+}
+
+struct ZTraceThread
+{
+	shared_ptr<ZTraceBuffer>	pBuffer;
+	uint32_t					uGeneration = 0;
+};
+
+static thread_local ZTraceThread t_Trace;
+
+uint64_t ZTrace::Now()
+{
+	return (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool ZTrace::Start(const char* szFile)
+{
+	if (NULL == szFile || 0 == szFile[0]) {
+		return false;
+	}
+
+	ZTraceState& state = TraceState();
+	lock_guard<mutex> lock(state.mtx);
+	if (s_bEnabled.load()) {
+		return false;
+	}
+	state.strFile = szFile;
+	state.uOrigin = Now();
+	state.uGeneration++;
+	state.arrBuffers.clear();
+	s_bEnabled.store(true);
+	return true;
+}
+
+void ZTrace::SetDefaultFile(const string& strFile)
+{
+	ZTraceState& state = TraceState();
+	lock_guard<mutex> lock(state.mtx);
+	state.strDefaultFile = strFile;
+}
+
+bool ZTrace::StartDefault()
+{
+	string strFile;
+	{
+		ZTraceState& state = TraceState();
+		lock_guard<mutex> lock(state.mtx);
+		strFile = state.strDefaultFile;
+	}
+	return Start(strFile.empty() ? getenv("ZSIGN_TRACE") : strFile.c_str());
+}
+
+void ZTrace::Record(const char* szName, const string& strDetail, uint64_t uBegin, uint64_t uEnd, uint64_t uBytes)
+{
+	if (!IsEnabled()) {
+		return;
+	}
+
+	ZTraceState& state = TraceState();
+	if (!t_Trace.pBuffer || t_Trace.uGeneration != state.uGeneration.load()) {
+		lock_guard<mutex> lock(state.mtx);
+		if (!s_bEnabled.load()) {
+			return;
+		}
+		t_Trace.pBuffer = make_shared<ZTraceBuffer>();
+		t_Trace.pBuffer->uThreadId = (uint32_t)state.arrBuffers.size() + 1;
+		t_Trace.uGeneration = state.uGeneration;
+		state.arrBuffers.push_back(t_Trace.pBuffer);
+	}
+
+	lock_guard<mutex> lock(t_Trace.pBuffer->mtx);
+	t_Trace.pBuffer->arrEvents.push_back({ szName, strDetail, uBegin, uEnd, uBytes });
+}
+
+static void AppendJsonString(string& strOutput, const string& strValue)
+{
+	strOutput += '"';
+	for (char c : strValue) {
+		if ('"' == c || '\\' == c) {
+			strOutput += '\\';
+			strOutput += c;
+		} else if ((unsigned char)c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			strOutput += buf;
+		} else {
+			strOutput += c;
+		}
+	}
+	strOutput += '"';
+}
+
+bool ZTrace::Stop()
+{
+	ZTraceState& state = TraceState();
+	vector<shared_ptr<ZTraceBuffer>> arrBuffers;
+	string strFile;
+	uint64_t uOrigin = 0;
+	{
+		lock_guard<mutex> lock(state.mtx);
+		if (!s_bEnabled.load()) {
+			return false;
+		}
+		s_bEnabled.store(false);
+		arrBuffers.swap(state.arrBuffers);
+		strFile = state.strFile;
+		uOrigin = state.uOrigin;
+	}
+
+	string strOutput = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool bFirst = true;
+	for (shared_ptr<ZTraceBuffer>& pBuffer : arrBuffers) {
+		lock_guard<mutex> lock(pBuffer->mtx);
+		for (const ZTraceEvent& event : pBuffer->arrEvents) {
+			string strEvent;
+			ZUtil::StringFormatV(strEvent, "%s{\"ph\":\"X\",\"cat\":\"zsign\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu,\"name\":",
+									bFirst ? "" : ",\n",
+									pBuffer->uThreadId,
+									(unsigned long long)(event.uBegin - uOrigin),
+									(unsigned long long)(event.uEnd - event.uBegin));
+			strOutput += strEvent;
+			AppendJsonString(strOutput, event.szName);
+			ZUtil::StringFormatV(strEvent, ",\"args\":{\"bytes\":%llu", (unsigned long long)event.uBytes);
+			strOutput += strEvent;
+			if (!event.strDetail.empty()) {
+				strOutput += ",\"detail\":";
+				AppendJsonString(strOutput, event.strDetail);
+			}
+			strOutput += "}}";
+			bFirst = false;
+		}
+	}
+	strOutput += "\n]}\n";
+
+	if (!ZFile::WriteFile(strFile.c_str(), strOutput)) {
+		return ZLog::ErrorV(">>> Can't write trace file! %s\n", strFile.c_str());
+	}
+	ZLog::PrintV(">>> Trace: \t%s\n", strFile.c_str());
+	return true;
+}
+
+ZTraceSpan::ZTraceSpan(const char* szName, uint64_t uBytes, const char* szDetail)
+{
+	m_bActive = ZTrace::IsEnabled();
+	m_szName = szName;
+	m_uBytes = uBytes;
+	m_uBegin = 0;
+	if (m_bActive) {
+		if (NULL != szDetail) {
+			m_strDetail = szDetail;
+		}
+		m_uBegin = ZTrace::Now();
+	}
+}
+
+ZTraceSpan::~ZTraceSpan()
+{
+	if (m_bActive) {
+		ZTrace::Record(m_szName, m_strDetail, m_uBegin, ZTrace::Now(), m_uBytes);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+
+// Scoped spans for profiling sign runs. Nothing is recorded unless tracing was started, either with an explicit
+// file or the default one (SetDefaultFile, else ZSIGN_TRACE=<file>). Stop writes Chrome Trace Event JSON.
+class ZTrace
+{
+public:
+	static bool Start(const char* szFile);
+	static bool StartDefault();
+	static void SetDefaultFile(const string& strFile);
+	static bool Stop();
+	static bool IsEnabled() { return s_bEnabled.load(std::memory_order_relaxed); }
+
+public:
+	static void Record(const char* szName, const string& strDetail, uint64_t uBegin, uint64_t uEnd, uint64_t uBytes);
+	static uint64_t Now();
+
+private:
+	static std::atomic<bool> s_bEnabled;
+};
+
+class ZTraceSpan
+{
+public:
+	ZTraceSpan(const char* szName, uint64_t uBytes = 0, const char* szDetail = NULL);
+	~ZTraceSpan();
+
+public:
+	void SetBytes(uint64_t uBytes) { m_uBytes = uBytes; }
+
+private:
+	const char*	m_szName;	// must be a literal, only the pointer is kept
+	string		m_strDetail;
+	uint64_t	m_uBegin;
+	uint64_t	m_uBytes;
+	bool		m_bActive;
+};
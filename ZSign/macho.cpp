@@ -5,12 +5,14 @@
 #include "signing.h"
 #include "macho.h"
 #include "Utils.hpp"
+#include "trace.h"
 
 ZMachO::ZMachO()
 {
 	m_pBase = NULL;
 	m_sSize = 0;
 	m_bCSRealloced = false;
+	m_bReadOnly = false;
 }
 
 ZMachO::~ZMachO()
@@ -18,9 +20,10 @@ ZMachO::~ZMachO()
 	FreeArchOes();
 }
 
-bool ZMachO::Init(const char* szFile)
+bool ZMachO::Init(const char* szFile, bool bReadOnly)
 {
 	m_strFile = szFile;
+	m_bReadOnly = bReadOnly;
 	return OpenFile(szFile);
 }
 
@@ -60,19 +63,30 @@ void ZMachO::FreeArchOes()
 
 bool ZMachO::OpenFile(const char* szPath)
 {
+	ZTraceSpan span("MapFile", 0, szPath);
 	FreeArchOes();
 
 	m_sSize = 0;
-	m_pBase = (uint8_t*)ZFile::MapFile(szPath, 0, 0, &m_sSize, false);
+	m_pBase = (uint8_t*)ZFile::MapFile(szPath, 0, 0, &m_sSize, m_bReadOnly, m_bReadOnly ? ZFile::E_MAP_NO_REFRESH : ZFile::E_MAP_DEFAULT);
+	span.SetBytes(m_sSize);
 	if (NULL != m_pBase) {
 		uint32_t magic = *((uint32_t*)m_pBase);
 		if (FAT_CIGAM == magic || FAT_MAGIC == magic) {
 			fat_header* pFatHeader = (fat_header*)m_pBase;
 			int nFatArch = (FAT_MAGIC == magic) ? pFatHeader->nfat_arch : LE(pFatHeader->nfat_arch);
+			if (sizeof(fat_header) + sizeof(fat_arch) * (uint64_t)(uint32_t)nFatArch > m_sSize) {
+				ZLog::ErrorV(">>> Truncated fat mach-o header!\n");
+				return false;
+			}
 			for (int i = 0; i < nFatArch; i++) {
 				fat_arch* pFatArch = (fat_arch*)(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * i);
-				uint8_t* pArchBase = m_pBase + ((FAT_MAGIC == magic) ? pFatArch->offset : LE(pFatArch->offset));
+				uint32_t uArchOffset = (FAT_MAGIC == magic) ? pFatArch->offset : LE(pFatArch->offset);
 				uint32_t uArchLength = (FAT_MAGIC == magic) ? pFatArch->size : LE(pFatArch->size);
+				if ((uint64_t)uArchOffset + uArchLength > m_sSize) {
+					ZLog::ErrorV(">>> Arch %d runs past the end of the fat mach-o file!\n", i);
+					return false;
+				}
+				uint8_t* pArchBase = m_pBase + uArchOffset;
 				if (!NewArchO(pArchBase, uArchLength)) {
 					ZLog::ErrorV(">>> Invalid arch file in fat mach-o file!\n");
 					return false;
@@ -98,11 +112,14 @@ bool ZMachO::CloseFile()
 		return false;
 	}
 
+	ZTraceSpan span("WriteBack", m_sSize, m_strFile.c_str());
 	if (!ZFile::UnmapFile((void*)m_pBase, m_sSize)) {
 		ZLog::ErrorV(">>> CodeSign write(munmap) failed! Error: %p, %lu, %s\n", m_pBase, m_sSize, strerror(errno));
 		return false;
 	}
-    refreshFile(m_strFile.c_str());
+	if (!m_bReadOnly) {
+		refreshFile(m_strFile.c_str());
+	}
 	return true;
 }
 
@@ -114,12 +131,85 @@ void ZMachO::PrintInfo()
 	}
 }
 
+// Page hashes LiveContainer took while extracting the file, see LiveContainerSwiftUI/LCPageHash.h. Signing only
+// rewrites the header pages and the signature behind the code, so they stay good until ZBundle drops them.
+bool ZMachO::LoadCodeSlots(const string& strSlotsFile, const string& strRelativePath)
+{
+	string strData;
+	if (!ZFile::ReadFile(strSlotsFile.c_str(), strData)) {
+		return false;
+	}
+
+	struct slots_header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t fileSize;
+		uint32_t sliceCount;
+		uint32_t pathLength;
+	} header;
+	if (strData.size() < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, strData.data(), sizeof(header));
+	size_t sOffset = sizeof(header);
+	if (0x4850434c != header.magic || 1 != header.version || header.fileSize != m_sSize ||
+		header.sliceCount != m_arrArchOes.size() || header.pathLength > strData.size() - sOffset ||
+		0 != strData.compare(sOffset, header.pathLength, strRelativePath) || strRelativePath.size() != header.pathLength) {
+		ZLog::WarnV(">>> Stale code slots, hashing every page! %s\n", strRelativePath.c_str());
+		return false;
+	}
+	sOffset += header.pathLength;
+
+	bool bLoaded = false;
+	for (uint32_t i = 0; i < header.sliceCount; i++) {
+		uint32_t uCodeLength = 0;
+		uint32_t uPageCount = 0;
+		if (strData.size() - sOffset < 8) {
+			return false;
+		}
+		memcpy(&uCodeLength, strData.data() + sOffset, 4);
+		memcpy(&uPageCount, strData.data() + sOffset + 4, 4);
+		sOffset += 8;
+		if ((strData.size() - sOffset) / 52 < uPageCount) {
+			return false;
+		}
+		if (uCodeLength > 0) {
+			string strCodeSlots1 = strData.substr(sOffset, uPageCount * 20);
+			string strCodeSlots256 = strData.substr(sOffset + uPageCount * 20, uPageCount * 32);
+			bLoaded |= m_arrArchOes[i]->SetCachedCodeSlots(uCodeLength, strCodeSlots1, strCodeSlots256);
+		}
+		sOffset += uPageCount * 52;
+	}
+	return bLoaded;
+}
+
+bool ZMachO::UseEmbeddedCodeSlots()
+{
+	bool bLoaded = false;
+	for (ZArchO* archo : m_arrArchOes) {
+		bLoaded |= archo->UseEmbeddedCodeSlots();
+	}
+	return bLoaded;
+}
+
 bool ZMachO::Sign(ZSignAsset* pSignAsset, bool bForce, string strBundleId, string strInfoSHA1, string strInfoSHA256, const string& strCodeResourcesData)
 {
 	if (NULL == m_pBase || m_arrArchOes.empty()) {
 		return false;
 	}
+	if (m_bReadOnly) {
+		return ZLog::Error(">>> Can't sign a mach-o file opened read only!\n");
+	}
 
+	ZTraceSpan span("SignMachO", m_sSize, m_strFile.c_str());
+	// a forced sign hashes every page front to back unless the pages were hashed on extraction, otherwise only the
+	// dirty pages are rehashed
+	bool bHashAll = false;
+	for (ZArchO* pArchO : m_arrArchOes) {
+		bHashAll |= bForce && pArchO->m_strCachedCodeSlots256.empty();
+	}
+	ZFile::AdviseMap(m_pBase, m_sSize, bHashAll ? (ZFile::E_MAP_SEQUENTIAL | ZFile::E_MAP_WILLNEED) : ZFile::E_MAP_RANDOM);
 	for (size_t i = 0; i < m_arrArchOes.size(); i++) {
 		ZArchO* archo = m_arrArchOes[i];
 		if (strBundleId.empty()) {
@@ -144,6 +234,10 @@ bool ZMachO::Sign(ZSignAsset* pSignAsset, bool bForce, string strBundleId, strin
 			if (!archo->m_bEnoughSpace && !m_bCSRealloced) {
 				m_bCSRealloced = true;
 				if (ReallocCodeSignSpace()) {
+					// __LINKEDIT and LC_CODE_SIGNATURE were resized in the load commands
+					for (ZArchO* pArchO : m_arrArchOes) {
+						pArchO->MarkLoadCommandsDirty();
+					}
 					return Sign(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesData);
 				}
 			}
@@ -154,9 +248,25 @@ bool ZMachO::Sign(ZSignAsset* pSignAsset, bool bForce, string strBundleId, strin
 	return CloseFile();
 }
 
+bool ZMachO::Verify(uint32_t uSampleStride, const string& strBundleFolder)
+{
+	if (NULL == m_pBase || m_arrArchOes.empty()) {
+		return false;
+	}
+
+	ZFile::AdviseMap(m_pBase, m_sSize, (uSampleStride > 1) ? ZFile::E_MAP_RANDOM : (ZFile::E_MAP_SEQUENTIAL | ZFile::E_MAP_WILLNEED));
+	for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+		if (!m_arrArchOes[i]->VerifySignature(uSampleStride, strBundleFolder)) {
+			return false;
+		}
+	}
+	return true;
+}
+
 bool ZMachO::ReallocCodeSignSpace()
 {
 	ZLog::Warn(">>> Realloc CodeSignature space... \n");
+	ZTraceSpan span("ReallocCodeSign", m_sSize, m_strFile.c_str());
 
 	vector<uint32_t> arrMachOesSizes;
 	for (size_t i = 0; i < m_arrArchOes.size(); i++) {
@@ -252,6 +362,9 @@ bool ZMachO::ReallocCodeSignSpace()
 
 bool ZMachO::InjectDylib(bool bWeakInject, const char* szDylibFile)
 {
+	if (m_bReadOnly) {
+		return ZLog::Error(">>> Can't inject into a mach-o file opened read only!\n");
+	}
 	ZLog::WarnV(">>> InjectDylib: %s %s... \n", szDylibFile, bWeakInject ? "(weak)" : "");
 
 	vector<uint32_t> arrMachOesSizes;
@@ -8,7 +8,8 @@ public:
 	~ZMachO();
 
 public:
-	bool Init(const char* szFile);
+	// bReadOnly maps the file as is and without write access, Sign and InjectDylib refuse to run on it
+	bool Init(const char* szFile, bool bReadOnly = false);
 	bool InitV(const char* szPath, ...);
 	bool Free();
 	void PrintInfo();
@@ -19,6 +20,9 @@ public:
 				string strInfoSHA256, 
 				const string& strCodeResourcesData);
 	bool InjectDylib(bool bWeakInject, const char* szDylibFile);
+	bool LoadCodeSlots(const string& strSlotsFile, const string& strRelativePath);
+	bool UseEmbeddedCodeSlots();
+	bool Verify(uint32_t uSampleStride, const string& strBundleFolder);
 
 private:
 	bool OpenFile(const char* szPath);
@@ -33,7 +37,10 @@ private:
 	string			m_strFile;
 	uint8_t*		m_pBase;
 	bool			m_bCSRealloced;
+	bool			m_bReadOnly;
 	vector<ZArchO*> m_arrArchOes;
+
+	friend class ZSignBench;
 };
 
 bool is_64bit_macho(const char *filepath);
@@ -288,6 +288,23 @@ bool ZSignAsset::GetCMSContent(const string& strCMSDataInput, string& strContent
 	return (!strContentOutput.empty());
 }
 
+bool ZSignAsset::VerifyCMS(uint8_t* pCMSData, uint32_t uCMSLength, const string& strContent)
+{
+	BIO* in = BIO_new_mem_buf(pCMSData, (int)uCMSLength);
+	CMS_ContentInfo* cms = d2i_CMS_bio(in, NULL);
+	BIO_free(in);
+	if (!cms) {
+		return CMSError();
+	}
+
+	// only the signature over the detached content is checked, the signer chain is not trusted offline
+	BIO* content = BIO_new_mem_buf(strContent.data(), (int)strContent.size());
+	int ret = CMS_verify(cms, NULL, NULL, content, NULL, CMS_NO_SIGNER_CERT_VERIFY | CMS_BINARY);
+	BIO_free(content);
+	CMS_ContentInfo_free(cms);
+	return (1 == ret) ? true : CMSError();
+}
+
 bool ZSignAsset::GetCertSubjectCN(void* pcert, string& strSubjectCN)
 {
 	if (!pcert) {
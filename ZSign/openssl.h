@@ -42,6 +42,7 @@ public:
 	static bool		GetCertInfo(void* pcert, jvalue& jvCertInfo);
 	static bool		GetCMSInfo(uint8_t* pCMSData, uint32_t uCMSLength, jvalue& jvOutput);
 	static bool		GetCMSContent(const string& strCMSDataInput, string& strContentOutput);
+	static bool		VerifyCMS(uint8_t* pCMSData, uint32_t uCMSLength, const string& strContent);
 	static void		ParseCertSubject(const string& strSubject, jvalue& jvSubject);
 	static string	ASN1_TIMEtoString(const void* time);
 
@@ -3,6 +3,7 @@
 #include "mach-o.h"
 #include "openssl.h"
 #include "signing.h"
+#include "trace.h"
 
 void ZSign::_DERLength(string& strBlob, uint64_t uLength)
 {
@@ -508,6 +509,7 @@ bool ZSign::SlotBuildCodeDirectory(bool bAlternate,
 	if (NULL != pCodeSlotsData && (uCodeSlotsDataLength == uCodeSlots * cdHeader.hashSize)) { //use exists
 		strOutput.append((const char*)pCodeSlotsData, uCodeSlotsDataLength);
 	} else {
+		ZTraceSpan span(bAlternate ? "HashPages SHA256" : "HashPages SHA1", uCodeLength);
 		for (uint32_t i = 0; i < uPages; i++) {
 			string strSHASum;
 			if (1 == cdHeader.hashType) {
@@ -600,6 +602,7 @@ bool ZSign::SlotBuildCMSSignature(ZSignAsset* pSignAsset,
 		return true;
 	}
 
+	ZTraceSpan span("CMS");
 	jvalue jvHashes;
 	string strCDHashesPlist;
 	string strCodeDirectorySlotSHA1;
@@ -0,0 +1,305 @@
+#include "common.h"
+#include "verify.h"
+#include "trace.h"
+#include <openssl/sha.h>
+#include <thread>
+#include <atomic>
+
+// a blob inside the SuperBlob, NULL unless its header and its whole length fit in the signature
+uint8_t* ZVerify::GetBlob(uint8_t* pCSBase, uint32_t uCSLength, uint32_t uOffset, uint32_t uMinLength)
+{
+	if ((uint64_t)uOffset + max<uint32_t>(uMinLength, sizeof(CS_GenericBlob)) > uCSLength) {
+		return NULL;
+	}
+	uint32_t uLength = LE(((CS_GenericBlob*)(pCSBase + uOffset))->length);
+	if (uLength < uMinLength || (uint64_t)uOffset + uLength > uCSLength) {
+		return NULL;
+	}
+	return pCSBase + uOffset;
+}
+
+bool ZVerify::HashBlob(uint8_t uHashType, const uint8_t* pData, size_t sSize, string& strOutput)
+{
+	if (CS_HASHTYPE_SHA1 == uHashType) {
+		return ZSHA::SHA1((uint8_t*)pData, sSize, strOutput);
+	} else if (CS_HASHTYPE_SHA256 == uHashType || CS_HASHTYPE_SHA256_TRUNCATED == uHashType) {
+		return ZSHA::SHA256((uint8_t*)pData, sSize, strOutput);
+	}
+	return ZLog::ErrorV(">>> Unsupported hash type %d!\n", uHashType);
+}
+
+bool ZVerify::VerifyCodeSlots(uint8_t* pBase, CS_CodeDirectory* pcd, uint8_t* pHashes, uint64_t uCodeLimit, uint32_t uSampleStride)
+{
+	uint32_t uCodeSlots = LE(pcd->nCodeSlots);
+	uint8_t uHashSize = pcd->hashSize;
+	uint8_t uHashType = pcd->hashType;
+	uint64_t uPageSize = pcd->pageSize ? (1ULL << pcd->pageSize) : uCodeLimit;
+	if (uPageSize > 0 && uCodeSlots != (uCodeLimit + uPageSize - 1) / uPageSize) {
+		return ZLog::ErrorV(">>> CodeDirectory has %u code slots for a %llu byte code limit!\n", uCodeSlots, uCodeLimit);
+	}
+	if (uSampleStride < 1) {
+		uSampleStride = 1;
+	}
+
+	ZTraceSpan span("VerifyPages", uCodeLimit);
+
+	// pages are handed out in small batches, every worker stops as soon as any of them sees a mismatch
+	const uint32_t uBatch = 16;
+	std::atomic<uint32_t> nextSlot(0);
+	std::atomic<int64_t> firstBadSlot(-1);
+	auto worker = [&]() {
+		string strHash;
+		while (firstBadSlot.load(std::memory_order_relaxed) < 0) {
+			uint32_t uBegin = nextSlot.fetch_add(uBatch, std::memory_order_relaxed);
+			if (uBegin >= uCodeSlots) {
+				break;
+			}
+			uint32_t uEnd = min(uBegin + uBatch, uCodeSlots);
+			for (uint32_t i = uBegin; i < uEnd; i++) {
+				if (i % uSampleStride != 0 && i != uCodeSlots - 1) {
+					continue;
+				}
+				uint64_t uOffset = i * uPageSize;
+				uint64_t uSize = min(uPageSize, uCodeLimit - uOffset);
+				HashBlob(uHashType, pBase + uOffset, (size_t)uSize, strHash);
+				if (strHash.size() < uHashSize || 0 != memcmp(strHash.data(), pHashes + (size_t)i * uHashSize, uHashSize)) {
+					int64_t expected = -1;
+					firstBadSlot.compare_exchange_strong(expected, i);
+					return;
+				}
+			}
+		}
+	};
+
+	uint32_t uThreads = max(1u, min(std::thread::hardware_concurrency(), uCodeSlots / 64));
+	vector<std::thread> arrThreads;
+	for (uint32_t i = 1; i < uThreads; i++) {
+		arrThreads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& t : arrThreads) {
+		t.join();
+	}
+
+	if (firstBadSlot >= 0) {
+		return ZLog::ErrorV(">>> Code page %lld does not match its hash! (hash type %d)\n", (long long)firstBadSlot.load(), uHashType);
+	}
+	return true;
+}
+
+bool ZVerify::VerifySpecialSlot(uint8_t* pCSBase, uint32_t uCSLength, uint32_t uSlotType, CS_CodeDirectory* pcd, uint8_t* pHashes, const string& strBundleFolder)
+{
+	uint8_t uHashSize = pcd->hashSize;
+	uint8_t* pExpected = pHashes - (size_t)uSlotType * uHashSize;
+	bool bEmptySlot = true;
+	for (uint8_t i = 0; i < uHashSize; i++) {
+		if (0 != pExpected[i]) {
+			bEmptySlot = false;
+			break;
+		}
+	}
+
+	string strData;
+	bool bHasData = false;
+	if (CSSLOT_INFOSLOT == uSlotType || CSSLOT_RESOURCEDIR == uSlotType) {
+		if (strBundleFolder.empty()) {
+			return true; // nothing to compare against
+		}
+		const char* szFile = (CSSLOT_INFOSLOT == uSlotType) ? "Info.plist" : "_CodeSignature/CodeResources";
+		bHasData = ZFile::ReadFileV(strData, "%s/%s", strBundleFolder.c_str(), szFile);
+	} else {
+		CS_SuperBlob* psb = (CS_SuperBlob*)pCSBase;
+		CS_BlobIndex* pbi = (CS_BlobIndex*)(pCSBase + sizeof(CS_SuperBlob));
+		for (uint32_t i = 0; i < LE(psb->count); i++, pbi++) {
+			if (LE(pbi->type) == uSlotType) {
+				uint8_t* pSlotBase = GetBlob(pCSBase, uCSLength, LE(pbi->offset), sizeof(CS_GenericBlob));
+				if (NULL == pSlotBase) {
+					return ZLog::ErrorV(">>> Special slot %u is truncated!\n", uSlotType);
+				}
+				strData.append((const char*)pSlotBase, LE(((CS_GenericBlob*)pSlotBase)->length));
+				bHasData = true;
+				break;
+			}
+		}
+	}
+
+	if (!bHasData) {
+		if (!bEmptySlot) {
+			return ZLog::ErrorV(">>> Special slot %u is hashed but its data is missing!\n", uSlotType);
+		}
+		return true;
+	}
+	if (bEmptySlot) {
+		// old signatures leave unused slots zeroed, only complain about data the signature cannot vouch for
+		return (CSSLOT_INFOSLOT == uSlotType || CSSLOT_RESOURCEDIR == uSlotType) ? true : ZLog::ErrorV(">>> Special slot %u has data but no hash!\n", uSlotType);
+	}
+
+	string strHash;
+	HashBlob(pcd->hashType, (const uint8_t*)strData.data(), strData.size(), strHash);
+	if (strHash.size() < uHashSize || 0 != memcmp(strHash.data(), pExpected, uHashSize)) {
+		return ZLog::ErrorV(">>> Special slot %u does not match its hash!\n", uSlotType);
+	}
+	return true;
+}
+
+bool ZVerify::VerifyCodeDirectory(uint8_t* pBase, uint32_t uCodeLength, uint8_t* pCSBase, uint32_t uCSLength, uint8_t* pCDBase, uint32_t uSampleStride, const string& strBundleFolder)
+{
+	CS_CodeDirectory* pcd = (CS_CodeDirectory*)pCDBase;
+	if (CSMAGIC_CODEDIRECTORY != LE(pcd->magic)) {
+		return ZLog::Error(">>> Invalid CodeDirectory magic!\n");
+	}
+	uint32_t uCDLength = LE(pcd->length);
+	uint32_t uHashOffset = LE(pcd->hashOffset);
+	uint32_t uSpecialSlots = LE(pcd->nSpecialSlots);
+	uint32_t uCodeSlots = LE(pcd->nCodeSlots);
+	if ((size_t)(pCDBase - pCSBase) + uCDLength > uCSLength ||
+		uCDLength < offsetof(CS_CodeDirectory, scatterOffset) ||
+		uHashOffset < (uint64_t)uSpecialSlots * pcd->hashSize ||
+		uHashOffset + (uint64_t)uCodeSlots * pcd->hashSize > uCDLength) {
+		return ZLog::Error(">>> CodeDirectory is truncated!\n");
+	}
+	// a zero hash size would compare nothing and pass every slot
+	uint8_t uExpectedHashSize = 0;
+	if (CS_HASHTYPE_SHA1 == pcd->hashType || CS_HASHTYPE_SHA256_TRUNCATED == pcd->hashType) {
+		uExpectedHashSize = CS_SHA1_LEN;
+	} else if (CS_HASHTYPE_SHA256 == pcd->hashType) {
+		uExpectedHashSize = CS_SHA256_LEN;
+	} else {
+		return ZLog::ErrorV(">>> Unsupported hash type %d!\n", pcd->hashType);
+	}
+	if (pcd->hashSize != uExpectedHashSize) {
+		return ZLog::ErrorV(">>> CodeDirectory hash size %u does not match hash type %u!\n", pcd->hashSize, pcd->hashType);
+	}
+	if (pcd->pageSize >= 32) {
+		return ZLog::ErrorV(">>> Invalid CodeDirectory page size 2^%u!\n", pcd->pageSize);
+	}
+
+	uint64_t uCodeLimit = LE(pcd->codeLimit);
+	if (LE(pcd->version) >= 0x20300 && uCDLength >= offsetof(CS_CodeDirectory, codeLimit64) + sizeof(pcd->codeLimit64) && 0 != pcd->codeLimit64) {
+		uCodeLimit = LE(pcd->codeLimit64);
+	}
+	if (uCodeLimit > uCodeLength) {
+		return ZLog::ErrorV(">>> CodeDirectory covers %llu bytes but the code is only %u bytes!\n", uCodeLimit, uCodeLength);
+	}
+
+	uint8_t* pHashes = pCDBase + uHashOffset;
+	uint32_t arrSpecialSlots[] = { CSSLOT_INFOSLOT, CSSLOT_REQUIREMENTS, CSSLOT_RESOURCEDIR, CSSLOT_ENTITLEMENTS, CSSLOT_DER_ENTITLEMENTS };
+	for (uint32_t uSlotType : arrSpecialSlots) {
+		if (uSlotType <= uSpecialSlots && !VerifySpecialSlot(pCSBase, uCSLength, uSlotType, pcd, pHashes, strBundleFolder)) {
+			return false;
+		}
+	}
+	return VerifyCodeSlots(pBase, pcd, pHashes, uCodeLimit, uSampleStride);
+}
+
+bool ZVerify::VerifyCMSSignature(uint8_t* pSlotBase, const vector<string>& arrCodeDirectories)
+{
+	uint32_t uSlotLength = LE(((CS_GenericBlob*)pSlotBase)->length);
+	if (uSlotLength <= 8) {
+		return true; // ad-hoc, there is no CMS to check
+	}
+	uint8_t* pCMSData = pSlotBase + 8;
+	uint32_t uCMSLength = uSlotLength - 8;
+
+	// the CMS signs the first CodeDirectory, its signed attributes carry the CDHash of every CodeDirectory
+	if (!ZSignAsset::VerifyCMS(pCMSData, uCMSLength, arrCodeDirectories[0])) {
+		return ZLog::Error(">>> CMS signature does not match the CodeDirectory!\n");
+	}
+
+	jvalue jvInfo;
+	if (!ZSignAsset::GetCMSInfo(pCMSData, uCMSLength, jvInfo)) {
+		return false;
+	}
+
+	if (jvInfo["attrs"].has("CDHashes")) {
+		jvalue jvHashes;
+		jvHashes.read_plist(jvInfo["attrs"]["CDHashes"]["data"].as_cstr());
+		if (jvHashes["cdhashes"].size() != arrCodeDirectories.size()) {
+			return ZLog::ErrorV(">>> CMS lists %d CDHashes for %d CodeDirectories!\n", (int)jvHashes["cdhashes"].size(), (int)arrCodeDirectories.size());
+		}
+		for (size_t i = 0; i < arrCodeDirectories.size(); i++) {
+			CS_CodeDirectory* pcd = (CS_CodeDirectory*)arrCodeDirectories[i].data();
+			string strCDHash;
+			HashBlob(pcd->hashType, (const uint8_t*)arrCodeDirectories[i].data(), arrCodeDirectories[i].size(), strCDHash);
+			strCDHash.resize(CS_CDHASH_LEN);
+			if (jvHashes["cdhashes"][(int)i].as_data() != strCDHash) {
+				return ZLog::ErrorV(">>> CDHash %d does not match the CMS!\n", (int)i);
+			}
+		}
+	}
+
+	if (jvInfo["attrs"].has("CDHashes2")) {
+		for (const string& strCD : arrCodeDirectories) {
+			if (CS_HASHTYPE_SHA256 != ((CS_CodeDirectory*)strCD.data())->hashType) {
+				continue;
+			}
+			string strSHA256;
+			ZSHA::SHA256(strCD, strSHA256);
+			string strHex;
+			char buf[4] = { 0 };
+			for (size_t i = 0; i < strSHA256.size(); i++) {
+				snprintf(buf, sizeof(buf), "%02x", (uint8_t)strSHA256[i]);
+				strHex += buf;
+			}
+			bool bFound = false;
+			for (size_t i = 0; i < jvInfo["attrs"]["CDHashes2"]["data"].size(); i++) {
+				if (string(jvInfo["attrs"]["CDHashes2"]["data"][(int)i].as_cstr()) == strHex) {
+					bFound = true;
+					break;
+				}
+			}
+			if (!bFound) {
+				return ZLog::Error(">>> SHA256 CDHash is missing from the CMS!\n");
+			}
+		}
+	}
+	return true;
+}
+
+bool ZVerify::VerifyCodeSignature(uint8_t* pBase, uint32_t uCodeLength, uint8_t* pCSBase, uint32_t uCSLength, uint32_t uSampleStride, const string& strBundleFolder)
+{
+	CS_SuperBlob* psb = (CS_SuperBlob*)pCSBase;
+	if (NULL == psb || uCSLength < sizeof(CS_SuperBlob) || CSMAGIC_EMBEDDED_SIGNATURE != LE(psb->magic)) {
+		return ZLog::Error(">>> No embedded code signature!\n");
+	}
+	uint32_t uCount = LE(psb->count);
+	if (sizeof(CS_SuperBlob) + (uint64_t)uCount * sizeof(CS_BlobIndex) > uCSLength) {
+		return ZLog::Error(">>> Code signature is truncated!\n");
+	}
+
+	// primary CodeDirectory first, then the alternates in slot order, the same order the CMS lists them in
+	vector<string> arrCodeDirectories;
+	uint8_t* pCMSSlot = NULL;
+	CS_BlobIndex* pbi = (CS_BlobIndex*)(pCSBase + sizeof(CS_SuperBlob));
+	for (uint32_t uType = CSSLOT_CODEDIRECTORY; uType < CSSLOT_ALTERNATE_CODEDIRECTORY_LIMIT; uType = (CSSLOT_CODEDIRECTORY == uType) ? CSSLOT_ALTERNATE_CODEDIRECTORIES : uType + 1) {
+		for (uint32_t i = 0; i < uCount; i++) {
+			if (LE(pbi[i].type) != uType) {
+				continue;
+			}
+			uint8_t* pCDBase = GetBlob(pCSBase, uCSLength, LE(pbi[i].offset), offsetof(CS_CodeDirectory, scatterOffset));
+			if (NULL == pCDBase) {
+				return ZLog::Error(">>> Code signature is truncated!\n");
+			}
+			if (!VerifyCodeDirectory(pBase, uCodeLength, pCSBase, uCSLength, pCDBase, uSampleStride, strBundleFolder)) {
+				return false;
+			}
+			arrCodeDirectories.push_back(string((const char*)pCDBase, LE(((CS_CodeDirectory*)pCDBase)->length)));
+		}
+	}
+	for (uint32_t i = 0; i < uCount; i++) {
+		if (CSSLOT_SIGNATURESLOT == LE(pbi[i].type)) {
+			pCMSSlot = GetBlob(pCSBase, uCSLength, LE(pbi[i].offset), sizeof(CS_GenericBlob));
+			if (NULL == pCMSSlot) {
+				return ZLog::Error(">>> CMS signature slot is truncated!\n");
+			}
+		}
+	}
+
+	if (arrCodeDirectories.empty()) {
+		return ZLog::Error(">>> Code signature has no CodeDirectory!\n");
+	}
+	if (NULL != pCMSSlot && !VerifyCMSSignature(pCMSSlot, arrCodeDirectories)) {
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "mach-o.h"
+#include "openssl.h"
+
+class ZVerify
+{
+public:
+	// uSampleStride > 1 rehashes only every Nth code page plus the last one, everything else is always checked.
+	// strBundleFolder is used for the Info.plist and CodeResources special slots and may be empty.
+	static bool VerifyCodeSignature(uint8_t* pBase,
+									uint32_t uCodeLength,
+									uint8_t* pCSBase,
+									uint32_t uCSLength,
+									uint32_t uSampleStride,
+									const string& strBundleFolder);
+
+private:
+	static uint8_t* GetBlob(uint8_t* pCSBase, uint32_t uCSLength, uint32_t uOffset, uint32_t uMinLength);
+	static bool HashBlob(uint8_t uHashType, const uint8_t* pData, size_t sSize, string& strOutput);
+	static bool VerifyCodeDirectory(uint8_t* pBase,
+									uint32_t uCodeLength,
+									uint8_t* pCSBase,
+									uint32_t uCSLength,
+									uint8_t* pCDBase,
+									uint32_t uSampleStride,
+									const string& strBundleFolder);
+	static bool VerifyCodeSlots(uint8_t* pBase, CS_CodeDirectory* pcd, uint8_t* pHashes, uint64_t uCodeLimit, uint32_t uSampleStride);
+	static bool VerifySpecialSlot(uint8_t* pCSBase, uint32_t uCSLength, uint32_t uSlotType, CS_CodeDirectory* pcd, uint8_t* pHashes, const string& strBundleFolder);
+	static bool VerifyCMSSignature(uint8_t* pSlotBase, const vector<string>& arrCodeDirectories);
+};
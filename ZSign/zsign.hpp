@@ -35,6 +35,21 @@ void zsign(NSString *appPath,
           void(^completionHandler)(BOOL success, NSError *error)
           );
 
+// Signs every app with one identity on a shared worker pool. threadCount = 0 uses one worker per CPU,
+// memoryLimit caps the bytes of binaries mapped at once (0 = no limit). errors is keyed by app path.
+void zsignBatch(NSArray<NSString *> *appPaths,
+               NSData *prov,
+               NSData *key,
+               NSString *pass,
+               int threadCount,
+               uint64_t memoryLimit,
+               NSProgress* progress,
+               void(^completionHandler)(BOOL success, NSDictionary<NSString *, NSError *> *errors)
+               );
+
+// Every following zsign/zsignBatch run writes a Chrome trace to path, nil turns it off
+void zsignSetTraceFile(NSString *path);
+
 bool adhocSignMachO(NSString *machoPath, NSString *bundleId, NSData* entitlementData);
 NSString* getTeamId(NSData *prov,
                     NSData *key,
@@ -4,6 +4,7 @@
 #include "openssl.h"
 #include "macho.h"
 #include "bundle.h"
+#include "batch.h"
 #include <libgen.h>
 #include <dirent.h>
 #include <getopt.h>
@@ -17,6 +18,7 @@
 #include <openssl/err.h>
 #include <openssl/asn1.h>
 #include "timer.h"
+#include "trace.h"
 #include "common/log.h"
 
 
@@ -79,13 +81,16 @@ void zsign(NSString *appPath,
 	
 	string strPath = [appPath cStringUsingEncoding:NSUTF8StringEncoding];
     
-    ZLog::logs.clear();
+    uint32_t uLogSession = ZLog::BeginSession();
+    bool bTrace = ZTrace::StartDefault();
 
 	__block ZSignAsset zSignAsset;
 	
     if (!zSignAsset.InitSimple(strPKeyFileData, (int)[key length], strProvFileData, (int)[prov length], strPassword)) {
-        completionHandler(NO, makeErrorFromLog(ZLog::logs));
-        ZLog::logs.clear();
+        if (bTrace) {
+            ZTrace::Stop();
+        }
+        completionHandler(NO, makeErrorFromLog(ZLog::EndSession(uLogSession)));
 		return;
 	}
     
@@ -96,8 +101,10 @@ void zsign(NSString *appPath,
 	bool success = bundle.ConfigureFolderSign(&zSignAsset, strFolder, "", "", "", strDyLibFile, bForce, bWeakInject, bEnableCache, bDontGenerateEmbeddedMobileProvision);
 
     if(!success) {
-        completionHandler(NO, makeErrorFromLog(ZLog::logs));
-        ZLog::logs.clear();
+        if (bTrace) {
+            ZTrace::Stop();
+        }
+        completionHandler(NO, makeErrorFromLog(ZLog::EndSession(uLogSession)));
         return;
     }
     
@@ -122,12 +129,85 @@ void zsign(NSString *appPath,
         signError = [NSError errorWithDomain:@"Failed to Sign" code:-1 userInfo:userInfo];
     }
     
+    if (bTrace) {
+        ZTrace::Stop();
+    }
+    ZLog::EndSession(uLogSession);
     completionHandler(YES, signError);
-    ZLog::logs.clear();
     
 	return;
 }
 
+void zsignBatch(NSArray<NSString *> *appPaths,
+               NSData *prov,
+               NSData *key,
+               NSString *pass,
+               int threadCount,
+               uint64_t memoryLimit,
+               NSProgress* progress,
+               void(^completionHandler)(BOOL success, NSDictionary<NSString *, NSError *> *errors)
+               )
+{
+    ZTimer timer;
+    string strPassword = [pass cStringUsingEncoding:NSUTF8StringEncoding];
+
+    uint32_t uLogSession = ZLog::BeginSession();
+    bool bTrace = ZTrace::StartDefault();
+
+    // the identity is loaded once and shared by every app in the batch
+    ZSignAsset zSignAsset;
+    if (!zSignAsset.InitSimple((const char*)[key bytes], (int)[key length], (const char*)[prov bytes], (int)[prov length], strPassword)) {
+        if (bTrace) {
+            ZTrace::Stop();
+        }
+        NSError* error = makeErrorFromLog(ZLog::EndSession(uLogSession));
+        NSMutableDictionary<NSString *, NSError *>* errors = [NSMutableDictionary dictionary];
+        for (NSString* appPath in appPaths) {
+            errors[appPath] = error;
+        }
+        completionHandler(NO, errors);
+        return;
+    }
+
+    ZBatchSign batch(&zSignAsset);
+    batch.SetLimits((uint32_t)max(threadCount, 0), memoryLimit);
+    for (NSString* appPath in appPaths) {
+        batch.AddApp(appPath.UTF8String);
+    }
+    batch.ConfigureSign(false, true);
+
+    [progress setTotalUnitCount:batch.GetSignCount()];
+    batch.progressHandler = [progress](size_t uAppIndex) {
+        [progress setCompletedUnitCount:progress.completedUnitCount + 1];
+    };
+
+    ZLog::PrintV(">>> Apps Need to Sign: \t%d, Files: %d\n", (int)appPaths.count, batch.GetSignCount());
+    bool bRet = batch.StartSign();
+    timer.PrintResult(bRet, ">>> Batch Signed %s!", bRet ? "OK" : "Failed");
+
+    NSMutableDictionary<NSString *, NSError *>* errors = [NSMutableDictionary dictionary];
+    for (const ZBatchSign::ZAppResult& result : batch.GetResults()) {
+        if (result.bSuccess && result.strFailedFiles.empty()) {
+            continue;
+        }
+        string strMessage = result.strError + result.strFailedFiles;
+        NSDictionary* userInfo = @{
+            NSLocalizedDescriptionKey : [NSString stringWithUTF8String:strMessage.c_str()]
+        };
+        errors[[NSString stringWithUTF8String:result.strAppPath.c_str()]] = [NSError errorWithDomain:@"Failed to Sign" code:-1 userInfo:userInfo];
+    }
+
+    if (bTrace) {
+        ZTrace::Stop();
+    }
+    ZLog::EndSession(uLogSession);
+    completionHandler(bRet, errors);
+}
+
+void zsignSetTraceFile(NSString *path) {
+    ZTrace::SetDefaultFile(path ? path.UTF8String : "");
+}
+
 bool adhocSignMachO(NSString *machoPath, NSString *bundleId, NSData* entitlementData) {
     ZSignAsset zSignAsset;
     zSignAsset.InitAdhoc([entitlementData bytes], (int)[entitlementData length]);
@@ -154,13 +234,10 @@ NSString* getTeamId(NSData *prov,
     const char* strPKeyFileData = (const char*)[key bytes];
     const char* strProvFileData = (const char*)[prov bytes];
     strPassword = [pass cStringUsingEncoding:NSUTF8StringEncoding];
-    
-    ZLog::logs.clear();
 
     __block ZSignAsset zSignAsset;
     
     if (!zSignAsset.InitSimple(strPKeyFileData, (int)[key length], strProvFileData, (int)[prov length], strPassword)) {
-        ZLog::logs.clear();
         return nil;
     }
     NSString* teamId = [NSString stringWithUTF8String:zSignAsset.m_strTeamId.c_str()];
@@ -174,13 +251,10 @@ int checkCert(NSData *prov,
     const char* strPKeyFileData = (const char*)[key bytes];
     const char* strProvFileData = (const char*)[prov bytes];
     string strPassword = [pass cStringUsingEncoding:NSUTF8StringEncoding];
-    
-    ZLog::logs.clear();
 
     __block ZSignAsset zSignAsset;
     
     if (!zSignAsset.InitSimple(strPKeyFileData, (int)[key length], strProvFileData, (int)[prov length], strPassword)) {
-        ZLog::logs.clear();
         completionHandler(2, nil, nil, @"Unable to initialize certificate. Please check your password.");
         return -1;
     }
@@ -0,0 +1,214 @@
+// Headless batch signer around the portable ZSign sources, not part of the ZSign target.
+// Build with the command below, indented lines continue the one above.
+// g++ -std=c++17 -O2 -IZSign -IZSign/common ZSign/zsign_cli.cpp ZSign/batch.cpp ZSign/bundle.cpp ZSign/macho.cpp
+//     ZSign/archo.cpp ZSign/signing.cpp ZSign/openssl.cpp ZSign/verify.cpp ZSign/common/*.cpp -lcrypto -lpthread -o zsign-batch
+#include "common.h"
+#include "openssl.h"
+#include "batch.h"
+#include "macho.h"
+#include "timer.h"
+#include "trace.h"
+
+extern "C" {
+const char* getDocumentsDirectory() { return ZFile::GetTempFolder(); }
+void writeToNSLog(const char*) {}
+void refreshFile(const char*) {}
+}
+
+const struct option options[] = {
+	{ "pkey", required_argument, NULL, 'k' },
+	{ "cert", required_argument, NULL, 'c' },
+	{ "prov", required_argument, NULL, 'm' },
+	{ "password", required_argument, NULL, 'p' },
+	{ "entitlements", required_argument, NULL, 'e' },
+	{ "adhoc", no_argument, NULL, 'a' },
+	{ "force", no_argument, NULL, 'f' },
+	{ "threads", required_argument, NULL, 'j' },
+	{ "memory", required_argument, NULL, 'M' },
+	{ "no-cache", no_argument, NULL, 'n' },
+	{ "trace", required_argument, NULL, 't' },
+	{ "verify", no_argument, NULL, 'V' },
+	{ "sample", required_argument, NULL, 'S' },
+	{ "debug", no_argument, NULL, 'd' },
+	{ "quiet", no_argument, NULL, 'q' },
+	{ "help", no_argument, NULL, 'h' },
+	{ }
+};
+
+int usage()
+{
+	ZLog::Print("Usage: zsign-batch [-options] [app folder ...]\n");
+	ZLog::Print("       zsign-batch -V [-S stride] [app folder or mach-o file ...]\n");
+	ZLog::Print("options:\n");
+	ZLog::Print("-k, --pkey\t\tPath to private key or p12 file. (PEM or DER format)\n");
+	ZLog::Print("-c, --cert\t\tPath to certificate file. (PEM or DER format)\n");
+	ZLog::Print("-m, --prov\t\tPath to mobile provisioning profile.\n");
+	ZLog::Print("-p, --password\t\tPassword for private key or p12 file.\n");
+	ZLog::Print("-e, --entitlements\tNew entitlements to change.\n");
+	ZLog::Print("-a, --adhoc\t\tPerform ad-hoc signature only.\n");
+	ZLog::Print("-f, --force\t\tForce sign without cache when signing folder.\n");
+	ZLog::Print("-j, --threads\t\tWorkers shared by all apps. (default: one per CPU)\n");
+	ZLog::Print("-M, --memory\t\tMegabytes of binaries mapped at once. (default: no limit)\n");
+	ZLog::Print("-n, --no-cache\t\tDon't write zsign_cache.json.\n");
+	ZLog::Print("-t, --trace\t\tWrite a Chrome trace of the run to this file. (or set ZSIGN_TRACE)\n");
+	ZLog::Print("-V, --verify\t\tVerify the existing signatures instead of signing, nothing is written.\n");
+	ZLog::Print("-S, --sample\t\tWith -V, only rehash every Nth code page. (default: 1, every page)\n");
+	ZLog::Print("-d, --debug\t\tGenerate debug output files.\n");
+	ZLog::Print("-q, --quiet\t\tQuiet operation.\n");
+	ZLog::Print("-h, --help\t\tShow help.\n");
+	return -1;
+}
+
+// an app folder verifies its CFBundleExecutable against the bundle's Info.plist and CodeResources too
+bool VerifyPath(const string& strPath, uint32_t uSampleStride)
+{
+	string strMachOFile = strPath;
+	string strBundleFolder;
+	if (ZFile::IsFolder(strPath.c_str())) {
+		jvalue jvInfo;
+		if (!jvInfo.read_plist_from_file("%s/Info.plist", strPath.c_str()) || !jvInfo.has("CFBundleExecutable")) {
+			return ZLog::ErrorV(">>> Can't find CFBundleExecutable in %s/Info.plist!\n", strPath.c_str());
+		}
+		strBundleFolder = strPath;
+		strMachOFile = strPath + "/" + jvInfo["CFBundleExecutable"].as_cstr();
+	}
+
+	ZMachO macho;
+	if (!macho.Init(strMachOFile.c_str(), true)) {
+		return ZLog::ErrorV(">>> Invalid mach-o file! %s\n", strMachOFile.c_str());
+	}
+	bool bRet = macho.Verify(uSampleStride, strBundleFolder);
+	macho.Free();
+	return bRet;
+}
+
+int main(int argc, char* argv[])
+{
+	ZTimer gtimer;
+
+	bool bForce = false;
+	bool bAdhoc = false;
+	bool bEnableCache = true;
+	bool bVerify = false;
+	uint32_t uSampleStride = 1;
+	uint32_t uThreads = 0;
+	uint64_t uMemoryLimit = 0;
+	string strCertFile;
+	string strPKeyFile;
+	string strProvFile;
+	string strPassword;
+	string strEntitleFile;
+	string strTraceFile;
+
+	int opt = 0;
+	int argslot = -1;
+	while (-1 != (opt = getopt_long(argc, argv, "k:c:m:p:e:afj:M:nt:VS:dqh", options, &argslot))) {
+		switch (opt) {
+			case 'k':
+				strPKeyFile = ZFile::GetFullPath(optarg);
+				break;
+			case 'c':
+				strCertFile = ZFile::GetFullPath(optarg);
+				break;
+			case 'm':
+				strProvFile = ZFile::GetFullPath(optarg);
+				break;
+			case 'p':
+				strPassword = optarg;
+				break;
+			case 'e':
+				strEntitleFile = ZFile::GetFullPath(optarg);
+				break;
+			case 'a':
+				bAdhoc = true;
+				break;
+			case 'f':
+				bForce = true;
+				break;
+			case 'j':
+				uThreads = (uint32_t)atoi(optarg);
+				break;
+			case 'M':
+				uMemoryLimit = (uint64_t)atoll(optarg) * 1024 * 1024;
+				break;
+			case 'n':
+				bEnableCache = false;
+				break;
+			case 't':
+				strTraceFile = ZFile::GetFullPath(optarg);
+				break;
+			case 'V':
+				bVerify = true;
+				break;
+			case 'S':
+				uSampleStride = max(1, atoi(optarg));
+				break;
+			case 'd':
+				ZLog::SetLogLever(ZLog::E_DEBUG);
+				break;
+			case 'q':
+				ZLog::SetLogLever(ZLog::E_NONE);
+				break;
+			case 'h':
+			case '?':
+			default:
+				return usage();
+		}
+	}
+
+	if (optind >= argc) {
+		return usage();
+	}
+
+	if (!strTraceFile.empty()) {
+		ZTrace::Start(strTraceFile.c_str());
+	} else {
+		ZTrace::StartDefault();
+	}
+
+	if (bVerify) {
+		bool bRet = true;
+		for (int i = optind; i < argc; i++) {
+			string strPath = ZFile::GetFullPath(argv[i]);
+			bool bOK = VerifyPath(strPath, uSampleStride);
+			ZLog::Flush();
+			printf("%s\t%s\n", bOK ? "OK" : "FAILED", strPath.c_str());
+			bRet &= bOK;
+		}
+		fflush(stdout);
+		ZTrace::Stop();
+		gtimer.PrintResult(bRet, ">>> Done.");
+		return bRet ? 0 : -1;
+	}
+
+	ZSignAsset zSignAsset;
+	if (!zSignAsset.Init(strCertFile, strPKeyFile, strProvFile, strEntitleFile, strPassword, bAdhoc, false, false)) {
+		return -1;
+	}
+
+	ZBatchSign batch(&zSignAsset);
+	batch.SetLimits(uThreads, uMemoryLimit);
+	for (int i = optind; i < argc; i++) {
+		batch.AddApp(ZFile::GetFullPath(argv[i]));
+	}
+	batch.ConfigureSign(bForce, bEnableCache);
+
+	ZLog::PrintV(">>> Apps Need to Sign: \t%d, Files: %d\n", argc - optind, batch.GetSignCount());
+	bool bRet = batch.StartSign();
+
+	// results go to stdout even with -q, one line per app
+	ZLog::Flush();
+	for (const ZBatchSign::ZAppResult& result : batch.GetResults()) {
+		bool bOK = result.bSuccess && result.strFailedFiles.empty();
+		printf("%s\t%s\t%d files\t%.03fs\n", bOK ? "OK" : "FAILED", result.strAppPath.c_str(), result.nSigned, result.uElapse / 1000000.0);
+		if (!bOK) {
+			string strMessage = result.strError + result.strFailedFiles;
+			printf("%s", strMessage.c_str());
+		}
+	}
+
+	fflush(stdout);
+	ZTrace::Stop();
+	gtimer.PrintResult(bRet, ">>> Done.");
+	return bRet ? 0 : -1;
+}